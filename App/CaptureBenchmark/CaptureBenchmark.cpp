@@ -0,0 +1,2962 @@
+// CaptureBenchmark.cpp : Microbenchmarks for the hot kernels between capture and the serial port.
+//
+// Only uses the portable parts of the CaptureProcessor, so it builds with the solution on Windows or
+// directly on Linux, e.g.
+//   g++ -std=c++11 -O2 -pthread -I../CaptureProcessor CaptureBenchmark.cpp ../CaptureProcessor/{PixelSums,ZoneAverager,TileSumCache,FrameGeometry,SoftwareCompositor,SyntheticFrameSource,LightLayout,LightValueBuffer,LightFrameRing,RegisteredLightBuffers,SharedMemory,FrameSlotExchange,CpuFrameSlots,MappedFile,CaptureTrace,TraceFrameSource,LatencyHistogram,LatencyStats,LightColourFormat,LightFrameCodec,LightProtocol,SerialPort,SerialTransport,ShardedTransport,NetworkProtocol,UdpSocket,NetworkTransport}.cpp -o CaptureBenchmark
+//
+// Usage: CaptureBenchmark [--filter text] [--output file.json] [--min-time milliseconds] [--trace file]
+// Results are written as JSON (to stdout unless an output file is given) so runs can be compared across commits
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CpuFrameSlots.h"
+#include "FrameGeometry.h"
+#include "LatencyHistogram.h"
+#include "LightColourFormat.h"
+#include "LightFrameRing.h"
+#include "LightFrameCodec.h"
+#include "LightLayout.h"
+#include "LightProtocol.h"
+#include "LightValueBuffer.h"
+#include "NetworkTransport.h"
+#include "PixelSums.h"
+#include "RegisteredLightBuffers.h"
+#include "SerialTransport.h"
+#include "ShardedTransport.h"
+#include "SoftwareCompositor.h"
+#include "SyntheticFrameSource.h"
+#include "TileSumCache.h"
+#include "TraceFrameSource.h"
+#include "ZoneAverager.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+struct BenchmarkResult
+{
+	std::string name;
+	uint64_t iterations;
+	double nanosecondsPerOp;
+	double itemsPerSecond;
+};
+
+struct BenchmarkOptions
+{
+	std::string filter;
+	std::string outputPath;
+	std::string tracePath;
+	double minimumSeconds;
+};
+
+struct Resolution
+{
+	const char* name;
+	int width;
+	int height;
+};
+
+struct ZoneGrid
+{
+	int columns;
+	int rows;
+};
+
+static const Resolution Resolutions[] =
+{
+	{ "1080p", 1920, 1080 },
+	{ "4k", 3840, 2160 },
+	{ "8k", 7680, 4320 }
+};
+
+static const ZoneGrid ZoneGrids[] =
+{
+	{ 16, 9 },
+	{ 32, 18 },
+	{ 64, 36 }
+};
+
+// Stops the compiler optimising away work whose results are never used
+static volatile uint32_t g_Sink = 0;
+
+static BenchmarkOptions g_Options;
+static std::vector<BenchmarkResult> g_Results;
+
+// Set when a benchmark that checks its results finds something wrong
+static bool g_ChecksFailed = false;
+
+static std::string GridName(const ZoneGrid& grid)
+{
+	return std::to_string(grid.columns) + "x" + std::to_string(grid.rows);
+}
+
+static const char* KernelName(PixelSumKernel kernel)
+{
+	switch (kernel)
+	{
+	case PixelSumKernelScalar:
+		return "scalar";
+	case PixelSumKernelSSE2:
+		return "sse2";
+	case PixelSumKernelAVX2:
+		return "avx2";
+	default:
+		return "auto";
+	}
+}
+
+//
+// Times operation, which does itemsPerOp items of work each call, and records the median of several runs
+//
+static bool IsSelected(const std::string& name)
+{
+	return g_Options.filter.empty() || name.find(g_Options.filter) != std::string::npos;
+}
+
+static void RunBenchmark(const std::string& name, double itemsPerOp, const std::function<void()>& operation)
+{
+	if (!IsSelected(name))
+	{
+		return;
+	}
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Warm up, then find how many iterations fill the minimum time
+	operation();
+	uint64_t iterations = 1;
+	for (;;)
+	{
+		Clock::time_point start = Clock::now();
+		for (uint64_t iteration = 0; iteration < iterations; ++iteration)
+		{
+			operation();
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if (seconds >= g_Options.minimumSeconds || iterations >= (1ull << 40))
+		{
+			break;
+		}
+
+		// Aim a little past the minimum so the next pass is likely to be the last
+		double scale = (seconds > 0.0) ? (g_Options.minimumSeconds * 1.2) / seconds : 10.0;
+		iterations = static_cast<uint64_t>(iterations * std::min(std::max(scale, 1.5), 10.0)) + 1;
+	}
+
+	// Take the median of a few runs, to be robust against the odd interruption
+	const int RunCount = 5;
+	std::vector<double> runNanoseconds;
+	for (int run = 0; run < RunCount; ++run)
+	{
+		Clock::time_point start = Clock::now();
+		for (uint64_t iteration = 0; iteration < iterations; ++iteration)
+		{
+			operation();
+		}
+		runNanoseconds.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations);
+	}
+	std::sort(runNanoseconds.begin(), runNanoseconds.end());
+
+	BenchmarkResult result;
+	result.name = name;
+	result.iterations = iterations;
+	result.nanosecondsPerOp = runNanoseconds[RunCount / 2];
+	result.itemsPerSecond = (result.nanosecondsPerOp > 0.0) ? (itemsPerOp * 1e9) / result.nanosecondsPerOp : 0.0;
+	g_Results.push_back(result);
+
+	fprintf(stderr, "%-48s %14.1f ns/op %16.0f items/s\n", name.c_str(), result.nanosecondsPerOp, result.itemsPerSecond);
+}
+
+//
+// First frame of the synthetic desktop, which is fully painted
+//
+static std::vector<uint8_t> MakeFrame(int width, int height)
+{
+	SyntheticFrameSource frameSource;
+	frameSource.Initialise(SyntheticFrameSource::GetDefaultConfig(width, height));
+
+	bool timeout;
+	FrameBuffer frameBuffer;
+	frameSource.GetFrame(&timeout);
+	frameSource.GetFrameBuffer(&frameBuffer);
+	return std::vector<uint8_t>(frameBuffer.pixels, frameBuffer.pixels + static_cast<size_t>(frameBuffer.pitch) * frameBuffer.height);
+}
+
+//
+// Frame of pseudo-random pixels, or of nothing but 255s to push the 16 bit sums as far as they go, with pitch
+// bytes to a row. Anything past the pixels in a row is 0xCD, which no zone should ever pick up
+//
+static std::vector<uint8_t> MakeCheckFrame(int width, int height, int pitch, bool saturated)
+{
+	std::vector<uint8_t> frame(static_cast<size_t>(pitch) * height, 0xCD);
+	uint32_t state = 0x12345678u;
+	for (int y = 0; y < height; ++y)
+	{
+		uint8_t* row = &frame[static_cast<size_t>(y) * pitch];
+		for (int x = 0; x < width * PixelSumBytesPerPixel; ++x)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			row[x] = saturated ? 0xFF : static_cast<uint8_t>(state);
+		}
+	}
+	return frame;
+}
+
+//
+// The plain box average of every zone, summed a pixel at a time over the same boundaries
+//
+static std::vector<uint32_t> AverageZones(const std::vector<uint8_t>& frame, int pitch, const ZoneAverager& zoneAverager, const ZoneGrid& grid)
+{
+	const float colourScale[3] = { 1.0f, 1.0f, 1.0f };
+	std::vector<uint32_t> zoneValues(grid.columns * grid.rows);
+	for (int row = 0; row < grid.rows; ++row)
+	{
+		for (int column = 0; column < grid.columns; ++column)
+		{
+			uint64_t channelSums[PixelSumBytesPerPixel] = { 0, 0, 0, 0 };
+			int left = zoneAverager.GetZoneLeft(column);
+			int right = zoneAverager.GetZoneLeft(column + 1);
+			int top = zoneAverager.GetZoneTop(row);
+			int bottom = zoneAverager.GetZoneTop(row + 1);
+			for (int y = top; y < bottom; ++y)
+			{
+				for (int x = left; x < right; ++x)
+				{
+					for (int channel = 0; channel < PixelSumBytesPerPixel; ++channel)
+					{
+						channelSums[channel] += frame[static_cast<size_t>(y) * pitch + x * PixelSumBytesPerPixel + channel];
+					}
+				}
+			}
+			uint64_t pixelCount = static_cast<uint64_t>(right - left) * (bottom - top);
+			zoneValues[row * grid.columns + column] = ResolvePixelAverage(channelSums, pixelCount, colourScale);
+		}
+	}
+	return zoneValues;
+}
+
+//
+// Checks a kernel's zone averages against AverageZones, for sizes that don't split evenly (down to zones with no
+// pixels at all), zones taller than the 16 bit sums can take before they're flushed, and rows with padding after
+// them. Needs no D3D device, so covers the CPU downsample on any machine
+//
+static bool CheckZoneAveraging(PixelSumKernel kernel)
+{
+	struct ZoneCheck
+	{
+		int width;
+		int height;
+		int padding;
+		ZoneGrid grid;
+	};
+	const ZoneCheck checks[] =
+	{
+		{ 17, 9, 0, { 5, 3 } },
+		{ 17, 9, 12, { 33, 7 } },
+		{ 1000, 777, 0, { 33, 7 } },
+		{ 1000, 777, 36, { 33, 7 } },
+		{ 1000, 777, 4, { 3, 2 } }
+	};
+
+	bool matched = true;
+	for (const ZoneCheck& check : checks)
+	{
+		int pitch = check.width * PixelSumBytesPerPixel + check.padding;
+		ZoneAverager zoneAverager;
+		zoneAverager.Initialise(check.width, check.height, check.grid.columns, check.grid.rows);
+		zoneAverager.SetKernel(kernel);
+		for (int saturated = 0; saturated < 2; ++saturated)
+		{
+			std::vector<uint8_t> frame = MakeCheckFrame(check.width, check.height, pitch, saturated != 0);
+			std::vector<uint32_t> zoneValues(check.grid.columns * check.grid.rows);
+			zoneAverager.Process(&frame[0], pitch, &zoneValues[0]);
+			if (zoneValues != AverageZones(frame, pitch, zoneAverager, check.grid))
+			{
+				fprintf(stderr, "%-48s doesn't match the reference at %dx%d, pitch %d, %s zones%s\n", (std::string("zone_average/") + KernelName(kernel)).c_str(),
+					check.width, check.height, pitch, GridName(check.grid).c_str(), saturated ? ", saturated" : "");
+				matched = false;
+			}
+		}
+	}
+	return matched;
+}
+
+//
+// Full frame zone averaging, with every available kernel, each checked against the reference first
+//
+static void BenchmarkZoneAveraging()
+{
+	const PixelSumKernel kernels[] = { PixelSumKernelScalar, PixelSumKernelSSE2, PixelSumKernelAVX2 };
+
+	for (PixelSumKernel kernel : kernels)
+	{
+		std::string prefix = std::string("zone_average/") + KernelName(kernel) + "/";
+		bool selected = false;
+		for (const Resolution& resolution : Resolutions)
+		{
+			for (const ZoneGrid& grid : ZoneGrids)
+			{
+				selected = selected || IsSelected(prefix + resolution.name + "/" + GridName(grid));
+			}
+		}
+		if (selected && IsPixelSumKernelSupported(kernel) && !CheckZoneAveraging(kernel))
+		{
+			g_ChecksFailed = true;
+		}
+	}
+
+	for (const Resolution& resolution : Resolutions)
+	{
+		std::vector<uint8_t> frame = MakeFrame(resolution.width, resolution.height);
+		for (const ZoneGrid& grid : ZoneGrids)
+		{
+			std::vector<uint32_t> zoneValues(grid.columns * grid.rows);
+			for (PixelSumKernel kernel : kernels)
+			{
+				if (!IsPixelSumKernelSupported(kernel))
+				{
+					continue;
+				}
+
+				ZoneAverager zoneAverager;
+				zoneAverager.Initialise(resolution.width, resolution.height, grid.columns, grid.rows);
+				zoneAverager.SetKernel(kernel);
+
+				std::string name = std::string("zone_average/") + KernelName(kernel) + "/" + resolution.name + "/" + GridName(grid);
+				RunBenchmark(name, static_cast<double>(resolution.width) * resolution.height, [&]()
+				{
+					zoneAverager.Process(&frame[0], resolution.width * 4, &zoneValues[0]);
+					g_Sink += zoneValues[0];
+				});
+			}
+		}
+	}
+}
+
+//
+// Checks a kernel's incremental tile sums against ZoneAverager re-summing the whole frame. Each step repaints a few
+// random rects and updates just those, with rects crossing tile edges, zone edges, the 257 row limit on tile height
+// and the edges of the frame itself
+//
+static bool CheckTileSums(PixelSumKernel kernel)
+{
+	struct TileCheck
+	{
+		int width;
+		int height;
+		int padding;
+		ZoneGrid grid;
+		int tileSize;
+		bool saturated;		// Painted near 255, so tiles any taller than 257 rows would overflow
+	};
+	const TileCheck checks[] =
+	{
+		{ 17, 9, 0, { 5, 3 }, 4, false },
+		{ 1000, 777, 0, { 33, 7 }, TileSumCache::DefaultTileSize, false },
+		{ 1000, 777, 36, { 3, 2 }, 300, true }
+	};
+	const int StepCount = 200;
+
+	bool matched = true;
+	uint32_t state = 0x9E3779B9u;
+	auto random = [&state](int range)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return static_cast<int>(state % static_cast<uint32_t>(range));
+	};
+
+	for (const TileCheck& check : checks)
+	{
+		int pitch = check.width * PixelSumBytesPerPixel + check.padding;
+		std::vector<uint8_t> frame = MakeCheckFrame(check.width, check.height, pitch, check.saturated);
+		int zoneCount = check.grid.columns * check.grid.rows;
+		std::vector<uint32_t> zoneValues(zoneCount);
+		std::vector<uint32_t> expectedValues(zoneCount);
+
+		TileSumCache tileSumCache;
+		ZoneAverager zoneAverager;
+		tileSumCache.Initialise(check.width, check.height, check.grid.columns, check.grid.rows, check.tileSize);
+		tileSumCache.SetKernel(kernel);
+		zoneAverager.Initialise(check.width, check.height, check.grid.columns, check.grid.rows);
+		zoneAverager.SetKernel(kernel);
+		tileSumCache.Update(&frame[0], pitch, nullptr, 0);
+
+		int tileSize = std::min(check.tileSize, PixelSumMaxRowsBeforeFlush);
+		int step = 0;
+		for (; step < StepCount; ++step)
+		{
+			FrameRect rects[4];
+			int rectCount = 1 + random(4);
+			for (int rectIndex = 0; rectIndex < rectCount; ++rectIndex)
+			{
+				// Somewhere to straddle, then a few pixels either side of it
+				int x = random(check.width);
+				int y = random(check.height);
+				switch (random(4))
+				{
+				case 1:
+					x = (x / tileSize) * tileSize;
+					y = (y / tileSize) * tileSize;
+					break;
+				case 2:
+					x = zoneAverager.GetZoneLeft(random(check.grid.columns));
+					y = zoneAverager.GetZoneTop(random(check.grid.rows));
+					break;
+				case 3:
+					y = std::min(PixelSumMaxRowsBeforeFlush, check.height - 1);
+					break;
+				default:
+					break;
+				}
+				FrameRect& rect = rects[rectIndex];
+				rect.left = x - random(40) - 1;
+				rect.top = y - random(40) - 1;
+				rect.right = x + random(40) + 1;
+				rect.bottom = y + random(40) + 1;
+
+				// Only the part on the frame is repainted
+				for (int paintY = std::max<int>(0, rect.top); paintY < std::min<int>(check.height, rect.bottom); ++paintY)
+				{
+					for (int paintX = std::max<int>(0, rect.left); paintX < std::min<int>(check.width, rect.right); ++paintX)
+					{
+						uint8_t* pixel = &frame[static_cast<size_t>(paintY) * pitch + paintX * PixelSumBytesPerPixel];
+						for (int channel = 0; channel < PixelSumBytesPerPixel; ++channel)
+						{
+							pixel[channel] = static_cast<uint8_t>(check.saturated ? 255 - random(8) : random(256));
+						}
+					}
+				}
+			}
+
+			tileSumCache.Update(&frame[0], pitch, rects, rectCount);
+			tileSumCache.GetZoneValues(&zoneValues[0]);
+			zoneAverager.Process(&frame[0], pitch, &expectedValues[0]);
+			if (zoneValues != expectedValues)
+			{
+				break;
+			}
+		}
+
+		if (step < StepCount)
+		{
+			fprintf(stderr, "%-48s doesn't match a full recompute at %dx%d, pitch %d, %s zones, %d tiles, step %d\n", (std::string("tile_sums/") + KernelName(kernel)).c_str(),
+				check.width, check.height, pitch, GridName(check.grid).c_str(), check.tileSize, step);
+			matched = false;
+		}
+	}
+	return matched;
+}
+
+//
+// The whole CPU path for a synthetic desktop: generating the frame, compositing it and updating the tile sums.
+// The tile sums are checked against a full recompute first
+//
+static void BenchmarkSyntheticPipeline()
+{
+	const ZoneGrid grid = { 32, 18 };
+	const PixelSumKernel kernels[] = { PixelSumKernelScalar, PixelSumKernelSSE2, PixelSumKernelAVX2 };
+
+	bool selected = false;
+	for (const Resolution& resolution : Resolutions)
+	{
+		selected = selected || IsSelected(std::string("pipeline/synthetic/") + resolution.name + "/" + GridName(grid));
+	}
+	for (PixelSumKernel kernel : kernels)
+	{
+		if (selected && IsPixelSumKernelSupported(kernel) && !CheckTileSums(kernel))
+		{
+			g_ChecksFailed = true;
+		}
+	}
+
+	for (const Resolution& resolution : Resolutions)
+	{
+		SyntheticFrameSource frameSource;
+		SoftwareCompositor compositor;
+		TileSumCache tileSumCache;
+		frameSource.Initialise(SyntheticFrameSource::GetDefaultConfig(resolution.width, resolution.height));
+		compositor.Initialise(resolution.width, resolution.height);
+		tileSumCache.Initialise(resolution.width, resolution.height, grid.columns, grid.rows);
+		std::vector<uint32_t> zoneValues(grid.columns * grid.rows);
+
+		std::string name = std::string("pipeline/synthetic/") + resolution.name + "/" + GridName(grid);
+		RunBenchmark(name, 1.0, [&]()
+		{
+			bool timeout;
+			frameSource.GetFrame(&timeout);
+			compositor.ProcessFrame(frameSource, 0, 0);
+			const std::vector<FrameRect>& updatedRects = compositor.GetUpdatedRects();
+			tileSumCache.Update(compositor.GetSurface(), compositor.GetSurfacePitch(), updatedRects.empty() ? nullptr : &updatedRects[0], updatedRects.size());
+			tileSumCache.GetZoneValues(&zoneValues[0]);
+			frameSource.ReleaseFrame();
+			g_Sink += zoneValues[0];
+		});
+	}
+}
+
+//
+// The same CPU path, fed from a recorded trace as fast as it will go
+//
+static void BenchmarkTraceReplay()
+{
+	if (g_Options.tracePath.empty())
+	{
+		return;
+	}
+
+	TraceFrameSource frameSource;
+	if (!frameSource.Initialise(g_Options.tracePath, TraceTimingFastest))
+	{
+		fprintf(stderr, "Couldn't open trace %s\n", g_Options.tracePath.c_str());
+		return;
+	}
+
+	const ZoneGrid grid = { 32, 18 };
+	const FrameOutputDesc& outputDesc = frameSource.GetFrameOutputDesc();
+	int width = outputDesc.desktopCoordinates.right - outputDesc.desktopCoordinates.left;
+	int height = outputDesc.desktopCoordinates.bottom - outputDesc.desktopCoordinates.top;
+
+	SoftwareCompositor compositor;
+	TileSumCache tileSumCache;
+	compositor.Initialise(width, height);
+	tileSumCache.Initialise(width, height, grid.columns, grid.rows);
+	std::vector<uint32_t> zoneValues(grid.columns * grid.rows);
+
+	RunBenchmark("pipeline/trace/" + GridName(grid), 1.0, [&]()
+	{
+		bool timeout;
+		frameSource.GetFrame(&timeout);
+		if (timeout)
+		{
+			// Loop the trace
+			frameSource.Rewind();
+			frameSource.GetFrame(&timeout);
+		}
+		compositor.ProcessFrame(frameSource, outputDesc.desktopCoordinates.left, outputDesc.desktopCoordinates.top);
+		const std::vector<FrameRect>& updatedRects = compositor.GetUpdatedRects();
+		tileSumCache.Update(compositor.GetSurface(), compositor.GetSurfacePitch(), updatedRects.empty() ? nullptr : &updatedRects[0], updatedRects.size());
+		tileSumCache.GetZoneValues(&zoneValues[0]);
+		frameSource.ReleaseFrame();
+		g_Sink += zoneValues[0];
+	});
+}
+
+//
+// Reversing every other row of lights for the serpentine strip layout
+//
+static void BenchmarkSerpentine()
+{
+	for (const ZoneGrid& grid : ZoneGrids)
+	{
+		std::vector<uint32_t> lightSurface(grid.columns * grid.rows);
+		for (size_t index = 0; index < lightSurface.size(); ++index)
+		{
+			lightSurface[index] = static_cast<uint32_t>(index * 0x010203);
+		}
+		std::vector<int32_t> lightValues(lightSurface.size());
+
+		RunBenchmark("serpentine/" + GridName(grid), static_cast<double>(lightValues.size()), [&]()
+		{
+			CopySerpentineRows(reinterpret_cast<const uint8_t*>(&lightSurface[0]), grid.columns * 4, grid.columns, grid.rows, &lightValues[0]);
+			g_Sink += lightValues[1];
+		});
+	}
+}
+
+//
+// Packing light values into the RGB bytes sent over serial
+//
+static void BenchmarkPackRGB()
+{
+	const int lightCounts[] = { 100, 300, 2304 };
+
+	for (int lightCount : lightCounts)
+	{
+		std::vector<int32_t> lightValues(lightCount);
+		for (int index = 0; index < lightCount; ++index)
+		{
+			lightValues[index] = index * 0x010203;
+		}
+		std::vector<uint8_t> packed(lightCount * 3);
+
+		RunBenchmark("pack_rgb/" + std::to_string(lightCount), lightCount, [&]()
+		{
+			PackLightsRGB(&lightValues[0], lightCount, &packed[0]);
+			g_Sink += packed[1];
+		});
+	}
+}
+
+//
+// Packing light values into wire bytes with every supported kernel, in both channel orders. Every kernel is first
+// checked against the reference for each light count up to a few SIMD blocks, so the tails are covered, and for
+// writing past the end of its output
+//
+static void BenchmarkPackWire()
+{
+	const int lightCounts[] = { 100, 300, 2304 };
+	const LightPackKernel kernels[] = { LightPackKernelScalar, LightPackKernelSSSE3, LightPackKernelAVX2 };
+	const char* kernelNames[] = { "scalar", "ssse3", "avx2" };
+	const LightChannelOrder orders[] = { LightChannelOrderRGB, LightChannelOrderGRB };
+	const char* orderNames[] = { "rgb", "grb" };
+	const int MaxCheckedCount = 64;
+	const int GuardBytes = 32;
+
+	for (int kernelIndex = 0; kernelIndex < 3; ++kernelIndex)
+	{
+		LightPackKernel kernel = kernels[kernelIndex];
+		if (!IsLightPackKernelSupported(kernel))
+		{
+			continue;
+		}
+
+		for (int orderIndex = 0; orderIndex < 2; ++orderIndex)
+		{
+			LightChannelOrder order = orders[orderIndex];
+			std::string prefix = std::string("pack_wire/") + kernelNames[kernelIndex] + "/" + orderNames[orderIndex] + "/";
+			bool selected = false;
+			for (int lightCount : lightCounts)
+			{
+				selected = selected || IsSelected(prefix + std::to_string(lightCount));
+			}
+			if (!selected)
+			{
+				continue;
+			}
+
+			bool mismatched = false;
+			for (int lightCount = 0; lightCount <= MaxCheckedCount; ++lightCount)
+			{
+				std::vector<int32_t> lightValues(lightCount);
+				for (int index = 0; index < lightCount; ++index)
+				{
+					lightValues[index] = static_cast<int32_t>((index * 0x9E3779B1u) ^ 0xFF000000u);
+				}
+
+				std::vector<uint8_t> expected(lightCount * 3);
+				for (int index = 0; index < lightCount; ++index)
+				{
+					uint32_t value = static_cast<uint32_t>(lightValues[index]);
+					uint8_t red = static_cast<uint8_t>(value >> 16);
+					uint8_t green = static_cast<uint8_t>(value >> 8);
+					expected[index * 3] = (order == LightChannelOrderGRB) ? green : red;
+					expected[index * 3 + 1] = (order == LightChannelOrderGRB) ? red : green;
+					expected[index * 3 + 2] = static_cast<uint8_t>(value);
+				}
+
+				std::vector<uint8_t> packed(lightCount * 3 + GuardBytes, 0xCD);
+				PackLightsWire(kernel, lightCount ? &lightValues[0] : nullptr, lightCount, order, &packed[0]);
+				mismatched = mismatched || !std::equal(expected.begin(), expected.end(), packed.begin()) ||
+					std::count(packed.begin() + lightCount * 3, packed.end(), 0xCD) != GuardBytes;
+			}
+			if (mismatched)
+			{
+				fprintf(stderr, "%-48s doesn't match the reference\n", prefix.c_str());
+				g_ChecksFailed = true;
+			}
+
+			for (int lightCount : lightCounts)
+			{
+				std::vector<int32_t> lightValues(lightCount);
+				for (int index = 0; index < lightCount; ++index)
+				{
+					lightValues[index] = index * 0x010203;
+				}
+				std::vector<uint8_t> packed(lightCount * 3);
+
+				RunBenchmark(prefix + std::to_string(lightCount), lightCount, [&]()
+				{
+					PackLightsWire(kernel, &lightValues[0], lightCount, order, &packed[0]);
+					g_Sink += packed[1];
+				});
+			}
+		}
+	}
+}
+
+//
+// Encoding a run of synthetic desktop frames as keyframes and delta frames, each decoded again with the reference
+// decoder to check the round trip. Every so often a frame is treated as lost, forcing a keyframe
+//
+static void BenchmarkLightCodec()
+{
+	const ZoneGrid lightGrids[] = { { 100, 3 }, { 64, 36 } };
+	const int frameCount = 240;
+	const int keyframeEvery = 60;
+
+	for (const ZoneGrid& grid : lightGrids)
+	{
+		std::string name = "light_codec/" + GridName(grid);
+		if (!IsSelected(name))
+		{
+			continue;
+		}
+
+		// Light values for each frame, as the capture path would have produced them
+		int lightCount = grid.columns * grid.rows;
+		SyntheticFrameSource frameSource;
+		SoftwareCompositor compositor;
+		TileSumCache tileSumCache;
+		frameSource.Initialise(SyntheticFrameSource::GetDefaultConfig(1920, 1080));
+		compositor.Initialise(1920, 1080);
+		tileSumCache.Initialise(1920, 1080, grid.columns, grid.rows);
+		std::vector<uint32_t> zoneValues(lightCount);
+		std::vector<uint8_t> frames(static_cast<size_t>(frameCount) * lightCount * 3);
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			bool timeout;
+			frameSource.GetFrame(&timeout);
+			compositor.ProcessFrame(frameSource, 0, 0);
+			const std::vector<FrameRect>& updatedRects = compositor.GetUpdatedRects();
+			tileSumCache.Update(compositor.GetSurface(), compositor.GetSurfacePitch(), updatedRects.empty() ? nullptr : &updatedRects[0], updatedRects.size());
+			tileSumCache.GetZoneValues(&zoneValues[0]);
+			frameSource.ReleaseFrame();
+			PackLightsRGB(reinterpret_cast<const int32_t*>(&zoneValues[0]), lightCount, &frames[static_cast<size_t>(frame) * lightCount * 3]);
+		}
+
+		LightFrameEncoder encoder;
+		std::vector<uint8_t> decoded(lightCount * 3);
+		int frame = 0;
+		uint64_t framesEncoded = 0;
+		uint64_t payloadBytes = 0;
+		uint64_t mismatches = 0;
+		RunBenchmark(name, lightCount, [&]()
+		{
+			const uint8_t* lightData = &frames[static_cast<size_t>(frame) * lightCount * 3];
+			const uint8_t* baseData = (frame % keyframeEvery) ? lightData - lightCount * 3 : nullptr;
+			uint8_t sequence = static_cast<uint8_t>(framesEncoded);
+			uint8_t type = encoder.Encode(lightData, baseData, lightCount, static_cast<uint8_t>(sequence - 1));
+			if (!DecodeLightFrame(type, encoder.GetPayload(), encoder.GetPayloadLength(), static_cast<uint8_t>(sequence - 1), &decoded[0], lightCount) ||
+				memcmp(&decoded[0], lightData, decoded.size()) != 0)
+			{
+				++mismatches;
+			}
+			payloadBytes += encoder.GetPayloadLength();
+			++framesEncoded;
+			frame = (frame + 1) % frameCount;
+		});
+
+		fprintf(stderr, "%-48s %.1f bytes/frame of %d, %llu mismatched\n", name.c_str(), static_cast<double>(payloadBytes) / framesEncoded, lightCount * 3,
+			static_cast<unsigned long long>(mismatches));
+		if (mismatches)
+		{
+			g_ChecksFailed = true;
+		}
+	}
+}
+
+//
+// Rounding lights to each reduced colour format and packing them. Checks that whatever the ditherer shows packs
+// and unpacks exactly, and that a still, dim gradient averages out to the colours asked for over a few frames
+//
+static void BenchmarkLightColourFormat()
+{
+	const int lightCounts[] = { 300, 2304 };
+	const LightColourFormat formats[] = { LightColourFormatRGB565, LightColourFormatRGB444 };
+	const int averagedFrames = 256;
+
+	for (LightColourFormat format : formats)
+	{
+		for (int lightCount : lightCounts)
+		{
+			std::string name = std::string("light_colour_format/") + ((format == LightColourFormatRGB565) ? "rgb565/" : "rgb444/") + std::to_string(lightCount);
+			if (!IsSelected(name))
+			{
+				continue;
+			}
+
+			std::vector<uint8_t> original(lightCount * 3);
+			for (int channel = 0; channel < lightCount * 3; ++channel)
+			{
+				original[channel] = static_cast<uint8_t>((channel * 7) % 64);
+			}
+
+			LightDitherer ditherer;
+			ditherer.Initialise(lightCount);
+			std::vector<uint8_t> lightData(lightCount * 3);
+			std::vector<uint8_t> packed(GetPackedLightsSize(format, lightCount));
+			std::vector<uint8_t> unpacked(lightCount * 3);
+			std::vector<uint32_t> totals(lightCount * 3, 0);
+			int frame = 0;
+			uint64_t mismatches = 0;
+			RunBenchmark(name, lightCount, [&]()
+			{
+				lightData = original;
+				ditherer.Apply(format, &lightData[0], lightCount);
+				PackLights(format, &lightData[0], lightCount, &packed[0]);
+				if (frame < averagedFrames)
+				{
+					UnpackLights(format, &packed[0], lightCount, &unpacked[0]);
+					if (unpacked != lightData)
+					{
+						++mismatches;
+					}
+					for (int channel = 0; channel < lightCount * 3; ++channel)
+					{
+						totals[channel] += unpacked[channel];
+					}
+					++frame;
+				}
+				g_Sink += packed[0];
+			});
+
+			double worstError = 0.0;
+			for (int channel = 0; channel < lightCount * 3; ++channel)
+			{
+				double error = static_cast<double>(totals[channel]) / frame - original[channel];
+				worstError = std::max(worstError, error < 0.0 ? -error : error);
+			}
+			fprintf(stderr, "%-48s %d bytes/frame of %d, worst average error %.2f over %d frames, %llu mismatched\n", name.c_str(), static_cast<int>(packed.size()), lightCount * 3,
+				worstError, frame, static_cast<unsigned long long>(mismatches));
+			if (mismatches || frame < averagedFrames || worstError > 0.1)
+			{
+				g_ChecksFailed = true;
+			}
+		}
+	}
+}
+
+//
+// Publishing light values and picking them up on the other side of the triple buffer
+//
+static void BenchmarkLightPublish()
+{
+	const int lightCounts[] = { 100, 300, 2304 };
+
+	for (int lightCount : lightCounts)
+	{
+		std::vector<uint32_t> lightSurface(lightCount);
+		for (int index = 0; index < lightCount; ++index)
+		{
+			lightSurface[index] = index * 0x010203;
+		}
+		LightValueBuffer lightValues;
+		lightValues.Initialise(lightCount);
+
+		RunBenchmark("light_publish/" + std::to_string(lightCount), lightCount, [&]()
+		{
+			CopySerpentineRows(reinterpret_cast<const uint8_t*>(&lightSurface[0]), lightCount * 4, lightCount, 1, lightValues.BeginWrite());
+			lightValues.Publish(0);
+
+			LightValueSnapshot snapshot;
+			lightValues.Acquire(&snapshot);
+			g_Sink += snapshot.values[1];
+		});
+	}
+}
+
+//
+// Light values published through the triple buffer into a shared ring, and read back out of it through a mapping of
+// its own the way another process would. Following has a thread publishing as fast as it can while each new frame
+// is read in place; frames that come back intact have to hold their frame number plus each light's index, while torn
+// ones are just counted, as are frames skipped over
+//
+static void BenchmarkSharedLights()
+{
+	const int lightCounts[] = { 100, 300, 2304 };
+	const std::string ringName = "LightsBenchmark-" + std::to_string(GetLatencyTimestamp());
+
+	for (int lightCount : lightCounts)
+	{
+		std::string publishName = "shared_lights/publish/" + std::to_string(lightCount);
+		std::string followName = "shared_lights/follow/" + std::to_string(lightCount);
+		std::string copyName = "shared_lights/copy_latest/" + std::to_string(lightCount);
+		if (!IsSelected(publishName) && !IsSelected(followName) && !IsSelected(copyName))
+		{
+			continue;
+		}
+
+		LightValueBuffer lightValues;
+		lightValues.Initialise(lightCount);
+		LightFrameRingWriter ringWriter;
+		LightFrameRingReader ringReader;
+		if (!ringWriter.Create(ringName, lightCount, 1, LightFrameRingWriter::DefaultSlotCount) || !ringReader.Open(ringName) || ringReader.GetLightCount() != lightCount)
+		{
+			fprintf(stderr, "%-48s couldn't create the shared ring\n", publishName.c_str());
+			g_ChecksFailed = true;
+			continue;
+		}
+		lightValues.AddSink(&ringWriter);
+
+		uint64_t sequence = 0;
+		auto publish = [&]()
+		{
+			int32_t* values = lightValues.BeginWrite();
+			++sequence;
+			for (int index = 0; index < lightCount; ++index)
+			{
+				values[index] = static_cast<int32_t>((sequence + index) & 0xFFFFFF);
+			}
+			lightValues.Publish(0);
+		};
+
+		bool checksFailed = false;
+		RunBenchmark(publishName, lightCount, [&]()
+		{
+			publish();
+			LightValueSnapshot snapshot;
+			lightValues.Acquire(&snapshot);
+			g_Sink += snapshot.values[1];
+		});
+
+		auto checkFrame = [&](const int32_t* values, uint64_t frame)
+		{
+			for (int index = 0; index < lightCount; ++index)
+			{
+				if (values[index] != static_cast<int32_t>((frame + index) & 0xFFFFFF))
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		std::atomic<bool> stopWriter(false);
+		std::thread writer([&]()
+		{
+			while (!stopWriter.load(std::memory_order_relaxed))
+			{
+				publish();
+				std::this_thread::yield();
+			}
+		});
+
+		uint64_t framesRead = 0;
+		uint64_t tornFrames = 0;
+		uint64_t skippedFrames = 0;
+		uint64_t lastFrame = ringReader.GetLatestFrame();
+		bool timedOut = false;
+		RunBenchmark(followName, lightCount, [&]()
+		{
+			// Wait for the next frame, reading it in place as soon as it's there
+			int64_t start = GetLatencyTimestamp();
+			uint64_t frame;
+			while ((frame = ringReader.GetLatestFrame()) == lastFrame)
+			{
+				if (GetLatencyTimestamp() - start > 1000000)
+				{
+					timedOut = true;
+					return;
+				}
+				std::this_thread::yield();
+			}
+			skippedFrames += frame - lastFrame - 1;
+			lastFrame = frame;
+
+			LightFrameView view;
+			if (!ringReader.Read(frame, &view))
+			{
+				++tornFrames;
+				return;
+			}
+			bool good = checkFrame(view.values, frame) && view.frame == frame;
+			if (!ringReader.IsIntact(view))
+			{
+				++tornFrames;
+			}
+			else if (!good)
+			{
+				checksFailed = true;
+			}
+			++framesRead;
+		});
+
+		std::vector<int32_t> copiedValues(lightCount);
+		RunBenchmark(copyName, lightCount, [&]()
+		{
+			LightFrameView view;
+			if (!ringReader.CopyLatest(&copiedValues[0], lightCount, &view) || !checkFrame(&copiedValues[0], view.frame))
+			{
+				checksFailed = true;
+			}
+		});
+
+		stopWriter = true;
+		writer.join();
+		lightValues.RemoveSink(&ringWriter);
+		ringWriter.Close();
+
+		fprintf(stderr, "%-48s %llu published, %llu read, %llu torn, %llu skipped%s\n", followName.c_str(), static_cast<unsigned long long>(sequence),
+			static_cast<unsigned long long>(framesRead), static_cast<unsigned long long>(tornFrames), static_cast<unsigned long long>(skippedFrames), timedOut ? ", timed out" : "");
+		if (checksFailed || timedOut || !ringReader.IsWriterClosed())
+		{
+			g_ChecksFailed = true;
+		}
+	}
+}
+
+//
+// Light values published through the triple buffer into registered buffers, and read in place by a consumer woken
+// by the filled callback, the way the server reads them. Nothing should ever be torn, as the buffer being read is
+// never filled, so every frame picked up has to hold its sequence plus each light's index. Once unregistered, the
+// buffers have to be left alone
+//
+static void BenchmarkRegisteredLights()
+{
+	const int lightCounts[] = { 100, 300, 2304 };
+
+	for (int lightCount : lightCounts)
+	{
+		std::string publishName = "registered_lights/publish/" + std::to_string(lightCount);
+		std::string followName = "registered_lights/follow/" + std::to_string(lightCount);
+		if (!IsSelected(publishName) && !IsSelected(followName))
+		{
+			continue;
+		}
+
+		struct Notification
+		{
+			std::mutex lock;
+			std::condition_variable filled;
+			uint64_t count;
+		} notification;
+		notification.count = 0;
+		auto onFilled = [](void* context)
+		{
+			Notification* notification = static_cast<Notification*>(context);
+			{
+				std::lock_guard<std::mutex> lock(notification->lock);
+				++notification->count;
+			}
+			notification->filled.notify_one();
+		};
+
+		const int bufferCount = RegisteredLightBuffers::MinBufferCount;
+		size_t size = RegisteredLightBuffers::GetSize(bufferCount, lightCount);
+		std::vector<uint64_t> memory((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		RegisteredLightsHeader* header = reinterpret_cast<RegisteredLightsHeader*>(&memory[0]);
+		LightValueBuffer lightValues;
+		lightValues.Initialise(lightCount);
+		RegisteredLightBuffers registeredLights;
+		if (!registeredLights.Register(&memory[0], size, bufferCount, lightCount, onFilled, &notification))
+		{
+			fprintf(stderr, "%-48s couldn't register the buffers\n", publishName.c_str());
+			g_ChecksFailed = true;
+			continue;
+		}
+		lightValues.AddSink(&registeredLights);
+
+		uint64_t sequence = 0;
+		auto publish = [&]()
+		{
+			int32_t* values = lightValues.BeginWrite();
+			++sequence;
+			for (int index = 0; index < lightCount; ++index)
+			{
+				values[index] = static_cast<int32_t>((sequence + index) & 0xFFFFFF);
+			}
+			lightValues.Publish(0);
+		};
+
+		auto checkBuffer = [&](int index)
+		{
+			uint64_t frame = RegisteredLightBuffers::GetInfo(header, index)->sequence;
+			const int32_t* values = RegisteredLightBuffers::GetValues(header, index);
+			for (int light = 0; light < lightCount; ++light)
+			{
+				if (values[light] != static_cast<int32_t>((frame + light) & 0xFFFFFF))
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		bool checksFailed = false;
+		RunBenchmark(publishName, lightCount, [&]()
+		{
+			publish();
+			int index = RegisteredLightBuffers::AcquireLatest(header);
+			g_Sink += RegisteredLightBuffers::GetValues(header, index)[1];
+		});
+
+		std::atomic<bool> stopWriter(false);
+		std::thread writer([&]()
+		{
+			while (!stopWriter.load(std::memory_order_relaxed))
+			{
+				publish();
+				std::this_thread::yield();
+			}
+		});
+
+		uint64_t framesRead = 0;
+		uint64_t skippedFrames = 0;
+		uint64_t lastSequence = 0;
+		uint64_t lastNotification = 0;
+		bool timedOut = false;
+		RunBenchmark(followName, lightCount, [&]()
+		{
+			// Wait to be told there's a new buffer, then check it in place
+			{
+				std::unique_lock<std::mutex> lock(notification.lock);
+				if (!notification.filled.wait_for(lock, std::chrono::seconds(1), [&]() { return notification.count != lastNotification; }))
+				{
+					timedOut = true;
+					return;
+				}
+				lastNotification = notification.count;
+			}
+
+			int index = RegisteredLightBuffers::AcquireLatest(header);
+			uint64_t frame = RegisteredLightBuffers::GetInfo(header, index)->sequence;
+			if (frame <= lastSequence || !checkBuffer(index))
+			{
+				checksFailed = true;
+			}
+			if (lastSequence)
+			{
+				skippedFrames += frame - lastSequence - 1;
+			}
+			lastSequence = frame;
+			++framesRead;
+		});
+
+		stopWriter = true;
+		writer.join();
+
+		// Nothing more gets written or signalled once they're unregistered
+		registeredLights.Unregister();
+		std::vector<uint64_t> unregisteredMemory = memory;
+		uint64_t unregisteredNotifications = notification.count;
+		publish();
+		if (memory != unregisteredMemory || notification.count != unregisteredNotifications)
+		{
+			checksFailed = true;
+		}
+		lightValues.RemoveSink(&registeredLights);
+
+		fprintf(stderr, "%-48s %llu published, %llu read, %llu skipped%s\n", followName.c_str(), static_cast<unsigned long long>(sequence),
+			static_cast<unsigned long long>(framesRead), static_cast<unsigned long long>(skippedFrames), timedOut ? ", timed out" : "");
+		if (checksFailed || timedOut)
+		{
+			g_ChecksFailed = true;
+		}
+	}
+}
+
+//
+// Picking up frames from every output's slots while a producer thread per output publishes as fast as it can.
+// Each frame is filled with a value made from its output and sequence, so any frame the consumer sees
+// half written, from the wrong output or out of order counts as a failure
+//
+static void BenchmarkFrameSlots()
+{
+	const int outputCounts[] = { 1, 2, 4 };
+	const int FrameWidth = 64;
+	const int FrameHeight = 36;
+
+	for (int outputCount : outputCounts)
+	{
+		std::string name = "frame_slots/" + std::to_string(outputCount) + "_outputs";
+		if (!IsSelected(name))
+		{
+			continue;
+		}
+
+		std::vector<int> widths(outputCount, FrameWidth);
+		std::vector<int> heights(outputCount, FrameHeight);
+		CpuFrameSlots frameSlots;
+		frameSlots.Initialise(outputCount, &widths[0], &heights[0]);
+
+		std::atomic<bool> stopProducers(false);
+		std::vector<std::thread> producers;
+		for (int output = 0; output < outputCount; ++output)
+		{
+			producers.push_back(std::thread([&frameSlots, &stopProducers, output]()
+			{
+				for (uint32_t sequence = 1; !stopProducers.load(std::memory_order_relaxed); ++sequence)
+				{
+					int pitch = 0;
+					uint32_t* pixels = reinterpret_cast<uint32_t*>(frameSlots.BeginWrite(output, &pitch));
+					std::fill(pixels, pixels + (pitch / 4) * FrameHeight, (static_cast<uint32_t>(output) << 24) | (sequence & 0xFFFFFF));
+					frameSlots.Publish(output, sequence);
+				}
+			}));
+		}
+
+		uint64_t framesSeen = 0;
+		uint64_t badFrames = 0;
+		std::vector<uint64_t> lastSequences(outputCount, 0);
+		RunBenchmark(name, outputCount, [&]()
+		{
+			for (int output = 0; output < outputCount; ++output)
+			{
+				FrameBuffer frameBuffer;
+				uint64_t sequence = 0;
+				int64_t presentTime = 0;
+				if (!frameSlots.Acquire(output, &frameBuffer, &sequence, &presentTime))
+				{
+					continue;
+				}
+
+				++framesSeen;
+				const uint32_t* pixels = reinterpret_cast<const uint32_t*>(frameBuffer.pixels);
+				const uint32_t* endPixel = pixels + (frameBuffer.pitch / 4) * frameBuffer.height;
+				uint32_t expected = (static_cast<uint32_t>(output) << 24) | (static_cast<uint32_t>(sequence) & 0xFFFFFF);
+				if (sequence <= lastSequences[output] || static_cast<uint64_t>(presentTime) != sequence || std::find_if(pixels, endPixel, [expected](uint32_t pixel) { return pixel != expected; }) != endPixel)
+				{
+					++badFrames;
+				}
+				lastSequences[output] = sequence;
+			}
+		});
+
+		stopProducers = true;
+		for (std::thread& producer : producers)
+		{
+			producer.join();
+		}
+
+		uint64_t published = 0;
+		uint64_t dropped = 0;
+		for (int output = 0; output < outputCount; ++output)
+		{
+			published += frameSlots.GetExchange()->GetPublishedCount(output);
+			dropped += frameSlots.GetExchange()->GetDroppedCount(output);
+		}
+		fprintf(stderr, "%-48s %llu published, %llu dropped, %llu seen, %llu bad\n", name.c_str(),
+			static_cast<unsigned long long>(published), static_cast<unsigned long long>(dropped),
+			static_cast<unsigned long long>(framesSeen), static_cast<unsigned long long>(badFrames));
+		if (badFrames)
+		{
+			g_ChecksFailed = true;
+		}
+	}
+}
+
+#if !defined(_WIN32)
+//
+// Plays the controller board on the master side of a pseudo terminal, so the serial transport can be driven
+// end to end without hardware. Every light in a frame is sent as its frame number plus its index, so any
+// frame that arrives torn, short or out of order counts as a failure. Offering no features makes it behave
+// like the original firmware, which never answers 'P'. The terminal takes any baud rate, so a link rate the
+// wiring couldn't manage is played by garbling the board's answer to the link test. With sync show, good
+// frames are held until 'W', and a board can be given a share of the lights starting part way along. With
+// the scheduled feature, its clock is well off the host's, and frames queue up to be shown when 'Z' says
+//
+class LoopbackBoard
+{
+public:
+	struct ShowRecord
+	{
+		uint32_t frame;
+		int64_t time;
+	};
+
+public:
+	LoopbackBoard(uint16_t features, int window) :
+		m_Master(-1),
+		m_Slave(-1),
+		m_LightCount(0),
+		m_FirstLight(0),
+		m_Features(features),
+		m_Window(window),
+		m_CorruptEvery(0),
+		m_WorkingLinkRate(0),
+		m_LinkRate(LightLinkRates[0]),
+		m_InputStart(0),
+		m_InputEnd(0),
+		m_StopRequested(false),
+		m_LogShows(false),
+		m_Connected(false),
+		m_ShownFrame(0),
+		m_FramesShown(0),
+		m_BadFrames(0),
+		m_RejectedFrames(0),
+		m_StrayBytes(0),
+		m_ActiveFeatures(0),
+		m_ShownSequence(-1),
+		m_HeldSequence(-1),
+		m_ChunkSequence(-1),
+		m_ChunkType(0),
+		m_ChunkTotalLength(0),
+		m_ScheduleSequence(-1),
+		m_ScheduleTime(0)
+	{
+	}
+
+	~LoopbackBoard()
+	{
+		Stop();
+	}
+
+	// Opens the terminal pair, returning the path the transport should open
+	bool Open(std::string* portPath)
+	{
+		m_Master = posix_openpt(O_RDWR | O_NOCTTY);
+		if (m_Master < 0 || grantpt(m_Master) != 0 || unlockpt(m_Master) != 0 || !ptsname(m_Master))
+		{
+			return false;
+		}
+		*portPath = ptsname(m_Master);
+
+		// Hold the slave side open ourselves, in raw mode, so nothing is echoed back and the master never sees a hang up
+		m_Slave = open(portPath->c_str(), O_RDWR | O_NOCTTY);
+		struct termios settings;
+		if (m_Slave < 0 || tcgetattr(m_Slave, &settings) != 0)
+		{
+			return false;
+		}
+		cfmakeraw(&settings);
+		return tcsetattr(m_Slave, TCSANOW, &settings) == 0;
+	}
+
+	// Flips a bit in one of every count framed light frames, as line noise would
+	void SetCorruptEvery(int count)
+	{
+		m_CorruptEvery = count;
+	}
+
+	// Link rates above this fail their test
+	void SetWorkingLinkRate(int baudRate)
+	{
+		m_WorkingLinkRate = baudRate;
+	}
+
+	int GetLinkRate() const
+	{
+		return m_LinkRate;
+	}
+
+	// Index of the board's first light in the frames made by MakeFrame
+	void SetFirstLight(int firstLight)
+	{
+		m_FirstLight = firstLight;
+	}
+
+	// Keeps every frame shown and when, for GetShows
+	void SetLogShows(bool logShows)
+	{
+		m_LogShows = logShows;
+	}
+
+	// Only read once stopped
+	const std::vector<ShowRecord>& GetShows() const
+	{
+		return m_Shows;
+	}
+
+	void Start(int lightColumns, int lightRows)
+	{
+		m_LightColumns = lightColumns;
+		m_LightRows = lightRows;
+		m_LightCount = lightColumns * lightRows;
+		m_FrameParser.Initialise(std::max(m_LightCount * 3, LightFrameChunkHeaderSize + LightFrameChunkLength));
+		m_Thread = std::thread(&LoopbackBoard::Run, this);
+	}
+
+	void Stop()
+	{
+		m_StopRequested = true;
+		if (m_Thread.joinable())
+		{
+			m_Thread.join();
+		}
+		if (m_Slave >= 0)
+		{
+			close(m_Slave);
+			m_Slave = -1;
+		}
+		if (m_Master >= 0)
+		{
+			close(m_Master);
+			m_Master = -1;
+		}
+	}
+
+	// Waits for the board to have shown frame, or anything after it
+	bool WaitForFrame(uint32_t frame, int timeoutMilliseconds)
+	{
+		std::unique_lock<std::mutex> lock(m_Lock);
+		return m_Shown.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this, frame]() { return m_ShownFrame >= frame; });
+	}
+
+	bool WaitForConnection(int timeoutMilliseconds)
+	{
+		std::unique_lock<std::mutex> lock(m_Lock);
+		return m_Shown.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this]() { return m_Connected; });
+	}
+
+	uint32_t GetShownFrame()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		return m_ShownFrame;
+	}
+
+	uint64_t GetFramesShown() const
+	{
+		return m_FramesShown;
+	}
+
+	uint64_t GetBadFrames() const
+	{
+		return m_BadFrames;
+	}
+
+	// Good frames that couldn't be applied to the lights
+	uint64_t GetRejectedFrames() const
+	{
+		return m_RejectedFrames;
+	}
+
+	// Bytes outside frames that weren't a command, as when the board and host disagree about a command's length
+	uint64_t GetStrayBytes() const
+	{
+		return m_StrayBytes;
+	}
+
+	// Only read once stopped
+	uint64_t GetCorruptFrames() const
+	{
+		return m_FrameParser.GetCorruptFrames();
+	}
+
+	// Reduced colour formats only get 12 bits through exactly, so the number is cut to 12 bits and spread over
+	// the top 4 bits of each channel
+	static void MakeFrame(uint32_t frame, LightColourFormat format, std::vector<int32_t>* lightValues)
+	{
+		for (size_t index = 0; index < lightValues->size(); ++index)
+		{
+			uint8_t light[3];
+			GetFrameLight(frame, static_cast<int>(index), format, light);
+			(*lightValues)[index] = (light[0] << 16) | (light[1] << 8) | light[2];
+		}
+	}
+
+private:
+	// Reads exactly length bytes, giving up on stop or after the timeout
+	bool ReadBytes(uint8_t* buffer, int length, int timeoutMilliseconds)
+	{
+		// Framed data is read a byte at a time, so don't look at the clock if it's already here
+		if (length <= m_InputEnd - m_InputStart)
+		{
+			memcpy(buffer, m_Input + m_InputStart, length);
+			m_InputStart += length;
+			return true;
+		}
+
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+		while (length > 0 && !m_StopRequested)
+		{
+			if (m_InputStart < m_InputEnd)
+			{
+				int copyLength = std::min(length, m_InputEnd - m_InputStart);
+				memcpy(buffer, m_Input + m_InputStart, copyLength);
+				m_InputStart += copyLength;
+				buffer += copyLength;
+				length -= copyLength;
+				continue;
+			}
+
+			int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+			if (remaining < 0)
+			{
+				return false;
+			}
+
+			// Wake up now and then to check for stop
+			struct pollfd pollFd = { m_Master, POLLIN, 0 };
+			if (poll(&pollFd, 1, std::min(remaining, 50)) <= 0)
+			{
+				continue;
+			}
+
+			ssize_t bytesRead = read(m_Master, m_Input, sizeof(m_Input));
+			if (bytesRead <= 0)
+			{
+				return false;
+			}
+			m_InputStart = 0;
+			m_InputEnd = static_cast<int>(bytesRead);
+		}
+		return length == 0;
+	}
+
+	void WriteBytes(const void* data, size_t length)
+	{
+		ssize_t written = write(m_Master, data, length);
+		(void)written;
+	}
+
+	static void GetFrameLight(uint32_t frame, int index, LightColourFormat format, uint8_t* light)
+	{
+		uint32_t value = (frame + index) & 0xFFFFFF;
+		if (format == LightColourFormatRGB888)
+		{
+			light[0] = static_cast<uint8_t>(value >> 16);
+			light[1] = static_cast<uint8_t>(value >> 8);
+			light[2] = static_cast<uint8_t>(value);
+			return;
+		}
+
+		const int channelBits[3] = { (format == LightColourFormatRGB565) ? 5 : 4, (format == LightColourFormatRGB565) ? 6 : 4, (format == LightColourFormatRGB565) ? 5 : 4 };
+		for (int channel = 0; channel < 3; ++channel)
+		{
+			int top = (value >> ((2 - channel) * 4)) & 0xF;
+			light[channel] = ExpandLightChannel(top << (channelBits[channel] - 4), channelBits[channel]);
+		}
+	}
+
+	// Milliseconds, wrapping like millis() on the board
+	static uint32_t GetBoardTime()
+	{
+		return static_cast<uint32_t>(GetLatencyTimestamp() / 1000) + BoardClockOffset;
+	}
+
+	// Queues a frame just decoded if the host has given it a time or there are frames ahead of it. Returns false
+	// if it's to be shown straight away instead
+	bool ScheduleFrame(uint8_t sequence, const std::vector<uint8_t>& lightData)
+	{
+		bool scheduled = m_ScheduleSequence == sequence;
+		if (!scheduled && m_ScheduledFrames.empty())
+		{
+			return false;
+		}
+
+		if (m_ScheduledFrames.size() == MaxScheduledFrames)
+		{
+			// No room, so the oldest goes early
+			ShowFrame(&m_ScheduledFrames.front().lightData[0]);
+			m_ScheduledFrames.pop_front();
+			m_Shown.notify_all();
+		}
+		ScheduledFrame frame = { scheduled ? m_ScheduleTime : GetBoardTime(), lightData };
+		m_ScheduledFrames.push_back(frame);
+		m_ScheduleSequence = -1;
+		return true;
+	}
+
+	// Shows the newest of the queued frames that are due, skipping any older ones
+	void ShowScheduledFrames()
+	{
+		bool due = false;
+		while (!m_ScheduledFrames.empty() && static_cast<int32_t>(GetBoardTime() - m_ScheduledFrames.front().time) >= 0)
+		{
+			m_DueLightData.swap(m_ScheduledFrames.front().lightData);
+			m_ScheduledFrames.pop_front();
+			due = true;
+		}
+		if (due)
+		{
+			ShowFrame(&m_DueLightData[0]);
+			m_Shown.notify_all();
+		}
+	}
+
+	void ShowFrame(const uint8_t* lightData)
+	{
+		LightColourFormat format = GetLightColourFormat(m_ActiveFeatures);
+		uint32_t frame = (((lightData[0] << 16) | (lightData[1] << 8) | lightData[2]) - m_FirstLight) & 0xFFFFFF;
+		if (format != LightColourFormatRGB888)
+		{
+			// Only the bottom 12 bits come through, so take the first frame after the last one shown that matches them
+			uint32_t low = ((((lightData[0] >> 4) << 8) | ((lightData[1] >> 4) << 4) | (lightData[2] >> 4)) - m_FirstLight) & 0xFFF;
+			std::lock_guard<std::mutex> lock(m_Lock);
+			frame = (m_ShownFrame & ~0xFFFu) | low;
+			if (frame <= m_ShownFrame)
+			{
+				frame += 0x1000;
+			}
+		}
+
+		bool good = true;
+		for (int index = 0; index < m_LightCount && good; ++index)
+		{
+			uint8_t expected[3];
+			GetFrameLight(frame, m_FirstLight + index, format, expected);
+			good = memcmp(&lightData[index * 3], expected, sizeof(expected)) == 0;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			if (!good || frame <= m_ShownFrame)
+			{
+				++m_BadFrames;
+			}
+			m_ShownFrame = std::max(m_ShownFrame, frame);
+		}
+		if (m_LogShows)
+		{
+			ShowRecord show = { frame, GetLatencyTimestamp() };
+			m_Shows.push_back(show);
+		}
+		++m_FramesShown;
+	}
+
+	void Run()
+	{
+		// Say hello until the transport answers, then ask for the config
+		uint8_t response[3];
+		while (!m_StopRequested)
+		{
+			WriteBytes("H", 1);
+			if (ReadBytes(response, 1, 100) && response[0] == 'H')
+			{
+				WriteBytes("C", 1);
+				if (ReadBytes(response, 3, 500) && response[0] == 'C' && response[1] == std::min(m_LightColumns, 255) && response[2] == std::min(m_LightRows, 255))
+				{
+					break;
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_Connected = true;
+		}
+		m_Shown.notify_all();
+
+		std::vector<uint8_t> lightData(m_LightCount * 3);
+		uint64_t framesStarted = 0;
+		size_t frameOffset = 0;
+		while (!m_StopRequested)
+		{
+			// Wait no longer than the next queued frame's due
+			ShowScheduledFrames();
+			int timeoutMilliseconds = 100;
+			if (!m_ScheduledFrames.empty())
+			{
+				timeoutMilliseconds = std::max(0, static_cast<int32_t>(m_ScheduledFrames.front().time - GetBoardTime()));
+			}
+
+			uint8_t value;
+			if (!ReadBytes(&value, 1, timeoutMilliseconds))
+			{
+				continue;
+			}
+
+			bool framed = (m_ActiveFeatures & LightProtocolFeatureFramed) != 0;
+			if (framed && (m_FrameParser.IsInFrame() || value == LightFrameSync0))
+			{
+				if (!m_FrameParser.IsInFrame())
+				{
+					++framesStarted;
+					frameOffset = 0;
+				}
+
+				// Flip a bit at the start of the payload, so the CRC has to catch it
+				if (m_CorruptEvery > 0 && (framesStarted % m_CorruptEvery) == 0 && frameOffset++ == LightFrameHeaderSize)
+				{
+					value ^= 0x10;
+				}
+
+				uint64_t corruptFrames = m_FrameParser.GetCorruptFrames();
+				if (m_FrameParser.Feed(value))
+				{
+					uint8_t type = m_FrameParser.GetType();
+					const uint8_t* payload = m_FrameParser.GetPayload();
+					size_t payloadLength = m_FrameParser.GetPayloadLength();
+					bool good = true;
+					if (type == LightFrameTypeChunk && (m_ActiveFeatures & LightProtocolFeatureLargeLayout))
+					{
+						// Only the last chunk gets an answer, once the whole frame is in
+						good = AddChunk(m_FrameParser.GetSequence(), payload, payloadLength);
+						if (good && m_ChunkData.size() < m_ChunkTotalLength)
+						{
+							continue;
+						}
+						type = m_ChunkType;
+						payload = m_ChunkData.data();
+						payloadLength = m_ChunkData.size();
+						m_ChunkSequence = -1;
+					}
+
+					m_HeldSequence = -1;
+					if (good && DecodeLightFrame(type, payload, payloadLength, m_ShownSequence, &lightData[0], m_LightCount))
+					{
+						m_ShownSequence = m_FrameParser.GetSequence();
+						if (ScheduleFrame(m_FrameParser.GetSequence(), lightData))
+						{
+						}
+						else if (m_ActiveFeatures & LightProtocolFeatureSyncShow)
+						{
+							m_HeldSequence = m_ShownSequence;
+						}
+						else
+						{
+							ShowFrame(&lightData[0]);
+						}
+						uint8_t shown[2] = { 'S', m_FrameParser.GetSequence() };
+						WriteBytes(shown, sizeof(shown));
+						m_Shown.notify_all();
+					}
+					else
+					{
+						// Most likely based on a frame that was lost, so ask for a keyframe
+						m_ShownSequence = -1;
+						++m_RejectedFrames;
+						uint8_t rejected[2] = { 'N', m_FrameParser.GetSequence() };
+						WriteBytes(rejected, sizeof(rejected));
+					}
+				}
+				else if (m_FrameParser.GetCorruptFrames() != corruptFrames)
+				{
+					// The firmware decodes straight into its lights, so a corrupt frame leaves them out of step
+					m_ShownSequence = -1;
+					m_HeldSequence = -1;
+					m_ChunkSequence = -1;
+					uint8_t rejected[2] = { 'N', m_FrameParser.GetSequence() };
+					WriteBytes(rejected, sizeof(rejected));
+				}
+				continue;
+			}
+
+			// Once framed, the host never sends 'A', 'P' or 'M', so they can only be left over from a dropped frame
+			if (framed && (value == 'A' || value == 'P' || value == 'M'))
+			{
+				continue;
+			}
+
+			if (value == 'A')
+			{
+				WriteBytes("R", 1);
+				if (!ReadBytes(&lightData[0], static_cast<int>(lightData.size()), 500))
+				{
+					++m_BadFrames;
+					continue;
+				}
+
+				ShowFrame(&lightData[0]);
+				WriteBytes("S", 1);
+				m_Shown.notify_all();
+			}
+			else if (value == 'P' && m_Features != 0)
+			{
+				LightProtocolCapabilities capabilities;
+				capabilities.version = LightProtocolVersion;
+				capabilities.features = m_Features;
+				capabilities.window = static_cast<uint8_t>(m_Window);
+				capabilities.maxLights = static_cast<uint16_t>(m_LightCount);
+				capabilities.linkRates = (m_Features & LightProtocolFeatureLinkRate) ? 0x0F : 0;
+				uint8_t reply[2 + LightProtocolCapabilitiesSize] = { 'P', LightProtocolCapabilitiesSize };
+				WriteLightProtocolCapabilities(capabilities, reply + 2);
+				WriteBytes(reply, sizeof(reply));
+			}
+			else if (value == 'M' && m_Features != 0)
+			{
+				uint8_t mode[2];
+				if (ReadBytes(mode, 2, 100))
+				{
+					m_ActiveFeatures = static_cast<uint16_t>(mode[0] | (mode[1] << 8)) & m_Features;
+					m_ShownSequence = -1;
+					m_HeldSequence = -1;
+					m_ScheduleSequence = -1;
+					m_ScheduledFrames.clear();
+					uint8_t reply[3] = { 'M', static_cast<uint8_t>(m_ActiveFeatures), static_cast<uint8_t>(m_ActiveFeatures >> 8) };
+					WriteBytes(reply, sizeof(reply));
+				}
+			}
+			else if (value == 'G' && (m_ActiveFeatures & LightProtocolFeatureLargeLayout))
+			{
+				// Only has room for the lights it was started with
+				uint8_t layout[4];
+				if (ReadBytes(layout, sizeof(layout), 100))
+				{
+					int lightCount = (layout[0] | (layout[1] << 8)) * (layout[2] | (layout[3] << 8));
+					if (lightCount != m_LightCount)
+					{
+						lightCount = 0;
+					}
+					uint8_t reply[3] = { 'G', static_cast<uint8_t>(lightCount), static_cast<uint8_t>(lightCount >> 8) };
+					WriteBytes(reply, sizeof(reply));
+				}
+			}
+			else if (value == 'B' && (m_ActiveFeatures & LightProtocolFeatureLinkRate))
+			{
+				uint8_t code;
+				if (ReadBytes(&code, 1, 100))
+				{
+					SwitchLinkRate(code);
+				}
+			}
+			else if (value == 'W' && (m_ActiveFeatures & LightProtocolFeatureSyncShow))
+			{
+				// Carries a sequence whether or not anything's held
+				uint8_t sequence;
+				if (ReadBytes(&sequence, 1, 100) && m_HeldSequence >= 0 && sequence == m_HeldSequence)
+				{
+					m_HeldSequence = -1;
+					ShowFrame(&lightData[0]);
+					m_Shown.notify_all();
+				}
+			}
+			else if (value == 'Q' && (m_ActiveFeatures & LightProtocolFeatureScheduled))
+			{
+				uint32_t time = GetBoardTime();
+				uint8_t reply[5] = { 'Q', static_cast<uint8_t>(time), static_cast<uint8_t>(time >> 8), static_cast<uint8_t>(time >> 16), static_cast<uint8_t>(time >> 24) };
+				WriteBytes(reply, sizeof(reply));
+			}
+			else if (value == 'Z' && (m_ActiveFeatures & LightProtocolFeatureScheduled))
+			{
+				// Like the firmware, only the low 2 bytes of the time come, and it won't wait too long
+				uint8_t schedule[3];
+				if (ReadBytes(schedule, sizeof(schedule), 100))
+				{
+					uint32_t now = GetBoardTime();
+					int16_t wait = static_cast<int16_t>(static_cast<uint16_t>((schedule[1] | (schedule[2] << 8)) - now));
+					m_ScheduleSequence = schedule[0];
+					m_ScheduleTime = now + std::min<int>(std::max<int>(wait, 0), MaxScheduleMilliseconds);
+				}
+			}
+			else if (value == 'D')
+			{
+				WriteBytes("DLoopback board\r\n", 17);
+			}
+			else if (framed && value != 'K')
+			{
+				++m_StrayBytes;
+			}
+		}
+	}
+
+	// Adds a chunk to the frame being gathered. Returns false if it doesn't carry on from the last one, as it
+	// would if one had gone missing
+	bool AddChunk(uint8_t sequence, const uint8_t* payload, size_t payloadLength)
+	{
+		LightFrameChunk chunk;
+		if (payloadLength <= static_cast<size_t>(LightFrameChunkHeaderSize))
+		{
+			m_ChunkSequence = -1;
+			return false;
+		}
+		ReadLightFrameChunk(payload, &chunk);
+
+		if (chunk.offset == 0)
+		{
+			m_ChunkSequence = sequence;
+			m_ChunkType = chunk.type;
+			m_ChunkTotalLength = chunk.totalLength;
+			m_ChunkData.clear();
+		}
+
+		size_t length = payloadLength - LightFrameChunkHeaderSize;
+		if (m_ChunkSequence != sequence || chunk.type != m_ChunkType || chunk.totalLength != m_ChunkTotalLength || chunk.offset != m_ChunkData.size() ||
+			chunk.offset + length > chunk.totalLength || chunk.totalLength > static_cast<size_t>(m_LightCount) * 3)
+		{
+			m_ChunkSequence = -1;
+			return false;
+		}
+		m_ChunkData.insert(m_ChunkData.end(), payload + LightFrameChunkHeaderSize, payload + payloadLength);
+		return true;
+	}
+
+	// Echoes the rate, checks the host's link test and answers it, then waits for the host to confirm. Like the
+	// firmware, anything missing or wrong leaves it at the rate it was on
+	void SwitchLinkRate(uint8_t code)
+	{
+		if (code >= LightLinkRateCount)
+		{
+			uint8_t refused[2] = { 'B', 0 };
+			WriteBytes(refused, sizeof(refused));
+			return;
+		}
+
+		uint8_t accepted[2] = { 'B', code };
+		WriteBytes(accepted, sizeof(accepted));
+
+		uint8_t expected[LightLinkTestSize];
+		uint8_t linkTest[1 + LightLinkTestSize];
+		MakeLightLinkTest(expected);
+		if (!ReadBytes(linkTest, sizeof(linkTest), 500) || linkTest[0] != 'T' || memcmp(&linkTest[1], expected, sizeof(expected)) != 0)
+		{
+			return;
+		}
+
+		if (LightLinkRates[code] > m_WorkingLinkRate)
+		{
+			linkTest[1 + LightLinkTestPatternLength / 2] ^= 0x10;
+		}
+		WriteBytes(linkTest, sizeof(linkTest));
+
+		uint8_t confirm;
+		if (ReadBytes(&confirm, 1, 500) && confirm == 'Y')
+		{
+			m_LinkRate = LightLinkRates[code];
+		}
+	}
+
+private:
+	struct ScheduledFrame
+	{
+		uint32_t				time;
+		std::vector<uint8_t>	lightData;
+	};
+
+	// The board's clock against the host's, the frames it can queue and the longest it'll wait for one, as on
+	// a board with plenty of memory
+	static const uint32_t BoardClockOffset = 0x89ABCDEF;
+	static const size_t MaxScheduledFrames = 4;
+	static const int MaxScheduleMilliseconds = 500;
+
+private:
+	int							m_Master;
+	int							m_Slave;
+	int							m_LightColumns;
+	int							m_LightRows;
+	int							m_LightCount;
+	int							m_FirstLight;
+	uint16_t					m_Features;
+	int							m_Window;
+	int							m_CorruptEvery;
+	int							m_WorkingLinkRate;
+	std::atomic<int>			m_LinkRate;
+	LightFrameParser			m_FrameParser;
+	uint8_t						m_Input[4096];
+	int							m_InputStart;
+	int							m_InputEnd;
+	std::thread					m_Thread;
+	std::atomic<bool>			m_StopRequested;
+	bool						m_LogShows;
+	std::vector<ShowRecord>		m_Shows;
+
+	std::mutex					m_Lock;
+	std::condition_variable		m_Shown;
+	bool						m_Connected;
+	uint32_t					m_ShownFrame;
+	std::atomic<uint64_t>		m_FramesShown;
+	std::atomic<uint64_t>		m_BadFrames;
+	std::atomic<uint64_t>		m_RejectedFrames;
+	std::atomic<uint64_t>		m_StrayBytes;
+	uint16_t					m_ActiveFeatures;
+
+	// Sequence of the frame the lights came from, or -1 if they're not from a good one
+	int							m_ShownSequence;
+
+	// With sync show, the sequence of the frame waiting for 'W', or -1 if there isn't one
+	int							m_HeldSequence;
+
+	// The chunked frame being gathered, if m_ChunkSequence isn't -1
+	int							m_ChunkSequence;
+	uint8_t						m_ChunkType;
+	size_t						m_ChunkTotalLength;
+	std::vector<uint8_t>		m_ChunkData;
+
+	// With the scheduled feature, the sequence the last 'Z' was for and when it's due, or -1 if it's been used,
+	// and the frames waiting to be shown, oldest first
+	int							m_ScheduleSequence;
+	uint32_t					m_ScheduleTime;
+	std::deque<ScheduledFrame>	m_ScheduledFrames;
+	std::vector<uint8_t>		m_DueLightData;
+};
+
+struct LoopbackProtocol
+{
+	const char* name;
+	uint16_t features;				// Offered by the board
+	int window;
+	int corruptEvery;
+	int workingLinkRate;			// For boards offering link rates, the fastest one that passes its test
+};
+
+//
+// The native serial transport talking to a loopback board over a pseudo terminal, with the original 'A'/'R'
+// protocol and with pipelined frames. A round trip is handing over a frame and waiting for the board to show
+// it; streaming hands frames over as fast as possible from another thread and times each one the board shows.
+// The lossy cases corrupt some frames on the way, which the board has to drop, and delta frames based on them
+// have to be rejected until the next keyframe. The reduced colour cases send lights the formats can show exactly. The terminal doesn't pace bytes
+// like a real port, so these measure the transport's own overhead. The large layout cases chunk the bigger frames, and also run a layout
+// too wide for the config. The interpolate case should be held to a frame every SerialTransport::InterpolatedFrameMilliseconds,
+// and once the board's clock is known, the scheduled case's round trips should take SerialTransport::ScheduledFrameDelayMilliseconds.
+// The sync show case has each frame shown as soon as it's acknowledged, while later frames are lost on the way, and the
+// board should never take the sequence after 'W' for a command
+//
+static void ShowReadyFrame(void* context)
+{
+	SerialTransport* transport = static_cast<SerialTransport*>(context);
+	transport->Show(transport->GetReadyGeneration());
+}
+
+static void BenchmarkSerialLoopback()
+{
+	const ZoneGrid lightGrids[] = { { 100, 3 }, { 64, 36 }, { 1000, 3 } };
+	const LoopbackProtocol protocols[] =
+	{
+		{ "legacy", 0, 1, 0, 0 },
+		{ "framed", LightProtocolFeatureFramed, 2, 0, 0 },
+		{ "framed_lossy", LightProtocolFeatureFramed, 2, 16, 0 },
+		{ "delta", LightProtocolFeatureFramed | LightProtocolFeatureDelta, 2, 0, 0 },
+		{ "delta_lossy", LightProtocolFeatureFramed | LightProtocolFeatureDelta, 2, 16, 0 },
+		{ "rgb565", LightProtocolFeatureFramed | LightProtocolFeatureRGB565, 2, 0, 0 },
+		{ "rgb444_delta", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureRGB444, 2, 0, 0 },
+		{ "rgb444_delta_lossy", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureRGB444, 2, 16, 0 },
+		{ "link_rate", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureLinkRate, 2, 0, 2000000 },
+		{ "link_rate_fallback", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureLinkRate, 2, 0, 500000 },
+		{ "large_layout", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureLargeLayout, 2, 0, 0 },
+		{ "large_layout_lossy", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureLargeLayout, 2, 16, 0 },
+		{ "interpolate", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureInterpolate, 2, 0, 0 },
+		{ "scheduled", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureScheduled, 2, 0, 0 },
+		{ "sync_show_lossy", LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureSyncShow, 2, 16, 0 }
+	};
+
+	for (const LoopbackProtocol& protocol : protocols)
+	{
+		for (const ZoneGrid& grid : lightGrids)
+		{
+			if ((grid.columns > 255 || grid.rows > 255) && !(protocol.features & LightProtocolFeatureLargeLayout))
+			{
+				continue;
+			}
+
+			std::string prefix = std::string("serial_loopback/") + protocol.name + "/";
+			std::string roundTripName = prefix + "round_trip/" + GridName(grid);
+			std::string streamName = prefix + "stream/" + GridName(grid);
+
+			// Lost frames make round trips meaningless
+			bool runRoundTrip = IsSelected(roundTripName) && protocol.corruptEvery == 0;
+			if (!runRoundTrip && !IsSelected(streamName))
+			{
+				continue;
+			}
+
+			int lightCount = grid.columns * grid.rows;
+			LightColourFormat format = GetLightColourFormat(protocol.features);
+			LoopbackBoard board(protocol.features, protocol.window);
+			board.SetCorruptEvery(protocol.corruptEvery);
+			board.SetWorkingLinkRate(protocol.workingLinkRate);
+
+			// Leave it to the board to say what gets used
+			SerialTransport transport(nullptr);
+			transport.SetFeatures(LightProtocolHostFeatures);
+			if (protocol.features & LightProtocolFeatureSyncShow)
+			{
+				transport.SetFrameCallback(&ShowReadyFrame, &transport);
+			}
+			std::string portPath;
+			if (!board.Open(&portPath) || !transport.Start(portPath, SerialTransport::DefaultBaudRate, grid.columns, grid.rows))
+			{
+				fprintf(stderr, "%-48s couldn't open a pseudo terminal\n", prefix.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			board.Start(grid.columns, grid.rows);
+			if (!board.WaitForConnection(SerialTransport::OpenDelayMilliseconds + 5000))
+			{
+				fprintf(stderr, "%-48s board never connected\n", prefix.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			// Older boards hold everything up until the transport gives up asking what they can do, and link rates
+			// that fail their test hold it up until the board has given up on them
+			std::vector<int32_t> lightValues(lightCount);
+			uint32_t frame = 1;
+			LoopbackBoard::MakeFrame(frame, format, &lightValues);
+			transport.SetLightValues(&lightValues[0], lightCount, 0);
+			int linkRateMilliseconds = LightLinkRateCount * (SerialTransport::LinkSwitchMilliseconds + SerialTransport::LinkTestTimeoutMilliseconds + SerialTransport::LinkFallbackMilliseconds);
+			bool timedOut = !board.WaitForFrame(frame, SerialTransport::NegotiationTimeoutMilliseconds + linkRateMilliseconds + 1000);
+			if (runRoundTrip)
+			{
+				LatencyHistogram roundTrips;
+				RunBenchmark(roundTripName, lightCount, [&]()
+				{
+					LoopbackBoard::MakeFrame(++frame, format, &lightValues);
+					int64_t start = GetLatencyTimestamp();
+					transport.SetLightValues(&lightValues[0], lightCount, start);
+					if (!board.WaitForFrame(frame, 1000))
+					{
+						timedOut = true;
+					}
+					roundTrips.Record(GetLatencyTimestamp() - start);
+				});
+				fprintf(stderr, "%-48s p50 %lldus, p99 %lldus, max %lldus\n", roundTripName.c_str(),
+					static_cast<long long>(roundTrips.GetPercentile(50.0)), static_cast<long long>(roundTrips.GetPercentile(99.0)), static_cast<long long>(roundTrips.GetMaximum()));
+			}
+
+			if (IsSelected(streamName))
+			{
+				std::atomic<bool> stopProducer(false);
+				std::atomic<uint32_t> producedFrame(frame);
+				std::thread producer([&]()
+				{
+					std::vector<int32_t> streamValues(lightCount);
+					while (!stopProducer.load(std::memory_order_relaxed))
+					{
+						uint32_t nextFrame = producedFrame + 1;
+						LoopbackBoard::MakeFrame(nextFrame, format, &streamValues);
+						transport.SetLightValues(&streamValues[0], lightCount, 0);
+						producedFrame = nextFrame;
+						std::this_thread::yield();
+					}
+				});
+
+				uint64_t framesShown = board.GetFramesShown();
+				RunBenchmark(streamName, lightCount, [&]()
+				{
+					if (!board.WaitForFrame(board.GetShownFrame() + 1, 1000))
+					{
+						timedOut = true;
+					}
+				});
+
+				stopProducer = true;
+				producer.join();
+				fprintf(stderr, "%-48s %llu produced, %llu shown\n", streamName.c_str(),
+					static_cast<unsigned long long>(producedFrame - frame), static_cast<unsigned long long>(board.GetFramesShown() - framesShown));
+			}
+
+			transport.Stop();
+			board.Stop();
+
+			// The transport should have agreed on whatever the board offered, and the board should only have dropped frames when they were corrupted
+			uint64_t framesSent = std::max<uint64_t>(1, transport.GetFramesSent());
+			fprintf(stderr, "%-48s %llu sent, %llu shown, %llu dropped, %llu corrupt, %llu rejected, %llu bad, %llu stray, %llu bytes/frame%s\n", (prefix + GridName(grid)).c_str(),
+				static_cast<unsigned long long>(transport.GetFramesSent()), static_cast<unsigned long long>(transport.GetFramesShown()),
+				static_cast<unsigned long long>(transport.GetFramesDropped()), static_cast<unsigned long long>(board.GetCorruptFrames()),
+				static_cast<unsigned long long>(board.GetRejectedFrames()), static_cast<unsigned long long>(board.GetBadFrames()), static_cast<unsigned long long>(board.GetStrayBytes()),
+				static_cast<unsigned long long>(transport.GetLightBytesSent() / framesSent), timedOut ? ", timed out" : "");
+
+			// Both ends should have settled on the fastest rate that works
+			int linkRate = (protocol.features & LightProtocolFeatureLinkRate) ? protocol.workingLinkRate : SerialTransport::DefaultBaudRate;
+			if (transport.GetBaudRate() != linkRate || board.GetLinkRate() != linkRate)
+			{
+				fprintf(stderr, "%-48s link rate %d, board %d, expected %d\n", (prefix + GridName(grid)).c_str(), transport.GetBaudRate(), board.GetLinkRate(), linkRate);
+				g_ChecksFailed = true;
+			}
+
+			bool lossy = protocol.corruptEvery != 0;
+			if (board.GetBadFrames() || board.GetStrayBytes() || timedOut || transport.GetActiveFeatures() != protocol.features || (board.GetCorruptFrames() != 0) != lossy || (board.GetRejectedFrames() != 0 && !lossy))
+			{
+				g_ChecksFailed = true;
+			}
+		}
+	}
+}
+
+//
+// The sharded transport splitting the lights over several loopback boards, each on its own pseudo terminal and
+// holding frames for 'W'. A round trip waits for every board to show the frame, and streaming times each frame
+// the slowest board shows. Every board has to show the same frames, and the skew is how far apart they did
+//
+static void BenchmarkShardedLoopback()
+{
+	const ZoneGrid lightGrids[] = { { 100, 3 }, { 64, 36 } };
+	const int boardCounts[] = { 2, 3 };
+	const uint16_t features = LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureSyncShow;
+
+	for (int boardCount : boardCounts)
+	{
+		for (const ZoneGrid& grid : lightGrids)
+		{
+			std::string prefix = std::string("serial_sharded/") + std::to_string(boardCount) + "_boards/";
+			std::string roundTripName = prefix + "round_trip/" + GridName(grid);
+			std::string streamName = prefix + "stream/" + GridName(grid);
+			if (!IsSelected(roundTripName) && !IsSelected(streamName))
+			{
+				continue;
+			}
+
+			int lightCount = grid.columns * grid.rows;
+			std::vector<std::unique_ptr<LoopbackBoard>> boards;
+			std::vector<std::string> portPaths(boardCount);
+			bool opened = true;
+			for (int index = 0; index < boardCount; ++index)
+			{
+				boards.emplace_back(new LoopbackBoard(features, 2));
+				opened = opened && boards.back()->Open(&portPaths[index]);
+			}
+
+			ShardedTransport transport(nullptr);
+			transport.SetFeatures(LightProtocolHostFeatures);
+			if (!opened || !transport.Start(portPaths, SerialTransport::DefaultBaudRate, grid.columns, grid.rows))
+			{
+				fprintf(stderr, "%-48s couldn't open a pseudo terminal\n", prefix.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			// Shards get whole rows when there are enough to go round
+			bool connected = true;
+			for (int index = 0; index < boardCount; ++index)
+			{
+				int shardLights = transport.GetShardLightCount(index);
+				int shardColumns = (grid.rows >= boardCount) ? grid.columns : shardLights;
+				boards[index]->SetFirstLight(transport.GetShardFirstLight(index));
+				boards[index]->SetLogShows(true);
+				boards[index]->Start(shardColumns, shardLights / shardColumns);
+			}
+			for (int index = 0; index < boardCount; ++index)
+			{
+				connected = connected && boards[index]->WaitForConnection(SerialTransport::OpenDelayMilliseconds + 5000);
+			}
+			if (!connected)
+			{
+				fprintf(stderr, "%-48s board never connected\n", prefix.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			auto waitForFrame = [&](uint32_t waitFrame, int timeoutMilliseconds)
+			{
+				bool shown = true;
+				for (const std::unique_ptr<LoopbackBoard>& board : boards)
+				{
+					shown = board->WaitForFrame(waitFrame, timeoutMilliseconds) && shown;
+				}
+				return shown;
+			};
+
+			std::vector<int32_t> lightValues(lightCount);
+			uint32_t frame = 1;
+			LoopbackBoard::MakeFrame(frame, LightColourFormatRGB888, &lightValues);
+			transport.SetLightValues(&lightValues[0], lightCount, 0);
+			bool timedOut = !waitForFrame(frame, SerialTransport::NegotiationTimeoutMilliseconds + 1000);
+			if (IsSelected(roundTripName))
+			{
+				LatencyHistogram roundTrips;
+				RunBenchmark(roundTripName, lightCount, [&]()
+				{
+					LoopbackBoard::MakeFrame(++frame, LightColourFormatRGB888, &lightValues);
+					int64_t start = GetLatencyTimestamp();
+					transport.SetLightValues(&lightValues[0], lightCount, start);
+					if (!waitForFrame(frame, 1000))
+					{
+						timedOut = true;
+					}
+					roundTrips.Record(GetLatencyTimestamp() - start);
+				});
+				fprintf(stderr, "%-48s p50 %lldus, p99 %lldus, max %lldus\n", roundTripName.c_str(),
+					static_cast<long long>(roundTrips.GetPercentile(50.0)), static_cast<long long>(roundTrips.GetPercentile(99.0)), static_cast<long long>(roundTrips.GetMaximum()));
+			}
+
+			if (IsSelected(streamName))
+			{
+				std::atomic<bool> stopProducer(false);
+				std::atomic<uint32_t> producedFrame(frame);
+				std::thread producer([&]()
+				{
+					std::vector<int32_t> streamValues(lightCount);
+					while (!stopProducer.load(std::memory_order_relaxed))
+					{
+						uint32_t nextFrame = producedFrame + 1;
+						LoopbackBoard::MakeFrame(nextFrame, LightColourFormatRGB888, &streamValues);
+						transport.SetLightValues(&streamValues[0], lightCount, 0);
+						producedFrame = nextFrame;
+						std::this_thread::yield();
+					}
+				});
+
+				RunBenchmark(streamName, lightCount, [&]()
+				{
+					if (!waitForFrame(boards[0]->GetShownFrame() + 1, 1000))
+					{
+						timedOut = true;
+					}
+				});
+
+				stopProducer = true;
+				producer.join();
+			}
+
+			transport.Stop();
+			bool checksFailed = timedOut;
+			for (int index = 0; index < boardCount; ++index)
+			{
+				boards[index]->Stop();
+				checksFailed = checksFailed || boards[index]->GetBadFrames() != 0 || boards[index]->GetRejectedFrames() != 0 || transport.GetShard(index)->GetActiveFeatures() != features;
+			}
+
+			// Stopping can come between telling one board to show and the next, but otherwise they all show the same
+			// frames, as near the same time as the terminals allow
+			LatencyHistogram skews;
+			size_t showCount = boards[0]->GetShows().size();
+			for (const std::unique_ptr<LoopbackBoard>& board : boards)
+			{
+				showCount = std::min(showCount, board->GetShows().size());
+				checksFailed = checksFailed || board->GetShows().size() > boards[0]->GetShows().size() + 1 || board->GetShows().size() + 1 < boards[0]->GetShows().size();
+			}
+			for (size_t show = 0; show < showCount; ++show)
+			{
+				int64_t first = boards[0]->GetShows()[show].time;
+				int64_t last = first;
+				for (const std::unique_ptr<LoopbackBoard>& board : boards)
+				{
+					const LoopbackBoard::ShowRecord& record = board->GetShows()[show];
+					checksFailed = checksFailed || record.frame != boards[0]->GetShows()[show].frame;
+					first = std::min(first, record.time);
+					last = std::max(last, record.time);
+				}
+				skews.Record(last - first);
+			}
+
+			fprintf(stderr, "%-48s %llu shown together, skew p50 %lldus, p99 %lldus, max %lldus%s\n", (prefix + GridName(grid)).c_str(),
+				static_cast<unsigned long long>(transport.GetFramesShown()), static_cast<long long>(skews.GetPercentile(50.0)),
+				static_cast<long long>(skews.GetPercentile(99.0)), static_cast<long long>(skews.GetMaximum()), timedOut ? ", timed out" : "");
+			if (checksFailed || showCount == 0)
+			{
+				g_ChecksFailed = true;
+			}
+		}
+	}
+}
+#endif
+
+//
+// A networked pixel controller on a loopback UDP port, putting frames back together from the packets the network
+// transport sends for the same universe mapping. A frame is shown once every packet of it has arrived, which for
+// DDP ends with a push and for synced E1.31 with the sync packet. Frames missing packets are counted as incomplete
+// rather than shown, and every light of a shown frame should hold its frame number plus its index
+//
+class NetworkLoopbackReceiver
+{
+public:
+	NetworkLoopbackReceiver(NetworkProtocol protocol, const std::vector<NetworkUniverse>& universes, int lightCount, int syncUniverse) :
+		m_Protocol(protocol),
+		m_Universes(universes),
+		m_LightCount(lightCount),
+		m_SyncUniverse(syncUniverse),
+		m_PacketsPerFrame(0),
+		m_Sequence(0),
+		m_FramePackets(0),
+		m_FrameShown(true),
+		m_StopRequested(false),
+		m_ShownFrame(0),
+		m_FramesShown(0),
+		m_IncompleteFrames(0),
+		m_BadFrames(0),
+		m_BadPackets(0)
+	{
+	}
+
+	~NetworkLoopbackReceiver()
+	{
+		Stop();
+	}
+
+	// Binds to a free port on the loopback address, returning it as a host for the transport
+	bool Start(std::string* host)
+	{
+		// An encoder laid out the same way says how many packets make a frame, and how big each destination is
+		NetworkFrameEncoder encoder;
+		E131Source source;
+		memset(&source, 0, sizeof(source));
+		if (!encoder.Initialise(m_Protocol, m_Universes, m_LightCount, source, m_SyncUniverse))
+		{
+			return false;
+		}
+		m_PacketsPerFrame = encoder.GetPacketCount() - (m_SyncUniverse != 0 ? 1 : 0);
+		for (const NetworkUniverse& universe : m_Universes)
+		{
+			std::vector<uint8_t>& channels = m_Destinations[universe.destination];
+			channels.resize(std::max(channels.size(), static_cast<size_t>(universe.startChannel + universe.lightCount * 3)));
+		}
+
+		UdpAddress address = { 0x7F000001, 0 };
+		if (!m_Socket.Bind(address))
+		{
+			return false;
+		}
+		*host = "127.0.0.1:" + std::to_string(m_Socket.GetLocalAddress().port);
+		m_Thread = std::thread(&NetworkLoopbackReceiver::Run, this);
+		return true;
+	}
+
+	void Stop()
+	{
+		if (m_Thread.joinable())
+		{
+			m_StopRequested = true;
+			m_Thread.join();
+		}
+		m_Socket.Close();
+	}
+
+	bool WaitForFrame(uint32_t frame, int timeoutMilliseconds)
+	{
+		std::unique_lock<std::mutex> lock(m_Lock);
+		return m_FrameShownEvent.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [&]() { return m_ShownFrame >= frame; });
+	}
+
+	uint32_t GetShownFrame()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		return m_ShownFrame;
+	}
+
+	uint64_t GetFramesShown() const { return m_FramesShown; }
+	uint64_t GetIncompleteFrames() const { return m_IncompleteFrames; }
+	uint64_t GetBadFrames() const { return m_BadFrames; }
+	uint64_t GetBadPackets() const { return m_BadPackets; }
+
+	static void MakeFrame(uint32_t frame, std::vector<int32_t>* lightValues)
+	{
+		for (size_t index = 0; index < lightValues->size(); ++index)
+		{
+			(*lightValues)[index] = static_cast<int32_t>((frame + index) & 0xFFFFFF);
+		}
+	}
+
+private:
+	void Run()
+	{
+		std::vector<uint8_t> buffer(2048);
+		while (!m_StopRequested)
+		{
+			int length = m_Socket.Receive(&buffer[0], static_cast<int>(buffer.size()), 50);
+			if (length < 0)
+			{
+				break;
+			}
+			if (length == 0)
+			{
+				continue;
+			}
+
+			if (m_Protocol == NetworkProtocolDDP)
+			{
+				DdpPacket packet;
+				if (!ReadDdpPacket(&buffer[0], length, &packet) || packet.dataType != DdpDataTypeRGB8 || !StoreChannels(packet.destination, packet.offset, packet.data, packet.dataLength))
+				{
+					++m_BadPackets;
+					continue;
+				}
+				CountPacket(packet.sequence);
+				if ((packet.flags & DdpFlagPush) && m_FramePackets == m_PacketsPerFrame)
+				{
+					ShowFrame();
+				}
+			}
+			else
+			{
+				E131Packet packet;
+				if (!ReadE131Packet(&buffer[0], length, &packet) || packet.syncUniverse != m_SyncUniverse)
+				{
+					++m_BadPackets;
+				}
+				else if (packet.sync)
+				{
+					if (packet.universe != m_SyncUniverse)
+					{
+						++m_BadPackets;
+					}
+					else if (m_FramePackets == m_PacketsPerFrame)
+					{
+						ShowFrame();
+					}
+				}
+				else if (!StoreChannels(packet.universe, 0, packet.channels, packet.channelCount))
+				{
+					++m_BadPackets;
+				}
+				else
+				{
+					CountPacket(packet.sequence);
+					if (m_SyncUniverse == 0 && m_FramePackets == m_PacketsPerFrame)
+					{
+						ShowFrame();
+					}
+				}
+			}
+		}
+	}
+
+	bool StoreChannels(int destination, size_t offset, const uint8_t* data, size_t length)
+	{
+		std::map<int, std::vector<uint8_t>>::iterator channels = m_Destinations.find(destination);
+		if (channels == m_Destinations.end() || offset + length > channels->second.size())
+		{
+			return false;
+		}
+		memcpy(&channels->second[offset], data, length);
+		return true;
+	}
+
+	// Packets of a frame share its sequence number, so a new one means the last frame has had all it's getting
+	void CountPacket(uint8_t sequence)
+	{
+		if (sequence != m_Sequence)
+		{
+			if (!m_FrameShown)
+			{
+				++m_IncompleteFrames;
+			}
+			m_Sequence = sequence;
+			m_FramePackets = 0;
+			m_FrameShown = false;
+		}
+		++m_FramePackets;
+	}
+
+	void ShowFrame()
+	{
+		m_FrameShown = true;
+		std::vector<uint8_t>& firstChannels = m_Destinations[m_Universes[0].destination];
+		const uint8_t* first = &firstChannels[m_Universes[0].startChannel];
+		uint32_t frame = ((first[0] << 16) | (first[1] << 8) | first[2]) - m_Universes[0].firstLight;
+
+		bool good = true;
+		for (const NetworkUniverse& universe : m_Universes)
+		{
+			const uint8_t* channels = &m_Destinations[universe.destination][universe.startChannel];
+			for (int light = 0; light < universe.lightCount; ++light, channels += 3)
+			{
+				uint32_t value = (channels[0] << 16) | (channels[1] << 8) | channels[2];
+				good = good && value == ((frame + universe.firstLight + light) & 0xFFFFFF);
+			}
+		}
+
+		// The last frame being sent again to keep the controller going is fine, but going backwards isn't
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (!good || frame < m_ShownFrame)
+		{
+			++m_BadFrames;
+		}
+		else if (frame > m_ShownFrame)
+		{
+			m_ShownFrame = frame;
+			++m_FramesShown;
+			m_FrameShownEvent.notify_all();
+		}
+	}
+
+private:
+	NetworkProtocol								m_Protocol;
+	std::vector<NetworkUniverse>				m_Universes;
+	int											m_LightCount;
+	int											m_SyncUniverse;
+	int											m_PacketsPerFrame;
+	UdpSocket									m_Socket;
+	std::thread									m_Thread;
+
+	// Only touched by the receiving thread
+	std::map<int, std::vector<uint8_t>>		m_Destinations;
+	uint8_t										m_Sequence;
+	int											m_FramePackets;
+	bool										m_FrameShown;
+
+	std::atomic<bool>							m_StopRequested;
+	std::mutex									m_Lock;
+	std::condition_variable						m_FrameShownEvent;
+	uint32_t									m_ShownFrame;
+	std::atomic<uint64_t>						m_FramesShown;
+	std::atomic<uint64_t>						m_IncompleteFrames;
+	std::atomic<uint64_t>						m_BadFrames;
+	std::atomic<uint64_t>						m_BadPackets;
+};
+
+//
+// Runs of 100 lights mapped from the end backwards, to go beyond the default mapping. E1.31 runs each start a few
+// channels into a universe of their own, and DDP runs alternate between two destinations
+//
+static std::string MakeNetworkMapping(NetworkProtocol protocol, int lightCount)
+{
+	const int RunLength = 100;
+	std::string mapping;
+	int ddpChannels[2] = { 0, 0 };
+	int run = 0;
+	for (int end = lightCount; end > 0; end -= RunLength, ++run)
+	{
+		int firstLight = std::max(0, end - RunLength);
+		int count = end - firstLight;
+		int destination = 100 + run;
+		int startChannel = 3;
+		if (protocol == NetworkProtocolDDP)
+		{
+			destination = 1 + run % 2;
+			startChannel = ddpChannels[run % 2];
+			ddpChannels[run % 2] += count * 3;
+		}
+		mapping += (mapping.empty() ? "" : ";") + std::to_string(destination) + ":" + std::to_string(firstLight) + ":" + std::to_string(count) + ":" + std::to_string(startChannel);
+	}
+	return mapping;
+}
+
+struct NetworkCase
+{
+	const char* name;
+	NetworkProtocol protocol;
+	int syncUniverse;
+	bool mapped;
+};
+
+static const NetworkCase NetworkCases[] =
+{
+	{ "ddp", NetworkProtocolDDP, 0, false },
+	{ "ddp_mapped", NetworkProtocolDDP, 0, true },
+	{ "e131", NetworkProtocolE131, 0, false },
+	{ "e131_sync", NetworkProtocolE131, 7000, false },
+	{ "e131_mapped", NetworkProtocolE131, 0, true }
+};
+
+static bool GetNetworkUniverses(const NetworkCase& networkCase, int lightCount, std::vector<NetworkUniverse>* universes)
+{
+	if (!networkCase.mapped)
+	{
+		MakeDefaultNetworkUniverses(networkCase.protocol, lightCount, universes);
+		return true;
+	}
+	return ParseNetworkUniverses(MakeNetworkMapping(networkCase.protocol, lightCount), networkCase.protocol, lightCount, universes);
+}
+
+//
+// Building every packet of a frame from the light values
+//
+static void BenchmarkNetworkPack()
+{
+	const ZoneGrid lightGrids[] = { { 100, 3 }, { 64, 36 }, { 1000, 3 } };
+
+	for (const NetworkCase& networkCase : NetworkCases)
+	{
+		for (const ZoneGrid& grid : lightGrids)
+		{
+			std::string name = std::string("network_pack/") + networkCase.name + "/" + GridName(grid);
+			if (!IsSelected(name))
+			{
+				continue;
+			}
+
+			int lightCount = grid.columns * grid.rows;
+			std::vector<NetworkUniverse> universes;
+			E131Source source;
+			memset(&source, 0, sizeof(source));
+			NetworkFrameEncoder encoder;
+			if (!GetNetworkUniverses(networkCase, lightCount, &universes) || !encoder.Initialise(networkCase.protocol, universes, lightCount, source, networkCase.syncUniverse))
+			{
+				fprintf(stderr, "%-48s couldn't lay out the packets\n", name.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			std::vector<int32_t> lightValues(lightCount);
+			uint32_t frame = 0;
+			RunBenchmark(name, lightCount, [&]()
+			{
+				NetworkLoopbackReceiver::MakeFrame(++frame, &lightValues);
+				encoder.Encode(&lightValues[0]);
+				g_Sink += encoder.GetPacket(0)[1];
+			});
+		}
+	}
+}
+
+//
+// The network transport sending to a loopback receiver. A round trip hands over a frame and waits for it to be
+// shown, and streaming times each new frame shown while another thread hands them over as fast as it can. Packets
+// per frame against send calls per frame shows how much the batching saves
+//
+static void BenchmarkNetworkLoopback()
+{
+	const ZoneGrid lightGrids[] = { { 100, 3 }, { 64, 36 }, { 1000, 3 } };
+
+	for (const NetworkCase& networkCase : NetworkCases)
+	{
+		for (const ZoneGrid& grid : lightGrids)
+		{
+			std::string prefix = std::string("network_loopback/") + networkCase.name + "/";
+			std::string roundTripName = prefix + "round_trip/" + GridName(grid);
+			std::string streamName = prefix + "stream/" + GridName(grid);
+			if (!IsSelected(roundTripName) && !IsSelected(streamName))
+			{
+				continue;
+			}
+
+			int lightCount = grid.columns * grid.rows;
+			std::vector<NetworkUniverse> universes;
+			if (!GetNetworkUniverses(networkCase, lightCount, &universes))
+			{
+				fprintf(stderr, "%-48s couldn't parse the mapping\n", prefix.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			NetworkLoopbackReceiver receiver(networkCase.protocol, universes, lightCount, networkCase.syncUniverse);
+			NetworkTransport transport(nullptr);
+			transport.SetSyncUniverse(networkCase.syncUniverse);
+			std::string host;
+			if (!receiver.Start(&host) || !transport.Start(host, networkCase.protocol, universes, lightCount))
+			{
+				fprintf(stderr, "%-48s couldn't open a loopback socket\n", prefix.c_str());
+				g_ChecksFailed = true;
+				continue;
+			}
+
+			std::vector<int32_t> lightValues(lightCount);
+			uint32_t frame = 1;
+			NetworkLoopbackReceiver::MakeFrame(frame, &lightValues);
+			transport.SetLightValues(&lightValues[0], lightCount, 0);
+			bool timedOut = !receiver.WaitForFrame(frame, 1000);
+			if (IsSelected(roundTripName))
+			{
+				LatencyHistogram roundTrips;
+				RunBenchmark(roundTripName, lightCount, [&]()
+				{
+					NetworkLoopbackReceiver::MakeFrame(++frame, &lightValues);
+					int64_t start = GetLatencyTimestamp();
+					transport.SetLightValues(&lightValues[0], lightCount, start);
+					if (!receiver.WaitForFrame(frame, 1000))
+					{
+						timedOut = true;
+					}
+					roundTrips.Record(GetLatencyTimestamp() - start);
+				});
+				fprintf(stderr, "%-48s p50 %lldus, p99 %lldus, max %lldus\n", roundTripName.c_str(),
+					static_cast<long long>(roundTrips.GetPercentile(50.0)), static_cast<long long>(roundTrips.GetPercentile(99.0)), static_cast<long long>(roundTrips.GetMaximum()));
+			}
+
+			if (IsSelected(streamName))
+			{
+				std::atomic<bool> stopProducer(false);
+				std::atomic<uint32_t> producedFrame(frame);
+				std::thread producer([&]()
+				{
+					std::vector<int32_t> streamValues(lightCount);
+					while (!stopProducer.load(std::memory_order_relaxed))
+					{
+						uint32_t nextFrame = producedFrame + 1;
+						NetworkLoopbackReceiver::MakeFrame(nextFrame, &streamValues);
+						transport.SetLightValues(&streamValues[0], lightCount, 0);
+						producedFrame = nextFrame;
+						std::this_thread::yield();
+					}
+				});
+
+				uint64_t framesShown = receiver.GetFramesShown();
+				RunBenchmark(streamName, lightCount, [&]()
+				{
+					if (!receiver.WaitForFrame(receiver.GetShownFrame() + 1, 1000))
+					{
+						timedOut = true;
+					}
+				});
+
+				stopProducer = true;
+				producer.join();
+				fprintf(stderr, "%-48s %llu produced, %llu shown\n", streamName.c_str(),
+					static_cast<unsigned long long>(producedFrame - frame), static_cast<unsigned long long>(receiver.GetFramesShown() - framesShown));
+			}
+
+			transport.Stop();
+			receiver.Stop();
+
+			// Loopback can still drop packets when the receiver falls behind, which only costs whole frames
+			uint64_t framesSent = std::max<uint64_t>(1, transport.GetFramesSent());
+			fprintf(stderr, "%-48s %llu sent, %llu shown, %llu incomplete, %llu bad, %llu bad packets, %d packets/frame, %.2f send calls/frame, %llu bytes/frame%s\n",
+				(prefix + GridName(grid)).c_str(), static_cast<unsigned long long>(transport.GetFramesSent()), static_cast<unsigned long long>(receiver.GetFramesShown()),
+				static_cast<unsigned long long>(receiver.GetIncompleteFrames()), static_cast<unsigned long long>(receiver.GetBadFrames()),
+				static_cast<unsigned long long>(receiver.GetBadPackets()), transport.GetPacketsPerFrame(), static_cast<double>(transport.GetSendCalls()) / framesSent,
+				static_cast<unsigned long long>(transport.GetBytesSent() / framesSent), timedOut ? ", timed out" : "");
+			if (receiver.GetBadFrames() || receiver.GetBadPackets() || transport.GetSendErrors() || timedOut)
+			{
+				g_ChecksFailed = true;
+			}
+		}
+	}
+}
+
+//
+// A fixed set of pseudo random rects within a 1080p output
+//
+static std::vector<FrameRect> MakeRects(int count)
+{
+	std::vector<FrameRect> rects(count);
+	uint32_t random = 12345;
+	for (FrameRect& rect : rects)
+	{
+		random = random * 1664525 + 1013904223;
+		rect.left = (random >> 8) % 1800;
+		random = random * 1664525 + 1013904223;
+		rect.top = (random >> 8) % 960;
+		random = random * 1664525 + 1013904223;
+		rect.right = rect.left + 1 + (random >> 8) % 120;
+		random = random * 1664525 + 1013904223;
+		rect.bottom = rect.top + 1 + (random >> 8) % 120;
+	}
+	return rects;
+}
+
+static FrameOutputDesc MakeOutputDesc(FrameRotation rotation)
+{
+	FrameOutputDesc outputDesc;
+	outputDesc.desktopCoordinates.left = 0;
+	outputDesc.desktopCoordinates.top = 0;
+	outputDesc.desktopCoordinates.right = 1920;
+	outputDesc.desktopCoordinates.bottom = 1080;
+	outputDesc.rotation = rotation;
+	return outputDesc;
+}
+
+//
+// Vertex generation for dirty rects, and move rect conversion, for each rotation
+//
+static void BenchmarkRectGeometry()
+{
+	const FrameRotation rotations[] = { FrameRotationIdentity, FrameRotationRotate90, FrameRotationRotate180, FrameRotationRotate270 };
+	const char* rotationNames[] = { "identity", "rotate90", "rotate180", "rotate270" };
+	const int RectCount = 1024;
+
+	std::vector<FrameRect> rects = MakeRects(RectCount);
+	std::vector<FrameMoveRect> moveRects(RectCount);
+	for (int index = 0; index < RectCount; ++index)
+	{
+		moveRects[index].destinationRect = rects[index];
+		moveRects[index].sourcePoint.x = rects[(index + 1) % RectCount].left;
+		moveRects[index].sourcePoint.y = rects[(index + 1) % RectCount].top;
+	}
+	std::vector<FrameVertex> vertices(RectCount * 6);
+
+	for (int rotationIndex = 0; rotationIndex < 4; ++rotationIndex)
+	{
+		FrameOutputDesc outputDesc = MakeOutputDesc(rotations[rotationIndex]);
+
+		RunBenchmark(std::string("dirty_verts/") + rotationNames[rotationIndex], RectCount, [&]()
+		{
+			for (int index = 0; index < RectCount; ++index)
+			{
+				BuildDirtyVertices(&vertices[index * 6], rects[index], 0, 0, outputDesc, 1920, 1080, 1920, 1080);
+			}
+			g_Sink += static_cast<uint32_t>(vertices[5].x * 1000.0f);
+		});
+
+		RunBenchmark(std::string("move_rect/") + rotationNames[rotationIndex], RectCount, [&]()
+		{
+			uint32_t total = 0;
+			for (int index = 0; index < RectCount; ++index)
+			{
+				FrameRect sourceRect;
+				FrameRect destRect;
+				ConvertMoveRect(&sourceRect, &destRect, outputDesc, moveRects[index], 1920, 1080);
+				total += sourceRect.left + destRect.bottom;
+			}
+			g_Sink += total;
+		});
+	}
+}
+
+static std::string EscapeJson(const std::string& text)
+{
+	std::string escaped;
+	for (char character : text)
+	{
+		if (character == '"' || character == '\\')
+		{
+			escaped += '\\';
+		}
+		escaped += character;
+	}
+	return escaped;
+}
+
+static bool WriteResults(FILE* file)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"context\": {\n");
+	fprintf(file, "    \"pixel_sum_kernel\": \"%s\",\n", KernelName(ResolvePixelSumKernel(PixelSumKernelAuto)));
+	fprintf(file, "    \"min_time_seconds\": %g\n", g_Options.minimumSeconds);
+	fprintf(file, "  },\n");
+	fprintf(file, "  \"benchmarks\": [\n");
+	for (size_t index = 0; index < g_Results.size(); ++index)
+	{
+		const BenchmarkResult& result = g_Results[index];
+		fprintf(file, "    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"items_per_second\": %.1f }%s\n",
+			EscapeJson(result.name).c_str(), static_cast<unsigned long long>(result.iterations), result.nanosecondsPerOp, result.itemsPerSecond,
+			(index + 1 < g_Results.size()) ? "," : "");
+	}
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+
+	return ferror(file) == 0;
+}
+
+static bool ParseOptions(int argc, char** argv)
+{
+	g_Options.minimumSeconds = 0.25;
+
+	for (int argIndex = 1; argIndex < argc; ++argIndex)
+	{
+		std::string arg = argv[argIndex];
+		bool haveValue = argIndex + 1 < argc;
+		if (arg == "--filter" && haveValue)
+		{
+			g_Options.filter = argv[++argIndex];
+		}
+		else if (arg == "--output" && haveValue)
+		{
+			g_Options.outputPath = argv[++argIndex];
+		}
+		else if (arg == "--trace" && haveValue)
+		{
+			g_Options.tracePath = argv[++argIndex];
+		}
+		else if (arg == "--min-time" && haveValue)
+		{
+			g_Options.minimumSeconds = atof(argv[++argIndex]) / 1000.0;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--filter text] [--output file.json] [--min-time milliseconds] [--trace file]\n", argv[0]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (!ParseOptions(argc, argv))
+	{
+		return 1;
+	}
+
+	BenchmarkZoneAveraging();
+	BenchmarkSyntheticPipeline();
+	BenchmarkTraceReplay();
+	BenchmarkSerpentine();
+	BenchmarkPackRGB();
+	BenchmarkPackWire();
+	BenchmarkLightCodec();
+	BenchmarkLightColourFormat();
+	BenchmarkLightPublish();
+	BenchmarkSharedLights();
+	BenchmarkRegisteredLights();
+	BenchmarkFrameSlots();
+#if !defined(_WIN32)
+	BenchmarkSerialLoopback();
+	BenchmarkShardedLoopback();
+#endif
+	BenchmarkNetworkPack();
+	BenchmarkNetworkLoopback();
+	BenchmarkRectGeometry();
+
+	FILE* output = stdout;
+	if (!g_Options.outputPath.empty())
+	{
+		output = fopen(g_Options.outputPath.c_str(), "w");
+		if (!output)
+		{
+			fprintf(stderr, "Couldn't open %s\n", g_Options.outputPath.c_str());
+			return 1;
+		}
+	}
+
+	bool written = WriteResults(output);
+	if (output != stdout)
+	{
+		fclose(output);
+	}
+
+	return (written && !g_ChecksFailed) ? 0 : 1;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <string>
+
+#include "LightFrameRing.h"
+#include "LightLayout.h"
 #include "LightProcessor.h"
 #include "ThreadManager.h"
 #include "DynamicWait.h"
@@ -8,30 +12,61 @@
 class CaptureProcessor
 {
 public:
-	CaptureProcessor();
+	CaptureProcessor(LatencyStats* latencyStats);
 	~CaptureProcessor();
 
 	bool Start(int singleOutput, int lightColumns, int lightRows);
 	bool Process();
+	bool WaitForWork(HANDLE stopEvent, DWORD timeout);
 	bool IsRunning();
 	void SetColourScale(float r, float g, float b);
+	void SetDownsampleMode(int mode);
+	void SetCaptureTrace(const std::string& path, bool dirtyOnly);
+	void SetFrameSlots(bool enabled);
+	void SetSharedLights(const std::string& name);
+	void AddLightSink(LightValueSink* sink);
+	void RemoveLightSink(LightValueSink* sink);
 	void GetLightValues(__int32* values, int length);
+	bool AcquireLightValues(const __int32** values, int* count, unsigned __int64* sequence);
+	int64_t GetLightPresentTime() const;
+	bool GetLightData(uint8_t* data, int length, LightChannelOrder order) const;
 	void Stop();
 
+private:
+	void OpenSharedLights();
+
 private:
 	bool m_Running;
 	bool m_FirstTime;
 
+	// Set when a setting the duplication threads were started with has changed, so they need starting again
+	bool m_RestartThreads;
+
 	int m_SingleOutput;
 	int m_LightColumns;
 	int m_LightRows;
 	float m_ColourScale[3];
+	LightProcessor::DownsampleMode m_DownsampleMode;
+	std::string m_CaptureTracePath;
+	CaptureTracePixels m_CaptureTracePixels;
+	bool m_UseFrameSlots;
+	std::vector<HANDLE> m_FrameSlotHandles;
 
 	HANDLE m_UnexpectedErrorEvent;
 	HANDLE m_ExpectedErrorEvent;
 	HANDLE m_TerminateThreadsEvent;
+	HANDLE m_FrameUpdatedEvent;
 
 	DynamicWait m_DynamicWait;
+	LatencyStats* m_LatencyStats;
 	LightProcessor* m_LightProcessor;
+
+	// Outlives the light processor, so the sequence keeps counting up through restarts
+	LightValueBuffer m_LightValueBuffer;
+	LightValueSnapshot m_LightSnapshot;
+
+	// Every published set of light values is also written here, for other processes to read
+	std::string m_SharedLightsName;
+	LightFrameRingWriter m_SharedLights;
 	ThreadManager* m_ThreadManager;
 };
\ No newline at end of file
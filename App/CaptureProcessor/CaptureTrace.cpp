@@ -0,0 +1,328 @@
+#include "CaptureTrace.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(CaptureTraceHeader) == 56, "CaptureTraceHeader layout is part of the file format");
+static_assert(sizeof(CaptureTraceFrameHeader) == 32, "CaptureTraceFrameHeader layout is part of the file format");
+static_assert(sizeof(FrameMoveRect) == 24 && sizeof(FrameRect) == 16, "Frame rect layouts are part of the file format");
+
+static const int BytesPerPixel = 4;
+
+const char CaptureTraceWriter::Magic[4] = { 'L', 'C', 'T', 'R' };
+
+//
+// Clips a dirty rect to the frame. Returns false if nothing is left
+//
+static bool ClipDirtyRect(const FrameRect& dirtyRect, int frameWidth, int frameHeight, FrameRect* clippedRect)
+{
+	clippedRect->left = std::max(dirtyRect.left, 0);
+	clippedRect->top = std::max(dirtyRect.top, 0);
+	clippedRect->right = std::min(dirtyRect.right, frameWidth);
+	clippedRect->bottom = std::min(dirtyRect.bottom, frameHeight);
+
+	return clippedRect->left < clippedRect->right && clippedRect->top < clippedRect->bottom;
+}
+
+static uint64_t AlignRecordSize(uint64_t size)
+{
+	return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+CaptureTraceWriter::CaptureTraceWriter() :
+	m_Pixels(CaptureTracePixelsFullFrame),
+	m_WriteOffset(0)
+{
+}
+
+CaptureTraceWriter::~CaptureTraceWriter()
+{
+	Close();
+}
+
+bool CaptureTraceWriter::Open(const std::string& path, CaptureTracePixels pixels)
+{
+	Close();
+
+	if (!m_File.OpenWrite(path, GrowSize))
+	{
+		return false;
+	}
+
+	m_Pixels = pixels;
+	m_WriteOffset = sizeof(CaptureTraceHeader);
+
+	// The frame size and output are filled in with the first frame
+	CaptureTraceHeader* header = GetHeader();
+	std::memset(header, 0, sizeof(CaptureTraceHeader));
+	std::memcpy(header->magic, Magic, sizeof(header->magic));
+	header->version = Version;
+	header->headerSize = sizeof(CaptureTraceHeader);
+	header->pixels = pixels;
+
+	return true;
+}
+
+void CaptureTraceWriter::Close()
+{
+	if (m_File.IsOpen())
+	{
+		m_File.Close(m_WriteOffset);
+	}
+	m_WriteOffset = 0;
+}
+
+bool CaptureTraceWriter::IsOpen() const
+{
+	return m_File.IsOpen();
+}
+
+bool CaptureTraceWriter::AppendFrame(FrameSource& frameSource)
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+
+	FrameBuffer frameBuffer;
+	if (!frameSource.GetFrameBuffer(&frameBuffer))
+	{
+		return false;
+	}
+
+	CaptureTraceHeader* header = GetHeader();
+	if (header->frameCount == 0)
+	{
+		header->frameWidth = frameBuffer.width;
+		header->frameHeight = frameBuffer.height;
+		header->outputDesc = frameSource.GetFrameOutputDesc();
+	}
+	else if (header->frameWidth != frameBuffer.width || header->frameHeight != frameBuffer.height)
+	{
+		// The mode changed under us. A trace only covers one frame size
+		return false;
+	}
+
+	uint32_t moveCount = static_cast<uint32_t>(frameSource.GetMoveCount());
+	uint32_t dirtyCount = static_cast<uint32_t>(frameSource.GetDirtyCount());
+	const FrameRect* dirtyRects = frameSource.GetDirtyRects();
+
+	// Work out how much pixel data we need
+	bool fullFrame = (m_Pixels == CaptureTracePixelsFullFrame) || (header->frameCount == 0);
+	uint64_t pixelSize = 0;
+	if (fullFrame)
+	{
+		pixelSize = static_cast<uint64_t>(frameBuffer.width) * frameBuffer.height * BytesPerPixel;
+	}
+	else
+	{
+		for (uint32_t dirtyIndex = 0; dirtyIndex < dirtyCount; ++dirtyIndex)
+		{
+			FrameRect clippedRect;
+			if (ClipDirtyRect(dirtyRects[dirtyIndex], frameBuffer.width, frameBuffer.height, &clippedRect))
+			{
+				pixelSize += static_cast<uint64_t>(clippedRect.right - clippedRect.left) * (clippedRect.bottom - clippedRect.top) * BytesPerPixel;
+			}
+		}
+	}
+
+	uint64_t recordSize = AlignRecordSize(sizeof(CaptureTraceFrameHeader) + moveCount * sizeof(FrameMoveRect) + dirtyCount * sizeof(FrameRect) + pixelSize);
+	if (!Reserve(recordSize))
+	{
+		return false;
+	}
+
+	// Growing the file may have moved it
+	header = GetHeader();
+	uint8_t* record = m_File.GetData() + m_WriteOffset;
+
+	CaptureTraceFrameHeader* frameHeader = reinterpret_cast<CaptureTraceFrameHeader*>(record);
+	frameHeader->recordSize = recordSize;
+	frameHeader->presentTime = frameSource.GetPresentTime();
+	frameHeader->flags = fullFrame ? CaptureTraceFrameFull : 0;
+	frameHeader->moveCount = moveCount;
+	frameHeader->dirtyCount = dirtyCount;
+	frameHeader->reserved = 0;
+	uint8_t* data = record + sizeof(CaptureTraceFrameHeader);
+
+	if (moveCount)
+	{
+		std::memcpy(data, frameSource.GetMoveRects(), moveCount * sizeof(FrameMoveRect));
+		data += moveCount * sizeof(FrameMoveRect);
+	}
+	if (dirtyCount)
+	{
+		std::memcpy(data, dirtyRects, dirtyCount * sizeof(FrameRect));
+		data += dirtyCount * sizeof(FrameRect);
+	}
+
+	// Then the pixels
+	if (fullFrame)
+	{
+		size_t rowBytes = static_cast<size_t>(frameBuffer.width) * BytesPerPixel;
+		for (int y = 0; y < frameBuffer.height; ++y, data += rowBytes)
+		{
+			std::memcpy(data, frameBuffer.pixels + static_cast<size_t>(y) * frameBuffer.pitch, rowBytes);
+		}
+	}
+	else
+	{
+		for (uint32_t dirtyIndex = 0; dirtyIndex < dirtyCount; ++dirtyIndex)
+		{
+			FrameRect clippedRect;
+			if (!ClipDirtyRect(dirtyRects[dirtyIndex], frameBuffer.width, frameBuffer.height, &clippedRect))
+			{
+				continue;
+			}
+
+			size_t rowBytes = static_cast<size_t>(clippedRect.right - clippedRect.left) * BytesPerPixel;
+			for (int y = clippedRect.top; y < clippedRect.bottom; ++y, data += rowBytes)
+			{
+				std::memcpy(data, frameBuffer.pixels + static_cast<size_t>(y) * frameBuffer.pitch + clippedRect.left * BytesPerPixel, rowBytes);
+			}
+		}
+	}
+
+	// Clear the padding so traces of the same frames are identical
+	std::memset(data, 0, static_cast<size_t>(record + recordSize - data));
+
+	// Only count the frame once it's all there
+	m_WriteOffset += recordSize;
+	header->dataSize = m_WriteOffset - sizeof(CaptureTraceHeader);
+	++header->frameCount;
+
+	return true;
+}
+
+uint32_t CaptureTraceWriter::GetFrameCount() const
+{
+	return IsOpen() ? GetHeader()->frameCount : 0;
+}
+
+std::string CaptureTraceWriter::GetOutputPath(const std::string& path, unsigned int outputIndex)
+{
+	return path + "." + std::to_string(outputIndex);
+}
+
+//
+// Makes sure there's room for a record of recordSize at the write offset
+//
+bool CaptureTraceWriter::Reserve(uint64_t recordSize)
+{
+	uint64_t requiredSize = m_WriteOffset + recordSize;
+	if (requiredSize <= m_File.GetSize())
+	{
+		return true;
+	}
+
+	uint64_t newSize = std::max(requiredSize, m_File.GetSize() + GrowSize);
+	return m_File.Resize(newSize);
+}
+
+CaptureTraceHeader* CaptureTraceWriter::GetHeader() const
+{
+	return reinterpret_cast<CaptureTraceHeader*>(m_File.GetData());
+}
+
+CaptureTraceReader::CaptureTraceReader() :
+	m_ReadOffset(0),
+	m_EndOffset(0)
+{
+	std::memset(&m_Header, 0, sizeof(m_Header));
+}
+
+CaptureTraceReader::~CaptureTraceReader()
+{
+	Close();
+}
+
+bool CaptureTraceReader::Open(const std::string& path)
+{
+	Close();
+
+	if (!m_File.OpenRead(path))
+	{
+		return false;
+	}
+
+	if (m_File.GetSize() < sizeof(CaptureTraceHeader))
+	{
+		Close();
+		return false;
+	}
+
+	std::memcpy(&m_Header, m_File.GetData(), sizeof(m_Header));
+	if (std::memcmp(m_Header.magic, CaptureTraceWriter::Magic, sizeof(m_Header.magic)) != 0 ||
+		m_Header.version != CaptureTraceWriter::Version ||
+		m_Header.headerSize != sizeof(CaptureTraceHeader) ||
+		m_Header.dataSize > m_File.GetSize() - sizeof(CaptureTraceHeader) ||
+		m_Header.frameWidth < 0 || m_Header.frameHeight < 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_ReadOffset = sizeof(CaptureTraceHeader);
+	m_EndOffset = sizeof(CaptureTraceHeader) + m_Header.dataSize;
+
+	return true;
+}
+
+void CaptureTraceReader::Close()
+{
+	m_File.Close();
+	std::memset(&m_Header, 0, sizeof(m_Header));
+	m_ReadOffset = 0;
+	m_EndOffset = 0;
+}
+
+const CaptureTraceHeader& CaptureTraceReader::GetHeader() const
+{
+	return m_Header;
+}
+
+uint32_t CaptureTraceReader::GetFrameCount() const
+{
+	return m_Header.frameCount;
+}
+
+bool CaptureTraceReader::NextFrame(CaptureTraceFrame* frame)
+{
+	if (m_ReadOffset + sizeof(CaptureTraceFrameHeader) > m_EndOffset)
+	{
+		return false;
+	}
+
+	const uint8_t* record = m_File.GetData() + m_ReadOffset;
+	const CaptureTraceFrameHeader* frameHeader = reinterpret_cast<const CaptureTraceFrameHeader*>(record);
+
+	// Don't trust the sizes in the file further than the file itself
+	uint64_t rectSize = static_cast<uint64_t>(frameHeader->moveCount) * sizeof(FrameMoveRect) + static_cast<uint64_t>(frameHeader->dirtyCount) * sizeof(FrameRect);
+	if (frameHeader->recordSize > m_EndOffset - m_ReadOffset || sizeof(CaptureTraceFrameHeader) + rectSize > frameHeader->recordSize)
+	{
+		return false;
+	}
+
+	const uint8_t* data = record + sizeof(CaptureTraceFrameHeader);
+	frame->presentTime = frameHeader->presentTime;
+	frame->flags = frameHeader->flags;
+	frame->moveCount = frameHeader->moveCount;
+	frame->moveRects = reinterpret_cast<const FrameMoveRect*>(data);
+	data += frameHeader->moveCount * sizeof(FrameMoveRect);
+	frame->dirtyCount = frameHeader->dirtyCount;
+	frame->dirtyRects = reinterpret_cast<const FrameRect*>(data);
+	data += frameHeader->dirtyCount * sizeof(FrameRect);
+	frame->pixels = data;
+	frame->pixelSize = frameHeader->recordSize - sizeof(CaptureTraceFrameHeader) - rectSize;
+
+	m_ReadOffset += frameHeader->recordSize;
+	return true;
+}
+
+void CaptureTraceReader::Rewind()
+{
+	if (m_File.IsOpen())
+	{
+		m_ReadOffset = sizeof(CaptureTraceHeader);
+	}
+}
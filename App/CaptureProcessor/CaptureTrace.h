@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "FrameSource.h"
+#include "MappedFile.h"
+
+// Capture trace files
+// A trace records what a FrameSource produced for one output: the move and dirty rects of every frame,
+// its present time and either the whole frame or just the dirty regions. The first frame is always
+// stored whole so a trace can be replayed from the start. Files are written append only through a
+// memory mapping, and the header only ever counts complete frames, so a trace cut short by a crash
+// still replays up to the last frame written. Values are stored in the machine's native (little endian) order
+//
+// Layout:
+//   CaptureTraceHeader
+//   For each frame:
+//     CaptureTraceFrameHeader
+//     FrameMoveRect[moveCount]
+//     FrameRect[dirtyCount]
+//     Pixels, as tightly packed BGRA rows. Either the whole frame, or each dirty rect (clipped to the frame) in turn
+//     Padding up to a multiple of 8 bytes
+
+enum CaptureTracePixels
+{
+	CaptureTracePixelsFullFrame = 0,
+	CaptureTracePixelsDirtyOnly = 1
+};
+
+enum CaptureTraceFrameFlags
+{
+	CaptureTraceFrameFull = 1 << 0		// The pixels are the whole frame rather than the dirty regions
+};
+
+struct CaptureTraceHeader
+{
+	char			magic[4];
+	uint32_t		version;
+	uint32_t		headerSize;
+	uint32_t		pixels;
+	int32_t			frameWidth;
+	int32_t			frameHeight;
+	FrameOutputDesc	outputDesc;
+	uint32_t		frameCount;
+
+	// Bytes of complete frames following the header
+	uint64_t		dataSize;
+};
+
+struct CaptureTraceFrameHeader
+{
+	uint64_t		recordSize;
+	int64_t			presentTime;
+	uint32_t		flags;
+	uint32_t		moveCount;
+	uint32_t		dirtyCount;
+	uint32_t		reserved;
+};
+
+// A frame read back from a trace. Pointers are into the mapped file
+struct CaptureTraceFrame
+{
+	int64_t					presentTime;
+	uint32_t				flags;
+	const FrameMoveRect*	moveRects;
+	uint32_t				moveCount;
+	const FrameRect*		dirtyRects;
+	uint32_t				dirtyCount;
+	const uint8_t*			pixels;
+	uint64_t				pixelSize;
+};
+
+class CaptureTraceWriter
+{
+public:
+	CaptureTraceWriter();
+	~CaptureTraceWriter();
+
+	bool Open(const std::string& path, CaptureTracePixels pixels);
+	void Close();
+	bool IsOpen() const;
+
+	// Records the current frame of frameSource. The source has to be able to provide a frame buffer
+	bool AppendFrame(FrameSource& frameSource);
+
+	uint32_t GetFrameCount() const;
+
+	// Trace file for one output, when each output is recorded separately
+	static std::string GetOutputPath(const std::string& path, unsigned int outputIndex);
+
+public:
+	static const char Magic[4];
+	static const uint32_t Version = 1;
+
+	// The file is grown in steps of at least this much, to keep remapping rare
+	static const uint64_t GrowSize = 64 * 1024 * 1024;
+
+private:
+	bool Reserve(uint64_t recordSize);
+	CaptureTraceHeader* GetHeader() const;
+
+private:
+	MappedFile			m_File;
+	CaptureTracePixels	m_Pixels;
+	uint64_t			m_WriteOffset;
+};
+
+class CaptureTraceReader
+{
+public:
+	CaptureTraceReader();
+	~CaptureTraceReader();
+
+	bool Open(const std::string& path);
+	void Close();
+
+	const CaptureTraceHeader& GetHeader() const;
+	uint32_t GetFrameCount() const;
+
+	// Reads the next frame. Returns false at the end of the trace
+	bool NextFrame(CaptureTraceFrame* frame);
+
+	// Goes back to the first frame
+	void Rewind();
+
+private:
+	MappedFile			m_File;
+	CaptureTraceHeader	m_Header;
+	uint64_t			m_ReadOffset;
+	uint64_t			m_EndOffset;
+};
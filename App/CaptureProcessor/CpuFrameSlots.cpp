@@ -0,0 +1,73 @@
+#include "CpuFrameSlots.h"
+
+CpuFrameSlots::CpuFrameSlots()
+{
+}
+
+CpuFrameSlots::~CpuFrameSlots()
+{
+}
+
+bool CpuFrameSlots::Initialise(int outputCount, const int* widths, const int* heights)
+{
+	if (outputCount <= 0)
+	{
+		return false;
+	}
+
+	m_Outputs.resize(outputCount);
+	for (int output = 0; output < outputCount; ++output)
+	{
+		if (widths[output] <= 0 || heights[output] <= 0)
+		{
+			return false;
+		}
+
+		OutputBuffers& outputBuffers = m_Outputs[output];
+		outputBuffers.width = widths[output];
+		outputBuffers.height = heights[output];
+		outputBuffers.pitch = widths[output] * 4;
+		for (int slot = 0; slot < FrameSlotExchange::SlotsPerOutput; ++slot)
+		{
+			outputBuffers.slots[slot].assign(static_cast<size_t>(outputBuffers.pitch) * outputBuffers.height, 0);
+		}
+	}
+
+	m_Exchange.Initialise(outputCount);
+	return true;
+}
+
+int CpuFrameSlots::GetOutputCount() const
+{
+	return static_cast<int>(m_Outputs.size());
+}
+
+FrameSlotExchange* CpuFrameSlots::GetExchange()
+{
+	return &m_Exchange;
+}
+
+uint8_t* CpuFrameSlots::BeginWrite(int output, int* pitch)
+{
+	OutputBuffers& outputBuffers = m_Outputs[output];
+	*pitch = outputBuffers.pitch;
+	return &outputBuffers.slots[m_Exchange.GetWriteSlot(output)][0];
+}
+
+void CpuFrameSlots::Publish(int output, int64_t presentTime)
+{
+	m_Exchange.Publish(output, presentTime);
+}
+
+bool CpuFrameSlots::Acquire(int output, FrameBuffer* frameBuffer, uint64_t* sequence, int64_t* presentTime)
+{
+	int slot = 0;
+	bool updated = m_Exchange.Acquire(output, &slot, sequence, presentTime);
+
+	const OutputBuffers& outputBuffers = m_Outputs[output];
+	frameBuffer->pixels = &outputBuffers.slots[slot][0];
+	frameBuffer->width = outputBuffers.width;
+	frameBuffer->height = outputBuffers.height;
+	frameBuffer->pitch = outputBuffers.pitch;
+	return updated;
+}
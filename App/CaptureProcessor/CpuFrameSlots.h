@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameSlotExchange.h"
+#include "FrameTypes.h"
+
+// Frame slots kept in system memory, handed over through a FrameSlotExchange.
+// Lets the per output handoff be driven and stress tested without a GPU
+class CpuFrameSlots
+{
+public:
+	CpuFrameSlots();
+	~CpuFrameSlots();
+
+	// One width / height per output. Not safe while anyone is using the slots
+	bool Initialise(int outputCount, const int* widths, const int* heights);
+
+	int GetOutputCount() const;
+	FrameSlotExchange* GetExchange();
+
+	// Producer side. Fill in the buffer, then publish it
+	uint8_t* BeginWrite(int output, int* pitch);
+	void Publish(int output, int64_t presentTime);
+
+	// Consumer side. The buffer stays put until the next Acquire for the output. Returns true if it's a newer frame
+	bool Acquire(int output, FrameBuffer* frameBuffer, uint64_t* sequence, int64_t* presentTime);
+
+private:
+	struct OutputBuffers
+	{
+		int width;
+		int height;
+		int pitch;
+		std::vector<uint8_t> slots[FrameSlotExchange::SlotsPerOutput];
+	};
+
+	FrameSlotExchange			m_Exchange;
+	std::vector<OutputBuffers>	m_Outputs;
+};
@@ -0,0 +1,65 @@
+#include "DirtyRegion.h"
+
+DirtyRegion::DirtyRegion() : m_Invalidated(true), m_PresentTime(0)
+{
+}
+
+DirtyRegion::~DirtyRegion()
+{
+}
+
+void DirtyRegion::Add(const FrameRect* rects, size_t rectCount, int64_t presentTime)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	if (presentTime > 0 && (m_PresentTime == 0 || presentTime < m_PresentTime))
+	{
+		m_PresentTime = presentTime;
+	}
+
+	if (m_Invalidated)
+	{
+		return;
+	}
+
+	if (m_PendingRects.size() + rectCount > MaxPendingRects)
+	{
+		m_PendingRects.clear();
+		m_Invalidated = true;
+		return;
+	}
+
+	m_PendingRects.insert(m_PendingRects.end(), rects, rects + rectCount);
+}
+
+void DirtyRegion::Invalidate()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_PendingRects.clear();
+	m_Invalidated = true;
+}
+
+bool DirtyRegion::Take(std::vector<FrameRect>* rects)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	rects->clear();
+	if (m_Invalidated)
+	{
+		m_Invalidated = false;
+		return false;
+	}
+
+	rects->swap(m_PendingRects);
+	return true;
+}
+
+int64_t DirtyRegion::TakePresentTime()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	int64_t presentTime = m_PresentTime;
+	m_PresentTime = 0;
+	return presentTime;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "FrameTypes.h"
+
+// Collects the rects of the shared surface that have been updated since the light processor last read it.
+// Written to by every duplication thread, so access is locked
+class DirtyRegion
+{
+public:
+	DirtyRegion();
+	~DirtyRegion();
+
+	// presentTime is when the frame the rects came from was presented, in microseconds
+	void Add(const FrameRect* rects, size_t rectCount, int64_t presentTime);
+
+	// Marks the whole surface as changed
+	void Invalidate();
+
+	// Swaps out the pending rects. Returns false if the whole surface needs to be treated as changed
+	bool Take(std::vector<FrameRect>* rects);
+
+	// Returns the present time of the oldest frame added since the last call, or 0 if there hasn't been one
+	int64_t TakePresentTime();
+
+public:
+	// Past this many pending rects we give up tracking them and treat the whole surface as changed
+	static const size_t MaxPendingRects = 4096;
+
+private:
+	std::mutex				m_Lock;
+	std::vector<FrameRect>	m_PendingRects;
+	bool					m_Invalidated;
+	int64_t					m_PresentTime;
+};
@@ -4,6 +4,10 @@
 
 using namespace Microsoft::WRL;
 
+// The portable frame types are read straight out of the duplication metadata
+static_assert(sizeof(FrameRect) == sizeof(RECT), "FrameRect must match RECT");
+static_assert(sizeof(FrameMoveRect) == sizeof(DXGI_OUTDUPL_MOVE_RECT), "FrameMoveRect must match DXGI_OUTDUPL_MOVE_RECT");
+
 DuplicationManager::DuplicationManager() :
 	m_Device(nullptr),
 	m_Duplication(nullptr),
@@ -12,15 +16,21 @@ DuplicationManager::DuplicationManager() :
 	m_DirtyCount(0),
 	m_MoveRects(nullptr),
 	m_MoveCount(0),
+	m_StagingMapped(false),
 	m_UnexpectedErrorEvent(nullptr),
 	m_ExpectedErrorEvent(nullptr)
 {
 	RtlZeroMemory(&m_OutputDesc, sizeof(m_OutputDesc));
 	RtlZeroMemory(&m_FrameInfo, sizeof(m_FrameInfo));
+	RtlZeroMemory(&m_FrameOutputDesc, sizeof(m_FrameOutputDesc));
+	RtlZeroMemory(&m_FrameBuffer, sizeof(m_FrameBuffer));
+	QueryPerformanceFrequency(&m_PerformanceFrequency);
 }
 
 DuplicationManager::~DuplicationManager()
 {
+	UnmapFrameBuffer();
+
 	if (m_AcquiredDesktopImage)
 	{
 		// Release the last frame
@@ -67,6 +77,12 @@ bool DuplicationManager::Initialise(ComPtr<ID3D11Device> device, unsigned int ou
 
 	dxgiOutput->GetDesc(&m_OutputDesc);
 
+	m_FrameOutputDesc.desktopCoordinates.left = m_OutputDesc.DesktopCoordinates.left;
+	m_FrameOutputDesc.desktopCoordinates.top = m_OutputDesc.DesktopCoordinates.top;
+	m_FrameOutputDesc.desktopCoordinates.right = m_OutputDesc.DesktopCoordinates.right;
+	m_FrameOutputDesc.desktopCoordinates.bottom = m_OutputDesc.DesktopCoordinates.bottom;
+	m_FrameOutputDesc.rotation = static_cast<FrameRotation>(m_OutputDesc.Rotation);
+
 	// QI for the Output 1 interface
 	ComPtr<IDXGIOutput1> dxgiOutput1 = nullptr;
 	hr = dxgiOutput.As(&dxgiOutput1);
@@ -97,6 +113,8 @@ bool DuplicationManager::GetFrame(bool* timeout)
 	m_MoveCount = 0;
 	m_DirtyCount = 0;
 
+	UnmapFrameBuffer();
+
 	if (m_AcquiredDesktopImage)
 	{
 		m_AcquiredDesktopImage = nullptr;
@@ -124,6 +142,8 @@ bool DuplicationManager::GetFrame(bool* timeout)
 		return false;
 	}
 
+	m_FrameInfo = frameInfo;
+
 	// Get the IDXGIResource interface
 	hr = desktopResource.As(&m_AcquiredDesktopImage);
 	desktopResource = nullptr;
@@ -146,7 +166,7 @@ bool DuplicationManager::GetFrame(bool* timeout)
 		UINT bufferSize = frameInfo.TotalMetadataBufferSize;
 
 		// Get move rectangles
-		m_MoveRects = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(&m_Metadata[0]);
+		m_MoveRects = reinterpret_cast<FrameMoveRect*>(&m_Metadata[0]);
 		hr = m_Duplication->GetFrameMoveRects(bufferSize, reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(&m_Metadata[0]), &bufferSize);
 		if (FAILED(hr))
 		{
@@ -157,7 +177,7 @@ bool DuplicationManager::GetFrame(bool* timeout)
 		m_MoveCount = bufferSize / sizeof(DXGI_OUTDUPL_MOVE_RECT);
 
 		// Get dirty rectangles
-		m_DirtyRects = reinterpret_cast<RECT*>(&m_Metadata[bufferSize]);
+		m_DirtyRects = reinterpret_cast<FrameRect*>(&m_Metadata[bufferSize]);
 		bufferSize = frameInfo.TotalMetadataBufferSize - bufferSize;
 		hr = m_Duplication->GetFrameDirtyRects(bufferSize, reinterpret_cast<RECT*>(m_DirtyRects), &bufferSize);
 		if (FAILED(hr))
@@ -174,6 +194,8 @@ bool DuplicationManager::GetFrame(bool* timeout)
 
 bool DuplicationManager::ReleaseFrame()
 {
+	UnmapFrameBuffer();
+
 	m_DirtyRects = nullptr;
 	m_DirtyCount = 0;
 	m_MoveRects = nullptr;
@@ -192,7 +214,7 @@ int DuplicationManager::GetDirtyCount() const
 	return m_DirtyCount;
 }
 
-RECT* DuplicationManager::GetDirtyRects() const
+const FrameRect* DuplicationManager::GetDirtyRects() const
 {
 	return m_DirtyRects;
 }
@@ -202,7 +224,7 @@ int DuplicationManager::GetMoveCount() const
 	return m_MoveCount;
 }
 
-DXGI_OUTDUPL_MOVE_RECT* DuplicationManager::GetMoveRects() const
+const FrameMoveRect* DuplicationManager::GetMoveRects() const
 {
 	return m_MoveRects;
 }
@@ -210,4 +232,103 @@ DXGI_OUTDUPL_MOVE_RECT* DuplicationManager::GetMoveRects() const
 const DXGI_OUTPUT_DESC& DuplicationManager::GetOutputDesc() const
 {
 	return m_OutputDesc;
-}
\ No newline at end of file
+}
+
+const FrameOutputDesc& DuplicationManager::GetFrameOutputDesc() const
+{
+	return m_FrameOutputDesc;
+}
+
+//
+// Present time of the current frame, in microseconds
+//
+int64_t DuplicationManager::GetPresentTime() const
+{
+	if (m_PerformanceFrequency.QuadPart == 0)
+	{
+		return 0;
+	}
+
+	int64_t ticks = m_FrameInfo.LastPresentTime.QuadPart;
+	return (ticks / m_PerformanceFrequency.QuadPart) * 1000000 + ((ticks % m_PerformanceFrequency.QuadPart) * 1000000) / m_PerformanceFrequency.QuadPart;
+}
+
+//
+// Reads the current frame back from the GPU. This stalls until the copy is done, so
+// it's only for things like trace recording, not the normal capture path
+//
+bool DuplicationManager::GetFrameBuffer(FrameBuffer* frameBuffer)
+{
+	if (!m_AcquiredDesktopImage)
+	{
+		return false;
+	}
+
+	if (!m_StagingMapped)
+	{
+		D3D11_TEXTURE2D_DESC desktopDescription;
+		m_AcquiredDesktopImage->GetDesc(&desktopDescription);
+
+		// (Re)create the staging texture if the frame size has changed
+		if (m_StagingDesktopImage)
+		{
+			D3D11_TEXTURE2D_DESC stagingDescription;
+			m_StagingDesktopImage->GetDesc(&stagingDescription);
+			if (stagingDescription.Width != desktopDescription.Width || stagingDescription.Height != desktopDescription.Height || stagingDescription.Format != desktopDescription.Format)
+			{
+				m_StagingDesktopImage = nullptr;
+			}
+		}
+
+		if (!m_StagingDesktopImage)
+		{
+			D3D11_TEXTURE2D_DESC stagingDescription = desktopDescription;
+			stagingDescription.MipLevels = 1;
+			stagingDescription.ArraySize = 1;
+			stagingDescription.SampleDesc.Count = 1;
+			stagingDescription.SampleDesc.Quality = 0;
+			stagingDescription.Usage = D3D11_USAGE_STAGING;
+			stagingDescription.BindFlags = 0;
+			stagingDescription.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			stagingDescription.MiscFlags = 0;
+			HRESULT hr = m_Device->CreateTexture2D(&stagingDescription, nullptr, &m_StagingDesktopImage);
+			if (FAILED(hr))
+			{
+				SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+				return false;
+			}
+		}
+
+		ComPtr<ID3D11DeviceContext> deviceContext;
+		m_Device->GetImmediateContext(&deviceContext);
+		deviceContext->CopyResource(m_StagingDesktopImage.Get(), m_AcquiredDesktopImage.Get());
+
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT hr = deviceContext->Map(m_StagingDesktopImage.Get(), 0, D3D11_MAP_READ, 0, &mappedResource);
+		if (FAILED(hr))
+		{
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+			return false;
+		}
+
+		m_StagingMapped = true;
+		m_FrameBuffer.pixels = static_cast<const uint8_t*>(mappedResource.pData);
+		m_FrameBuffer.width = desktopDescription.Width;
+		m_FrameBuffer.height = desktopDescription.Height;
+		m_FrameBuffer.pitch = mappedResource.RowPitch;
+	}
+
+	*frameBuffer = m_FrameBuffer;
+	return true;
+}
+
+void DuplicationManager::UnmapFrameBuffer()
+{
+	if (m_StagingMapped)
+	{
+		ComPtr<ID3D11DeviceContext> deviceContext;
+		m_Device->GetImmediateContext(&deviceContext);
+		deviceContext->Unmap(m_StagingDesktopImage.Get(), 0);
+		m_StagingMapped = false;
+	}
+}
@@ -2,24 +2,33 @@
 
 #include <vector>
 
+#include "FrameSource.h"
+
 // For handling the duplication of a single display
-class DuplicationManager
+class DuplicationManager : public FrameSource
 {
 public:
 	DuplicationManager();
-	~DuplicationManager();
+	virtual ~DuplicationManager();
 
 	bool Initialise(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int outputIndex, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent);
-	bool GetFrame(bool* timeout);
-	bool ReleaseFrame();
+	virtual bool GetFrame(bool* timeout);
+	virtual bool ReleaseFrame();
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> GetTexture() const;
 
-	int GetDirtyCount() const;
-	RECT* GetDirtyRects() const;
-	int GetMoveCount() const;
-	DXGI_OUTDUPL_MOVE_RECT* GetMoveRects() const;
+	virtual int GetDirtyCount() const;
+	virtual const FrameRect* GetDirtyRects() const;
+	virtual int GetMoveCount() const;
+	virtual const FrameMoveRect* GetMoveRects() const;
 
 	const DXGI_OUTPUT_DESC& GetOutputDesc() const;
+	virtual const FrameOutputDesc& GetFrameOutputDesc() const;
+
+	virtual int64_t GetPresentTime() const;
+	virtual bool GetFrameBuffer(FrameBuffer* frameBuffer);
+
+private:
+	void UnmapFrameBuffer();
 
 private:
 	HANDLE					m_UnexpectedErrorEvent;
@@ -34,6 +43,11 @@ private:
 	// The last duplicated frame
 	Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_AcquiredDesktopImage;
 
+	// CPU readable copy of the last frame, only made when someone asks for the frame buffer
+	Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_StagingDesktopImage;
+	bool							m_StagingMapped;
+	FrameBuffer						m_FrameBuffer;
+
 	// The last duplicated frame info
 	DXGI_OUTDUPL_FRAME_INFO			m_FrameInfo;
 
@@ -41,12 +55,15 @@ private:
 	std::vector<BYTE>				m_Metadata;
 
 	// These are raw pointers into the m_Metadata array
-	RECT*							m_DirtyRects;
+	FrameRect*						m_DirtyRects;
 	unsigned int					m_DirtyCount;
-	DXGI_OUTDUPL_MOVE_RECT*			m_MoveRects;
+	FrameMoveRect*					m_MoveRects;
 	unsigned int					m_MoveCount;
 
 	// Output description
 	DXGI_OUTPUT_DESC				m_OutputDesc;
-	
+	FrameOutputDesc					m_FrameOutputDesc;
+
+	// For converting present times to microseconds
+	LARGE_INTEGER					m_PerformanceFrequency;
 };
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "FrameGeometry.h"
+
+#include <cassert>
+#include <cstring>
+
+static void SetTexCoord(FrameVertex* vertex, float u, float v)
+{
+	vertex->u = u;
+	vertex->v = v;
+}
+
+static void SetPosition(FrameVertex* vertex, float x, float y, float z)
+{
+	vertex->x = x;
+	vertex->y = y;
+	vertex->z = z;
+}
+
+void ConvertMoveRect(FrameRect* sourceRect, FrameRect* destRect, const FrameOutputDesc& outputDesc, const FrameMoveRect& moveRect, int texWidth, int texHeight)
+{
+	switch (outputDesc.rotation)
+	{
+	case FrameRotationUnspecified:
+	case FrameRotationIdentity:
+	{
+		sourceRect->left = moveRect.sourcePoint.x;
+		sourceRect->top = moveRect.sourcePoint.y;
+		sourceRect->right = moveRect.sourcePoint.x + moveRect.destinationRect.right - moveRect.destinationRect.left;
+		sourceRect->bottom = moveRect.sourcePoint.y + moveRect.destinationRect.bottom - moveRect.destinationRect.top;
+
+		*destRect = moveRect.destinationRect;
+		
+	}
+	break;
+
+	case FrameRotationRotate90:
+	{
+		sourceRect->left = texHeight - (moveRect.sourcePoint.y + moveRect.destinationRect.bottom - moveRect.destinationRect.top);
+		sourceRect->top = moveRect.sourcePoint.x;
+		sourceRect->right = texHeight - moveRect.sourcePoint.y;
+		sourceRect->bottom = moveRect.sourcePoint.x + moveRect.destinationRect.right - moveRect.destinationRect.left;
+
+		destRect->left = texHeight - moveRect.destinationRect.bottom;
+		destRect->top = moveRect.destinationRect.left;
+		destRect->right = texHeight - moveRect.destinationRect.top;
+		destRect->bottom = moveRect.destinationRect.right;
+		
+	}
+	break;
+
+	case FrameRotationRotate180:
+	{
+		sourceRect->left = texWidth - (moveRect.sourcePoint.x + moveRect.destinationRect.right - moveRect.destinationRect.left);
+		sourceRect->top = texHeight - (moveRect.sourcePoint.y + moveRect.destinationRect.bottom - moveRect.destinationRect.top);
+		sourceRect->right = texWidth - moveRect.sourcePoint.x;
+		sourceRect->bottom = texHeight - moveRect.sourcePoint.y;
+
+		destRect->left = texWidth - moveRect.destinationRect.right;
+		destRect->top = texHeight - moveRect.destinationRect.bottom;
+		destRect->right = texWidth - moveRect.destinationRect.left;
+		destRect->bottom = texHeight - moveRect.destinationRect.top;
+	}
+	break;
+
+	case FrameRotationRotate270:
+		{
+			sourceRect->left = moveRect.sourcePoint.x;
+			sourceRect->top = texWidth - (moveRect.sourcePoint.x + moveRect.destinationRect.right - moveRect.destinationRect.left);
+			sourceRect->right = moveRect.sourcePoint.y + moveRect.destinationRect.bottom - moveRect.destinationRect.top;
+			sourceRect->bottom = texWidth - moveRect.sourcePoint.x;
+
+			destRect->left = moveRect.destinationRect.top;
+			destRect->top = texWidth - moveRect.destinationRect.right;
+			destRect->right = moveRect.destinationRect.bottom;
+			destRect->bottom = texWidth - moveRect.destinationRect.left;
+		}
+		break;
+
+	default:
+		{
+			std::memset(destRect, 0, sizeof(FrameRect));
+			std::memset(sourceRect, 0, sizeof(FrameRect));
+		}
+		break;
+	}
+}
+
+FrameRect RotateDirtyRect(const FrameRect& dirtyRect, const FrameOutputDesc& outputDesc)
+{
+	int width = outputDesc.desktopCoordinates.right - outputDesc.desktopCoordinates.left;
+	int height = outputDesc.desktopCoordinates.bottom - outputDesc.desktopCoordinates.top;
+
+	FrameRect destDirty = dirtyRect;
+	switch (outputDesc.rotation)
+	{
+	case FrameRotationRotate90:
+		destDirty.left = width - dirtyRect.bottom;
+		destDirty.top = dirtyRect.left;
+		destDirty.right = width - dirtyRect.top;
+		destDirty.bottom = dirtyRect.right;
+		break;
+
+	case FrameRotationRotate180:
+		destDirty.left = width - dirtyRect.right;
+		destDirty.top = height - dirtyRect.bottom;
+		destDirty.right = width - dirtyRect.left;
+		destDirty.bottom = height - dirtyRect.top;
+		break;
+
+	case FrameRotationRotate270:
+		destDirty.left = dirtyRect.top;
+		destDirty.top = height - dirtyRect.right;
+		destDirty.right = dirtyRect.bottom;
+		destDirty.bottom = height - dirtyRect.left;
+		break;
+
+	default:
+		break;
+	}
+
+	return destDirty;
+}
+
+//
+// Sets up the six vertices (two triangles) for drawing a dirty rect onto the shared surface, compensating for rotation
+//
+void BuildDirtyVertices(FrameVertex* vertices, const FrameRect& dirtyRect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, int surfaceWidth, int surfaceHeight, int sourceWidth, int sourceHeight)
+{
+	int centerX = surfaceWidth / 2;
+	int centerY = surfaceHeight / 2;
+
+	// Rotation compensated destination rect
+	FrameRect destDirty = RotateDirtyRect(dirtyRect, outputDesc);
+
+	// Set appropriate texture coordinates compensated for rotation
+	switch (outputDesc.rotation)
+	{
+	case FrameRotationRotate90:
+		{
+			SetTexCoord(&vertices[0], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[1], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[2], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[5], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+		}
+		break;
+
+	case FrameRotationRotate180:
+		{
+			SetTexCoord(&vertices[0], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[1], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[2], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[5], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+		
+		}
+		break;
+
+		case FrameRotationRotate270:
+		{
+			SetTexCoord(&vertices[0], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[1], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[2], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[5], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+		}
+		break;
+
+	default:
+		assert(false); // drop through
+	case FrameRotationUnspecified:
+	case FrameRotationIdentity:
+		{
+			SetTexCoord(&vertices[0], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[1], dirtyRect.left / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[2], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.bottom / static_cast<float>(sourceHeight));
+			SetTexCoord(&vertices[5], dirtyRect.right / static_cast<float>(sourceWidth), dirtyRect.top / static_cast<float>(sourceHeight));
+			
+		}
+		break;
+	}
+
+	// Set positions
+	// First triangle
+	SetPosition(&vertices[0], (destDirty.left + outputDesc.desktopCoordinates.left - offsetX - centerX) / static_cast<float>(centerX),
+										-1 * (destDirty.bottom + outputDesc.desktopCoordinates.top - offsetY - centerY) / static_cast<float>(centerY),
+										0.0f);
+	SetPosition(&vertices[1], (destDirty.left + outputDesc.desktopCoordinates.left - offsetX - centerX) / static_cast<float>(centerX),
+										-1 * (destDirty.top + outputDesc.desktopCoordinates.top - offsetY - centerY) / static_cast<float>(centerY),
+										0.0f);
+	SetPosition(&vertices[2], (destDirty.right + outputDesc.desktopCoordinates.left - offsetX - centerX) / static_cast<float>(centerX),
+										-1 * (destDirty.bottom + outputDesc.desktopCoordinates.top - offsetY - centerY) / static_cast<float>(centerY),
+										0.0f);
+	
+	// Second triangle
+	SetPosition(&vertices[3], vertices[2].x, vertices[2].y, vertices[2].z);
+	SetPosition(&vertices[4], vertices[1].x, vertices[1].y, vertices[1].z);
+	SetPosition(&vertices[5], (destDirty.right + outputDesc.desktopCoordinates.left - offsetX - centerX) / static_cast<float>(centerX),
+										-1 * (destDirty.top + outputDesc.desktopCoordinates.top - offsetY - centerY) / static_cast<float>(centerY),
+										0.0f);
+
+	// Remaining texture coordinates
+	SetTexCoord(&vertices[3], vertices[2].u, vertices[2].v);
+	SetTexCoord(&vertices[4], vertices[1].u, vertices[1].v);
+}
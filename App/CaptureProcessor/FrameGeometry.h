@@ -0,0 +1,24 @@
+#pragma once
+
+#include "FrameTypes.h"
+
+// Rotation handling for move and dirty rects, shared by the GPU and software compositors
+
+// Same layout as the D3D Vertex, a position followed by a texture coordinate
+struct FrameVertex
+{
+	float x;
+	float y;
+	float z;
+	float u;
+	float v;
+};
+
+// Converts a move rect into a source & destination rect in desktop space
+void ConvertMoveRect(FrameRect* sourceRect, FrameRect* destRect, const FrameOutputDesc& outputDesc, const FrameMoveRect& moveRect, int texWidth, int texHeight);
+
+// Converts a dirty rect into desktop space
+FrameRect RotateDirtyRect(const FrameRect& dirtyRect, const FrameOutputDesc& outputDesc);
+
+// Builds the two triangles that draw a dirty rect of a sourceWidth x sourceHeight frame onto a surfaceWidth x surfaceHeight surface
+void BuildDirtyVertices(FrameVertex* vertices, const FrameRect& dirtyRect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, int surfaceWidth, int surfaceHeight, int sourceWidth, int sourceHeight);
@@ -0,0 +1,96 @@
+#include "FrameSlotExchange.h"
+
+FrameSlotExchange::FrameSlotExchange() : m_OutputCount(0)
+{
+}
+
+FrameSlotExchange::~FrameSlotExchange()
+{
+}
+
+void FrameSlotExchange::Initialise(int outputCount)
+{
+	m_OutputCount = (outputCount > 0) ? outputCount : 0;
+	m_Outputs.reset(m_OutputCount ? new OutputSlots[m_OutputCount] : nullptr);
+
+	for (int output = 0; output < m_OutputCount; ++output)
+	{
+		OutputSlots& outputSlots = m_Outputs[output];
+		outputSlots.writeSlot = 0;
+		outputSlots.readSlot = 1;
+		outputSlots.sharedSlot.store(2, std::memory_order_relaxed);
+		outputSlots.sequence = 0;
+		outputSlots.readSequence = 0;
+		outputSlots.droppedCount.store(0, std::memory_order_relaxed);
+		for (int slot = 0; slot < SlotsPerOutput; ++slot)
+		{
+			outputSlots.slots[slot].sequence = 0;
+			outputSlots.slots[slot].presentTime = 0;
+		}
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+int FrameSlotExchange::GetOutputCount() const
+{
+	return m_OutputCount;
+}
+
+int FrameSlotExchange::GetWriteSlot(int output) const
+{
+	return m_Outputs[output].writeSlot;
+}
+
+void FrameSlotExchange::Publish(int output, int64_t presentTime)
+{
+	OutputSlots& outputSlots = m_Outputs[output];
+	SlotInfo& slotInfo = outputSlots.slots[outputSlots.writeSlot];
+	slotInfo.sequence = ++outputSlots.sequence;
+	slotInfo.presentTime = presentTime;
+
+	// Release so the consumer sees the frame, acquire so we don't start writing a slot it's only just let go of
+	unsigned int previous = outputSlots.sharedSlot.exchange(outputSlots.writeSlot | FreshFlag, std::memory_order_acq_rel);
+	outputSlots.writeSlot = previous & IndexMask;
+
+	if (previous & FreshFlag)
+	{
+		// The consumer never got to the frame we've just taken back
+		outputSlots.droppedCount.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+bool FrameSlotExchange::Acquire(int output, int* slot, uint64_t* sequence, int64_t* presentTime)
+{
+	OutputSlots& outputSlots = m_Outputs[output];
+	if (outputSlots.sharedSlot.load(std::memory_order_relaxed) & FreshFlag)
+	{
+		unsigned int previous = outputSlots.sharedSlot.exchange(outputSlots.readSlot, std::memory_order_acq_rel);
+		outputSlots.readSlot = previous & IndexMask;
+	}
+
+	const SlotInfo& slotInfo = outputSlots.slots[outputSlots.readSlot];
+	bool updated = slotInfo.sequence != outputSlots.readSequence;
+	outputSlots.readSequence = slotInfo.sequence;
+
+	*slot = outputSlots.readSlot;
+	if (sequence)
+	{
+		*sequence = slotInfo.sequence;
+	}
+	if (presentTime)
+	{
+		*presentTime = slotInfo.presentTime;
+	}
+	return updated;
+}
+
+uint64_t FrameSlotExchange::GetPublishedCount(int output) const
+{
+	// Only meaningful from the producer's thread, or once it's stopped
+	return m_Outputs[output].sequence;
+}
+
+uint64_t FrameSlotExchange::GetDroppedCount(int output) const
+{
+	return m_Outputs[output].droppedCount.load(std::memory_order_relaxed);
+}
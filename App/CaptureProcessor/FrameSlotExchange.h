@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Latest-wins handoff of whole frames from one producer per output to a single consumer, without locks.
+// Each output has SlotsPerOutput slots: one the producer is filling, one the consumer is reading, and one
+// in between holding the latest published frame. Publishing swaps the filled slot with the one in between,
+// so a producer never waits on the consumer or another output, and frames the consumer didn't get to in time
+// are simply replaced.
+// Only slot indices change hands here; the frames themselves live wherever the caller keeps them
+// (shared textures for the D3D path, CpuFrameSlots for testing the handoff anywhere)
+class FrameSlotExchange
+{
+public:
+	FrameSlotExchange();
+	~FrameSlotExchange();
+
+	// Not safe while anyone is using the exchange
+	void Initialise(int outputCount);
+	int GetOutputCount() const;
+
+	// Producer side. Only the producer for an output may call these for it
+	int GetWriteSlot(int output) const;
+	void Publish(int output, int64_t presentTime);
+
+	// Consumer side. Gets the slot holding the latest frame for an output, which stays the consumer's until
+	// its next Acquire for that output. Returns true if it's a newer frame than last time
+	bool Acquire(int output, int* slot, uint64_t* sequence, int64_t* presentTime);
+
+	// Frames published, and frames replaced before the consumer saw them
+	uint64_t GetPublishedCount(int output) const;
+	uint64_t GetDroppedCount(int output) const;
+
+public:
+	static const int SlotsPerOutput = 3;
+
+private:
+	static const unsigned int FreshFlag = 0x4;
+	static const unsigned int IndexMask = 0x3;
+
+	struct SlotInfo
+	{
+		uint64_t	sequence;
+		int64_t		presentTime;
+	};
+
+	// Everything for one output, padded out so outputs don't share cache lines
+	struct OutputSlots
+	{
+		// Shared between producer and consumer
+		std::atomic<unsigned int>	sharedSlot;
+		std::atomic<uint64_t>		droppedCount;
+		char						sharedPadding[64];
+
+		// Producer only
+		unsigned int				writeSlot;
+		uint64_t					sequence;
+		char						producerPadding[64];
+
+		// Consumer only
+		unsigned int				readSlot;
+		uint64_t					readSequence;
+		char						consumerPadding[64];
+
+		SlotInfo					slots[SlotsPerOutput];
+	};
+
+	std::unique_ptr<OutputSlots[]>	m_Outputs;
+	int								m_OutputCount;
+};
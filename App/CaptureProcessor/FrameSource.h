@@ -0,0 +1,31 @@
+#pragma once
+
+#include "FrameTypes.h"
+
+// Something that produces frames for a single output, along with the rects that changed in each one.
+// Implemented by the DuplicationManager for real desktops, and by the synthetic and trace sources.
+// The capture threads only ever read from duplication, as the ScreenProcessor composites from its GPU
+// texture. The other sources feed the SoftwareCompositor, which only the benchmark uses, so the CPU side
+// of the pipeline can be run without a Windows desktop
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	// Gets the next frame, setting timeout if there wasn't one available
+	virtual bool GetFrame(bool* timeout) = 0;
+	virtual bool ReleaseFrame() = 0;
+
+	virtual int GetDirtyCount() const = 0;
+	virtual const FrameRect* GetDirtyRects() const = 0;
+	virtual int GetMoveCount() const = 0;
+	virtual const FrameMoveRect* GetMoveRects() const = 0;
+
+	virtual const FrameOutputDesc& GetFrameOutputDesc() const = 0;
+
+	// Time the current frame was presented, in microseconds
+	virtual int64_t GetPresentTime() const = 0;
+
+	// Gets CPU access to the pixels of the current frame. Returns false if the frame is only available on the GPU
+	virtual bool GetFrameBuffer(FrameBuffer* frameBuffer) = 0;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+// Portable versions of the desktop duplication types, so frames can be produced and
+// processed without DXGI. Layouts match the Win32 / DXGI types they stand in for
+
+// Same layout as a Win32 RECT
+struct FrameRect
+{
+	int32_t left;
+	int32_t top;
+	int32_t right;
+	int32_t bottom;
+};
+
+// Same layout as a Win32 POINT
+struct FramePoint
+{
+	int32_t x;
+	int32_t y;
+};
+
+// Same layout as a DXGI_OUTDUPL_MOVE_RECT
+struct FrameMoveRect
+{
+	FramePoint sourcePoint;
+	FrameRect destinationRect;
+};
+
+// Same values as DXGI_MODE_ROTATION
+enum FrameRotation
+{
+	FrameRotationUnspecified = 0,
+	FrameRotationIdentity = 1,
+	FrameRotationRotate90 = 2,
+	FrameRotationRotate180 = 3,
+	FrameRotationRotate270 = 4
+};
+
+// Where an output sits on the desktop
+struct FrameOutputDesc
+{
+	FrameRect desktopCoordinates;
+	FrameRotation rotation;
+};
+
+// CPU accessible BGRA pixels of a frame
+struct FrameBuffer
+{
+	const uint8_t* pixels;
+	int width;
+	int height;
+	int pitch;
+};
@@ -0,0 +1,160 @@
+#include "LatencyHistogram.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+int64_t GetLatencyTimestamp()
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (counter.QuadPart / frequency.QuadPart) * 1000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart;
+#else
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+void LatencyHistogram::Record(int64_t value)
+{
+	if (value < 0)
+	{
+		// Clocks that aren't quite in step. Count it as instant
+		value = 0;
+	}
+
+	m_Buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	m_Count.fetch_add(1, std::memory_order_relaxed);
+
+	int64_t maximum = m_Maximum.load(std::memory_order_relaxed);
+	while (value > maximum && !m_Maximum.compare_exchange_weak(maximum, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+//
+// Clears the histogram. Values recorded at the same time may or may not survive
+//
+void LatencyHistogram::Reset()
+{
+	for (int bucketIndex = 0; bucketIndex < BucketCount; ++bucketIndex)
+	{
+		m_Buckets[bucketIndex].store(0, std::memory_order_relaxed);
+	}
+	m_Count.store(0, std::memory_order_relaxed);
+	m_Maximum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+	return m_Count.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::GetMaximum() const
+{
+	return m_Maximum.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::GetPercentile(double percentile) const
+{
+	// Take a copy first, as values can still be arriving
+	static_assert(BucketCount > 0, "Histogram needs buckets");
+	uint64_t counts[BucketCount];
+	uint64_t total = 0;
+	for (int bucketIndex = 0; bucketIndex < BucketCount; ++bucketIndex)
+	{
+		counts[bucketIndex] = m_Buckets[bucketIndex].load(std::memory_order_relaxed);
+		total += counts[bucketIndex];
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	if (percentile < 0.0)
+	{
+		percentile = 0.0;
+	}
+	else if (percentile > 100.0)
+	{
+		percentile = 100.0;
+	}
+
+	// The rank of the value we're after, counting from 1
+	uint64_t rank = static_cast<uint64_t>((percentile / 100.0) * total + 0.5);
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for (int bucketIndex = 0; bucketIndex < BucketCount; ++bucketIndex)
+	{
+		seen += counts[bucketIndex];
+		if (seen >= rank)
+		{
+			// Don't report more than we've actually seen
+			int64_t value = GetBucketUpperValue(bucketIndex);
+			int64_t maximum = GetMaximum();
+			return (maximum > 0 && value > maximum) ? maximum : value;
+		}
+	}
+
+	return GetMaximum();
+}
+
+//
+// Values below SubBucketCount get a bucket each. Above that, the top SubBucketBits bits below the
+// leading one pick the bucket within each power of two
+//
+int LatencyHistogram::GetBucketIndex(int64_t value)
+{
+	const int64_t maxValue = (static_cast<int64_t>(1) << MaxValueBits) - 1;
+	if (value > maxValue)
+	{
+		value = maxValue;
+	}
+
+	if (value < SubBucketCount)
+	{
+		return static_cast<int>(value);
+	}
+
+	int magnitude = 0;
+	for (uint64_t remaining = static_cast<uint64_t>(value) >> 1; remaining; remaining >>= 1)
+	{
+		++magnitude;
+	}
+
+	int shift = magnitude - SubBucketBits;
+	int subBucket = static_cast<int>((value >> shift) & (SubBucketCount - 1));
+	return (shift + 1) * SubBucketCount + subBucket;
+}
+
+int64_t LatencyHistogram::GetBucketUpperValue(int bucketIndex)
+{
+	if (bucketIndex < SubBucketCount)
+	{
+		return bucketIndex;
+	}
+
+	int shift = bucketIndex / SubBucketCount - 1;
+	int subBucket = bucketIndex % SubBucketCount;
+	int64_t lowerValue = static_cast<int64_t>(SubBucketCount + subBucket) << shift;
+	return lowerValue + (static_cast<int64_t>(1) << shift) - 1;
+}
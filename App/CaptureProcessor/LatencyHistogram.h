@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Microseconds on the same clock desktop duplication uses for present times
+// (the performance counter on Windows, the steady clock everywhere else)
+int64_t GetLatencyTimestamp();
+
+// Log-linear histogram of latencies in microseconds, in the style of HdrHistogram.
+// Values are bucketed by power of two, with each power of two split into SubBucketCount linear
+// buckets, so anything reported is within 1 / SubBucketCount (about 3%) of the true value.
+// Recording is lock free and safe from any number of threads
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void Record(int64_t value);
+	void Reset();
+
+	uint64_t GetCount() const;
+	int64_t GetMaximum() const;
+
+	// Value at or below which percentile (0 - 100) of the recorded values fall, to the histogram's precision
+	int64_t GetPercentile(double percentile) const;
+
+public:
+	static const int SubBucketBits = 5;
+	static const int SubBucketCount = 1 << SubBucketBits;
+
+	// Values are clamped to 2^MaxValueBits - 1 microseconds, which is well over a day
+	static const int MaxValueBits = 40;
+	static const int BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+	static int GetBucketIndex(int64_t value);
+
+	// Highest value that goes in a bucket
+	static int64_t GetBucketUpperValue(int bucketIndex);
+
+private:
+	std::atomic<uint64_t>	m_Buckets[BucketCount];
+	std::atomic<uint64_t>	m_Count;
+	std::atomic<int64_t>	m_Maximum;
+};
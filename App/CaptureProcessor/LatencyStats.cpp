@@ -0,0 +1,68 @@
+#include "LatencyStats.h"
+
+LatencyStats::LatencyStats()
+{
+}
+
+void LatencyStats::Record(int stage, int64_t presentTime)
+{
+	if (presentTime <= 0)
+	{
+		return;
+	}
+
+	RecordAt(stage, presentTime, GetLatencyTimestamp());
+}
+
+void LatencyStats::RecordAt(int stage, int64_t presentTime, int64_t now)
+{
+	if (stage < 0 || stage >= LatencyStageCount || presentTime <= 0)
+	{
+		return;
+	}
+
+	m_Histograms[stage].Record(now - presentTime);
+}
+
+void LatencyStats::Reset()
+{
+	for (int stage = 0; stage < LatencyStageCount; ++stage)
+	{
+		m_Histograms[stage].Reset();
+	}
+}
+
+const LatencyHistogram* LatencyStats::GetHistogram(int stage) const
+{
+	if (stage < 0 || stage >= LatencyStageCount)
+	{
+		return nullptr;
+	}
+
+	return &m_Histograms[stage];
+}
+
+bool LatencyStats::GetPercentiles(int stage, int64_t* values, int length) const
+{
+	const LatencyHistogram* histogram = GetHistogram(stage);
+	if (!histogram || !values)
+	{
+		return false;
+	}
+
+	int64_t allValues[PercentileValueCount] =
+	{
+		static_cast<int64_t>(histogram->GetCount()),
+		histogram->GetPercentile(50.0),
+		histogram->GetPercentile(99.0),
+		histogram->GetPercentile(99.9),
+		histogram->GetMaximum()
+	};
+
+	for (int valueIndex = 0; valueIndex < length && valueIndex < PercentileValueCount; ++valueIndex)
+	{
+		values[valueIndex] = allValues[valueIndex];
+	}
+
+	return true;
+}
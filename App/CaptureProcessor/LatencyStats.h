@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "LatencyHistogram.h"
+
+// The points a frame passes on its way from the desktop to the LEDs.
+// Each is measured from the frame's present time. Values are shared with the server, so don't reorder them
+enum LatencyStage
+{
+	LatencyStageAcquire = 0,		// Desktop duplication handed us the frame
+	LatencyStageComposite = 1,		// Frame drawn onto the shared surface
+	LatencyStageLights = 2,			// Light values worked out from the shared surface
+	LatencyStageSerialWrite = 3,	// Light values written to the serial port, or sent over the network
+	LatencyStageShow = 4,			// Board acknowledged showing the light values, or the time it was told to show them
+	LatencyStageCount
+};
+
+// Per stage latency histograms. Recording is lock free, so the capture threads, the light processor
+// and the server can all record at once
+class LatencyStats
+{
+public:
+	LatencyStats();
+
+	// Records how long it's been since presentTime (microseconds, on the GetLatencyTimestamp clock) for a stage.
+	// Frames without a present time are ignored
+	void Record(int stage, int64_t presentTime);
+	void RecordAt(int stage, int64_t presentTime, int64_t now);
+
+	void Reset();
+
+	const LatencyHistogram* GetHistogram(int stage) const;
+
+	// Fills values with [count, p50, p99, p99.9, max], in microseconds. Returns false for an unknown stage
+	bool GetPercentiles(int stage, int64_t* values, int length) const;
+
+public:
+	static const int PercentileValueCount = 5;
+
+private:
+	LatencyHistogram	m_Histograms[LatencyStageCount];
+};
@@ -0,0 +1,142 @@
+#include "LightColourFormat.h"
+
+#include "LightProtocol.h"
+
+// Bits kept for each channel, red first
+static const int RGB565Bits[3] = { 5, 6, 5 };
+static const int RGB444Bits[3] = { 4, 4, 4 };
+
+LightColourFormat GetLightColourFormat(uint16_t features)
+{
+	if (features & LightProtocolFeatureRGB444)
+	{
+		return LightColourFormatRGB444;
+	}
+	if (features & LightProtocolFeatureRGB565)
+	{
+		return LightColourFormatRGB565;
+	}
+	return LightColourFormatRGB888;
+}
+
+size_t GetPackedLightsSize(LightColourFormat format, int lightCount)
+{
+	switch (format)
+	{
+	case LightColourFormatRGB565:
+		return static_cast<size_t>(lightCount) * 2;
+
+	case LightColourFormatRGB444:
+		return (static_cast<size_t>(lightCount) * 3 + 1) / 2;
+
+	default:
+		return static_cast<size_t>(lightCount) * 3;
+	}
+}
+
+uint8_t ExpandLightChannel(int value, int bits)
+{
+	int expanded = value << (8 - bits);
+	return static_cast<uint8_t>(expanded | (expanded >> bits));
+}
+
+void PackLights(LightColourFormat format, const uint8_t* lightData, int lightCount, uint8_t* output)
+{
+	switch (format)
+	{
+	case LightColourFormatRGB565:
+		for (int lightIndex = 0; lightIndex < lightCount; ++lightIndex, lightData += 3)
+		{
+			uint16_t packed = static_cast<uint16_t>(((lightData[0] >> 3) << 11) | ((lightData[1] >> 2) << 5) | (lightData[2] >> 3));
+			*output++ = static_cast<uint8_t>(packed);
+			*output++ = static_cast<uint8_t>(packed >> 8);
+		}
+		break;
+
+	case LightColourFormatRGB444:
+		{
+			// Two channels to a byte, so an odd number of lights leaves the bottom half of the last byte empty
+			int channelCount = lightCount * 3;
+			for (int channel = 0; channel < channelCount; channel += 2)
+			{
+				uint8_t low = (channel + 1 < channelCount) ? (lightData[channel + 1] >> 4) : 0;
+				*output++ = static_cast<uint8_t>((lightData[channel] & 0xF0) | low);
+			}
+		}
+		break;
+
+	default:
+		for (int channel = 0; channel < lightCount * 3; ++channel)
+		{
+			output[channel] = lightData[channel];
+		}
+		break;
+	}
+}
+
+void UnpackLights(LightColourFormat format, const uint8_t* packed, int lightCount, uint8_t* lightData)
+{
+	switch (format)
+	{
+	case LightColourFormatRGB565:
+		for (int lightIndex = 0; lightIndex < lightCount; ++lightIndex, packed += 2)
+		{
+			uint16_t value = static_cast<uint16_t>(packed[0] | (packed[1] << 8));
+			*lightData++ = ExpandLightChannel(value >> 11, 5);
+			*lightData++ = ExpandLightChannel((value >> 5) & 0x3F, 6);
+			*lightData++ = ExpandLightChannel(value & 0x1F, 5);
+		}
+		break;
+
+	case LightColourFormatRGB444:
+		for (int channel = 0; channel < lightCount * 3; ++channel)
+		{
+			uint8_t value = packed[channel / 2];
+			lightData[channel] = ExpandLightChannel((channel % 2) ? (value & 0x0F) : (value >> 4), 4);
+		}
+		break;
+
+	default:
+		for (int channel = 0; channel < lightCount * 3; ++channel)
+		{
+			lightData[channel] = packed[channel];
+		}
+		break;
+	}
+}
+
+void LightDitherer::Initialise(int lightCount)
+{
+	m_Errors.assign(static_cast<size_t>(lightCount) * 3, 0);
+}
+
+void LightDitherer::Apply(LightColourFormat format, uint8_t* lightData, int lightCount)
+{
+	if (format == LightColourFormatRGB888)
+	{
+		return;
+	}
+
+	const int* channelBits = (format == LightColourFormatRGB565) ? RGB565Bits : RGB444Bits;
+	int channelCount = lightCount * 3;
+	if (static_cast<int>(m_Errors.size()) < channelCount)
+	{
+		m_Errors.resize(channelCount, 0);
+	}
+
+	for (int channel = 0; channel < channelCount; ++channel)
+	{
+		int bits = channelBits[channel % 3];
+		int maximum = (1 << bits) - 1;
+
+		// Aim for the colour asked for plus whatever was left over last frame. Only the level is clamped, so the
+		// error isn't thrown away at either end
+		int target = lightData[channel] + m_Errors[channel];
+		int level = (target * maximum + 127) / 255;
+		level = (level < 0) ? 0 : ((level > maximum) ? maximum : level);
+
+		uint8_t shown = ExpandLightChannel(level, bits);
+		m_Errors[channel] = static_cast<int16_t>(target - shown);
+		lightData[channel] = shown;
+	}
+}
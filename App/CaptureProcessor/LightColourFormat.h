@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reduced precision colour formats for light frames, for links too slow for 3 bytes per light.
+//   RGB565  2 bytes per light, little endian, with red in the top 5 bits and blue in the bottom 5
+//   RGB444  12 bits per light, as a stream of 4 bit values (red, green, blue, red...), high half of each byte first
+// Channels are widened again by repeating their top bits, so full black and full white survive
+
+enum LightColourFormat
+{
+	LightColourFormatRGB888,
+	LightColourFormatRGB565,
+	LightColourFormatRGB444
+};
+
+// The smallest format switched on in a set of LightProtocolFeature flags
+LightColourFormat GetLightColourFormat(uint16_t features);
+
+// Size of a packed frame
+size_t GetPackedLightsSize(LightColourFormat format, int lightCount);
+
+// Widens a channel value of the given number of bits back to 8
+uint8_t ExpandLightChannel(int value, int bits);
+
+// Packs lights (3 bytes each, red first) by dropping the low bits of each channel, and unpacks them again
+void PackLights(LightColourFormat format, const uint8_t* lightData, int lightCount, uint8_t* output);
+void UnpackLights(LightColourFormat format, const uint8_t* packed, int lightCount, uint8_t* lightData);
+
+// Rounds lights to what a reduced format can show, carrying each light's rounding error over to the next frame.
+// Flickering between the two nearest levels then averages out to the colour asked for, which keeps dim and
+// subtle colours from banding
+class LightDitherer
+{
+public:
+	void Initialise(int lightCount);
+
+	// Rounds lightData (3 bytes per light) in place, so it packs without losing anything more
+	void Apply(LightColourFormat format, uint8_t* lightData, int lightCount);
+
+private:
+	std::vector<int16_t>	m_Errors;
+};
@@ -0,0 +1,328 @@
+#include "LightFrameCodec.h"
+
+#include "LightColourFormat.h"
+#include "LightProtocol.h"
+
+static bool IsSameLight(const uint8_t* a, const uint8_t* b)
+{
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+static bool IsSmallChange(const uint8_t* light, const uint8_t* base)
+{
+	for (int channel = 0; channel < 3; ++channel)
+	{
+		int change = light[channel] - base[channel];
+		if (change < LightDeltaMin || change > LightDeltaMax)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// How many lights from index on are the same colour, up to the longest run
+//
+static int GetRepeatLength(const uint8_t* lightData, int index, int lightCount)
+{
+	int end = (lightCount - index < MaxLightRunLength) ? lightCount : index + MaxLightRunLength;
+	int next = index + 1;
+	while (next < end && IsSameLight(&lightData[next * 3], &lightData[index * 3]))
+	{
+		++next;
+	}
+	return next - index;
+}
+
+static void AppendRun(uint8_t runType, int length, std::vector<uint8_t>* output)
+{
+	output->push_back(static_cast<uint8_t>(runType | (length - 1)));
+}
+
+static void AppendLights(const uint8_t* lightData, int index, int length, std::vector<uint8_t>* output)
+{
+	output->insert(output->end(), lightData + index * 3, lightData + (index + length) * 3);
+}
+
+void EncodeLightKeyframe(const uint8_t* lightData, int lightCount, std::vector<uint8_t>* output)
+{
+	output->clear();
+	int index = 0;
+	while (index < lightCount)
+	{
+		int repeatLength = GetRepeatLength(lightData, index, lightCount);
+		if (repeatLength >= 2)
+		{
+			AppendRun(LightRunRepeat, repeatLength, output);
+			AppendLights(lightData, index, 1, output);
+			index += repeatLength;
+			continue;
+		}
+
+		// Everything up to the next repeat
+		int end = index + 1;
+		while (end < lightCount && end - index < MaxLightRunLength && (end + 1 == lightCount || !IsSameLight(&lightData[end * 3], &lightData[(end + 1) * 3])))
+		{
+			++end;
+		}
+		AppendRun(LightRunLiteral, end - index, output);
+		AppendLights(lightData, index, end - index, output);
+		index = end;
+	}
+}
+
+void EncodeLightDelta(const uint8_t* lightData, const uint8_t* baseData, int lightCount, uint8_t baseSequence, std::vector<uint8_t>* output)
+{
+	output->clear();
+	output->push_back(baseSequence);
+
+	int index = 0;
+	while (index < lightCount)
+	{
+		const uint8_t* light = &lightData[index * 3];
+		const uint8_t* base = &baseData[index * 3];
+		if (IsSameLight(light, base))
+		{
+			int end = index + 1;
+			while (end < lightCount && IsSameLight(&lightData[end * 3], &baseData[end * 3]))
+			{
+				++end;
+			}
+			if (end == lightCount)
+			{
+				// Anything after the last run is unchanged anyway
+				break;
+			}
+
+			for (; index < end; index += MaxLightRunLength)
+			{
+				AppendRun(LightRunSkip, (end - index < MaxLightRunLength) ? end - index : MaxLightRunLength, output);
+			}
+			index = end;
+			continue;
+		}
+
+		// A repeat costs the same as two deltas, so it's only worth breaking a run of deltas for three or more
+		bool smallChange = IsSmallChange(light, base);
+		int repeatLength = GetRepeatLength(lightData, index, lightCount);
+		if (repeatLength >= 3 || (repeatLength == 2 && !smallChange))
+		{
+			AppendRun(LightRunRepeat, repeatLength, output);
+			AppendLights(lightData, index, 1, output);
+			index += repeatLength;
+			continue;
+		}
+
+		int end = index + 1;
+		while (end < lightCount && end - index < MaxLightRunLength)
+		{
+			const uint8_t* nextLight = &lightData[end * 3];
+			const uint8_t* nextBase = &baseData[end * 3];
+
+			// Stop where a skip or a repeat would take over
+			bool twoSame = end + 1 < lightCount && IsSameLight(nextLight, nextBase) && IsSameLight(&lightData[(end + 1) * 3], &baseData[(end + 1) * 3]);
+			if (IsSmallChange(nextLight, nextBase) != smallChange || twoSame || GetRepeatLength(lightData, end, lightCount) >= 3)
+			{
+				break;
+			}
+			++end;
+		}
+
+		if (smallChange)
+		{
+			AppendRun(LightRunDelta, end - index, output);
+			for (; index < end; ++index)
+			{
+				const uint8_t* changedLight = &lightData[index * 3];
+				const uint8_t* changedBase = &baseData[index * 3];
+				uint16_t delta = static_cast<uint16_t>(((changedLight[0] - changedBase[0]) & 0x1F) | (((changedLight[1] - changedBase[1]) & 0x1F) << 5) | (((changedLight[2] - changedBase[2]) & 0x1F) << 10));
+				output->push_back(static_cast<uint8_t>(delta));
+				output->push_back(static_cast<uint8_t>(delta >> 8));
+			}
+		}
+		else
+		{
+			AppendRun(LightRunLiteral, end - index, output);
+			AppendLights(lightData, index, end - index, output);
+			index = end;
+		}
+	}
+}
+
+LightFrameEncoder::LightFrameEncoder() :
+	m_Features(LightProtocolDefaultFeatures),
+	m_Payload(nullptr),
+	m_PayloadLength(0)
+{
+}
+
+void LightFrameEncoder::SetFeatures(uint16_t features)
+{
+	m_Features = features;
+}
+
+uint8_t LightFrameEncoder::Encode(const uint8_t* lightData, const uint8_t* baseData, int lightCount, uint8_t baseSequence)
+{
+	uint8_t type = LightFrameTypeLights;
+	m_Payload = lightData;
+	m_PayloadLength = static_cast<size_t>(lightCount) * 3;
+
+	LightColourFormat format = GetLightColourFormat(m_Features);
+	if (format != LightColourFormatRGB888)
+	{
+		type = (format == LightColourFormatRGB565) ? LightFrameTypeRGB565 : LightFrameTypeRGB444;
+		m_Packed.resize(GetPackedLightsSize(format, lightCount));
+		PackLights(format, lightData, lightCount, m_Packed.data());
+		m_Payload = m_Packed.data();
+		m_PayloadLength = m_Packed.size();
+	}
+
+	if (!(m_Features & LightProtocolFeatureDelta))
+	{
+		return type;
+	}
+
+	EncodeLightKeyframe(lightData, lightCount, &m_Keyframe);
+	if (m_Keyframe.size() < m_PayloadLength)
+	{
+		type = LightFrameTypeKeyframe;
+		m_Payload = m_Keyframe.data();
+		m_PayloadLength = m_Keyframe.size();
+	}
+
+	if (baseData)
+	{
+		EncodeLightDelta(lightData, baseData, lightCount, baseSequence, &m_Delta);
+		if (m_Delta.size() < m_PayloadLength)
+		{
+			type = LightFrameTypeDelta;
+			m_Payload = m_Delta.data();
+			m_PayloadLength = m_Delta.size();
+		}
+	}
+	return type;
+}
+
+const uint8_t* LightFrameEncoder::GetPayload() const
+{
+	return m_Payload;
+}
+
+size_t LightFrameEncoder::GetPayloadLength() const
+{
+	return m_PayloadLength;
+}
+
+//
+// Sign extends one 5 bit change
+//
+static int GetLightDelta(uint16_t delta, int shift)
+{
+	int change = (delta >> shift) & 0x1F;
+	return (change & 0x10) ? change - 0x20 : change;
+}
+
+bool DecodeLightFrame(uint8_t type, const uint8_t* payload, size_t payloadLength, int baseSequence, uint8_t* lightData, int lightCount)
+{
+	size_t lightBytes = static_cast<size_t>(lightCount) * 3;
+	if (type == LightFrameTypeRGB565 || type == LightFrameTypeRGB444)
+	{
+		LightColourFormat format = (type == LightFrameTypeRGB565) ? LightColourFormatRGB565 : LightColourFormatRGB444;
+		if (payloadLength != GetPackedLightsSize(format, lightCount))
+		{
+			return false;
+		}
+		UnpackLights(format, payload, lightCount, lightData);
+		return true;
+	}
+
+	if (type == LightFrameTypeLights)
+	{
+		if (payloadLength != lightBytes)
+		{
+			return false;
+		}
+		for (size_t index = 0; index < lightBytes; ++index)
+		{
+			lightData[index] = payload[index];
+		}
+		return true;
+	}
+
+	size_t position = 0;
+	if (type == LightFrameTypeDelta)
+	{
+		if (payloadLength < 1 || payload[0] != baseSequence)
+		{
+			return false;
+		}
+		position = 1;
+	}
+	else if (type != LightFrameTypeKeyframe)
+	{
+		return false;
+	}
+
+	int index = 0;
+	while (position < payloadLength)
+	{
+		uint8_t runType = payload[position] & LightRunTypeMask;
+		int length = (payload[position] & ~LightRunTypeMask) + 1;
+		++position;
+		if (index + length > lightCount || (runType == LightRunSkip && type != LightFrameTypeDelta) || (runType == LightRunDelta && type != LightFrameTypeDelta))
+		{
+			return false;
+		}
+
+		uint8_t* light = &lightData[index * 3];
+		switch (runType)
+		{
+		case LightRunSkip:
+			break;
+
+		case LightRunDelta:
+			if (payloadLength - position < static_cast<size_t>(length) * 2)
+			{
+				return false;
+			}
+			for (int run = 0; run < length; ++run, light += 3, position += 2)
+			{
+				uint16_t delta = static_cast<uint16_t>(payload[position] | (payload[position + 1] << 8));
+				light[0] = static_cast<uint8_t>(light[0] + GetLightDelta(delta, 0));
+				light[1] = static_cast<uint8_t>(light[1] + GetLightDelta(delta, 5));
+				light[2] = static_cast<uint8_t>(light[2] + GetLightDelta(delta, 10));
+			}
+			break;
+
+		case LightRunLiteral:
+			if (payloadLength - position < static_cast<size_t>(length) * 3)
+			{
+				return false;
+			}
+			for (int channel = 0; channel < length * 3; ++channel)
+			{
+				light[channel] = payload[position++];
+			}
+			break;
+
+		case LightRunRepeat:
+			if (payloadLength - position < 3)
+			{
+				return false;
+			}
+			for (int run = 0; run < length; ++run, light += 3)
+			{
+				light[0] = payload[position];
+				light[1] = payload[position + 1];
+				light[2] = payload[position + 2];
+			}
+			position += 3;
+			break;
+		}
+		index += length;
+	}
+
+	// Keyframes have to cover everything, whereas delta frames leave the rest unchanged
+	return type == LightFrameTypeDelta || index == lightCount;
+}
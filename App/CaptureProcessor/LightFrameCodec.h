@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed light frame payloads, for the keyframe and delta frame types.
+//
+// Both are a list of runs over the lights, each starting with a byte holding the run type in its top two bits
+// and the run length minus one in the rest:
+//   Skip     Lights unchanged since the base frame. Delta frames only
+//   Delta    2 bytes per light, little endian, holding signed 5 bit changes to red (bits 0-4), green (5-9) and blue (10-14)
+//   Literal  3 bytes per light, red first
+//   Repeat   3 bytes for one light, shown across the whole run
+// Keyframes must cover every light. Delta frames start with the sequence of the frame they're based on, which must
+// be the last frame the board showed, and any lights after their last run are unchanged
+
+enum LightRunType
+{
+	LightRunSkip = 0x00,
+	LightRunDelta = 0x40,
+	LightRunLiteral = 0x80,
+	LightRunRepeat = 0xC0
+};
+
+static const uint8_t LightRunTypeMask = 0xC0;
+static const int MaxLightRunLength = 64;
+
+static const int LightDeltaMin = -16;
+static const int LightDeltaMax = 15;
+
+// Picks the smallest way of sending each frame
+class LightFrameEncoder
+{
+public:
+	LightFrameEncoder();
+
+	// Which frame types to pick from, as LightProtocolFeature flags. With a reduced colour format, the lights
+	// have to have been rounded to it already (see LightDitherer)
+	void SetFeatures(uint16_t features);
+
+	// lightData and baseData are 3 bytes per light. Pass a null baseData to force a keyframe or plain frame.
+	// Returns the frame type (LightFrameType), with the payload then in GetPayload
+	uint8_t Encode(const uint8_t* lightData, const uint8_t* baseData, int lightCount, uint8_t baseSequence);
+
+	// Valid until the next Encode, and points into lightData for plain frames
+	const uint8_t* GetPayload() const;
+	size_t GetPayloadLength() const;
+
+private:
+	uint16_t				m_Features;
+	const uint8_t*			m_Payload;
+	size_t					m_PayloadLength;
+	std::vector<uint8_t>	m_Packed;
+	std::vector<uint8_t>	m_Keyframe;
+	std::vector<uint8_t>	m_Delta;
+};
+
+void EncodeLightKeyframe(const uint8_t* lightData, int lightCount, std::vector<uint8_t>* output);
+void EncodeLightDelta(const uint8_t* lightData, const uint8_t* baseData, int lightCount, uint8_t baseSequence, std::vector<uint8_t>* output);
+
+// Reference decoder, matching the one in the firmware. lightData holds the last frame shown, whose sequence is
+// baseSequence (-1 if there isn't one), and is updated in place. Returns false if the frame can't be applied,
+// in which case lightData may be partly updated
+bool DecodeLightFrame(uint8_t type, const uint8_t* payload, size_t payloadLength, int baseSequence, uint8_t* lightData, int lightCount);
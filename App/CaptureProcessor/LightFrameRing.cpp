@@ -0,0 +1,251 @@
+#include "LightFrameRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "LatencyHistogram.h"
+
+static const size_t CacheLineSize = 64;
+static const int MaxCopyAttempts = 64;
+
+static_assert(sizeof(LightFrameRingHeader) == CacheLineSize, "Ring header must be one cache line");
+static_assert(sizeof(LightFrameRingSlot) == CacheLineSize, "Ring slot header must be one cache line");
+
+static int32_t* GetSlotValues(LightFrameRingSlot* slot)
+{
+	return reinterpret_cast<int32_t*>(slot + 1);
+}
+
+static const int32_t* GetSlotValues(const LightFrameRingSlot* slot)
+{
+	return reinterpret_cast<const int32_t*>(slot + 1);
+}
+
+LightFrameRingWriter::LightFrameRingWriter() :
+	m_Header(nullptr)
+{
+}
+
+LightFrameRingWriter::~LightFrameRingWriter()
+{
+	Close();
+}
+
+bool LightFrameRingWriter::Create(const std::string& name, int lightColumns, int lightRows, int slotCount)
+{
+	Close();
+	int lightCount = lightColumns * lightRows;
+	if (lightColumns <= 0 || lightRows <= 0 || slotCount < 2)
+	{
+		return false;
+	}
+
+	// Slots sit on cache lines of their own, so readers of one frame don't slow down writes to the next
+	size_t slotSize = sizeof(LightFrameRingSlot) + ((lightCount * sizeof(int32_t) + CacheLineSize - 1) / CacheLineSize) * CacheLineSize;
+	if (!m_Memory.Create(name, sizeof(LightFrameRingHeader) + static_cast<uint64_t>(slotSize) * slotCount))
+	{
+		return false;
+	}
+
+	// Readers check the magic number last, so everything else has to be in place by then
+	m_Header = reinterpret_cast<LightFrameRingHeader*>(m_Memory.GetData());
+	m_Header->version = LightFrameRingVersion;
+	m_Header->slotCount = static_cast<uint32_t>(slotCount);
+	m_Header->slotSize = static_cast<uint32_t>(slotSize);
+	m_Header->lightCount = lightCount;
+	m_Header->lightColumns = lightColumns;
+	m_Header->lightRows = lightRows;
+	m_Header->writerClosed.store(0, std::memory_order_relaxed);
+	m_Header->latestFrame.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_Header->magic = LightFrameRingMagic;
+	return true;
+}
+
+void LightFrameRingWriter::Close()
+{
+	if (m_Header)
+	{
+		m_Header->writerClosed.store(1, std::memory_order_release);
+		m_Header = nullptr;
+	}
+	m_Memory.Close();
+}
+
+bool LightFrameRingWriter::IsOpen() const
+{
+	return m_Header != nullptr;
+}
+
+void LightFrameRingWriter::Write(const int32_t* values, int count, uint64_t frame, int64_t presentTime)
+{
+	if (!m_Header)
+	{
+		return;
+	}
+
+	LightFrameRingSlot* slot = reinterpret_cast<LightFrameRingSlot*>(m_Memory.GetData() + sizeof(LightFrameRingHeader) + (frame % m_Header->slotCount) * m_Header->slotSize);
+
+	// Mark the slot as being written before anything in it changes
+	uint64_t lock = slot->lock.load(std::memory_order_relaxed);
+	slot->lock.store(lock + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	int copyCount = std::max(0, std::min(count, m_Header->lightCount));
+	int32_t* slotValues = GetSlotValues(slot);
+	memcpy(slotValues, values, copyCount * sizeof(int32_t));
+	memset(slotValues + copyCount, 0, (m_Header->lightCount - copyCount) * sizeof(int32_t));
+	slot->frame = frame;
+	slot->presentTime = presentTime;
+	slot->publishTime = GetLatencyTimestamp();
+
+	slot->lock.store(lock + 2, std::memory_order_release);
+	m_Header->latestFrame.store(frame, std::memory_order_release);
+}
+
+void LightFrameRingWriter::WriteLights(const int32_t* values, int count, uint64_t sequence, int64_t presentTime)
+{
+	Write(values, count, sequence, presentTime);
+}
+
+LightFrameRingReader::LightFrameRingReader() :
+	m_Header(nullptr)
+{
+}
+
+LightFrameRingReader::~LightFrameRingReader()
+{
+	Close();
+}
+
+bool LightFrameRingReader::Open(const std::string& name)
+{
+	Close();
+	if (!m_Memory.OpenRead(name) || m_Memory.GetSize() < sizeof(LightFrameRingHeader))
+	{
+		Close();
+		return false;
+	}
+
+	// Anything we don't understand, or that isn't all there, is left alone
+	const LightFrameRingHeader* header = reinterpret_cast<const LightFrameRingHeader*>(m_Memory.GetData());
+	bool valid = header->magic == LightFrameRingMagic;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	valid = valid && header->version == LightFrameRingVersion && header->slotCount >= 2 && header->lightCount > 0 &&
+		header->slotSize >= sizeof(LightFrameRingSlot) + header->lightCount * sizeof(int32_t) &&
+		m_Memory.GetSize() >= sizeof(LightFrameRingHeader) + static_cast<uint64_t>(header->slotSize) * header->slotCount;
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	m_Header = header;
+	return true;
+}
+
+void LightFrameRingReader::Close()
+{
+	m_Header = nullptr;
+	m_Memory.Close();
+}
+
+bool LightFrameRingReader::IsOpen() const
+{
+	return m_Header != nullptr;
+}
+
+int LightFrameRingReader::GetLightCount() const
+{
+	return m_Header ? m_Header->lightCount : 0;
+}
+
+int LightFrameRingReader::GetLightColumns() const
+{
+	return m_Header ? m_Header->lightColumns : 0;
+}
+
+int LightFrameRingReader::GetLightRows() const
+{
+	return m_Header ? m_Header->lightRows : 0;
+}
+
+int LightFrameRingReader::GetSlotCount() const
+{
+	return m_Header ? static_cast<int>(m_Header->slotCount) : 0;
+}
+
+uint64_t LightFrameRingReader::GetLatestFrame() const
+{
+	return m_Header ? m_Header->latestFrame.load(std::memory_order_acquire) : 0;
+}
+
+bool LightFrameRingReader::IsWriterClosed() const
+{
+	return !m_Header || m_Header->writerClosed.load(std::memory_order_acquire) != 0;
+}
+
+const LightFrameRingSlot* LightFrameRingReader::GetSlot(uint64_t frame) const
+{
+	return reinterpret_cast<const LightFrameRingSlot*>(m_Memory.GetData() + sizeof(LightFrameRingHeader) + (frame % m_Header->slotCount) * m_Header->slotSize);
+}
+
+bool LightFrameRingReader::Read(uint64_t frame, LightFrameView* view) const
+{
+	if (!m_Header || frame == 0)
+	{
+		return false;
+	}
+
+	const LightFrameRingSlot* slot = GetSlot(frame);
+	uint64_t lock = slot->lock.load(std::memory_order_acquire);
+	if ((lock & 1) != 0 || slot->frame != frame)
+	{
+		return false;
+	}
+
+	view->values = GetSlotValues(slot);
+	view->count = m_Header->lightCount;
+	view->frame = frame;
+	view->presentTime = slot->presentTime;
+	view->publishTime = slot->publishTime;
+	view->lock = lock;
+
+	// The frame number might have been torn too
+	return IsIntact(*view);
+}
+
+bool LightFrameRingReader::ReadLatest(LightFrameView* view) const
+{
+	return Read(GetLatestFrame(), view);
+}
+
+bool LightFrameRingReader::IsIntact(const LightFrameView& view) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return GetSlot(view.frame)->lock.load(std::memory_order_relaxed) == view.lock;
+}
+
+bool LightFrameRingReader::CopyLatest(int32_t* values, int length, LightFrameView* view) const
+{
+	// Only a writer lapping the whole ring while we copy gets in the way, so this rarely goes round more than once.
+	// A writer that died part way through a frame leaves it marked as being written for good, so don't wait forever
+	for (int attempt = 0; attempt < MaxCopyAttempts; ++attempt)
+	{
+		uint64_t frame = GetLatestFrame();
+		if (frame == 0)
+		{
+			return false;
+		}
+
+		if (Read(frame, view))
+		{
+			memcpy(values, view->values, std::max(0, std::min(length, view->count)) * sizeof(int32_t));
+			if (IsIntact(*view))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
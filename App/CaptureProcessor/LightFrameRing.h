@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "LightValueBuffer.h"
+#include "SharedMemory.h"
+
+// A ring of recent light frames in shared memory, so other processes (recorders, visualisers, more controllers)
+// can read the lights as they're published without copies, locks, or anything to slow the capture down.
+//
+// The block starts with a LightFrameRingHeader, followed by slotCount slots of slotSize bytes each. Each slot is
+// a LightFrameRingSlot followed by lightCount light values (0x00RRGGBB, serpentine order as sent to the board),
+// and frame N (counting from 1) goes in slot N % slotCount. Every slot is guarded by its own sequence counter,
+// which is odd while the slot is being written. Readers load the counter, read the slot, then load the counter
+// again: if it's even and unchanged, what they read is intact. The writer never waits for readers, so a reader
+// that falls slotCount frames behind finds its frame overwritten and has to skip ahead.
+// Timestamps are microseconds on the GetLatencyTimestamp clock, which every process on the machine shares
+
+static const uint32_t LightFrameRingMagic = 0x4752464C;		// "LFRG"
+static const uint32_t LightFrameRingVersion = 1;
+
+struct LightFrameRingHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;						// Bytes, a whole number of cache lines
+	int32_t lightCount;
+	int32_t lightColumns;
+	int32_t lightRows;
+	std::atomic<uint32_t> writerClosed;		// Set once nothing more will be written
+	std::atomic<uint64_t> latestFrame;		// Newest complete frame, 0 before the first
+	uint8_t padding[24];
+};
+
+struct LightFrameRingSlot
+{
+	std::atomic<uint64_t> lock;				// Odd while the slot is being written
+	uint64_t frame;
+	int64_t presentTime;					// When the oldest desktop frame behind the lights was presented, 0 if not known
+	int64_t publishTime;					// When the lights were written to the ring
+	uint8_t padding[32];
+};
+
+// A frame read in place. The values may be overwritten at any time, so check IsIntact after using them
+struct LightFrameView
+{
+	const int32_t* values;
+	int count;
+	uint64_t frame;
+	int64_t presentTime;
+	int64_t publishTime;
+	uint64_t lock;
+};
+
+// Creates the ring and writes frames into it, from one thread at a time. As a sink, it writes every set of light
+// values a LightValueBuffer publishes
+class LightFrameRingWriter : public LightValueSink
+{
+public:
+	LightFrameRingWriter();
+	~LightFrameRingWriter();
+
+	bool Create(const std::string& name, int lightColumns, int lightRows, int slotCount);
+	void Close();
+	bool IsOpen() const;
+
+	// Writes the next frame, keeping the frame number it was published with. Values past the ring's light count
+	// are left out, and any missing ones are zero
+	void Write(const int32_t* values, int count, uint64_t frame, int64_t presentTime);
+
+	virtual void WriteLights(const int32_t* values, int count, uint64_t sequence, int64_t presentTime);
+
+public:
+	// Enough for a reader to be a few frames late at 144Hz without missing any
+	static const int DefaultSlotCount = 8;
+
+private:
+	SharedMemory			m_Memory;
+	LightFrameRingHeader*	m_Header;
+};
+
+// Opens a ring another process is writing, and reads frames from it in place
+class LightFrameRingReader
+{
+public:
+	LightFrameRingReader();
+	~LightFrameRingReader();
+
+	bool Open(const std::string& name);
+	void Close();
+	bool IsOpen() const;
+
+	int GetLightCount() const;
+	int GetLightColumns() const;
+	int GetLightRows() const;
+	int GetSlotCount() const;
+
+	// Newest complete frame, or 0 if there hasn't been one
+	uint64_t GetLatestFrame() const;
+
+	// True once the writer has closed the ring, after which it won't change
+	bool IsWriterClosed() const;
+
+	// Points view at a frame. Returns false if it's not in the ring, because it's yet to be written or has been
+	// written over, or is being written right now
+	bool Read(uint64_t frame, LightFrameView* view) const;
+	bool ReadLatest(LightFrameView* view) const;
+
+	// Whether a view is still what was written, now that it's been used
+	bool IsIntact(const LightFrameView& view) const;
+
+	// Copies the newest frame out, trying again if it's written over part way. Returns false if there isn't one
+	bool CopyLatest(int32_t* values, int length, LightFrameView* view) const;
+
+private:
+	const LightFrameRingSlot* GetSlot(uint64_t frame) const;
+
+private:
+	SharedMemory				m_Memory;
+	const LightFrameRingHeader*	m_Header;
+};
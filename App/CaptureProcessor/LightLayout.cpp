@@ -0,0 +1,188 @@
+#include "LightLayout.h"
+
+#include <cstring>
+
+#include "PixelSums.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LIGHT_LAYOUT_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LIGHT_LAYOUT_TARGET_SSSE3
+#define LIGHT_LAYOUT_TARGET_AVX2
+#else
+#define LIGHT_LAYOUT_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define LIGHT_LAYOUT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+void CopySerpentineRows(const uint8_t* lightBytes, unsigned int rowPitch, int columns, int rows, int32_t* outputValues)
+{
+	const uint8_t* lightRow = lightBytes;
+	for (int rowIndex = 0; rowIndex < rows; ++rowIndex, lightRow += rowPitch, outputValues += columns)
+	{
+		if ((rowIndex % 2) == 1)
+		{
+			const int32_t* rowValues = reinterpret_cast<const int32_t*>(lightRow);
+			for (int column = 0, textureColumn = columns - 1; column < columns; ++column, --textureColumn)
+			{
+				outputValues[column] = rowValues[textureColumn];
+			}
+		}
+		else
+		{
+			std::memcpy(outputValues, lightRow, 4 * columns);
+		}
+	}
+}
+
+//
+// Reference version of PackLightsWire, in RGB order
+//
+void PackLightsRGB(const int32_t* lightValues, int lightCount, uint8_t* output)
+{
+	for (int lightIndex = 0; lightIndex < lightCount; ++lightIndex)
+	{
+		uint32_t lightValue = static_cast<uint32_t>(lightValues[lightIndex]);
+		*output++ = static_cast<uint8_t>((lightValue & 0xFF0000) >> 16);
+		*output++ = static_cast<uint8_t>((lightValue & 0xFF00) >> 8);
+		*output++ = static_cast<uint8_t>(lightValue & 0xFF);
+	}
+}
+
+//
+// Wire packing kernels. Light values are 0x00RRGGBB, so in memory each one is B, G, R, then an unused byte
+//
+static void PackLightsWireScalar(const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output)
+{
+	const int firstShift = (order == LightChannelOrderGRB) ? 8 : 16;
+	const int secondShift = (order == LightChannelOrderGRB) ? 16 : 8;
+	for (int lightIndex = 0; lightIndex < lightCount; ++lightIndex)
+	{
+		uint32_t lightValue = static_cast<uint32_t>(lightValues[lightIndex]);
+		*output++ = static_cast<uint8_t>(lightValue >> firstShift);
+		*output++ = static_cast<uint8_t>(lightValue >> secondShift);
+		*output++ = static_cast<uint8_t>(lightValue);
+	}
+}
+
+#if defined(LIGHT_LAYOUT_X86)
+// Picks the 3 channel bytes out of each of 4 lights, leaving the last 4 bytes zero
+static const int8_t WireShuffleRGB[16] = { 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 };
+static const int8_t WireShuffleGRB[16] = { 1, 2, 0, 5, 6, 4, 9, 10, 8, 13, 14, 12, -1, -1, -1, -1 };
+
+LIGHT_LAYOUT_TARGET_SSSE3 static void PackLightsWireSSSE3(const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output)
+{
+	const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>((order == LightChannelOrderGRB) ? WireShuffleGRB : WireShuffleRGB));
+
+	// Each store writes 16 bytes for 12 bytes of lights, so stop while there are still enough lights after them
+	// for the spare bytes to land on, which are then written over
+	int lightIndex = 0;
+	for (; lightIndex + 6 <= lightCount; lightIndex += 4, output += 12)
+	{
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lightValues + lightIndex));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_shuffle_epi8(values, shuffle));
+	}
+
+	PackLightsWireScalar(lightValues + lightIndex, lightCount - lightIndex, order, output);
+}
+
+LIGHT_LAYOUT_TARGET_AVX2 static void PackLightsWireAVX2(const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output)
+{
+	// Shuffles within each 128 bit lane, then moves the upper lane's 12 bytes down next to the lower lane's
+	const __m128i laneShuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>((order == LightChannelOrderGRB) ? WireShuffleGRB : WireShuffleRGB));
+	const __m256i shuffle = _mm256_broadcastsi128_si256(laneShuffle);
+	const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	// 32 byte stores for 24 bytes of lights, so the same as above with 8 spare bytes
+	int lightIndex = 0;
+	for (; lightIndex + 11 <= lightCount; lightIndex += 8, output += 24)
+	{
+		__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lightValues + lightIndex));
+		__m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(values, shuffle), compact);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(output), packed);
+	}
+
+	PackLightsWireSSSE3(lightValues + lightIndex, lightCount - lightIndex, order, output);
+}
+#endif
+
+//
+// CPU feature detection. AVX2 is detected the same way as for the pixel sums
+//
+static bool CpuSupportsSSSE3()
+{
+#if defined(LIGHT_LAYOUT_X86) && defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	return (cpuInfo[2] & (1 << 9)) != 0;
+#elif defined(LIGHT_LAYOUT_X86)
+	return __builtin_cpu_supports("ssse3") != 0;
+#else
+	return false;
+#endif
+}
+
+bool IsLightPackKernelSupported(LightPackKernel kernel)
+{
+	switch (kernel)
+	{
+	case LightPackKernelAuto:
+	case LightPackKernelScalar:
+		return true;
+
+	case LightPackKernelSSSE3:
+		return CpuSupportsSSSE3();
+
+	case LightPackKernelAVX2:
+		return CpuSupportsSSSE3() && IsPixelSumKernelSupported(PixelSumKernelAVX2);
+
+	default:
+		return false;
+	}
+}
+
+LightPackKernel ResolveLightPackKernel(LightPackKernel kernel)
+{
+	if (kernel != LightPackKernelAuto)
+	{
+		return kernel;
+	}
+
+	if (IsLightPackKernelSupported(LightPackKernelAVX2))
+	{
+		return LightPackKernelAVX2;
+	}
+	else if (IsLightPackKernelSupported(LightPackKernelSSSE3))
+	{
+		return LightPackKernelSSSE3;
+	}
+	return LightPackKernelScalar;
+}
+
+void PackLightsWire(LightPackKernel kernel, const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output)
+{
+	switch (kernel)
+	{
+#if defined(LIGHT_LAYOUT_X86)
+	case LightPackKernelAVX2:
+		PackLightsWireAVX2(lightValues, lightCount, order, output);
+		break;
+
+	case LightPackKernelSSSE3:
+		PackLightsWireSSSE3(lightValues, lightCount, order, output);
+		break;
+#endif
+
+	default:
+		PackLightsWireScalar(lightValues, lightCount, order, output);
+		break;
+	}
+}
+
+void PackLightsWire(const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output)
+{
+	static const LightPackKernel kernel = ResolveLightPackKernel(LightPackKernelAuto);
+	PackLightsWire(kernel, lightValues, lightCount, order, output);
+}
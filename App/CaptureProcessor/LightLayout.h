@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+// How light values are laid out between the light surface and the strip
+
+// Order the colour channels of each light go over the wire in
+enum LightChannelOrder
+{
+	LightChannelOrderRGB = 0,
+	LightChannelOrderGRB = 1
+};
+
+// SIMD kernels for packing light values into wire bytes
+enum LightPackKernel
+{
+	LightPackKernelAuto,
+	LightPackKernelScalar,
+	LightPackKernelSSSE3,
+	LightPackKernelAVX2
+};
+
+// Copies rows of BGRA light values to output, reversing every odd row to follow the strip as it snakes back and forth
+void CopySerpentineRows(const uint8_t* lightBytes, unsigned int rowPitch, int columns, int rows, int32_t* outputValues);
+
+// Packs light values (0x00RRGGBB) into 3 bytes per light, red first, as sent to the board
+void PackLightsRGB(const int32_t* lightValues, int lightCount, uint8_t* output);
+
+bool IsLightPackKernelSupported(LightPackKernel kernel);
+
+// Returns the best supported kernel for LightPackKernelAuto, otherwise the kernel passed in
+LightPackKernel ResolveLightPackKernel(LightPackKernel kernel);
+
+// Packs light values (0x00RRGGBB) into 3 bytes per light in the given channel order, shuffling several lights at
+// a time. Light values are already in strip order and tinted by the time they're published, so this is all that's
+// left to turn them into what goes over the wire
+void PackLightsWire(LightPackKernel kernel, const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output);
+
+// The same, with the best kernel the CPU has
+void PackLightsWire(const int32_t* lightValues, int lightCount, LightChannelOrder order, uint8_t* output);
@@ -2,6 +2,8 @@
 
 #include "LightProcessor.h"
 
+#include "LightLayout.h"
+
 #include "Vertex.h"
 
 #include "VertexShader.h"
@@ -12,6 +14,9 @@
 
 using namespace Microsoft::WRL;
 
+// Amount of each new frame blended into the light values, the rest comes from the previous frame
+static const float LightBlendFactor = 0.7f;
+
 LightProcessor::LightProcessor() : 
 	m_Device(nullptr),
 	m_Factory(nullptr),
@@ -29,7 +34,13 @@ LightProcessor::LightProcessor() :
 	m_LightSurfaceWidth(0),
 	m_LightSurfaceHeight(0),
 	m_UnexpectedErrorEvent(nullptr),
-	m_ExpectedErrorEvent(nullptr)
+	m_ExpectedErrorEvent(nullptr),
+	m_DownsampleMode(DownsampleGPU),
+	m_FullUpdate(true),
+	m_UseFrameSlots(false),
+	m_LightValues(nullptr),
+	m_LightPresentTime(0),
+	m_StagingDesktopSurface(nullptr)
 {
 	m_ColourScale[0] = m_ColourScale[1] = m_ColourScale[2] = 1.0f;
 }
@@ -39,14 +50,19 @@ LightProcessor::~LightProcessor()
 	
 }
 
-bool LightProcessor::Initialise(int singleOutput, int lightTextureWidth, int lightTextureHeight, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent)
+bool LightProcessor::Initialise(int singleOutput, int lightTextureWidth, int lightTextureHeight, LightValueBuffer* lightValues, bool useFrameSlots, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent)
 {
 	HRESULT hr;
 
 	m_ExpectedErrorEvent = expectedErrorEvent;
 	m_UnexpectedErrorEvent = unexpectedErrorEvent;
+	m_UseFrameSlots = useFrameSlots;
 
-	m_LightValues.resize(lightTextureWidth * lightTextureHeight);
+	m_LightValues = lightValues;
+	if (m_LightValues->GetCount() != lightTextureWidth * lightTextureHeight)
+	{
+		m_LightValues->Initialise(lightTextureWidth * lightTextureHeight);
+	}
 
 	// Driver types supported
 	D3D_DRIVER_TYPE driverTypes[] =
@@ -121,6 +137,12 @@ bool LightProcessor::Initialise(int singleOutput, int lightTextureWidth, int lig
 	{
 		return false;
 	}
+
+	// And somewhere for each output to hand frames over, if they're not drawing straight onto it
+	if (m_UseFrameSlots && !CreateFrameSlots())
+	{
+		return false;
+	}
 	
 	// Make new render target view
 	m_LightSurfaceWidth = lightTextureWidth;
@@ -133,6 +155,14 @@ bool LightProcessor::Initialise(int singleOutput, int lightTextureWidth, int lig
 	// Set view port
 	SetViewPort(m_LightSurfaceWidth, m_LightSurfaceHeight);
 
+	// Set up the CPU downsampler for the desktop size
+	if (!m_TileSumCache.Initialise(m_DesktopBounds.right - m_DesktopBounds.left, m_DesktopBounds.bottom - m_DesktopBounds.top, m_LightSurfaceWidth, m_LightSurfaceHeight))
+	{
+		return false;
+	}
+	m_ZoneValues.resize(m_LightSurfaceWidth * m_LightSurfaceHeight);
+	m_BlendedZoneValues.assign(m_LightSurfaceWidth * m_LightSurfaceHeight, 0);
+
 	// Create the sample state
 	D3D11_SAMPLER_DESC samplerDescription;
 	RtlZeroMemory(&samplerDescription, sizeof(samplerDescription));
@@ -205,6 +235,11 @@ void LightProcessor::SetColourScale(float r, float g, float b)
 	m_ColourScale[2] = b;
 }
 
+void LightProcessor::SetDownsampleMode(DownsampleMode mode)
+{
+	m_DownsampleMode = mode;
+}
+
 int LightProcessor::GetOutputCount() const
 {
 	return m_OutputCount;
@@ -215,20 +250,54 @@ const RECT& LightProcessor::GetDesktopBounds() const
 	return m_DesktopBounds;
 }
 
+DirtyRegion* LightProcessor::GetDirtyRegion()
+{
+	return &m_DirtyRegion;
+}
+
+int64_t LightProcessor::GetLightPresentTime() const
+{
+	return m_LightPresentTime;
+}
+
+FrameSlotExchange* LightProcessor::GetFrameSlots()
+{
+	return m_UseFrameSlots ? &m_FrameSlots : nullptr;
+}
+
+bool LightProcessor::GetFrameSlotHandles(std::vector<HANDLE>* handles)
+{
+	handles->clear();
+	for (auto &frameSlotSurface : m_FrameSlotSurfaces)
+	{
+		ComPtr<IDXGIResource> DXGIResource = nullptr;
+		HANDLE handle = nullptr;
+		HRESULT hr = frameSlotSurface.As(&DXGIResource);
+		if (FAILED(hr) || FAILED(DXGIResource->GetSharedHandle(&handle)))
+		{
+			handles->clear();
+			return false;
+		}
+		handles->push_back(handle);
+	}
+
+	return true;
+}
+
 bool LightProcessor::ProcessFrame()
 {
-	HRESULT hr = m_KeyMutex->AcquireSync(0, 100);
-	if (hr == static_cast<HRESULT>(WAIT_TIMEOUT))
+	if (!AcquireSharedSurface())
 	{
-		// Another thread has the keyed mutex so try again later
 		return false;
 	}
-	else if (FAILED(hr))
+
+	if (m_DownsampleMode == DownsampleCPU)
 	{
-		SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
-		return false;
+		return ProcessFrameCPU();
 	}
 
+	HRESULT hr;
+
 	// Set up the vertices
 	Vertex vertices[6];
 	vertices[0].Pos = DirectX::XMFLOAT3(-1, -1, 0);
@@ -261,7 +330,7 @@ bool LightProcessor::ProcessFrame()
 	hr = m_Device->CreateBuffer(&bufferDesc, &initData, &vertexBuffer);
 	if (FAILED(hr))
 	{
-		m_KeyMutex->ReleaseSync(0);
+		ReleaseSharedSurface();
 
 		SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
 		return false;
@@ -285,7 +354,7 @@ bool LightProcessor::ProcessFrame()
 	{
 		vertexBuffer = nullptr;
 
-		m_KeyMutex->ReleaseSync(0);
+		ReleaseSharedSurface();
 
 		SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
 		return false;
@@ -320,14 +389,14 @@ bool LightProcessor::ProcessFrame()
 	hr = m_Device->CreateBuffer(&constantBufferDesc, &constantBufferInitData, &constantBuffer);
 	if (FAILED(hr))
 	{
-		m_KeyMutex->ReleaseSync(0);
+		ReleaseSharedSurface();
 
 		SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
 		return false;
 	}
 
 	// Set up shader / blending states
-	FLOAT blendFactor[4] = { 0.7f, 0.7f, 0.7f, 1.0f };
+	FLOAT blendFactor[4] = { LightBlendFactor, LightBlendFactor, LightBlendFactor, 1.0f };
 	m_DeviceContext->OMSetBlendState(m_BlendState.Get(), blendFactor, 0xFFFFFFFF);
 	m_DeviceContext->OMSetRenderTargets(1, m_RTV.GetAddressOf(), nullptr);
 	m_DeviceContext->VSSetShader(m_VertexShader.Get(), nullptr, 0);
@@ -344,7 +413,7 @@ bool LightProcessor::ProcessFrame()
 	vertexBuffer = nullptr;
 	shaderResource = nullptr;
 
-	m_KeyMutex->ReleaseSync(0);
+	ReleaseSharedSurface();
 
 	// Copy the light surface to our staging surface so we can read it on the CPU
 	m_DeviceContext->CopyResource(m_StagingLightSurface.Get(), m_LightSurface.Get());
@@ -359,35 +428,195 @@ bool LightProcessor::ProcessFrame()
 		return true;
 	}
 
-	BYTE* lightBytes = (BYTE*)mappedResource.pData;
-	unsigned int rowPitch = mappedResource.RowPitch;
+	CopyLightValues((BYTE*)mappedResource.pData, mappedResource.RowPitch);
+
+	m_DeviceContext->Unmap(m_StagingLightSurface.Get(), 0);
+
+	return true;
+}
 
-	// Copy the rows to our light values (reversing every odd row)
-	BYTE* lightRow = lightBytes;
-	__int32* outputValues = &m_LightValues[0];
-	for (int rowIndex = 0; rowIndex < m_LightSurfaceHeight; ++rowIndex, lightRow += rowPitch, outputValues += m_LightSurfaceWidth)
+//
+// Gets hold of the shared surface, along with what's changed on it since we last had it.
+// With frame slots, this is where the latest frame from each output gets copied onto it
+//
+bool LightProcessor::AcquireSharedSurface()
+{
+	if (!m_UseFrameSlots)
 	{
-		if ((rowIndex % 2) == 1)
+		HRESULT hr = m_KeyMutex->AcquireSync(0, 100);
+		if (hr == static_cast<HRESULT>(WAIT_TIMEOUT))
+		{
+			// Another thread has the keyed mutex so try again later
+			return false;
+		}
+		else if (FAILED(hr))
 		{
-			for (int column = 0, textureColumn = m_LightSurfaceWidth - 1; column < m_LightSurfaceWidth; ++column, --textureColumn)
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+			return false;
+		}
+	}
+
+	// Oldest frame that's made it onto the shared surface since we last looked. Zero if nothing has changed.
+	// Duplication threads publish a frame before adding its rects, so taking these before the frames means
+	// we can't miss a change, only occasionally pick one up early
+	m_LightPresentTime = m_DirtyRegion.TakePresentTime();
+	m_FullUpdate = !m_DirtyRegion.Take(&m_UpdatedRects);
+
+	if (m_UseFrameSlots)
+	{
+		return CopyFrameSlots();
+	}
+
+	return true;
+}
+
+void LightProcessor::ReleaseSharedSurface()
+{
+	if (!m_UseFrameSlots)
+	{
+		m_KeyMutex->ReleaseSync(0);
+	}
+}
+
+//
+// Copies the latest frame from each output's slots to where the output sits on the shared surface
+//
+bool LightProcessor::CopyFrameSlots()
+{
+	bool copiedAll = true;
+	for (int output = 0; output < m_FrameSlots.GetOutputCount(); ++output)
+	{
+		int slot = 0;
+		if (m_FrameSlots.Acquire(output, &slot, nullptr, nullptr))
+		{
+			m_FrameSlotPending[output] = true;
+		}
+
+		if (!m_FrameSlotPending[output])
+		{
+			// Nothing new from this output
+			continue;
+		}
+
+		// The slot is ours until we next acquire, so this is only here to order the GPU work between devices
+		ComPtr<IDXGIKeyedMutex> frameSlotMutex = m_FrameSlotMutexes[output * FrameSlotExchange::SlotsPerOutput + slot];
+		HRESULT hr = frameSlotMutex->AcquireSync(0, 100);
+		if (hr == static_cast<HRESULT>(WAIT_TIMEOUT))
+		{
+			// Try again next time
+			copiedAll = false;
+			continue;
+		}
+		else if (FAILED(hr))
+		{
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+			return false;
+		}
+
+		const RECT& outputRect = m_OutputRects[output];
+		m_DeviceContext->CopySubresourceRegion(m_SharedSurface.Get(), 0, outputRect.left - m_DesktopBounds.left, outputRect.top - m_DesktopBounds.top, 0,
+			m_FrameSlotSurfaces[output * FrameSlotExchange::SlotsPerOutput + slot].Get(), 0, nullptr);
+
+		frameSlotMutex->ReleaseSync(0);
+		m_FrameSlotPending[output] = false;
+	}
+
+	if (!copiedAll)
+	{
+		// We've already taken the changed rects for the frames we've not copied yet
+		m_DirtyRegion.Invalidate();
+	}
+
+	return true;
+}
+
+//
+// Downsamples the shared surface on the CPU. Expects the shared surface to be held, and releases it
+//
+bool LightProcessor::ProcessFrameCPU()
+{
+	// Copy the changed parts of the top level of the shared surface to our staging surface so we can read them on the CPU
+	int desktopWidth = m_DesktopBounds.right - m_DesktopBounds.left;
+	int desktopHeight = m_DesktopBounds.bottom - m_DesktopBounds.top;
+	bool fullUpdate = m_FullUpdate;
+	if (fullUpdate)
+	{
+		// Everything needs updating
+		m_DeviceContext->CopySubresourceRegion(m_StagingDesktopSurface.Get(), 0, 0, 0, 0, m_SharedSurface.Get(), 0, nullptr);
+		m_TileSumCache.Invalidate();
+	}
+	else
+	{
+		for (auto &updatedRect : m_UpdatedRects)
+		{
+			int left = max(static_cast<int>(updatedRect.left), 0);
+			int top = max(static_cast<int>(updatedRect.top), 0);
+			int right = min(static_cast<int>(updatedRect.right), desktopWidth);
+			int bottom = min(static_cast<int>(updatedRect.bottom), desktopHeight);
+			if (left < right && top < bottom)
 			{
-				outputValues[column] = ((__int32*)lightRow)[textureColumn];
+				D3D11_BOX box;
+				box.left = left;
+				box.top = top;
+				box.front = 0;
+				box.right = right;
+				box.bottom = bottom;
+				box.back = 1;
+				m_DeviceContext->CopySubresourceRegion(m_StagingDesktopSurface.Get(), 0, box.left, box.top, 0, m_SharedSurface.Get(), 0, &box);
 			}
 		}
-		else
+	}
+
+	ReleaseSharedSurface();
+
+	// Re-sum the tiles that changed
+	if (fullUpdate || !m_UpdatedRects.empty())
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT hr = m_DeviceContext->Map(m_StagingDesktopSurface.Get(), 0, D3D11_MAP_READ, 0, &mappedResource);
+		if (FAILED(hr))
 		{
-			memcpy(outputValues, lightRow, 4 * m_LightSurfaceWidth);
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+			return false;
 		}
+
+		m_TileSumCache.Update((const uint8_t*)mappedResource.pData, mappedResource.RowPitch, m_UpdatedRects.empty() ? nullptr : &m_UpdatedRects[0], m_UpdatedRects.size());
+
+		m_DeviceContext->Unmap(m_StagingDesktopSurface.Get(), 0);
 	}
 
-	m_DeviceContext->Unmap(m_StagingLightSurface.Get(), 0);
+	m_TileSumCache.SetColourScale(m_ColourScale[0], m_ColourScale[1], m_ColourScale[2]);
+	m_TileSumCache.GetZoneValues(&m_ZoneValues[0]);
+
+	// Blend with the previous values the same as the GPU blend state does
+	size_t zoneCount = m_ZoneValues.size();
+	for (size_t zoneIndex = 0; zoneIndex < zoneCount; ++zoneIndex)
+	{
+		uint32_t newValue = m_ZoneValues[zoneIndex];
+		uint32_t oldValue = m_BlendedZoneValues[zoneIndex];
+		uint32_t blendedValue = newValue & 0xFF000000;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			float newChannel = static_cast<float>((newValue >> shift) & 0xFF);
+			float oldChannel = static_cast<float>((oldValue >> shift) & 0xFF);
+			uint32_t channel = static_cast<uint32_t>(newChannel * LightBlendFactor + oldChannel * (1.0f - LightBlendFactor) + 0.5f);
+			blendedValue |= min(channel, 255u) << shift;
+		}
+		m_BlendedZoneValues[zoneIndex] = blendedValue;
+	}
+
+	CopyLightValues((const BYTE*)&m_BlendedZoneValues[0], m_LightSurfaceWidth * 4);
 
 	return true;
 }
 
-const std::vector<__int32> LightProcessor::GetLightValues() const
+//
+// Copy the rows of the light surface to our light values (reversing every odd row), and publish them
+//
+void LightProcessor::CopyLightValues(const BYTE* lightBytes, unsigned int rowPitch)
 {
-	return m_LightValues;
+	CopySerpentineRows(lightBytes, rowPitch, m_LightSurfaceWidth, m_LightSurfaceHeight, m_LightValues->BeginWrite());
+	m_LightValues->Publish(m_LightPresentTime);
 }
 
 bool LightProcessor::CreateRenderTarget(unsigned int width, unsigned int height)
@@ -524,6 +753,7 @@ bool LightProcessor::CreateSharedSurface(int singleOutput)
 	m_DesktopBounds.bottom = INT_MIN;
 
 	ComPtr<IDXGIOutput> dxgiOutput = nullptr;
+	m_OutputRects.clear();
 
 	// Figure out right dimensions for full size desktop texture and # of outputs to duplicate
 	if (singleOutput < 0)
@@ -539,6 +769,7 @@ bool LightProcessor::CreateSharedSurface(int singleOutput)
 				dxgiOutput->GetDesc(&desktopDescription);
 				dxgiOutput = nullptr;
 
+				m_OutputRects.push_back(desktopDescription.DesktopCoordinates);
 				m_DesktopBounds.left = min(desktopDescription.DesktopCoordinates.left, m_DesktopBounds.left);
 				m_DesktopBounds.top = min(desktopDescription.DesktopCoordinates.top, m_DesktopBounds.top);
 				m_DesktopBounds.right = max(desktopDescription.DesktopCoordinates.right, m_DesktopBounds.right);
@@ -560,6 +791,7 @@ bool LightProcessor::CreateSharedSurface(int singleOutput)
 		DXGI_OUTPUT_DESC desktopDescription;
 		dxgiOutput->GetDesc(&desktopDescription);
 		m_DesktopBounds = desktopDescription.DesktopCoordinates;
+		m_OutputRects.push_back(desktopDescription.DesktopCoordinates);
 
 		if (dxgiOutput)
 		{
@@ -619,7 +851,7 @@ bool LightProcessor::CreateSharedSurface(int singleOutput)
 	stagingTextureDescription.BindFlags = 0;
 	stagingTextureDescription.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 	stagingTextureDescription.MiscFlags = 0;
-	hr = m_Device->CreateTexture2D(&stagingTextureDescription, nullptr, &m_StagingLightSurface);
+	hr = m_Device->CreateTexture2D(&stagingTextureDescription, nullptr, &m_StagingDesktopSurface);
 	if (FAILED(hr))
 	{
 		SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
@@ -628,3 +860,52 @@ bool LightProcessor::CreateSharedSurface(int singleOutput)
 
 	return true;
 }
+
+//
+// Creates the frame slots for each output to hand frames over through. Each is the size of its output,
+// with a keyed mutex so the duplication thread's device can share it
+//
+bool LightProcessor::CreateFrameSlots()
+{
+	int outputCount = static_cast<int>(m_OutputRects.size());
+	m_FrameSlots.Initialise(outputCount);
+	m_FrameSlotSurfaces.resize(outputCount * FrameSlotExchange::SlotsPerOutput);
+	m_FrameSlotMutexes.resize(outputCount * FrameSlotExchange::SlotsPerOutput);
+	m_FrameSlotPending.assign(outputCount, false);
+
+	for (int output = 0; output < outputCount; ++output)
+	{
+		D3D11_TEXTURE2D_DESC frameSlotDescription;
+		RtlZeroMemory(&frameSlotDescription, sizeof(D3D11_TEXTURE2D_DESC));
+		frameSlotDescription.Width = m_OutputRects[output].right - m_OutputRects[output].left;
+		frameSlotDescription.Height = m_OutputRects[output].bottom - m_OutputRects[output].top;
+		frameSlotDescription.MipLevels = 1;
+		frameSlotDescription.ArraySize = 1;
+		frameSlotDescription.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+		frameSlotDescription.SampleDesc.Count = 1;
+		frameSlotDescription.Usage = D3D11_USAGE_DEFAULT;
+		frameSlotDescription.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		frameSlotDescription.CPUAccessFlags = 0;
+		frameSlotDescription.MiscFlags = D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX;
+
+		for (int slot = 0; slot < FrameSlotExchange::SlotsPerOutput; ++slot)
+		{
+			int slotIndex = output * FrameSlotExchange::SlotsPerOutput + slot;
+			HRESULT hr = m_Device->CreateTexture2D(&frameSlotDescription, nullptr, &m_FrameSlotSurfaces[slotIndex]);
+			if (FAILED(hr))
+			{
+				SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+				return false;
+			}
+
+			hr = m_FrameSlotSurfaces[slotIndex].As(&m_FrameSlotMutexes[slotIndex]);
+			if (FAILED(hr))
+			{
+				SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, m_ExpectedErrorEvent, m_UnexpectedErrorEvent);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
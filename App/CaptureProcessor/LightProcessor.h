@@ -2,32 +2,61 @@
 
 #include <vector>
 
+#include "DirtyRegion.h"
+#include "FrameSlotExchange.h"
+#include "LightValueBuffer.h"
+#include "TileSumCache.h"
+
 // Creates and processes the shared surface to extract light values
 class LightProcessor
 {
+public:
+	// How the shared surface is reduced down to light values
+	enum DownsampleMode
+	{
+		DownsampleGPU,
+		DownsampleCPU
+	};
+
 public:
 	LightProcessor();
 	~LightProcessor();
 
-	bool Initialise(int singleOutput, int lightTextureWidth, int lightTextureHeight, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent);
+	bool Initialise(int singleOutput, int lightTextureWidth, int lightTextureHeight, LightValueBuffer* lightValues, bool useFrameSlots, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent);
 	HANDLE GetSharedSurfaceHandle();
 
 	void SetColourScale(float r, float g, float b);
+	void SetDownsampleMode(DownsampleMode mode);
 	int GetOutputCount() const;
 	const RECT& GetDesktopBounds() const;
+	DirtyRegion* GetDirtyRegion();
 
-	bool ProcessFrame();
+	// Per output frame slots the duplication threads hand frames over through, or null if they share one surface.
+	// There are FrameSlotExchange::SlotsPerOutput handles for each output, one output after another
+	FrameSlotExchange* GetFrameSlots();
+	bool GetFrameSlotHandles(std::vector<HANDLE>* handles);
 
-	const std::vector<__int32> GetLightValues() const;
+	// Present time (microseconds) of the oldest frame that went into the last light values, or 0 if none did
+	int64_t GetLightPresentTime() const;
+
+	bool ProcessFrame();
 
 private:
 	bool CreateRenderTarget(unsigned int width, unsigned int height);
 	void SetViewPort(unsigned int width, unsigned int height);
 	bool InitShaders();
 	bool CreateSharedSurface(int singleOutput);
+	bool CreateFrameSlots();
+	bool AcquireSharedSurface();
+	void ReleaseSharedSurface();
+	bool CopyFrameSlots();
+	bool ProcessFrameCPU();
+	void CopyLightValues(const BYTE* lightBytes, unsigned int rowPitch);
 
 private:
-	std::vector<__int32>	m_LightValues;
+	// Where we publish light values to. Set up by whoever owns it
+	LightValueBuffer*		m_LightValues;
+	int64_t					m_LightPresentTime;
 
 	int						m_OutputCount;
 	RECT					m_DesktopBounds;
@@ -58,4 +87,25 @@ private:
 
 	// Mutex for accessing the shared surface
 	Microsoft::WRL::ComPtr<IDXGIKeyedMutex>		m_KeyMutex;
+
+	// Where each output sits on the shared surface, in desktop coordinates
+	std::vector<RECT>		m_OutputRects;
+
+	// Per output frame slots. When in use, only we touch the shared surface, and the duplication
+	// threads never wait on us or each other
+	bool					m_UseFrameSlots;
+	FrameSlotExchange		m_FrameSlots;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Texture2D>>	m_FrameSlotSurfaces;
+	std::vector<Microsoft::WRL::ComPtr<IDXGIKeyedMutex>>	m_FrameSlotMutexes;
+	std::vector<bool>		m_FrameSlotPending;
+
+	// Resources for downsampling on the CPU
+	DownsampleMode			m_DownsampleMode;
+	DirtyRegion				m_DirtyRegion;
+	TileSumCache			m_TileSumCache;
+	std::vector<FrameRect>	m_UpdatedRects;
+	bool					m_FullUpdate;
+	std::vector<uint32_t>	m_ZoneValues;
+	std::vector<uint32_t>	m_BlendedZoneValues;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D>		m_StagingDesktopSurface;
 };
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "LightProtocol.h"
+
+//
+// Builds the table for LightFrameCrc, the CRC of each possible top byte
+//
+static std::vector<uint16_t> MakeLightFrameCrcTable()
+{
+	std::vector<uint16_t> table(256);
+	for (int value = 0; value < 256; ++value)
+	{
+		uint16_t crc = static_cast<uint16_t>(value << 8);
+		for (int bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+		}
+		table[value] = crc;
+	}
+	return table;
+}
+
+uint16_t LightFrameCrc(const uint8_t* data, size_t length, uint16_t crc)
+{
+	// A byte at a time from a table, as a bit at a time is far too slow for whole frames
+	static const std::vector<uint16_t> table = MakeLightFrameCrcTable();
+	for (size_t index = 0; index < length; ++index)
+	{
+		crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[index]]);
+	}
+	return crc;
+}
+
+//
+// Makes room for a frame at the end of output and fills in its header. Returns where the frame starts
+//
+static size_t AddLightFrame(uint8_t type, uint8_t sequence, size_t payloadLength, std::vector<uint8_t>* output)
+{
+	size_t frameStart = output->size();
+	output->resize(frameStart + LightFrameOverhead + payloadLength);
+	uint8_t* frame = &(*output)[frameStart];
+
+	frame[0] = LightFrameSync0;
+	frame[1] = LightFrameSync1;
+	frame[2] = type;
+	frame[3] = sequence;
+	frame[4] = static_cast<uint8_t>(payloadLength);
+	frame[5] = static_cast<uint8_t>(payloadLength >> 8);
+	return frameStart;
+}
+
+//
+// Fills in the CRC of the last frame in output, once its payload is in place
+//
+static void FinishLightFrame(size_t frameStart, std::vector<uint8_t>* output)
+{
+	uint8_t* frame = &(*output)[frameStart];
+	size_t crcOffset = output->size() - frameStart - LightFrameCrcSize;
+
+	// The sync bytes aren't covered, as the parser has already matched them
+	uint16_t crc = LightFrameCrc(frame + 2, crcOffset - 2);
+	frame[crcOffset] = static_cast<uint8_t>(crc);
+	frame[crcOffset + 1] = static_cast<uint8_t>(crc >> 8);
+}
+
+void AppendLightFrame(uint8_t type, uint8_t sequence, const uint8_t* payload, size_t payloadLength, std::vector<uint8_t>* output)
+{
+	size_t frameStart = AddLightFrame(type, sequence, payloadLength, output);
+	uint8_t* framePayload = &(*output)[frameStart + LightFrameHeaderSize];
+	for (size_t index = 0; index < payloadLength; ++index)
+	{
+		framePayload[index] = payload[index];
+	}
+	FinishLightFrame(frameStart, output);
+}
+
+void AppendLightFrameChunk(uint8_t type, uint8_t sequence, const uint8_t* payload, size_t offset, size_t length, size_t payloadLength, std::vector<uint8_t>* output)
+{
+	LightFrameChunk chunk;
+	chunk.type = type;
+	chunk.offset = static_cast<uint32_t>(offset);
+	chunk.totalLength = static_cast<uint32_t>(payloadLength);
+
+	size_t frameStart = AddLightFrame(LightFrameTypeChunk, sequence, LightFrameChunkHeaderSize + length, output);
+	uint8_t* framePayload = &(*output)[frameStart + LightFrameHeaderSize];
+	WriteLightFrameChunk(chunk, framePayload);
+	for (size_t index = 0; index < length; ++index)
+	{
+		framePayload[LightFrameChunkHeaderSize + index] = payload[offset + index];
+	}
+	FinishLightFrame(frameStart, output);
+}
+
+void WriteLightFrameChunk(const LightFrameChunk& chunk, uint8_t* output)
+{
+	output[0] = chunk.type;
+	output[1] = static_cast<uint8_t>(chunk.offset);
+	output[2] = static_cast<uint8_t>(chunk.offset >> 8);
+	output[3] = static_cast<uint8_t>(chunk.offset >> 16);
+	output[4] = static_cast<uint8_t>(chunk.totalLength);
+	output[5] = static_cast<uint8_t>(chunk.totalLength >> 8);
+	output[6] = static_cast<uint8_t>(chunk.totalLength >> 16);
+}
+
+void ReadLightFrameChunk(const uint8_t* input, LightFrameChunk* chunk)
+{
+	chunk->type = input[0];
+	chunk->offset = input[1] | (input[2] << 8) | (static_cast<uint32_t>(input[3]) << 16);
+	chunk->totalLength = input[4] | (input[5] << 8) | (static_cast<uint32_t>(input[6]) << 16);
+}
+
+void WriteLightProtocolCapabilities(const LightProtocolCapabilities& capabilities, uint8_t* output)
+{
+	output[0] = capabilities.version;
+	output[1] = static_cast<uint8_t>(capabilities.features);
+	output[2] = static_cast<uint8_t>(capabilities.features >> 8);
+	output[3] = capabilities.window;
+	output[4] = static_cast<uint8_t>(capabilities.maxLights);
+	output[5] = static_cast<uint8_t>(capabilities.maxLights >> 8);
+	output[6] = capabilities.linkRates;
+}
+
+void ReadLightProtocolCapabilities(const uint8_t* input, LightProtocolCapabilities* capabilities)
+{
+	capabilities->version = input[0];
+	capabilities->features = static_cast<uint16_t>(input[1] | (input[2] << 8));
+	capabilities->window = input[3];
+	capabilities->maxLights = static_cast<uint16_t>(input[4] | (input[5] << 8));
+	capabilities->linkRates = input[6];
+}
+
+void MakeLightLinkTest(uint8_t* output)
+{
+	for (int index = 0; index < LightLinkTestPatternLength; ++index)
+	{
+		output[index] = static_cast<uint8_t>(index * 0x4B + 0xA5);
+	}
+
+	uint16_t crc = LightFrameCrc(output, LightLinkTestPatternLength);
+	output[LightLinkTestPatternLength] = static_cast<uint8_t>(crc);
+	output[LightLinkTestPatternLength + 1] = static_cast<uint8_t>(crc >> 8);
+}
+
+LightFrameParser::LightFrameParser() :
+	m_State(StateSync0),
+	m_HeaderLength(0),
+	m_PayloadLength(0),
+	m_PayloadReceived(0),
+	m_MaxPayloadLength(0),
+	m_CrcReceived(0),
+	m_GoodFrames(0),
+	m_CorruptFrames(0)
+{
+}
+
+void LightFrameParser::Initialise(size_t maxPayloadLength)
+{
+	m_MaxPayloadLength = maxPayloadLength;
+	m_Payload.resize(maxPayloadLength);
+	m_GoodFrames = 0;
+	m_CorruptFrames = 0;
+	Reset();
+}
+
+void LightFrameParser::Reset()
+{
+	m_State = StateSync0;
+	m_HeaderLength = 0;
+	m_PayloadLength = 0;
+	m_PayloadReceived = 0;
+	m_CrcReceived = 0;
+}
+
+bool LightFrameParser::Feed(uint8_t value)
+{
+	switch (m_State)
+	{
+	case StateSync0:
+		if (value == LightFrameSync0)
+		{
+			m_State = StateSync1;
+		}
+		break;
+
+	case StateSync1:
+		if (value == LightFrameSync1)
+		{
+			m_Header[0] = LightFrameSync0;
+			m_Header[1] = LightFrameSync1;
+			m_HeaderLength = 2;
+			m_State = StateHeader;
+		}
+		else if (value != LightFrameSync0)
+		{
+			m_State = StateSync0;
+		}
+		break;
+
+	case StateHeader:
+		m_Header[m_HeaderLength++] = value;
+		if (m_HeaderLength == LightFrameHeaderSize)
+		{
+			m_PayloadLength = m_Header[4] | (m_Header[5] << 8);
+			m_PayloadReceived = 0;
+			m_CrcReceived = 0;
+			if (m_PayloadLength > m_MaxPayloadLength)
+			{
+				// Can't be one of ours, so it was a false sync or a corrupt length
+				++m_CorruptFrames;
+				m_State = StateSync0;
+			}
+			else
+			{
+				m_State = (m_PayloadLength > 0) ? StatePayload : StateCrc;
+			}
+		}
+		break;
+
+	case StatePayload:
+		m_Payload[m_PayloadReceived++] = value;
+		if (m_PayloadReceived == m_PayloadLength)
+		{
+			m_State = StateCrc;
+		}
+		break;
+
+	case StateCrc:
+		m_Crc[m_CrcReceived++] = value;
+		if (m_CrcReceived == LightFrameCrcSize)
+		{
+			m_State = StateSync0;
+
+			uint16_t crc = LightFrameCrc(m_Header + 2, LightFrameHeaderSize - 2);
+			crc = LightFrameCrc(m_Payload.data(), m_PayloadLength, crc);
+			if (crc == (m_Crc[0] | (m_Crc[1] << 8)))
+			{
+				++m_GoodFrames;
+				return true;
+			}
+			++m_CorruptFrames;
+		}
+		break;
+	}
+
+	return false;
+}
+
+bool LightFrameParser::IsInFrame() const
+{
+	return m_State != StateSync0;
+}
+
+uint8_t LightFrameParser::GetType() const
+{
+	return m_Header[2];
+}
+
+uint8_t LightFrameParser::GetSequence() const
+{
+	return m_Header[3];
+}
+
+const uint8_t* LightFrameParser::GetPayload() const
+{
+	return m_Payload.data();
+}
+
+size_t LightFrameParser::GetPayloadLength() const
+{
+	return m_PayloadLength;
+}
+
+uint64_t LightFrameParser::GetGoodFrames() const
+{
+	return m_GoodFrames;
+}
+
+uint64_t LightFrameParser::GetCorruptFrames() const
+{
+	return m_CorruptFrames;
+}
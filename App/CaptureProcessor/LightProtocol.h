@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The framed light protocol, shared by the serial transport and anything standing in for the board.
+//
+// After the board has its config, the host asks what it can do with 'P'. A board that knows the framed protocol
+// replies 'P', a length byte and its capabilities; older boards ignore it. The host then picks features with
+// 'M' and two bytes of feature flags, which the board echoes back. Once framed, light data goes as frames:
+//   0xA5 0x5A, type, sequence, payload length (2 bytes), payload, CRC-16 of type to payload (2 bytes)
+// with multi-byte values little endian. The board shows each good frame then replies 'S' and its sequence.
+// It drops frames that fail their CRC or can't be applied, replying 'N' and the sequence it got, so the host
+// can send a keyframe straight away. The host keeps up to the board's window of frames in flight.
+// Single byte 'K' and 'D' carry on working between frames.
+//
+// With the link rate feature, the host then tries raising the baud rate, fastest first. It sends 'B' and a rate
+// code (an index into LightLinkRates), and the board echoes them before switching, or echoes code 0 if it won't.
+// At the new rate the host sends 'T' and the link test (see MakeLightLinkTest), the board checks it and sends
+// the same back, and the host confirms with 'Y'. Either end that doesn't get what it expects in time goes back
+// to the original rate on its own, and the host tries the next rate down once the board will have done the same.
+//
+// The config only has a byte for each dimension, so with the large layout feature the host follows 'M' with 'G'
+// and the columns and rows as 2 bytes each. The board replies 'G' and the number of lights it'll now show, or
+// 0 if it can't take that many. Frames with more than LightFrameChunkLength bytes of payload are then split
+// into chunk frames with the same sequence, each with its own CRC. The board only answers the last one, and
+// drops the whole frame with 'N' if any chunk is corrupt or missing.
+//
+// With the sync show feature, the board holds each good frame rather than showing it, still replying 'S'. It
+// shows the frame when the host sends 'W' and that frame's sequence, so several boards can show together
+
+static const uint8_t LightFrameSync0 = 0xA5;
+static const uint8_t LightFrameSync1 = 0x5A;
+
+static const int LightFrameHeaderSize = 6;
+static const int LightFrameCrcSize = 2;
+static const int LightFrameOverhead = LightFrameHeaderSize + LightFrameCrcSize;
+
+static const uint8_t LightProtocolVersion = 1;
+
+enum LightFrameType
+{
+	LightFrameTypeLights = 'L',		// 3 bytes per light, red first
+	LightFrameTypeKeyframe = 'K',	// Run-length coded lights (see LightFrameCodec.h)
+	LightFrameTypeDelta = 'D',		// Changes since an earlier frame (see LightFrameCodec.h)
+	LightFrameTypeRGB565 = '5',		// 2 bytes per light (see LightColourFormat.h)
+	LightFrameTypeRGB444 = '4',		// 12 bits per light (see LightColourFormat.h)
+	LightFrameTypeChunk = 'C'		// Part of a bigger frame (see LightFrameChunk)
+};
+
+// Feature flags, as offered by the board and picked by the host
+enum LightProtocolFeature
+{
+	LightProtocolFeatureFramed = 0x0001,
+	LightProtocolFeatureDelta = 0x0002,		// Keyframes and delta frames as well as plain light frames. Needs framing
+	LightProtocolFeatureRGB565 = 0x0004,	// Reduced colour frames. Needs framing, and if both are on the host uses RGB444
+	LightProtocolFeatureRGB444 = 0x0008,
+	LightProtocolFeatureLinkRate = 0x0010,	// Faster baud rates, out of those in the board's capabilities. Needs framing
+	LightProtocolFeatureLargeLayout = 0x0020,	// 2 byte dimensions with 'G', and chunked frames. Needs framing
+	LightProtocolFeatureSyncShow = 0x0040,		// Frames are held until 'W'. Needs framing
+	LightProtocolFeatureInterpolate = 0x0080,	// The board blends towards each frame at its own rate, so they're sent less often. Needs framing
+	LightProtocolFeatureScheduled = 0x0100		// Frames say when to show them by the board's clock, read with 'Q', and wait in a queue till then. Needs framing
+};
+
+// Everything the host side knows how to use
+static const uint16_t LightProtocolHostFeatures = LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureRGB565 | LightProtocolFeatureRGB444 |
+	LightProtocolFeatureLinkRate | LightProtocolFeatureLargeLayout | LightProtocolFeatureSyncShow | LightProtocolFeatureInterpolate |
+	LightProtocolFeatureScheduled;
+
+// What the host uses unless told otherwise. Reduced colour loses precision, so has to be asked for, held
+// frames are only any use to something sending 'W', and interpolated and scheduled frames show up later than they could
+static const uint16_t LightProtocolDefaultFeatures = LightProtocolFeatureFramed | LightProtocolFeatureDelta | LightProtocolFeatureLinkRate |
+	LightProtocolFeatureLargeLayout;
+
+// Baud rates by their code in 'B'. Every board starts at the first
+static const int LightLinkRateCount = 4;
+static const int LightLinkRates[LightLinkRateCount] = { 288000, 500000, 1000000, 2000000 };
+
+// The link test is a fixed pattern followed by its CRC
+static const int LightLinkTestPatternLength = 64;
+static const int LightLinkTestSize = LightLinkTestPatternLength + 2;
+
+struct LightProtocolCapabilities
+{
+	uint8_t version;
+	uint16_t features;
+	uint8_t window;					// Frames the board can have in flight before it acknowledges one
+	uint16_t maxLights;
+	uint8_t linkRates;				// Bit n set if the board can switch to LightLinkRates[n]
+};
+
+// Size of the capabilities after the 'P' and length byte
+static const int LightProtocolCapabilitiesSize = 7;
+
+// With the large layout feature, the most lights and the most payload sent in one frame before it's chunked
+static const int LightLayoutMaxLights = 65535;
+static const int LightFrameChunkLength = 1024;
+
+// A chunk frame's payload starts with which part of the whole frame's payload it holds, followed by that part
+struct LightFrameChunk
+{
+	uint8_t type;					// Of the whole frame
+	uint32_t offset;				// 3 bytes
+	uint32_t totalLength;			// 3 bytes, the whole frame's payload length
+};
+
+static const int LightFrameChunkHeaderSize = 7;
+
+// CRC-16/CCITT-FALSE. Pass the previous result back in to carry on over more data
+uint16_t LightFrameCrc(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+// Appends a whole frame to output
+void AppendLightFrame(uint8_t type, uint8_t sequence, const uint8_t* payload, size_t payloadLength, std::vector<uint8_t>* output);
+
+// Appends a chunk frame holding length bytes of payload from offset on
+void AppendLightFrameChunk(uint8_t type, uint8_t sequence, const uint8_t* payload, size_t offset, size_t length, size_t payloadLength, std::vector<uint8_t>* output);
+
+void WriteLightFrameChunk(const LightFrameChunk& chunk, uint8_t* output);
+void ReadLightFrameChunk(const uint8_t* input, LightFrameChunk* chunk);
+
+void WriteLightProtocolCapabilities(const LightProtocolCapabilities& capabilities, uint8_t* output);
+void ReadLightProtocolCapabilities(const uint8_t* input, LightProtocolCapabilities* capabilities);
+
+// Fills output with the LightLinkTestSize bytes of the link test. Each bit of a byte is set and clear somewhere
+// in the pattern, and no two bytes of it are the same
+void MakeLightLinkTest(uint8_t* output);
+
+// Picks frames out of a byte stream, skipping anything between them and dropping frames that fail their CRC
+class LightFrameParser
+{
+public:
+	LightFrameParser();
+
+	void Initialise(size_t maxPayloadLength);
+	void Reset();
+
+	// Feeds in one byte. Returns true when it completes a good frame, which stays valid until the next call
+	bool Feed(uint8_t value);
+
+	// Returns true if a frame is partly through
+	bool IsInFrame() const;
+
+	uint8_t GetType() const;
+	uint8_t GetSequence() const;
+	const uint8_t* GetPayload() const;
+	size_t GetPayloadLength() const;
+
+	uint64_t GetGoodFrames() const;
+	uint64_t GetCorruptFrames() const;
+
+private:
+	enum State
+	{
+		StateSync0,
+		StateSync1,
+		StateHeader,
+		StatePayload,
+		StateCrc
+	};
+
+private:
+	State					m_State;
+	uint8_t					m_Header[LightFrameHeaderSize];
+	size_t					m_HeaderLength;
+	std::vector<uint8_t>	m_Payload;
+	size_t					m_PayloadLength;
+	size_t					m_PayloadReceived;
+	size_t					m_MaxPayloadLength;
+	uint8_t					m_Crc[LightFrameCrcSize];
+	size_t					m_CrcReceived;
+
+	uint64_t				m_GoodFrames;
+	uint64_t				m_CorruptFrames;
+};
@@ -0,0 +1,88 @@
+#include "LightValueBuffer.h"
+
+#include <algorithm>
+
+LightValueBuffer::LightValueBuffer() :
+	m_Count(0),
+	m_WriteIndex(0),
+	m_Sequence(0),
+	m_ReadIndex(1),
+	m_SharedIndex(2)
+{
+	Initialise(0);
+}
+
+void LightValueBuffer::Initialise(int count)
+{
+	m_Count = (count > 0) ? count : 0;
+	for (unsigned int slotIndex = 0; slotIndex < SlotCount; ++slotIndex)
+	{
+		m_Slots[slotIndex].values.assign(m_Count, 0);
+		m_Slots[slotIndex].sequence = 0;
+		m_Slots[slotIndex].presentTime = 0;
+	}
+
+	m_WriteIndex = 0;
+	m_Sequence = 0;
+	m_ReadIndex = 1;
+	m_SharedIndex.store(2, std::memory_order_release);
+}
+
+int LightValueBuffer::GetCount() const
+{
+	return m_Count;
+}
+
+int32_t* LightValueBuffer::BeginWrite()
+{
+	return m_Count ? &m_Slots[m_WriteIndex].values[0] : nullptr;
+}
+
+void LightValueBuffer::Publish(int64_t presentTime)
+{
+	Slot& slot = m_Slots[m_WriteIndex];
+	slot.sequence = ++m_Sequence;
+	slot.presentTime = presentTime;
+	if (m_Count)
+	{
+		for (LightValueSink* sink : m_Sinks)
+		{
+			sink->WriteLights(&slot.values[0], m_Count, slot.sequence, presentTime);
+		}
+	}
+
+	// Hand the filled slot over, and take back whichever one was in the middle.
+	// Release so the reader sees the values, acquire so we don't write over a slot it's still reading
+	unsigned int previous = m_SharedIndex.exchange(m_WriteIndex | FreshFlag, std::memory_order_acq_rel);
+	m_WriteIndex = previous & IndexMask;
+}
+
+void LightValueBuffer::AddSink(LightValueSink* sink)
+{
+	if (std::find(m_Sinks.begin(), m_Sinks.end(), sink) == m_Sinks.end())
+	{
+		m_Sinks.push_back(sink);
+	}
+}
+
+void LightValueBuffer::RemoveSink(LightValueSink* sink)
+{
+	m_Sinks.erase(std::remove(m_Sinks.begin(), m_Sinks.end(), sink), m_Sinks.end());
+}
+
+bool LightValueBuffer::Acquire(LightValueSnapshot* snapshot)
+{
+	bool fresh = (m_SharedIndex.load(std::memory_order_relaxed) & FreshFlag) != 0;
+	if (fresh)
+	{
+		unsigned int previous = m_SharedIndex.exchange(m_ReadIndex, std::memory_order_acq_rel);
+		m_ReadIndex = previous & IndexMask;
+	}
+
+	const Slot& slot = m_Slots[m_ReadIndex];
+	snapshot->values = m_Count ? &slot.values[0] : nullptr;
+	snapshot->count = m_Count;
+	snapshot->sequence = slot.sequence;
+	snapshot->presentTime = slot.presentTime;
+	return fresh;
+}
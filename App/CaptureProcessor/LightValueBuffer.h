@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// A read only view of one published set of light values
+struct LightValueSnapshot
+{
+	const int32_t* values;
+	int count;
+
+	// Increases by one for every set published. Zero until the first one
+	uint64_t sequence;
+
+	// Present time (microseconds) of the oldest frame behind the values, or 0 if not known
+	int64_t presentTime;
+};
+
+// Something that gets every set of light values as it's published, on the writer's thread, such as a ring other
+// processes read. It mustn't hold the writer up
+class LightValueSink
+{
+public:
+	virtual ~LightValueSink() {}
+
+	virtual void WriteLights(const int32_t* values, int count, uint64_t sequence, int64_t presentTime) = 0;
+};
+
+// Triple buffered light values, passed from one writer to one reader without locks or copies.
+// The writer fills in the back buffer and publishes it; the reader picks up the latest published
+// buffer, which then stays untouched until the reader asks for another one. Neither side ever waits
+// on the other, and if the writer publishes more than once in between, the reader only sees the latest
+class LightValueBuffer
+{
+public:
+	LightValueBuffer();
+
+	// Sizes the buffers and clears everything. Not safe while either side is using the buffer
+	void Initialise(int count);
+
+	int GetCount() const;
+
+	// Writer side. Fill in all the values returned by BeginWrite, then publish them
+	int32_t* BeginWrite();
+	void Publish(int64_t presentTime);
+
+	// Hands every set published to a sink as well. Writer side only
+	void AddSink(LightValueSink* sink);
+	void RemoveSink(LightValueSink* sink);
+
+	// Reader side. Points snapshot at the latest published values, which stay valid until the next call.
+	// Returns true if they're newer than the last ones picked up
+	bool Acquire(LightValueSnapshot* snapshot);
+
+private:
+	struct Slot
+	{
+		std::vector<int32_t>	values;
+		uint64_t				sequence;
+		int64_t					presentTime;
+	};
+
+	static const unsigned int SlotCount = 3;
+
+	// Set on the shared index when it holds values the reader hasn't picked up yet
+	static const unsigned int FreshFlag = 0x4;
+	static const unsigned int IndexMask = 0x3;
+
+	Slot						m_Slots[SlotCount];
+	int							m_Count;
+
+	// Slot the writer can fill (writer only)
+	unsigned int				m_WriteIndex;
+	uint64_t					m_Sequence;
+	std::vector<LightValueSink*> m_Sinks;
+
+	// Slot the reader is looking at (reader only)
+	unsigned int				m_ReadIndex;
+
+	// The slot in between, swapped with by both sides
+	std::atomic<unsigned int>	m_SharedIndex;
+};
@@ -0,0 +1,259 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+//
+// Paths are UTF-8 everywhere, so convert for the wide Win32 calls
+//
+static std::wstring WidenPath(const std::string& path)
+{
+	int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	if (length <= 0)
+	{
+		return std::wstring();
+	}
+
+	std::wstring widePath(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+	widePath.resize(length - 1);
+	return widePath;
+}
+#endif
+
+MappedFile::MappedFile() :
+#if defined(_WIN32)
+	m_File(INVALID_HANDLE_VALUE),
+	m_Mapping(nullptr),
+#else
+	m_File(-1),
+#endif
+	m_Writable(false),
+	m_Data(nullptr),
+	m_Size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::OpenRead(const std::string& path)
+{
+	Close();
+
+#if defined(_WIN32)
+	m_File = CreateFileW(WidenPath(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_File, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	m_Size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+	m_File = open(path.c_str(), O_RDONLY);
+	if (m_File < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(m_File, &fileStat) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_Size = static_cast<uint64_t>(fileStat.st_size);
+#endif
+
+	m_Writable = false;
+	if (!Map())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::OpenWrite(const std::string& path, uint64_t initialSize)
+{
+	Close();
+
+#if defined(_WIN32)
+	m_File = CreateFileW(WidenPath(path).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+#else
+	m_File = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_File < 0)
+	{
+		return false;
+	}
+#endif
+
+	m_Writable = true;
+	if (!Resize(initialSize))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::Resize(uint64_t size)
+{
+	if (!IsOpen() || !m_Writable)
+	{
+		return false;
+	}
+
+	Unmap();
+
+#if defined(_WIN32)
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(m_File, fileSize, nullptr, FILE_BEGIN) || !SetEndOfFile(m_File))
+	{
+		return false;
+	}
+#else
+	if (ftruncate(m_File, static_cast<off_t>(size)) != 0)
+	{
+		return false;
+	}
+#endif
+
+	m_Size = size;
+	return Map();
+}
+
+void MappedFile::Close(uint64_t finalSize)
+{
+	if (IsOpen() && m_Writable && finalSize != m_Size)
+	{
+		Resize(finalSize);
+	}
+
+	Close();
+}
+
+void MappedFile::Close()
+{
+	Unmap();
+
+#if defined(_WIN32)
+	if (m_File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_File);
+		m_File = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_File >= 0)
+	{
+		close(m_File);
+		m_File = -1;
+	}
+#endif
+
+	m_Writable = false;
+	m_Size = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+#if defined(_WIN32)
+	return m_File != INVALID_HANDLE_VALUE;
+#else
+	return m_File >= 0;
+#endif
+}
+
+bool MappedFile::IsWritable() const
+{
+	return m_Writable;
+}
+
+uint8_t* MappedFile::GetData() const
+{
+	return m_Data;
+}
+
+uint64_t MappedFile::GetSize() const
+{
+	return m_Size;
+}
+
+bool MappedFile::Map()
+{
+	// Empty files can't be mapped, but there's nothing to access either
+	if (m_Size == 0)
+	{
+		return true;
+	}
+
+#if defined(_WIN32)
+	m_Mapping = CreateFileMappingW(m_File, nullptr, m_Writable ? PAGE_READWRITE : PAGE_READONLY, static_cast<DWORD>(m_Size >> 32), static_cast<DWORD>(m_Size), nullptr);
+	if (!m_Mapping)
+	{
+		return false;
+	}
+
+	m_Data = static_cast<uint8_t*>(MapViewOfFile(m_Mapping, m_Writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+	if (!m_Data)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+		return false;
+	}
+#else
+	void* data = mmap(nullptr, static_cast<size_t>(m_Size), m_Writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_File, 0);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+	m_Data = static_cast<uint8_t*>(data);
+#endif
+
+	return true;
+}
+
+void MappedFile::Unmap()
+{
+#if defined(_WIN32)
+	if (m_Data)
+	{
+		UnmapViewOfFile(m_Data);
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+#else
+	if (m_Data)
+	{
+		munmap(m_Data, static_cast<size_t>(m_Size));
+	}
+#endif
+
+	m_Data = nullptr;
+}
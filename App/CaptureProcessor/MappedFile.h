@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// A file mapped into memory, using file mappings on Windows and mmap everywhere else.
+// Writable files can be grown (which may move the mapping) and are truncated to the
+// requested size when closed
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Opens an existing file read only
+	bool OpenRead(const std::string& path);
+
+	// Creates (or replaces) a file to write to
+	bool OpenWrite(const std::string& path, uint64_t initialSize);
+
+	// Grows or shrinks a writable file. Pointers from GetData are invalid afterwards
+	bool Resize(uint64_t size);
+
+	// Closes the file, truncating a writable one to finalSize
+	void Close(uint64_t finalSize);
+	void Close();
+
+	bool IsOpen() const;
+	bool IsWritable() const;
+	uint8_t* GetData() const;
+	uint64_t GetSize() const;
+
+private:
+	bool Map();
+	void Unmap();
+
+private:
+#if defined(_WIN32)
+	void*			m_File;
+	void*			m_Mapping;
+#else
+	int				m_File;
+#endif
+	bool			m_Writable;
+	uint8_t*		m_Data;
+	uint64_t		m_Size;
+};
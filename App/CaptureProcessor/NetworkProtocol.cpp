@@ -0,0 +1,433 @@
+#include "NetworkProtocol.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "LightLayout.h"
+
+static const uint8_t E131PacketIdentifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+static const uint32_t E131RootVectorData = 0x00000004;
+static const uint32_t E131RootVectorExtended = 0x00000008;
+static const uint32_t E131FramingVectorData = 0x00000002;
+static const uint32_t E131FramingVectorSync = 0x00000001;
+static const uint8_t E131DmpVectorSetProperty = 0x02;
+static const uint8_t E131DmpAddressType = 0xA1;
+
+static void WriteUInt16(uint16_t value, uint8_t* output)
+{
+	output[0] = static_cast<uint8_t>(value >> 8);
+	output[1] = static_cast<uint8_t>(value);
+}
+
+static void WriteUInt32(uint32_t value, uint8_t* output)
+{
+	output[0] = static_cast<uint8_t>(value >> 24);
+	output[1] = static_cast<uint8_t>(value >> 16);
+	output[2] = static_cast<uint8_t>(value >> 8);
+	output[3] = static_cast<uint8_t>(value);
+}
+
+static uint16_t ReadUInt16(const uint8_t* input)
+{
+	return static_cast<uint16_t>((input[0] << 8) | input[1]);
+}
+
+static uint32_t ReadUInt32(const uint8_t* input)
+{
+	return (static_cast<uint32_t>(input[0]) << 24) | (input[1] << 16) | (input[2] << 8) | input[3];
+}
+
+//
+// An ACN PDU's flags and length, where the length runs from the PDU's start to the end of the packet
+//
+static void WriteE131FlagsAndLength(size_t pduLength, uint8_t* output)
+{
+	WriteUInt16(static_cast<uint16_t>(0x7000 | pduLength), output);
+}
+
+static bool CheckE131FlagsAndLength(const uint8_t* input, size_t pduLength)
+{
+	return ReadUInt16(input) == (0x7000 | pduLength);
+}
+
+//
+// The root layer shared by every E1.31 packet, up to the framing layer at byte 38
+//
+static void WriteE131RootLayer(const E131Source& source, uint32_t vector, size_t packetLength, uint8_t* output)
+{
+	WriteUInt16(0x0010, output);
+	WriteUInt16(0x0000, output + 2);
+	memcpy(output + 4, E131PacketIdentifier, sizeof(E131PacketIdentifier));
+	WriteE131FlagsAndLength(packetLength - 16, output + 16);
+	WriteUInt32(vector, output + 18);
+	memcpy(output + 22, source.cid, sizeof(source.cid));
+}
+
+//
+// Parses a whole number from the start of text to its end, returning false if there's anything else there
+//
+static bool ParseWholeNumber(const std::string& text, int* value)
+{
+	if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos)
+	{
+		return false;
+	}
+	*value = atoi(text.c_str());
+	return true;
+}
+
+bool ParseNetworkUniverses(const std::string& text, NetworkProtocol protocol, int lightCount, std::vector<NetworkUniverse>* universes)
+{
+	universes->clear();
+	size_t start = 0;
+	while (start <= text.size())
+	{
+		size_t end = text.find(';', start);
+		if (end == std::string::npos)
+		{
+			end = text.size();
+		}
+
+		std::string entry = text.substr(start, end - start);
+		start = end + 1;
+		if (entry.empty())
+		{
+			continue;
+		}
+
+		// Split out the fields, of which the start channel is optional
+		int fields[4] = { 0, 0, 0, 0 };
+		int fieldCount = 0;
+		size_t fieldStart = 0;
+		while (fieldStart <= entry.size())
+		{
+			size_t fieldEnd = entry.find(':', fieldStart);
+			if (fieldEnd == std::string::npos)
+			{
+				fieldEnd = entry.size();
+			}
+			if (fieldCount == 4 || !ParseWholeNumber(entry.substr(fieldStart, fieldEnd - fieldStart), &fields[fieldCount]))
+			{
+				return false;
+			}
+			++fieldCount;
+			fieldStart = fieldEnd + 1;
+		}
+
+		NetworkUniverse universe;
+		universe.destination = fields[0];
+		universe.firstLight = fields[1];
+		universe.lightCount = fields[2];
+		universe.startChannel = fields[3];
+		if (fieldCount < 3 || universe.destination < 1 || universe.lightCount < 1 || universe.firstLight + universe.lightCount > lightCount)
+		{
+			return false;
+		}
+
+		bool fits = (protocol == NetworkProtocolE131) ?
+			(universe.destination <= E131MaxUniverse && universe.startChannel + universe.lightCount * 3 <= E131MaxChannels) :
+			(universe.destination <= 255);
+		if (!fits)
+		{
+			return false;
+		}
+		universes->push_back(universe);
+	}
+	return !universes->empty();
+}
+
+void MakeDefaultNetworkUniverses(NetworkProtocol protocol, int lightCount, std::vector<NetworkUniverse>* universes)
+{
+	universes->clear();
+	int lightsPerUniverse = (protocol == NetworkProtocolE131) ? E131MaxChannels / 3 : lightCount;
+	for (int firstLight = 0; firstLight < lightCount; firstLight += lightsPerUniverse)
+	{
+		NetworkUniverse universe;
+		universe.destination = (protocol == NetworkProtocolE131) ? 1 + firstLight / lightsPerUniverse : DdpDefaultDestination;
+		universe.startChannel = 0;
+		universe.firstLight = firstLight;
+		universe.lightCount = std::min(lightsPerUniverse, lightCount - firstLight);
+		universes->push_back(universe);
+	}
+}
+
+uint32_t GetE131MulticastAddress(int universe)
+{
+	return (239u << 24) | (255u << 16) | static_cast<uint32_t>(universe & 0xFFFF);
+}
+
+void WriteDdpHeader(const DdpPacket& packet, uint8_t* output)
+{
+	output[0] = packet.flags;
+	output[1] = packet.sequence;
+	output[2] = packet.dataType;
+	output[3] = packet.destination;
+	WriteUInt32(packet.offset, output + 4);
+	WriteUInt16(static_cast<uint16_t>(packet.dataLength), output + 8);
+}
+
+void WriteE131Header(const E131Source& source, int universe, int syncUniverse, uint8_t sequence, int channelCount, uint8_t* output)
+{
+	size_t packetLength = E131HeaderSize + channelCount;
+	WriteE131RootLayer(source, E131RootVectorData, packetLength, output);
+
+	// Framing layer
+	WriteE131FlagsAndLength(packetLength - 38, output + 38);
+	WriteUInt32(E131FramingVectorData, output + 40);
+	memset(output + 44, 0, sizeof(source.name));
+	memcpy(output + 44, source.name, strnlen(source.name, sizeof(source.name) - 1));
+	output[108] = source.priority;
+	WriteUInt16(static_cast<uint16_t>(syncUniverse), output + 109);
+	output[111] = sequence;
+	output[112] = 0;
+	WriteUInt16(static_cast<uint16_t>(universe), output + 113);
+
+	// DMP layer, holding the start code and channels
+	WriteE131FlagsAndLength(packetLength - 115, output + 115);
+	output[117] = E131DmpVectorSetProperty;
+	output[118] = E131DmpAddressType;
+	WriteUInt16(0x0000, output + 119);
+	WriteUInt16(0x0001, output + 121);
+	WriteUInt16(static_cast<uint16_t>(channelCount + 1), output + 123);
+	output[125] = 0;
+}
+
+void WriteE131SyncPacket(const E131Source& source, int syncUniverse, uint8_t sequence, uint8_t* output)
+{
+	WriteE131RootLayer(source, E131RootVectorExtended, E131SyncPacketSize, output);
+	WriteE131FlagsAndLength(E131SyncPacketSize - 38, output + 38);
+	WriteUInt32(E131FramingVectorSync, output + 40);
+	output[44] = sequence;
+	WriteUInt16(static_cast<uint16_t>(syncUniverse), output + 45);
+	WriteUInt16(0, output + 47);
+}
+
+bool ReadDdpPacket(const uint8_t* input, size_t length, DdpPacket* packet)
+{
+	if (length < static_cast<size_t>(DdpHeaderSize) || (input[0] & 0xC0) != DdpFlagsVersion1)
+	{
+		return false;
+	}
+
+	packet->flags = input[0];
+	packet->sequence = input[1] & 0x0F;
+	packet->dataType = input[2];
+	packet->destination = input[3];
+	packet->offset = ReadUInt32(input + 4);
+	packet->dataLength = ReadUInt16(input + 8);
+	packet->data = input + DdpHeaderSize;
+	return packet->dataLength == length - DdpHeaderSize;
+}
+
+bool ReadE131Packet(const uint8_t* input, size_t length, E131Packet* packet)
+{
+	if (length < static_cast<size_t>(E131SyncPacketSize) || ReadUInt16(input) != 0x0010 || memcmp(input + 4, E131PacketIdentifier, sizeof(E131PacketIdentifier)) != 0 ||
+		!CheckE131FlagsAndLength(input + 16, length - 16) || !CheckE131FlagsAndLength(input + 38, length - 38))
+	{
+		return false;
+	}
+
+	uint32_t rootVector = ReadUInt32(input + 18);
+	uint32_t framingVector = ReadUInt32(input + 40);
+	if (rootVector == E131RootVectorExtended && framingVector == E131FramingVectorSync)
+	{
+		packet->sync = true;
+		packet->sequence = input[44];
+		packet->syncUniverse = ReadUInt16(input + 45);
+		packet->universe = packet->syncUniverse;
+		packet->priority = 0;
+		packet->channels = nullptr;
+		packet->channelCount = 0;
+		return length == static_cast<size_t>(E131SyncPacketSize);
+	}
+
+	if (rootVector != E131RootVectorData || framingVector != E131FramingVectorData || length < static_cast<size_t>(E131HeaderSize) ||
+		!CheckE131FlagsAndLength(input + 115, length - 115) || input[117] != E131DmpVectorSetProperty || input[118] != E131DmpAddressType ||
+		ReadUInt16(input + 123) != length - (E131HeaderSize - 1) || input[125] != 0)
+	{
+		return false;
+	}
+
+	packet->sync = false;
+	packet->priority = input[108];
+	packet->syncUniverse = ReadUInt16(input + 109);
+	packet->sequence = input[111];
+	packet->universe = ReadUInt16(input + 113);
+	packet->channels = input + E131HeaderSize;
+	packet->channelCount = static_cast<int>(length - E131HeaderSize);
+	return packet->channelCount <= E131MaxChannels;
+}
+
+NetworkFrameEncoder::NetworkFrameEncoder() :
+	m_Protocol(NetworkProtocolDDP),
+	m_SyncUniverse(0),
+	m_LightCount(0),
+	m_Frame(0)
+{
+	memset(&m_Source, 0, sizeof(m_Source));
+}
+
+bool NetworkFrameEncoder::Initialise(NetworkProtocol protocol, const std::vector<NetworkUniverse>& universes, int lightCount, const E131Source& source, int syncUniverse)
+{
+	m_Protocol = protocol;
+	m_Source = source;
+	m_SyncUniverse = (protocol == NetworkProtocolE131) ? syncUniverse : 0;
+	m_LightCount = lightCount;
+	m_Frame = 0;
+	m_Data.clear();
+	m_Packets.clear();
+	m_Runs.clear();
+
+	for (const NetworkUniverse& universe : universes)
+	{
+		if (universe.firstLight < 0 || universe.lightCount < 1 || universe.firstLight + universe.lightCount > lightCount || universe.startChannel < 0)
+		{
+			return false;
+		}
+	}
+
+	if (protocol == NetworkProtocolDDP)
+	{
+		// Each run goes in as many packets as it takes, and the last packet to each destination tells it to show them
+		const int maxPacketLights = DdpMaxDataLength / 3;
+		for (const NetworkUniverse& universe : universes)
+		{
+			if (universe.destination < 1 || universe.destination > 255)
+			{
+				return false;
+			}
+
+			for (int light = 0; light < universe.lightCount; light += maxPacketLights)
+			{
+				DdpPacket header;
+				header.flags = DdpFlagsVersion1;
+				header.sequence = 0;
+				header.dataType = DdpDataTypeRGB8;
+				header.destination = static_cast<uint8_t>(universe.destination);
+				header.offset = static_cast<uint32_t>(universe.startChannel + light * 3);
+				header.dataLength = std::min(maxPacketLights, universe.lightCount - light) * 3;
+
+				Run run;
+				run.packet = AddPacket(DdpHeaderSize + header.dataLength, universe.destination, 1);
+				run.dataOffset = DdpHeaderSize;
+				run.firstLight = universe.firstLight + light;
+				run.lightCount = static_cast<int>(header.dataLength / 3);
+				m_Runs.push_back(run);
+				WriteDdpHeader(header, &m_Data[m_Packets[run.packet].offset]);
+			}
+		}
+
+		for (size_t packet = 0; packet < m_Packets.size(); ++packet)
+		{
+			bool lastToDestination = true;
+			for (size_t laterPacket = packet + 1; laterPacket < m_Packets.size() && lastToDestination; ++laterPacket)
+			{
+				lastToDestination = m_Packets[laterPacket].destination != m_Packets[packet].destination;
+			}
+			if (lastToDestination)
+			{
+				m_Data[m_Packets[packet].offset] |= DdpFlagPush;
+			}
+		}
+	}
+	else
+	{
+		// Runs sharing a universe share its packet, which only needs to reach the last channel any of them use
+		std::vector<int> universeNumbers;
+		std::vector<int> channelCounts;
+		for (const NetworkUniverse& universe : universes)
+		{
+			if (universe.destination < 1 || universe.destination > E131MaxUniverse)
+			{
+				return false;
+			}
+
+			size_t index = std::find(universeNumbers.begin(), universeNumbers.end(), universe.destination) - universeNumbers.begin();
+			if (index == universeNumbers.size())
+			{
+				universeNumbers.push_back(universe.destination);
+				channelCounts.push_back(0);
+			}
+			channelCounts[index] = std::max(channelCounts[index], universe.startChannel + universe.lightCount * 3);
+			if (channelCounts[index] > E131MaxChannels)
+			{
+				return false;
+			}
+		}
+
+		for (size_t index = 0; index < universeNumbers.size(); ++index)
+		{
+			int packet = AddPacket(E131HeaderSize + channelCounts[index], universeNumbers[index], 111);
+			WriteE131Header(m_Source, universeNumbers[index], m_SyncUniverse, 0, channelCounts[index], &m_Data[m_Packets[packet].offset]);
+		}
+
+		for (const NetworkUniverse& universe : universes)
+		{
+			Run run;
+			run.packet = static_cast<int>(std::find(universeNumbers.begin(), universeNumbers.end(), universe.destination) - universeNumbers.begin());
+			run.dataOffset = E131HeaderSize + universe.startChannel;
+			run.firstLight = universe.firstLight;
+			run.lightCount = universe.lightCount;
+			m_Runs.push_back(run);
+		}
+
+		if (m_SyncUniverse != 0)
+		{
+			int packet = AddPacket(E131SyncPacketSize, m_SyncUniverse, 44);
+			WriteE131SyncPacket(m_Source, m_SyncUniverse, 0, &m_Data[m_Packets[packet].offset]);
+		}
+	}
+	return !m_Packets.empty();
+}
+
+void NetworkFrameEncoder::Encode(const int32_t* lightValues)
+{
+	// DDP sequence numbers run from 1 to 15, as 0 means they're not in use
+	++m_Frame;
+	uint8_t sequence = (m_Protocol == NetworkProtocolDDP) ? static_cast<uint8_t>(1 + m_Frame % 15) : static_cast<uint8_t>(m_Frame);
+	for (const Packet& packet : m_Packets)
+	{
+		m_Data[packet.offset + packet.sequenceOffset] = sequence;
+	}
+
+	for (const Run& run : m_Runs)
+	{
+		PackLightsWire(lightValues + run.firstLight, run.lightCount, LightChannelOrderRGB, &m_Data[m_Packets[run.packet].offset + run.dataOffset]);
+	}
+}
+
+int NetworkFrameEncoder::GetPacketCount() const
+{
+	return static_cast<int>(m_Packets.size());
+}
+
+const uint8_t* NetworkFrameEncoder::GetPacket(int index) const
+{
+	return &m_Data[m_Packets[index].offset];
+}
+
+size_t NetworkFrameEncoder::GetPacketLength(int index) const
+{
+	return m_Packets[index].length;
+}
+
+int NetworkFrameEncoder::GetPacketDestination(int index) const
+{
+	return m_Packets[index].destination;
+}
+
+//
+// Makes room for a packet at the end of the buffer, returning its index
+//
+int NetworkFrameEncoder::AddPacket(size_t length, int destination, size_t sequenceOffset)
+{
+	Packet packet;
+	packet.offset = m_Data.size();
+	packet.length = length;
+	packet.destination = destination;
+	packet.sequenceOffset = sequenceOffset;
+	m_Data.resize(m_Data.size() + length, 0);
+	m_Packets.push_back(packet);
+	return static_cast<int>(m_Packets.size() - 1);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Light values for networked pixel controllers, sent over UDP as DDP or E1.31 (sACN).
+//
+// DDP packets are a 10 byte header followed by up to DdpMaxDataLength bytes of RGB data: flags (version 1, with
+// push set on the last packet of a frame), a sequence number (1-15), the data type (8 bit RGB), the destination
+// ID, then the byte offset of the data in the destination (4 bytes) and its length (2 bytes). Multi-byte values
+// are big endian, and packets go to port 4048.
+//
+// E1.31 packets carry one DMX universe of up to 512 channels, 3 per light, behind the ACN root, framing and DMP
+// layers. They go to port 5568, multicast to 239.255.<universe high>.<universe low> unless sent to a particular
+// controller. With a sync universe, controllers hold the universes until a sync packet for it follows them
+
+enum NetworkProtocol
+{
+	NetworkProtocolDDP = 0,
+	NetworkProtocolE131 = 1
+};
+
+static const int DdpPort = 4048;
+static const int DdpHeaderSize = 10;
+static const int DdpMaxDataLength = 1440;			// 480 lights, which keeps packets inside an Ethernet frame
+static const uint8_t DdpFlagsVersion1 = 0x40;
+static const uint8_t DdpFlagPush = 0x01;
+static const uint8_t DdpDataTypeRGB8 = 0x0B;
+static const uint8_t DdpDefaultDestination = 1;
+
+static const int E131Port = 5568;
+static const int E131HeaderSize = 126;				// Up to and including the DMX start code
+static const int E131MaxChannels = 512;
+static const int E131SyncPacketSize = 49;
+static const int E131MaxUniverse = 63999;
+static const uint8_t E131DefaultPriority = 100;
+
+// A run of lights and where they go. For E1.31 the destination is a universe (1-63999), and for DDP it's a
+// destination ID (1 being a controller's own output). The lights start at startChannel in the destination,
+// counting from 0. Runs can share an E1.31 universe, as long as they all fit in its 512 channels, while DDP runs
+// are split into as many packets as they need
+struct NetworkUniverse
+{
+	int destination;
+	int startChannel;
+	int firstLight;
+	int lightCount;
+};
+
+// Parses a mapping of "destination:firstLight:lightCount[:startChannel]" runs separated by ';'. Returns false if
+// any run is malformed, doesn't fit its destination, or has lights outside the lightCount there are
+bool ParseNetworkUniverses(const std::string& text, NetworkProtocol protocol, int lightCount, std::vector<NetworkUniverse>* universes);
+
+// Every light in order. E1.31 fills universes from 1, 170 lights each, and DDP sends them all to its default destination
+void MakeDefaultNetworkUniverses(NetworkProtocol protocol, int lightCount, std::vector<NetworkUniverse>* universes);
+
+// The multicast group for an E1.31 universe, as an IPv4 address in host byte order
+uint32_t GetE131MulticastAddress(int universe);
+
+// Identifies the sender of E1.31 packets
+struct E131Source
+{
+	uint8_t cid[16];				// A UUID, the same for the whole time we're sending
+	char name[64];					// UTF-8, null terminated
+	uint8_t priority;				// 0-200
+};
+
+struct DdpPacket
+{
+	uint8_t flags;
+	uint8_t sequence;
+	uint8_t dataType;
+	uint8_t destination;
+	uint32_t offset;
+	const uint8_t* data;
+	size_t dataLength;
+};
+
+struct E131Packet
+{
+	bool sync;						// A sync packet, which has no channels
+	int universe;
+	int syncUniverse;				// 0 if the universe isn't synced, and what sync packets are for
+	uint8_t sequence;
+	uint8_t priority;
+	const uint8_t* channels;		// After the start code
+	int channelCount;
+};
+
+void WriteDdpHeader(const DdpPacket& packet, uint8_t* output);
+void WriteE131Header(const E131Source& source, int universe, int syncUniverse, uint8_t sequence, int channelCount, uint8_t* output);
+void WriteE131SyncPacket(const E131Source& source, int syncUniverse, uint8_t sequence, uint8_t* output);
+
+// Checks a whole packet, returning false for anything that isn't a well formed packet of that protocol. The data
+// and channels point into the packet
+bool ReadDdpPacket(const uint8_t* input, size_t length, DdpPacket* packet);
+bool ReadE131Packet(const uint8_t* input, size_t length, E131Packet* packet);
+
+// Turns light values into the packets for a frame. Their layout is worked out up front, so each frame only has
+// to fill in sequence numbers and pack the lights, and every packet sits in one buffer ready to be sent together
+class NetworkFrameEncoder
+{
+public:
+	NetworkFrameEncoder();
+
+	// With a sync universe (E1.31 only, 0 for none), every frame ends with a sync packet for it
+	bool Initialise(NetworkProtocol protocol, const std::vector<NetworkUniverse>& universes, int lightCount, const E131Source& source, int syncUniverse);
+
+	// Fills in every packet from the lights. They hold zero on any channels no run covers
+	void Encode(const int32_t* lightValues);
+
+	// Valid from Initialise on, and filled in by Encode
+	int GetPacketCount() const;
+	const uint8_t* GetPacket(int index) const;
+	size_t GetPacketLength(int index) const;
+
+	// The E1.31 universe a packet is for, the sync universe for the sync packet, or the DDP destination
+	int GetPacketDestination(int index) const;
+
+private:
+	struct Packet
+	{
+		size_t offset;
+		size_t length;
+		int destination;
+		size_t sequenceOffset;		// Where its sequence number goes
+	};
+
+	// Lights copied into a packet, from firstLight onwards to offset in its data
+	struct Run
+	{
+		int packet;
+		size_t dataOffset;
+		int firstLight;
+		int lightCount;
+	};
+
+private:
+	int AddPacket(size_t length, int destination, size_t sequenceOffset);
+
+private:
+	NetworkProtocol			m_Protocol;
+	E131Source				m_Source;
+	int						m_SyncUniverse;
+	int						m_LightCount;
+	uint32_t				m_Frame;
+	std::vector<uint8_t>	m_Data;
+	std::vector<Packet>		m_Packets;
+	std::vector<Run>		m_Runs;
+};
@@ -0,0 +1,225 @@
+#include "NetworkTransport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+const char* NetworkTransport::SourceName = "Lights";
+
+//
+// A random (version 4) UUID, so every run of the transport counts as a new E1.31 source
+//
+static void MakeSourceCid(uint8_t* cid)
+{
+	std::random_device random;
+	for (int index = 0; index < 16; index += 4)
+	{
+		uint32_t value = random();
+		memcpy(cid + index, &value, sizeof(value));
+	}
+	cid[6] = static_cast<uint8_t>((cid[6] & 0x0F) | 0x40);
+	cid[8] = static_cast<uint8_t>((cid[8] & 0x3F) | 0x80);
+}
+
+NetworkTransport::NetworkTransport(LatencyStats* latencyStats) :
+	m_LatencyStats(latencyStats),
+	m_SyncUniverse(0),
+	m_Running(false),
+	m_FramesSent(0),
+	m_PacketsSent(0),
+	m_BytesSent(0),
+	m_SendCalls(0),
+	m_SendErrors(0),
+	m_StopRequested(false),
+	m_LightsUpdated(false),
+	m_LightPresentTime(0)
+{
+}
+
+NetworkTransport::~NetworkTransport()
+{
+	Stop();
+}
+
+bool NetworkTransport::Start(const std::string& host, NetworkProtocol protocol, const std::vector<NetworkUniverse>& universes, int lightCount)
+{
+	if (m_Thread.joinable() || lightCount <= 0)
+	{
+		return false;
+	}
+
+	int port = (protocol == NetworkProtocolE131) ? E131Port : DdpPort;
+	UdpAddress hostAddress = { 0, 0 };
+	bool multicast = host.empty();
+	if ((multicast && protocol != NetworkProtocolE131) || (!multicast && !ResolveUdpAddress(host, port, &hostAddress)))
+	{
+		return false;
+	}
+
+	E131Source source;
+	memset(&source, 0, sizeof(source));
+	MakeSourceCid(source.cid);
+	memcpy(source.name, SourceName, std::min(strlen(SourceName), sizeof(source.name) - 1));
+	source.priority = E131DefaultPriority;
+	if (!m_Encoder.Initialise(protocol, universes, lightCount, source, m_SyncUniverse) || !m_Socket.Open())
+	{
+		return false;
+	}
+
+	// Packets sit in the encoder's buffer for good, so only their contents change from frame to frame
+	m_Packets.resize(m_Encoder.GetPacketCount());
+	for (int index = 0; index < m_Encoder.GetPacketCount(); ++index)
+	{
+		UdpPacket& packet = m_Packets[index];
+		packet.data = m_Encoder.GetPacket(index);
+		packet.length = m_Encoder.GetPacketLength(index);
+		packet.destination = hostAddress;
+		if (multicast)
+		{
+			packet.destination.address = GetE131MulticastAddress(m_Encoder.GetPacketDestination(index));
+			packet.destination.port = static_cast<uint16_t>(port);
+		}
+	}
+
+	m_LightValues.assign(lightCount, 0);
+	m_SentLightValues.assign(lightCount, 0);
+	m_LightsUpdated = false;
+	m_LightPresentTime = 0;
+	m_StopRequested = false;
+	m_FramesSent = 0;
+	m_PacketsSent = 0;
+	m_BytesSent = 0;
+	m_SendCalls = 0;
+	m_SendErrors = 0;
+	m_Running = true;
+	m_Thread = std::thread(&NetworkTransport::Run, this);
+	return true;
+}
+
+void NetworkTransport::Stop()
+{
+	if (m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_StopRequested = true;
+		}
+		m_Wake.notify_all();
+		m_Thread.join();
+	}
+	m_Socket.Close();
+	m_Running = false;
+}
+
+bool NetworkTransport::IsRunning() const
+{
+	return m_Running;
+}
+
+void NetworkTransport::SetSyncUniverse(int syncUniverse)
+{
+	m_SyncUniverse = syncUniverse;
+}
+
+void NetworkTransport::SetLightValues(const int32_t* values, int count, int64_t presentTime)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		size_t copyCount = std::min(static_cast<size_t>(count), m_LightValues.size());
+		if (copyCount > 0)
+		{
+			memcpy(&m_LightValues[0], values, copyCount * sizeof(int32_t));
+		}
+		m_LightsUpdated = true;
+
+		// Keep the oldest frame we've not sent yet
+		if (m_LightPresentTime == 0)
+		{
+			m_LightPresentTime = presentTime;
+		}
+	}
+	m_Wake.notify_all();
+}
+
+uint64_t NetworkTransport::GetFramesSent() const
+{
+	return m_FramesSent;
+}
+
+uint64_t NetworkTransport::GetPacketsSent() const
+{
+	return m_PacketsSent;
+}
+
+uint64_t NetworkTransport::GetBytesSent() const
+{
+	return m_BytesSent;
+}
+
+uint64_t NetworkTransport::GetSendCalls() const
+{
+	return m_SendCalls;
+}
+
+uint64_t NetworkTransport::GetSendErrors() const
+{
+	return m_SendErrors;
+}
+
+int NetworkTransport::GetPacketsPerFrame() const
+{
+	return static_cast<int>(m_Packets.size());
+}
+
+//
+// Main loop of the sending thread. Sends each new set of light values as soon as it's handed over, or the last
+// ones again if it's been a while
+//
+void NetworkTransport::Run()
+{
+	size_t frameBytes = 0;
+	for (const UdpPacket& packet : m_Packets)
+	{
+		frameBytes += packet.length;
+	}
+
+	std::unique_lock<std::mutex> lock(m_Lock);
+	while (!m_StopRequested)
+	{
+		m_Wake.wait_for(lock, std::chrono::milliseconds(KeepAliveMilliseconds), [this]() { return m_StopRequested || m_LightsUpdated; });
+		if (m_StopRequested)
+		{
+			break;
+		}
+
+		int64_t presentTime = m_LightPresentTime;
+		if (m_LightsUpdated)
+		{
+			m_SentLightValues = m_LightValues;
+			m_LightPresentTime = 0;
+			m_LightsUpdated = false;
+		}
+		lock.unlock();
+
+		// Network errors come and go, so they don't stop us
+		m_Encoder.Encode(&m_SentLightValues[0]);
+		int calls = m_Socket.Send(&m_Packets[0], static_cast<int>(m_Packets.size()));
+		if (calls < 0)
+		{
+			++m_SendErrors;
+		}
+		else
+		{
+			m_SendCalls += calls;
+			m_PacketsSent += m_Packets.size();
+			m_BytesSent += frameBytes;
+			++m_FramesSent;
+			if (m_LatencyStats)
+			{
+				m_LatencyStats->Record(LatencyStageSerialWrite, presentTime);
+			}
+		}
+		lock.lock();
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LatencyStats.h"
+#include "NetworkProtocol.h"
+#include "UdpSocket.h"
+
+// Sends light values to networked pixel controllers as DDP or E1.31 on its own thread, next to (or instead of)
+// the serial transport. A universe mapping says which lights go where (see NetworkUniverse), and each frame's
+// packets are built in one go and handed to the socket as a batch. Nothing comes back, so the latest light values
+// go out as soon as they're handed over, and the last frame is sent again now and then so controllers don't
+// give up on us. Light values are handed over from any thread. Start and Stop must not overlap with any other calls
+class NetworkTransport
+{
+public:
+	NetworkTransport(LatencyStats* latencyStats);
+	~NetworkTransport();
+
+	// host is "address" or "address:port", with the protocol's port by default. For E1.31 it can be left empty,
+	// to multicast each universe to its own group
+	bool Start(const std::string& host, NetworkProtocol protocol, const std::vector<NetworkUniverse>& universes, int lightCount);
+	void Stop();
+
+	bool IsRunning() const;
+
+	// E1.31 universe for sync packets, or 0 for none. Set before Start
+	void SetSyncUniverse(int syncUniverse);
+
+	// Replaces the light values waiting to be sent. presentTime is when the frame behind them was presented,
+	// for measuring latency (0 if not known)
+	void SetLightValues(const int32_t* values, int count, int64_t presentTime);
+
+	uint64_t GetFramesSent() const;
+	uint64_t GetPacketsSent() const;
+	uint64_t GetBytesSent() const;
+
+	// Calls into the socket, which batching keeps below the number of packets
+	uint64_t GetSendCalls() const;
+
+	// Frames that couldn't be sent, such as while the network was down
+	uint64_t GetSendErrors() const;
+
+	int GetPacketsPerFrame() const;
+
+public:
+	// Time between sending the last frame again when nothing has changed. E1.31 receivers give up after 2.5s
+	static const int KeepAliveMilliseconds = 1000;
+
+	// Shown by E1.31 receivers as where the light values came from
+	static const char* SourceName;
+
+private:
+	void Run();
+
+private:
+	LatencyStats*				m_LatencyStats;
+	UdpSocket					m_Socket;
+	NetworkFrameEncoder			m_Encoder;
+	std::vector<UdpPacket>		m_Packets;
+	std::thread					m_Thread;
+	int							m_SyncUniverse;
+	std::atomic<bool>			m_Running;
+	std::atomic<uint64_t>		m_FramesSent;
+	std::atomic<uint64_t>		m_PacketsSent;
+	std::atomic<uint64_t>		m_BytesSent;
+	std::atomic<uint64_t>		m_SendCalls;
+	std::atomic<uint64_t>		m_SendErrors;
+
+	// Shared with the threads handing over light values
+	std::mutex					m_Lock;
+	std::condition_variable		m_Wake;
+	bool						m_StopRequested;
+	std::vector<int32_t>		m_LightValues;
+	bool						m_LightsUpdated;
+	int64_t						m_LightPresentTime;
+
+	// Only touched by the sending thread
+	std::vector<int32_t>		m_SentLightValues;
+};
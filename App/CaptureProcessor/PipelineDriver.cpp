@@ -0,0 +1,288 @@
+#include "stdafx.h"
+
+#include "PipelineDriver.h"
+
+PipelineSettings::PipelineSettings() :
+	downsampleMode(0),
+	captureTraceDirtyOnly(true),
+	frameSlots(false)
+{
+	colourScale[0] = colourScale[1] = colourScale[2] = 1.0f;
+}
+
+PipelineDriver::PipelineDriver(LatencyStats* latencyStats) :
+	m_LatencyStats(latencyStats),
+	m_CaptureProcessor(nullptr),
+	m_Thread(nullptr),
+	m_StopEvent(nullptr),
+	m_LightsReadyEvent(nullptr),
+	m_Running(0),
+	m_Callback(nullptr),
+	m_CallbackContext(nullptr),
+	m_SettingsChanged(true)
+{
+}
+
+PipelineDriver::~PipelineDriver()
+{
+	Stop();
+}
+
+bool PipelineDriver::Start(int singleOutput, int lightColumns, int lightRows, const PipelineSettings& settings, LightsReadyCallback callback, void* callbackContext)
+{
+	if (m_Thread)
+	{
+		return false;
+	}
+
+	m_StopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	m_LightsReadyEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (!m_StopEvent || !m_LightsReadyEvent)
+	{
+		Stop();
+		return false;
+	}
+
+	// Set up here rather than on the driver thread, so the light values can be read as soon as we return
+	m_CaptureProcessor = new CaptureProcessor(m_LatencyStats);
+	if (!m_CaptureProcessor->Start(singleOutput, lightColumns, lightRows))
+	{
+		Stop();
+		return false;
+	}
+	m_CaptureProcessor->AddLightSink(&m_RegisteredLights);
+
+	m_Callback = callback;
+	m_CallbackContext = callbackContext;
+
+	// Handed over before the thread's first Process, which is when the duplication threads are set up
+	{
+		std::lock_guard<std::mutex> lock(m_SettingsLock);
+		m_Settings = settings;
+		m_SettingsChanged = true;
+	}
+	InterlockedExchange(&m_Running, 1);
+
+	DWORD threadID;
+	m_Thread = CreateThread(nullptr, 0, DriverThreadProc, this, 0, &threadID);
+	if (!m_Thread)
+	{
+		Stop();
+		return false;
+	}
+
+	return true;
+}
+
+void PipelineDriver::Stop()
+{
+	if (m_Thread)
+	{
+		SetEvent(m_StopEvent);
+		WaitForSingleObject(m_Thread, INFINITE);
+		CloseHandle(m_Thread);
+		m_Thread = nullptr;
+	}
+	InterlockedExchange(&m_Running, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(m_ReadLock);
+		delete m_CaptureProcessor;
+		m_CaptureProcessor = nullptr;
+	}
+
+	if (m_StopEvent)
+	{
+		CloseHandle(m_StopEvent);
+		m_StopEvent = nullptr;
+	}
+	if (m_LightsReadyEvent)
+	{
+		CloseHandle(m_LightsReadyEvent);
+		m_LightsReadyEvent = nullptr;
+	}
+	m_Callback = nullptr;
+	m_CallbackContext = nullptr;
+}
+
+bool PipelineDriver::IsRunning() const
+{
+	return m_Running != 0;
+}
+
+void PipelineDriver::SetColourScale(float r, float g, float b)
+{
+	// The app passes every setting on whenever any one changes, so only hand on values that differ. Changing
+	// the frame slots or capture trace restarts the duplication threads
+	std::lock_guard<std::mutex> lock(m_SettingsLock);
+	if (m_Settings.colourScale[0] != r || m_Settings.colourScale[1] != g || m_Settings.colourScale[2] != b)
+	{
+		m_Settings.colourScale[0] = r;
+		m_Settings.colourScale[1] = g;
+		m_Settings.colourScale[2] = b;
+		m_SettingsChanged = true;
+	}
+}
+
+void PipelineDriver::SetDownsampleMode(int mode)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsLock);
+	if (m_Settings.downsampleMode != mode)
+	{
+		m_Settings.downsampleMode = mode;
+		m_SettingsChanged = true;
+	}
+}
+
+void PipelineDriver::SetCaptureTrace(const std::string& path, bool dirtyOnly)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsLock);
+	if (m_Settings.captureTracePath != path || m_Settings.captureTraceDirtyOnly != dirtyOnly)
+	{
+		m_Settings.captureTracePath = path;
+		m_Settings.captureTraceDirtyOnly = dirtyOnly;
+		m_SettingsChanged = true;
+	}
+}
+
+void PipelineDriver::SetFrameSlots(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsLock);
+	if (m_Settings.frameSlots != enabled)
+	{
+		m_Settings.frameSlots = enabled;
+		m_SettingsChanged = true;
+	}
+}
+
+void PipelineDriver::SetSharedLights(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsLock);
+	if (m_Settings.sharedLightsName != name)
+	{
+		m_Settings.sharedLightsName = name;
+		m_SettingsChanged = true;
+	}
+}
+
+HANDLE PipelineDriver::GetLightsReadyEvent() const
+{
+	return m_LightsReadyEvent;
+}
+
+bool PipelineDriver::GetLightValues(__int32* values, int length, unsigned __int64* sequence)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+	if (!m_CaptureProcessor)
+	{
+		*sequence = 0;
+		return false;
+	}
+
+	const __int32* lightValues = nullptr;
+	int count = 0;
+	bool updated = m_CaptureProcessor->AcquireLightValues(&lightValues, &count, sequence);
+	if (lightValues)
+	{
+		memcpy(values, lightValues, min(length, count) * sizeof(__int32));
+	}
+	return updated;
+}
+
+int64_t PipelineDriver::GetLightPresentTime()
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+	return m_CaptureProcessor ? m_CaptureProcessor->GetLightPresentTime() : 0;
+}
+
+bool PipelineDriver::GetLightData(uint8_t* data, int length, LightChannelOrder order)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+	return m_CaptureProcessor ? m_CaptureProcessor->GetLightData(data, length, order) : false;
+}
+
+bool PipelineDriver::RegisterLightBuffers(void* memory, size_t size, int bufferCount, int lightCount, HANDLE filledEvent)
+{
+	return m_RegisteredLights.Register(memory, size, bufferCount, lightCount, filledEvent ? LightBuffersFilled : nullptr, filledEvent);
+}
+
+void PipelineDriver::UnregisterLightBuffers()
+{
+	m_RegisteredLights.Unregister();
+}
+
+void PipelineDriver::LightBuffersFilled(void* context)
+{
+	SetEvent(reinterpret_cast<HANDLE>(context));
+}
+
+DWORD WINAPI PipelineDriver::DriverThreadProc(void* param)
+{
+	reinterpret_cast<PipelineDriver*>(param)->Run();
+	return 0;
+}
+
+//
+// Hands any changed settings over to the capture processor
+//
+void PipelineDriver::ApplySettings()
+{
+	std::lock_guard<std::mutex> lock(m_SettingsLock);
+	if (!m_SettingsChanged)
+	{
+		return;
+	}
+
+	m_CaptureProcessor->SetColourScale(m_Settings.colourScale[0], m_Settings.colourScale[1], m_Settings.colourScale[2]);
+	m_CaptureProcessor->SetDownsampleMode(m_Settings.downsampleMode);
+	m_CaptureProcessor->SetCaptureTrace(m_Settings.captureTracePath, m_Settings.captureTraceDirtyOnly);
+	m_CaptureProcessor->SetFrameSlots(m_Settings.frameSlots);
+	m_CaptureProcessor->SetSharedLights(m_Settings.sharedLightsName);
+	m_SettingsChanged = false;
+}
+
+//
+// Main loop of the driver thread. Processes straight away whenever a frame arrives, then keeps going for a
+// few intervals afterwards so the lights finish blending towards it
+//
+void PipelineDriver::Run()
+{
+	int settleFramesLeft = 0;
+	while (WaitForSingleObjectEx(m_StopEvent, 0, FALSE) == WAIT_TIMEOUT)
+	{
+		ApplySettings();
+
+		if (m_CaptureProcessor->Process())
+		{
+			// New light values have been published
+			SetEvent(m_LightsReadyEvent);
+			if (m_Callback)
+			{
+				m_Callback(m_CallbackContext);
+			}
+		}
+
+		if (!m_CaptureProcessor->IsRunning())
+		{
+			// Unexpected error, so there's nothing more we can do
+			break;
+		}
+
+		if (m_CaptureProcessor->WaitForWork(m_StopEvent, (settleFramesLeft > 0) ? SettleIntervalMilliseconds : IdleIntervalMilliseconds))
+		{
+			settleFramesLeft = SettleFrameCount;
+		}
+		else if (settleFramesLeft > 0)
+		{
+			--settleFramesLeft;
+		}
+	}
+
+	// Wake up anyone waiting on us, so they can see we've stopped
+	InterlockedExchange(&m_Running, 0);
+	SetEvent(m_LightsReadyEvent);
+	if (m_Callback)
+	{
+		m_Callback(m_CallbackContext);
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+
+#include "CaptureProcessor.h"
+#include "RegisteredLightBuffers.h"
+
+// Settings for the capture processor, kept by whoever starts the driver so they're in place for the first frame
+struct PipelineSettings
+{
+	PipelineSettings();
+
+	float colourScale[3];
+	int downsampleMode;
+	std::string captureTracePath;
+	bool captureTraceDirtyOnly;
+	bool frameSlots;
+	std::string sharedLightsName;
+};
+
+// Runs the capture pipeline on its own thread, processing each new frame as soon as a duplication thread
+// hands it over instead of waiting to be polled. Consumers wait on the lights ready event, or get a callback,
+// each time new light values are published.
+// Everything here may be called from any thread except the callback itself
+class PipelineDriver
+{
+public:
+	typedef void (__stdcall *LightsReadyCallback)(void* context);
+
+public:
+	PipelineDriver(LatencyStats* latencyStats);
+	~PipelineDriver();
+
+	bool Start(int singleOutput, int lightColumns, int lightRows, const PipelineSettings& settings, LightsReadyCallback callback, void* callbackContext);
+	void Stop();
+	bool IsRunning() const;
+
+	// Picked up by the driver thread before it next processes
+	void SetColourScale(float r, float g, float b);
+	void SetDownsampleMode(int mode);
+	void SetCaptureTrace(const std::string& path, bool dirtyOnly);
+	void SetFrameSlots(bool enabled);
+	void SetSharedLights(const std::string& name);
+
+	// Auto reset event, signalled each time new light values are published, and once more when the driver stops.
+	// Valid until Stop
+	HANDLE GetLightsReadyEvent() const;
+
+	// Copies out the latest light values. Returns true if they've changed since the last call
+	bool GetLightValues(__int32* values, int length, unsigned __int64* sequence);
+	int64_t GetLightPresentTime();
+
+	// Packs the light values last copied out by GetLightValues into the bytes sent for them
+	bool GetLightData(uint8_t* data, int length, LightChannelOrder order);
+
+	// Fills buffers in the consumer's memory with every set of light values published, signalling filledEvent
+	// (if any) each time, so they never have to be copied out (see RegisteredLightBuffers). Stays registered
+	// through restarts until UnregisterLightBuffers, after which neither the memory nor the event are touched
+	bool RegisterLightBuffers(void* memory, size_t size, int bufferCount, int lightCount, HANDLE filledEvent);
+	void UnregisterLightBuffers();
+
+public:
+	// While the lights are still blending towards the last frame, keep processing at roughly the old polling rate
+	static const DWORD SettleIntervalMilliseconds = 16;
+	static const int SettleFrameCount = 8;
+
+	// How long to wait for a frame before checking on things anyway
+	static const DWORD IdleIntervalMilliseconds = 1000;
+
+private:
+	static DWORD WINAPI DriverThreadProc(void* param);
+	static void LightBuffersFilled(void* context);
+	void Run();
+	void ApplySettings();
+
+private:
+	LatencyStats*			m_LatencyStats;
+	CaptureProcessor*		m_CaptureProcessor;
+
+	HANDLE					m_Thread;
+	HANDLE					m_StopEvent;
+	HANDLE					m_LightsReadyEvent;
+	volatile LONG			m_Running;
+
+	LightsReadyCallback		m_Callback;
+	void*					m_CallbackContext;
+
+	// Settings are set from the consumer's thread and applied on the driver thread
+	std::mutex				m_SettingsLock;
+	PipelineSettings		m_Settings;
+	bool					m_SettingsChanged;
+
+	// Only one reader of the light values at a time
+	std::mutex				m_ReadLock;
+
+	RegisteredLightBuffers	m_RegisteredLights;
+};
@@ -0,0 +1,201 @@
+#include "PixelSums.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_SUMS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PIXEL_SUMS_TARGET_SSE2
+#define PIXEL_SUMS_TARGET_AVX2
+#else
+#define PIXEL_SUMS_TARGET_SSE2 __attribute__((target("sse2")))
+#define PIXEL_SUMS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//
+// Row accumulation kernels. Each adds one row of bytes into the 16 bit column sums
+//
+static void AccumulateRowScalar(const uint8_t* row, uint16_t* sums, int count)
+{
+	for (int index = 0; index < count; ++index)
+	{
+		sums[index] = static_cast<uint16_t>(sums[index] + row[index]);
+	}
+}
+
+#if defined(PIXEL_SUMS_X86)
+PIXEL_SUMS_TARGET_SSE2 static void AccumulateRowSSE2(const uint8_t* row, uint16_t* sums, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	int index = 0;
+	for (; index + 16 <= count; index += 16)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + index));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+		__m128i* lowSums = reinterpret_cast<__m128i*>(sums + index);
+		__m128i* highSums = reinterpret_cast<__m128i*>(sums + index + 8);
+		_mm_storeu_si128(lowSums, _mm_add_epi16(_mm_loadu_si128(lowSums), low));
+		_mm_storeu_si128(highSums, _mm_add_epi16(_mm_loadu_si128(highSums), high));
+	}
+
+	AccumulateRowScalar(row + index, sums + index, count - index);
+}
+
+PIXEL_SUMS_TARGET_AVX2 static void AccumulateRowAVX2(const uint8_t* row, uint16_t* sums, int count)
+{
+	int index = 0;
+	for (; index + 32 <= count; index += 32)
+	{
+		__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + index));
+		__m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes));
+		__m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1));
+
+		__m256i* lowSums = reinterpret_cast<__m256i*>(sums + index);
+		__m256i* highSums = reinterpret_cast<__m256i*>(sums + index + 16);
+		_mm256_storeu_si256(lowSums, _mm256_add_epi16(_mm256_loadu_si256(lowSums), low));
+		_mm256_storeu_si256(highSums, _mm256_add_epi16(_mm256_loadu_si256(highSums), high));
+	}
+
+	AccumulateRowScalar(row + index, sums + index, count - index);
+}
+#endif
+
+//
+// CPU feature detection
+//
+static bool CpuSupportsSSE2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	// Always available on x64
+	return true;
+#elif defined(PIXEL_SUMS_X86) && defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	return (cpuInfo[3] & (1 << 26)) != 0;
+#elif defined(PIXEL_SUMS_X86)
+	return __builtin_cpu_supports("sse2") != 0;
+#else
+	return false;
+#endif
+}
+
+static bool CpuSupportsAVX2()
+{
+#if defined(PIXEL_SUMS_X86) && defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0);
+	if (cpuInfo[0] < 7)
+	{
+		return false;
+	}
+
+	// Need AVX and the OS to save the YMM registers
+	__cpuid(cpuInfo, 1);
+	bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+	bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(cpuInfo, 7, 0);
+	return (cpuInfo[1] & (1 << 5)) != 0;
+#elif defined(PIXEL_SUMS_X86)
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+
+bool IsPixelSumKernelSupported(PixelSumKernel kernel)
+{
+	switch (kernel)
+	{
+	case PixelSumKernelAuto:
+	case PixelSumKernelScalar:
+		return true;
+
+	case PixelSumKernelSSE2:
+		return CpuSupportsSSE2();
+
+	case PixelSumKernelAVX2:
+		return CpuSupportsAVX2();
+
+	default:
+		return false;
+	}
+}
+
+PixelSumKernel ResolvePixelSumKernel(PixelSumKernel kernel)
+{
+	if (kernel != PixelSumKernelAuto)
+	{
+		return kernel;
+	}
+
+	if (IsPixelSumKernelSupported(PixelSumKernelAVX2))
+	{
+		return PixelSumKernelAVX2;
+	}
+	else if (IsPixelSumKernelSupported(PixelSumKernelSSE2))
+	{
+		return PixelSumKernelSSE2;
+	}
+	return PixelSumKernelScalar;
+}
+
+void AccumulatePixelRow(PixelSumKernel kernel, const uint8_t* row, uint16_t* sums, int count)
+{
+	switch (kernel)
+	{
+#if defined(PIXEL_SUMS_X86)
+	case PixelSumKernelAVX2:
+		AccumulateRowAVX2(row, sums, count);
+		break;
+
+	case PixelSumKernelSSE2:
+		AccumulateRowSSE2(row, sums, count);
+		break;
+#endif
+
+	default:
+		AccumulateRowScalar(row, sums, count);
+		break;
+	}
+}
+
+void FlushPixelSums(uint16_t* sums16, uint32_t* sums32, int count)
+{
+	for (int index = 0; index < count; ++index)
+	{
+		sums32[index] += sums16[index];
+	}
+	std::memset(sums16, 0, count * sizeof(uint16_t));
+}
+
+uint32_t ResolvePixelAverage(const uint64_t channelSums[PixelSumBytesPerPixel], uint64_t pixelCount, const float colourScale[3])
+{
+	if (pixelCount == 0)
+	{
+		return 0;
+	}
+
+	// Average and tint, matching the shader's UNORM rounding. Pixels are BGRA but the colour scale is RGB
+	const float channelScale[PixelSumBytesPerPixel] = { colourScale[2], colourScale[1], colourScale[0], 1.0f };
+	uint32_t value = 0;
+	for (int channel = 0; channel < PixelSumBytesPerPixel; ++channel)
+	{
+		double average = static_cast<double>(channelSums[channel]) / static_cast<double>(pixelCount);
+		double scaled = average * channelScale[channel] + 0.5;
+		uint32_t channelValue = scaled >= 255.0 ? 255u : (scaled <= 0.0 ? 0u : static_cast<uint32_t>(scaled));
+		value |= channelValue << (channel * 8);
+	}
+
+	return value;
+}
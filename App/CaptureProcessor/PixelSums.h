@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// SIMD kernels for summing BGRA pixels, shared by the CPU downsamplers
+enum PixelSumKernel
+{
+	PixelSumKernelAuto,
+	PixelSumKernelScalar,
+	PixelSumKernelSSE2,
+	PixelSumKernelAVX2
+};
+
+// Bytes per BGRA pixel
+static const int PixelSumBytesPerPixel = 4;
+
+// Number of rows of 8 bit values that can be added into a 16 bit sum before it can overflow (257 * 255 = 65535)
+static const int PixelSumMaxRowsBeforeFlush = 257;
+
+bool IsPixelSumKernelSupported(PixelSumKernel kernel);
+
+// Returns the best supported kernel for PixelSumKernelAuto, otherwise the kernel passed in
+PixelSumKernel ResolvePixelSumKernel(PixelSumKernel kernel);
+
+// Adds count bytes from row into the 16 bit sums
+void AccumulatePixelRow(PixelSumKernel kernel, const uint8_t* row, uint16_t* sums, int count);
+
+// Adds the 16 bit sums into the 32 bit sums and clears the 16 bit sums
+void FlushPixelSums(uint16_t* sums16, uint32_t* sums32, int count);
+
+// Averages the channel sums of a zone and applies the RGB colour scale, returning a BGRA value
+uint32_t ResolvePixelAverage(const uint64_t channelSums[PixelSumBytesPerPixel], uint64_t pixelCount, const float colourScale[3]);
@@ -0,0 +1,129 @@
+#include "RegisteredLightBuffers.h"
+
+#include <algorithm>
+#include <cstring>
+
+static RegisteredLightsInfo* GetInfos(RegisteredLightsHeader* header)
+{
+	return reinterpret_cast<RegisteredLightsInfo*>(header + 1);
+}
+
+static int32_t* GetBuffer(RegisteredLightsHeader* header, int index)
+{
+	int32_t* buffers = reinterpret_cast<int32_t*>(GetInfos(header) + header->bufferCount);
+	return buffers + static_cast<size_t>(index) * header->lightCount;
+}
+
+RegisteredLightBuffers::RegisteredLightBuffers() :
+	m_Header(nullptr),
+	m_Callback(nullptr),
+	m_CallbackContext(nullptr)
+{
+}
+
+RegisteredLightBuffers::~RegisteredLightBuffers()
+{
+	Unregister();
+}
+
+size_t RegisteredLightBuffers::GetSize(int bufferCount, int lightCount)
+{
+	if (bufferCount < MinBufferCount || lightCount <= 0)
+	{
+		return 0;
+	}
+	return sizeof(RegisteredLightsHeader) + bufferCount * (sizeof(RegisteredLightsInfo) + static_cast<size_t>(lightCount) * sizeof(int32_t));
+}
+
+bool RegisteredLightBuffers::Register(void* memory, size_t size, int bufferCount, int lightCount, FilledCallback callback, void* callbackContext)
+{
+	size_t neededSize = GetSize(bufferCount, lightCount);
+	if (!memory || neededSize == 0 || size < neededSize || (reinterpret_cast<uintptr_t>(memory) % alignof(RegisteredLightsInfo)) != 0)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	memset(memory, 0, neededSize);
+	m_Header = static_cast<RegisteredLightsHeader*>(memory);
+	m_Header->latestIndex.store(-1);
+	m_Header->readingIndex.store(-1);
+	m_Header->bufferCount = bufferCount;
+	m_Header->lightCount = lightCount;
+	m_Callback = callback;
+	m_CallbackContext = callbackContext;
+	return true;
+}
+
+void RegisteredLightBuffers::Unregister()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Header = nullptr;
+	m_Callback = nullptr;
+	m_CallbackContext = nullptr;
+}
+
+bool RegisteredLightBuffers::IsRegistered()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Header != nullptr;
+}
+
+void RegisteredLightBuffers::WriteLights(const int32_t* values, int count, uint64_t sequence, int64_t presentTime)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (!m_Header)
+	{
+		return;
+	}
+
+	// Any buffer that's neither the latest nor being read. With three or more, there's always one
+	int latestIndex = m_Header->latestIndex.load();
+	int readingIndex = m_Header->readingIndex.load();
+	int index = 0;
+	while (index == latestIndex || index == readingIndex)
+	{
+		++index;
+	}
+
+	int copyCount = std::max(0, std::min(count, m_Header->lightCount));
+	int32_t* buffer = GetBuffer(m_Header, index);
+	memcpy(buffer, values, copyCount * sizeof(int32_t));
+	memset(buffer + copyCount, 0, (m_Header->lightCount - copyCount) * sizeof(int32_t));
+	RegisteredLightsInfo& info = GetInfos(m_Header)[index];
+	info.sequence = sequence;
+	info.presentTime = presentTime;
+	m_Header->latestIndex.store(index);
+
+	// Still under the lock, so nothing is called once Unregister has returned
+	if (m_Callback)
+	{
+		m_Callback(m_CallbackContext);
+	}
+}
+
+int RegisteredLightBuffers::AcquireLatest(RegisteredLightsHeader* header)
+{
+	int index = header->latestIndex.load();
+	while (index >= 0)
+	{
+		header->readingIndex.store(index);
+		int latestIndex = header->latestIndex.load();
+		if (latestIndex == index)
+		{
+			break;
+		}
+		index = latestIndex;
+	}
+	return index;
+}
+
+const RegisteredLightsInfo* RegisteredLightBuffers::GetInfo(const RegisteredLightsHeader* header, int index)
+{
+	return GetInfos(const_cast<RegisteredLightsHeader*>(header)) + index;
+}
+
+const int32_t* RegisteredLightBuffers::GetValues(const RegisteredLightsHeader* header, int index)
+{
+	return GetBuffer(const_cast<RegisteredLightsHeader*>(header), index);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "LightValueBuffer.h"
+
+// Light values filled in place in memory a consumer registers once, so it can pick up each new set without copying,
+// pinning or marshalling it, and is told when there's one instead of having to poll.
+//
+// The memory starts with a RegisteredLightsHeader, followed by a RegisteredLightsInfo for each buffer, then the
+// buffers themselves, lightCount values each (0x00RRGGBB). There are at least three buffers, so one can be
+// filled while the consumer reads another without either waiting. To read the latest, the consumer:
+//   1. loads latestIndex, stopping if it's -1
+//   2. stores it in readingIndex, with a full barrier (an interlocked exchange)
+//   3. loads latestIndex again, going back to 2 if it's changed
+// and then has the buffer to itself until it changes readingIndex again. Buffers are never filled while they're
+// the latest or being read, and latestIndex is stored with a full barrier once one has been
+struct RegisteredLightsHeader
+{
+	std::atomic<int32_t> latestIndex;		// Buffer with the newest light values, -1 before the first. Set by us
+	std::atomic<int32_t> readingIndex;		// Buffer the consumer is reading, -1 for none. Set by the consumer
+	int32_t bufferCount;
+	int32_t lightCount;
+};
+
+struct RegisteredLightsInfo
+{
+	uint64_t sequence;						// As published, so increasing by one for every set
+	int64_t presentTime;					// Present time (microseconds) of the oldest frame behind the values, or 0
+};
+
+// Fills registered buffers as a sink of the published light values, which can be registered and unregistered
+// from any thread while they're being published
+class RegisteredLightBuffers : public LightValueSink
+{
+public:
+	typedef void (*FilledCallback)(void* context);
+
+public:
+	RegisteredLightBuffers();
+	~RegisteredLightBuffers();
+
+	// Bytes of memory needed for bufferCount buffers of lightCount values
+	static size_t GetSize(int bufferCount, int lightCount);
+
+	// Lays out the header in memory and fills it from then on, calling callback (if any) each time a buffer has
+	// been filled. The callback is called on the writer's thread and mustn't hold it up. The memory must stay put
+	// until Unregister, and registering again replaces it
+	bool Register(void* memory, size_t size, int bufferCount, int lightCount, FilledCallback callback, void* callbackContext);
+
+	// Once this returns, the memory isn't touched again and the callback isn't called
+	void Unregister();
+
+	bool IsRegistered();
+
+	virtual void WriteLights(const int32_t* values, int count, uint64_t sequence, int64_t presentTime);
+
+	// The consumer's side, for consumers in the same process. Returns the index of the latest buffer, which is then
+	// theirs until the next call, or -1 if there isn't one
+	static int AcquireLatest(RegisteredLightsHeader* header);
+	static const RegisteredLightsInfo* GetInfo(const RegisteredLightsHeader* header, int index);
+	static const int32_t* GetValues(const RegisteredLightsHeader* header, int index);
+
+public:
+	static const int MinBufferCount = 3;
+
+private:
+	std::mutex					m_Lock;
+	RegisteredLightsHeader*		m_Header;
+	FilledCallback				m_Callback;
+	void*						m_CallbackContext;
+};
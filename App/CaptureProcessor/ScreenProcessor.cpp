@@ -2,6 +2,8 @@
 
 #include "ScreenProcessor.h"
 
+#include "FrameGeometry.h"
+
 #include "VertexShader.h"
 #include "PixelShader.h"
 
@@ -146,25 +148,27 @@ Microsoft::WRL::ComPtr<ID3D11Device> ScreenProcessor::GetDevice() const
 //
 // Process a given frame and its metadata
 //
-bool ScreenProcessor::ProcessFrame(const DuplicationManager& duplicationManager, ComPtr<ID3D11Texture2D> sharedSurface, int offsetX, int offsetY)
+bool ScreenProcessor::ProcessFrame(const FrameSource& frameSource, ComPtr<ID3D11Texture2D> frameTexture, ComPtr<ID3D11Texture2D> sharedSurface, int offsetX, int offsetY)
 {
+	m_UpdatedRects.clear();
+
 	// Process dirties and moves
 	D3D11_TEXTURE2D_DESC textureDescription;
-	duplicationManager.GetTexture()->GetDesc(&textureDescription);
+	frameTexture->GetDesc(&textureDescription);
 
 	// Process the moves first
-	if (duplicationManager.GetMoveCount())
+	if (frameSource.GetMoveCount())
 	{
-		if (!ProcessMoves(sharedSurface, duplicationManager.GetMoveRects(), duplicationManager.GetMoveCount(), offsetX, offsetY, duplicationManager.GetOutputDesc(), textureDescription.Width, textureDescription.Height))
+		if (!ProcessMoves(sharedSurface, frameSource.GetMoveRects(), frameSource.GetMoveCount(), offsetX, offsetY, frameSource.GetFrameOutputDesc(), textureDescription.Width, textureDescription.Height))
 		{
 			return false;
 		}
 	}
 
 	// Now process the dirties
-	if (duplicationManager.GetDirtyCount())
+	if (frameSource.GetDirtyCount())
 	{
-		if (!ProcessDirty(duplicationManager.GetTexture(), sharedSurface, duplicationManager.GetDirtyRects(), duplicationManager.GetDirtyCount(), offsetX, offsetY, duplicationManager.GetOutputDesc()))
+		if (!ProcessDirty(frameTexture, sharedSurface, frameSource.GetDirtyRects(), frameSource.GetDirtyCount(), offsetX, offsetY, frameSource.GetFrameOutputDesc()))
 		{
 			return false;
 		}
@@ -173,10 +177,18 @@ bool ScreenProcessor::ProcessFrame(const DuplicationManager& duplicationManager,
 	return true;
 }
 
+//
+// Returns the rects of the shared surface updated by the last processed frame
+//
+const std::vector<FrameRect>& ScreenProcessor::GetUpdatedRects() const
+{
+	return m_UpdatedRects;
+}
+
 //
 // Copy move rectangles
 //
-bool ScreenProcessor::ProcessMoves(ComPtr<ID3D11Texture2D> sharedSurface, DXGI_OUTDUPL_MOVE_RECT* moveRects, unsigned int moveCount, int offsetX, int offsetY, const DXGI_OUTPUT_DESC& desktopDescription, int texWidth, int texHeight)
+bool ScreenProcessor::ProcessMoves(ComPtr<ID3D11Texture2D> sharedSurface, const FrameMoveRect* moveRects, unsigned int moveCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, int texWidth, int texHeight)
 {
 	D3D11_TEXTURE2D_DESC sharedDescription;
 	sharedSurface->GetDesc(&sharedDescription);
@@ -187,8 +199,8 @@ bool ScreenProcessor::ProcessMoves(ComPtr<ID3D11Texture2D> sharedSurface, DXGI_O
 	{
 		D3D11_TEXTURE2D_DESC moveDescription;
 		moveDescription = sharedDescription;
-		moveDescription.Width = desktopDescription.DesktopCoordinates.right - desktopDescription.DesktopCoordinates.left;
-		moveDescription.Height = desktopDescription.DesktopCoordinates.bottom - desktopDescription.DesktopCoordinates.top;
+		moveDescription.Width = outputDesc.desktopCoordinates.right - outputDesc.desktopCoordinates.left;
+		moveDescription.Height = outputDesc.desktopCoordinates.bottom - outputDesc.desktopCoordinates.top;
 		moveDescription.BindFlags = D3D11_BIND_RENDER_TARGET;
 		moveDescription.MiscFlags = 0;
 		HRESULT hr = m_Device->CreateTexture2D(&moveDescription, nullptr, &m_MoveSurface);
@@ -201,18 +213,18 @@ bool ScreenProcessor::ProcessMoves(ComPtr<ID3D11Texture2D> sharedSurface, DXGI_O
 
 	for (unsigned int moveRectIndex = 0; moveRectIndex < moveCount; ++moveRectIndex)
 	{
-		RECT srcRect;
-		RECT destRect;
+		FrameRect srcRect;
+		FrameRect destRect;
 
-		ConvertMoveRect(&srcRect, &destRect, desktopDescription, moveRects[moveRectIndex], texWidth, texHeight);
+		ConvertMoveRect(&srcRect, &destRect, outputDesc, moveRects[moveRectIndex], texWidth, texHeight);
 
 		// Copy rect out of shared surface to our temporary one
 		D3D11_BOX box;
-		box.left = srcRect.left + desktopDescription.DesktopCoordinates.left - offsetX;
-		box.top = srcRect.top + desktopDescription.DesktopCoordinates.top - offsetY;
+		box.left = srcRect.left + outputDesc.desktopCoordinates.left - offsetX;
+		box.top = srcRect.top + outputDesc.desktopCoordinates.top - offsetY;
 		box.front = 0;
-		box.right = srcRect.right + desktopDescription.DesktopCoordinates.left - offsetX;
-		box.bottom = srcRect.bottom + desktopDescription.DesktopCoordinates.top - offsetY;
+		box.right = srcRect.right + outputDesc.desktopCoordinates.left - offsetX;
+		box.bottom = srcRect.bottom + outputDesc.desktopCoordinates.top - offsetY;
 		box.back = 1;
 		m_DeviceContext->CopySubresourceRegion(m_MoveSurface.Get(), 0, srcRect.left, srcRect.top, 0, sharedSurface.Get(), 0, &box);
 
@@ -223,87 +235,19 @@ bool ScreenProcessor::ProcessMoves(ComPtr<ID3D11Texture2D> sharedSurface, DXGI_O
 		box.right = srcRect.right;
 		box.bottom = srcRect.bottom;
 		box.back = 1;
-		m_DeviceContext->CopySubresourceRegion(sharedSurface.Get(), 0, destRect.left + desktopDescription.DesktopCoordinates.left - offsetX, destRect.top + desktopDescription.DesktopCoordinates.top - offsetY, 0, m_MoveSurface.Get(), 0, &box);
+		m_DeviceContext->CopySubresourceRegion(sharedSurface.Get(), 0, destRect.left + outputDesc.desktopCoordinates.left - offsetX, destRect.top + outputDesc.desktopCoordinates.top - offsetY, 0, m_MoveSurface.Get(), 0, &box);
+
+		AddUpdatedRect(destRect, offsetX, offsetY, outputDesc);
 	}
 
 	return true;
 }
 
 
-// Converts a DX Move Rect into a source & destination RECT
-void ScreenProcessor::ConvertMoveRect(RECT* sourceRect, RECT* destRect, const DXGI_OUTPUT_DESC& desktopDescription, const DXGI_OUTDUPL_MOVE_RECT& moveRect, int texWidth, int texHeight)
-{
-	switch (desktopDescription.Rotation)
-	{
-	case DXGI_MODE_ROTATION_UNSPECIFIED:
-	case DXGI_MODE_ROTATION_IDENTITY:
-	{
-		sourceRect->left = moveRect.SourcePoint.x;
-		sourceRect->top = moveRect.SourcePoint.y;
-		sourceRect->right = moveRect.SourcePoint.x + moveRect.DestinationRect.right - moveRect.DestinationRect.left;
-		sourceRect->bottom = moveRect.SourcePoint.y + moveRect.DestinationRect.bottom - moveRect.DestinationRect.top;
-
-		*destRect = moveRect.DestinationRect;
-		
-	}
-	break;
-
-	case DXGI_MODE_ROTATION_ROTATE90:
-	{
-		sourceRect->left = texHeight - (moveRect.SourcePoint.y + moveRect.DestinationRect.bottom - moveRect.DestinationRect.top);
-		sourceRect->top = moveRect.SourcePoint.x;
-		sourceRect->right = texHeight - moveRect.SourcePoint.y;
-		sourceRect->bottom = moveRect.SourcePoint.x + moveRect.DestinationRect.right - moveRect.DestinationRect.left;
-
-		destRect->left = texHeight - moveRect.DestinationRect.bottom;
-		destRect->top = moveRect.DestinationRect.left;
-		destRect->right = texHeight - moveRect.DestinationRect.top;
-		destRect->bottom = moveRect.DestinationRect.right;
-		
-	}
-	break;
-
-	case DXGI_MODE_ROTATION_ROTATE180:
-	{
-		sourceRect->left = texWidth - (moveRect.SourcePoint.x + moveRect.DestinationRect.right - moveRect.DestinationRect.left);
-		sourceRect->top = texHeight - (moveRect.SourcePoint.y + moveRect.DestinationRect.bottom - moveRect.DestinationRect.top);
-		sourceRect->right = texWidth - moveRect.SourcePoint.x;
-		sourceRect->bottom = texHeight - moveRect.SourcePoint.y;
-
-		destRect->left = texWidth - moveRect.DestinationRect.right;
-		destRect->top = texHeight - moveRect.DestinationRect.bottom;
-		destRect->right = texWidth - moveRect.DestinationRect.left;
-		destRect->bottom = texHeight - moveRect.DestinationRect.top;
-	}
-	break;
-
-	case DXGI_MODE_ROTATION_ROTATE270:
-		{
-			sourceRect->left = moveRect.SourcePoint.x;
-			sourceRect->top = texWidth - (moveRect.SourcePoint.x + moveRect.DestinationRect.right - moveRect.DestinationRect.left);
-			sourceRect->right = moveRect.SourcePoint.y + moveRect.DestinationRect.bottom - moveRect.DestinationRect.top;
-			sourceRect->bottom = texWidth - moveRect.SourcePoint.x;
-
-			destRect->left = moveRect.DestinationRect.top;
-			destRect->top = texWidth - moveRect.DestinationRect.right;
-			destRect->right = moveRect.DestinationRect.bottom;
-			destRect->bottom = texWidth - moveRect.DestinationRect.left;
-		}
-		break;
-
-	default:
-		{
-			RtlZeroMemory(destRect, sizeof(RECT));
-			RtlZeroMemory(sourceRect, sizeof(RECT));
-		}
-		break;
-	}
-}
-
 //
 // Copies dirty rectangles
 //
-bool ScreenProcessor::ProcessDirty(ComPtr<ID3D11Texture2D> sourceSurface, ComPtr<ID3D11Texture2D> sharedSurface, RECT* dirtyRects, unsigned int dirtyCount, int offsetX, int offsetY, const DXGI_OUTPUT_DESC& desktopDescription)
+bool ScreenProcessor::ProcessDirty(ComPtr<ID3D11Texture2D> sourceSurface, ComPtr<ID3D11Texture2D> sharedSurface, const FrameRect* dirtyRects, unsigned int dirtyCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc)
 {
 	HRESULT hr;
 
@@ -366,7 +310,8 @@ bool ScreenProcessor::ProcessDirty(ComPtr<ID3D11Texture2D> sourceSurface, ComPtr
 	Vertex* vertex = &m_DirtyRectVertices[0];
 	for (unsigned int rectIndex = 0; rectIndex < dirtyCount; ++rectIndex, vertex += numVerticesPerRect)
 	{
-		BuildDirtyVerts(vertex, dirtyRects[rectIndex], offsetX, offsetY, desktopDescription, sharedDescription, sourceDescription);
+		BuildDirtyVerts(vertex, dirtyRects[rectIndex], offsetX, offsetY, outputDesc, sharedDescription, sourceDescription);
+		AddUpdatedRect(RotateDirtyRect(dirtyRects[rectIndex], outputDesc), offsetX, offsetY, outputDesc);
 	}
 
 	// Create vertex buffer
@@ -415,98 +360,23 @@ bool ScreenProcessor::ProcessDirty(ComPtr<ID3D11Texture2D> sourceSurface, ComPtr
 //
 // Sets up vertices for dirty rects for rotated desktops
 //
-void ScreenProcessor::BuildDirtyVerts(Vertex* vertices, const RECT& dirtyRect, int offsetX, int offsetY, const DXGI_OUTPUT_DESC& desktopDescription, const D3D11_TEXTURE2D_DESC& sharedDescription, const D3D11_TEXTURE2D_DESC& sourceDescription)
+void ScreenProcessor::BuildDirtyVerts(Vertex* vertices, const FrameRect& dirtyRect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, const D3D11_TEXTURE2D_DESC& sharedDescription, const D3D11_TEXTURE2D_DESC& sourceDescription)
 {
-	int centerX = sharedDescription.Width / 2;
-	int centerY = sharedDescription.Height / 2;
-
-	int width = desktopDescription.DesktopCoordinates.right - desktopDescription.DesktopCoordinates.left;
-	int height = desktopDescription.DesktopCoordinates.bottom - desktopDescription.DesktopCoordinates.top;
-
-	// Rotation compensated destination rect
-	RECT destDirty = dirtyRect;
-
-	// Set appropriate coordinates compensated for rotation
-	switch (desktopDescription.Rotation)
-	{
-	case DXGI_MODE_ROTATION_ROTATE90:
-		{
-			destDirty.left = width - dirtyRect.bottom;
-			destDirty.top = dirtyRect.left;
-			destDirty.right = width - dirtyRect.top;
-			destDirty.bottom = dirtyRect.right;
-
-			vertices[0].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[1].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[2].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[5].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-		}
-		break;
-
-	case DXGI_MODE_ROTATION_ROTATE180:
-		{
-			destDirty.left = width - dirtyRect.right;
-			destDirty.top = height - dirtyRect.bottom;
-			destDirty.right = width - dirtyRect.left;
-			destDirty.bottom = height - dirtyRect.top;
-
-			vertices[0].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[1].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[2].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[5].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-		
-		}
-		break;
-
-		case DXGI_MODE_ROTATION_ROTATE270:
-		{
-			destDirty.left = dirtyRect.top;
-			destDirty.top = height - dirtyRect.right;
-			destDirty.right = dirtyRect.bottom;
-			destDirty.bottom = height - dirtyRect.left;
-
-			vertices[0].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[1].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[2].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[5].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-		}
-		break;
+	static_assert(sizeof(Vertex) == sizeof(FrameVertex), "Vertex must match FrameVertex");
 
-	default:
-		assert(false); // drop through
-	case DXGI_MODE_ROTATION_UNSPECIFIED:
-	case DXGI_MODE_ROTATION_IDENTITY:
-		{
-			vertices[0].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[1].TexCoord = DirectX::XMFLOAT2(dirtyRect.left / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[2].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.bottom / static_cast<FLOAT>(sourceDescription.Height));
-			vertices[5].TexCoord = DirectX::XMFLOAT2(dirtyRect.right / static_cast<FLOAT>(sourceDescription.Width), dirtyRect.top / static_cast<FLOAT>(sourceDescription.Height));
-			
-		}
-		break;
-	}
+	BuildDirtyVertices(reinterpret_cast<FrameVertex*>(vertices), dirtyRect, offsetX, offsetY, outputDesc, sharedDescription.Width, sharedDescription.Height, sourceDescription.Width, sourceDescription.Height);
+}
 
-	// Set positions
-	// First triangle
-	vertices[0].Pos = DirectX::XMFLOAT3((destDirty.left + desktopDescription.DesktopCoordinates.left - offsetX - centerX) / static_cast<FLOAT>(centerX),
-										-1 * (destDirty.bottom + desktopDescription.DesktopCoordinates.top - offsetY - centerY) / static_cast<FLOAT>(centerY),
-										0.0f);
-	vertices[1].Pos = DirectX::XMFLOAT3((destDirty.left + desktopDescription.DesktopCoordinates.left - offsetX - centerX) / static_cast<FLOAT>(centerX),
-										-1 * (destDirty.top + desktopDescription.DesktopCoordinates.top - offsetY - centerY) / static_cast<FLOAT>(centerY),
-										0.0f);
-	vertices[2].Pos = DirectX::XMFLOAT3((destDirty.right + desktopDescription.DesktopCoordinates.left - offsetX - centerX) / static_cast<FLOAT>(centerX),
-										-1 * (destDirty.bottom + desktopDescription.DesktopCoordinates.top - offsetY - centerY) / static_cast<FLOAT>(centerY),
-										0.0f);
-	
-	// Second triangle
-	vertices[3].Pos = vertices[2].Pos;
-	vertices[4].Pos = vertices[1].Pos;
-	vertices[5].Pos = DirectX::XMFLOAT3((destDirty.right + desktopDescription.DesktopCoordinates.left - offsetX - centerX) / static_cast<FLOAT>(centerX),
-										-1 * (destDirty.top + desktopDescription.DesktopCoordinates.top - offsetY - centerY) / static_cast<FLOAT>(centerY),
-										0.0f);
-
-	// Remaining texture coordinates
-	vertices[3].TexCoord = vertices[2].TexCoord;
-	vertices[4].TexCoord = vertices[1].TexCoord;
+//
+// Records a rect in desktop space as updated on the shared surface
+//
+void ScreenProcessor::AddUpdatedRect(const FrameRect& rect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc)
+{
+	FrameRect updatedRect;
+	updatedRect.left = rect.left + outputDesc.desktopCoordinates.left - offsetX;
+	updatedRect.top = rect.top + outputDesc.desktopCoordinates.top - offsetY;
+	updatedRect.right = rect.right + outputDesc.desktopCoordinates.left - offsetX;
+	updatedRect.bottom = rect.bottom + outputDesc.desktopCoordinates.top - offsetY;
+	m_UpdatedRects.push_back(updatedRect);
 }
 
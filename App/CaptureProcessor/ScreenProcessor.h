@@ -1,13 +1,15 @@
 #pragma once
 
+#include <vector>
+
 #include "DirectXResources.h"
 
-#include "DuplicationManager.h"
+#include "FrameSource.h"
 
 #include "Vertex.h"
 
 // For handling updates from a single screen
-// This processes updates from the DuplicationManager and composites them onto
+// This processes updates from a FrameSource and composites them onto
 // the shared surface
 class ScreenProcessor
 {
@@ -16,14 +18,15 @@ public:
 	~ScreenProcessor();
 	bool Initialise(HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent);
 	Microsoft::WRL::ComPtr<ID3D11Device> GetDevice() const;
-	bool ProcessFrame(const DuplicationManager& duplicationManager, Microsoft::WRL::ComPtr<ID3D11Texture2D> sharedSurface, int offsetX, int offsetY);
+	bool ProcessFrame(const FrameSource& frameSource, Microsoft::WRL::ComPtr<ID3D11Texture2D> frameTexture, Microsoft::WRL::ComPtr<ID3D11Texture2D> sharedSurface, int offsetX, int offsetY);
+	const std::vector<FrameRect>& GetUpdatedRects() const;
 
 private:
-	bool ProcessMoves(Microsoft::WRL::ComPtr<ID3D11Texture2D> sharedSurface, DXGI_OUTDUPL_MOVE_RECT* moveRects, unsigned int moveCount, int offsetX, int offsetY, const DXGI_OUTPUT_DESC& desktopDescription, int texWidth, int texHeight);
-	void ConvertMoveRect(RECT* sourceRect, RECT* destRect, const DXGI_OUTPUT_DESC& desktopDescription, const DXGI_OUTDUPL_MOVE_RECT& moveRect, int texWidth, int texHeight);
+	bool ProcessMoves(Microsoft::WRL::ComPtr<ID3D11Texture2D> sharedSurface, const FrameMoveRect* moveRects, unsigned int moveCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, int texWidth, int texHeight);
 
-	bool ProcessDirty(Microsoft::WRL::ComPtr<ID3D11Texture2D> sourceSurface, Microsoft::WRL::ComPtr<ID3D11Texture2D> sharedSurface, RECT* dirtyRects, unsigned int dirtyCount, int offsetX, int offsetY, const DXGI_OUTPUT_DESC& desktopDescription);
-	void BuildDirtyVerts(Vertex* vertices, const RECT& dirtyRect, int offsetX, int offsetY, const DXGI_OUTPUT_DESC& desktopDescription, const D3D11_TEXTURE2D_DESC& sharedDescription, const D3D11_TEXTURE2D_DESC& sourceDescription);
+	bool ProcessDirty(Microsoft::WRL::ComPtr<ID3D11Texture2D> sourceSurface, Microsoft::WRL::ComPtr<ID3D11Texture2D> sharedSurface, const FrameRect* dirtyRects, unsigned int dirtyCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc);
+	void BuildDirtyVerts(Vertex* vertices, const FrameRect& dirtyRect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, const D3D11_TEXTURE2D_DESC& sharedDescription, const D3D11_TEXTURE2D_DESC& sourceDescription);
+	void AddUpdatedRect(const FrameRect& rect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc);
 	
 	
 private:
@@ -51,6 +54,9 @@ private:
 	// Vertex buffer for dirty rects
 	std::vector<Vertex>		m_DirtyRectVertices;
 
+	// Rects of the shared surface updated by the last frame
+	std::vector<FrameRect>	m_UpdatedRects;
+
 	HANDLE					m_UnexpectedErrorEvent;
 	HANDLE					m_ExpectedErrorEvent;
 };
@@ -0,0 +1,556 @@
+#include "SerialPort.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#endif
+
+#if defined(_WIN32)
+//
+// COM10 and above can only be opened through the device namespace, which works for the rest too
+//
+static std::wstring DevicePath(const std::string& port)
+{
+	std::string path = (port.compare(0, 4, "\\\\.\\") == 0) ? port : "\\\\.\\" + port;
+	int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	if (length <= 0)
+	{
+		return std::wstring();
+	}
+
+	std::wstring widePath(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+	widePath.resize(length - 1);
+	return widePath;
+}
+#else
+#if defined(__linux__) && defined(TCGETS2)
+// The kernel's termios2, which takes any baud rate. glibc doesn't declare it, and the kernel headers clash with termios.h
+struct termios2
+{
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+
+#if !defined(BOTHER)
+#define BOTHER 0010000
+#endif
+#endif
+
+//
+// The termios constant for a baud rate, or B0 if there isn't one
+//
+static speed_t BaudRateConstant(int baudRate)
+{
+	switch (baudRate)
+	{
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+#if defined(B460800)
+	case 460800: return B460800;
+#endif
+#if defined(B500000)
+	case 500000: return B500000;
+#endif
+#if defined(B921600)
+	case 921600: return B921600;
+#endif
+#if defined(B1000000)
+	case 1000000: return B1000000;
+#endif
+#if defined(B2000000)
+	case 2000000: return B2000000;
+#endif
+	default: return B0;
+	}
+}
+
+static int64_t MillisecondsNow()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+SerialPort::SerialPort() :
+#if defined(_WIN32)
+	m_Port(INVALID_HANDLE_VALUE),
+	m_ReadEvent(nullptr),
+	m_WriteEvent(nullptr),
+	m_WakeEvent(nullptr),
+	m_ReadTimeout(0)
+#else
+	m_Port(-1),
+	m_Epoll(-1)
+#endif
+{
+#if !defined(_WIN32)
+	m_WakeFds[0] = m_WakeFds[1] = -1;
+#endif
+}
+
+SerialPort::~SerialPort()
+{
+	Close();
+}
+
+bool SerialPort::Open(const std::string& port, int baudRate)
+{
+	Close();
+
+#if defined(_WIN32)
+	m_Port = CreateFileW(DevicePath(port).c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+	if (m_Port == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	// Read and write events are manual reset, as overlapped I/O expects. Wakes are used up by the wait
+	m_ReadEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	m_WriteEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	m_WakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (!m_ReadEvent || !m_WriteEvent || !m_WakeEvent)
+	{
+		Close();
+		return false;
+	}
+#else
+	m_Port = open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (m_Port < 0)
+	{
+		return false;
+	}
+
+	if (pipe(m_WakeFds) != 0)
+	{
+		m_WakeFds[0] = m_WakeFds[1] = -1;
+		Close();
+		return false;
+	}
+	for (int wakeFd : m_WakeFds)
+	{
+		fcntl(wakeFd, F_SETFL, fcntl(wakeFd, F_GETFL) | O_NONBLOCK);
+		fcntl(wakeFd, F_SETFD, FD_CLOEXEC);
+	}
+
+#if defined(__linux__)
+	m_Epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (m_Epoll < 0)
+	{
+		Close();
+		return false;
+	}
+
+	struct epoll_event portEvent = {};
+	portEvent.events = EPOLLIN;
+	portEvent.data.fd = m_Port;
+	struct epoll_event wakeEvent = {};
+	wakeEvent.events = EPOLLIN;
+	wakeEvent.data.fd = m_WakeFds[0];
+	if (epoll_ctl(m_Epoll, EPOLL_CTL_ADD, m_Port, &portEvent) != 0 || epoll_ctl(m_Epoll, EPOLL_CTL_ADD, m_WakeFds[0], &wakeEvent) != 0)
+	{
+		Close();
+		return false;
+	}
+#endif
+#endif
+
+	if (!Configure(baudRate))
+	{
+		Close();
+		return false;
+	}
+
+	DiscardInput();
+	return true;
+}
+
+bool SerialPort::SetBaudRate(int baudRate)
+{
+	return IsOpen() && Configure(baudRate);
+}
+
+//
+// Raw 8 data bits, no parity, one stop bit and no flow control, matching the controller board
+//
+bool SerialPort::Configure(int baudRate)
+{
+#if defined(_WIN32)
+	DCB dcb = {};
+	dcb.DCBlength = sizeof(dcb);
+	if (!GetCommState(m_Port, &dcb))
+	{
+		return false;
+	}
+
+	dcb.BaudRate = baudRate;
+	dcb.ByteSize = 8;
+	dcb.Parity = NOPARITY;
+	dcb.StopBits = ONESTOPBIT;
+	dcb.fBinary = TRUE;
+	dcb.fParity = FALSE;
+	dcb.fOutxCtsFlow = FALSE;
+	dcb.fOutxDsrFlow = FALSE;
+	dcb.fDtrControl = DTR_CONTROL_DISABLE;
+	dcb.fDsrSensitivity = FALSE;
+	dcb.fOutX = FALSE;
+	dcb.fInX = FALSE;
+	dcb.fNull = FALSE;
+	dcb.fRtsControl = RTS_CONTROL_DISABLE;
+	dcb.fAbortOnError = FALSE;
+	if (!SetCommState(m_Port, &dcb))
+	{
+		return false;
+	}
+
+	// Plenty of room for a whole frame of light data either way
+	SetupComm(m_Port, 4096, 4096);
+
+	// Reads return as soon as anything arrives. The timeout is set for each read
+	COMMTIMEOUTS timeouts = {};
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	if (!SetCommTimeouts(m_Port, &timeouts))
+	{
+		return false;
+	}
+	m_ReadTimeout = 0;
+	return true;
+#else
+	struct termios settings;
+	if (tcgetattr(m_Port, &settings) != 0)
+	{
+		return false;
+	}
+
+	cfmakeraw(&settings);
+	settings.c_cflag |= CLOCAL | CREAD;
+	settings.c_cflag &= ~(CSTOPB | PARENB);
+#if defined(CRTSCTS)
+	settings.c_cflag &= ~CRTSCTS;
+#endif
+	settings.c_iflag &= ~(IXON | IXOFF | IXANY);
+	settings.c_cc[VMIN] = 0;
+	settings.c_cc[VTIME] = 0;
+
+	speed_t speed = BaudRateConstant(baudRate);
+	if (speed != B0)
+	{
+		cfsetispeed(&settings, speed);
+		cfsetospeed(&settings, speed);
+	}
+	if (tcsetattr(m_Port, TCSANOW, &settings) != 0)
+	{
+		return false;
+	}
+
+	if (speed == B0)
+	{
+#if defined(__linux__) && defined(TCGETS2)
+		// Not a standard rate (like the board's 288000), so ask for it directly
+		struct termios2 customSettings;
+		if (ioctl(m_Port, TCGETS2, &customSettings) != 0)
+		{
+			return false;
+		}
+		customSettings.c_cflag &= ~CBAUD;
+		customSettings.c_cflag |= BOTHER;
+		customSettings.c_ispeed = baudRate;
+		customSettings.c_ospeed = baudRate;
+		if (ioctl(m_Port, TCSETS2, &customSettings) != 0)
+		{
+			return false;
+		}
+#else
+		return false;
+#endif
+	}
+	return true;
+#endif
+}
+
+void SerialPort::Close()
+{
+#if defined(_WIN32)
+	if (m_Port != INVALID_HANDLE_VALUE)
+	{
+		CancelIoEx(m_Port, nullptr);
+		CloseHandle(m_Port);
+		m_Port = INVALID_HANDLE_VALUE;
+	}
+	if (m_ReadEvent)
+	{
+		CloseHandle(m_ReadEvent);
+		m_ReadEvent = nullptr;
+	}
+	if (m_WriteEvent)
+	{
+		CloseHandle(m_WriteEvent);
+		m_WriteEvent = nullptr;
+	}
+	if (m_WakeEvent)
+	{
+		CloseHandle(m_WakeEvent);
+		m_WakeEvent = nullptr;
+	}
+#else
+	if (m_Epoll >= 0)
+	{
+		close(m_Epoll);
+		m_Epoll = -1;
+	}
+	for (int& wakeFd : m_WakeFds)
+	{
+		if (wakeFd >= 0)
+		{
+			close(wakeFd);
+			wakeFd = -1;
+		}
+	}
+	if (m_Port >= 0)
+	{
+		close(m_Port);
+		m_Port = -1;
+	}
+#endif
+}
+
+bool SerialPort::IsOpen() const
+{
+#if defined(_WIN32)
+	return m_Port != INVALID_HANDLE_VALUE;
+#else
+	return m_Port >= 0;
+#endif
+}
+
+int SerialPort::Read(uint8_t* buffer, int length, int timeoutMilliseconds)
+{
+	if (!IsOpen())
+	{
+		return -1;
+	}
+
+#if defined(_WIN32)
+	// A read returns as soon as any input arrives, or after the total timeout. That can't be MAXDWORD, so wait
+	// on the overlapped read ourselves in that case
+	DWORD readTimeout = (timeoutMilliseconds < 0 || timeoutMilliseconds >= MAXDWORD) ? (MAXDWORD - 1) : static_cast<DWORD>(timeoutMilliseconds);
+	if (readTimeout != m_ReadTimeout)
+	{
+		COMMTIMEOUTS timeouts = {};
+		timeouts.ReadIntervalTimeout = MAXDWORD;
+		if (readTimeout > 0)
+		{
+			timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+			timeouts.ReadTotalTimeoutConstant = readTimeout;
+		}
+		if (!SetCommTimeouts(m_Port, &timeouts))
+		{
+			return -1;
+		}
+		m_ReadTimeout = readTimeout;
+	}
+
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = m_ReadEvent;
+	DWORD bytesRead = 0;
+	if (!ReadFile(m_Port, buffer, length, &bytesRead, &overlapped))
+	{
+		if (GetLastError() != ERROR_IO_PENDING)
+		{
+			return -1;
+		}
+
+		HANDLE events[] = { m_ReadEvent, m_WakeEvent };
+		if (WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE) != WAIT_OBJECT_0)
+		{
+			// Woken, so give up on the read. Anything that arrived in the meantime is still returned
+			CancelIoEx(m_Port, &overlapped);
+		}
+		if (!GetOverlappedResult(m_Port, &overlapped, &bytesRead, TRUE) && GetLastError() != ERROR_OPERATION_ABORTED)
+		{
+			return -1;
+		}
+	}
+	return static_cast<int>(bytesRead);
+#else
+	// Take anything that's already arrived without waiting
+	ssize_t bytesRead = read(m_Port, buffer, length);
+	if (bytesRead > 0)
+	{
+		return static_cast<int>(bytesRead);
+	}
+	if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	{
+		return -1;
+	}
+
+	bool portReady = false;
+	bool portFailed = false;
+	bool woken = false;
+#if defined(__linux__)
+	struct epoll_event events[2];
+	int eventCount = epoll_wait(m_Epoll, events, 2, timeoutMilliseconds);
+	for (int eventIndex = 0; eventIndex < eventCount; ++eventIndex)
+	{
+		if (events[eventIndex].data.fd == m_WakeFds[0])
+		{
+			woken = true;
+		}
+		else
+		{
+			portReady = (events[eventIndex].events & EPOLLIN) != 0;
+			portFailed = (events[eventIndex].events & (EPOLLERR | EPOLLHUP)) != 0;
+		}
+	}
+#else
+	struct pollfd pollFds[2] = { { m_Port, POLLIN, 0 }, { m_WakeFds[0], POLLIN, 0 } };
+	if (poll(pollFds, 2, timeoutMilliseconds) > 0)
+	{
+		portReady = (pollFds[0].revents & POLLIN) != 0;
+		portFailed = (pollFds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+		woken = (pollFds[1].revents & POLLIN) != 0;
+	}
+#endif
+
+	if (woken)
+	{
+		uint8_t wakeBytes[16];
+		while (read(m_WakeFds[0], wakeBytes, sizeof(wakeBytes)) > 0)
+		{
+		}
+	}
+
+	if (portReady)
+	{
+		bytesRead = read(m_Port, buffer, length);
+		if (bytesRead > 0)
+		{
+			return static_cast<int>(bytesRead);
+		}
+		if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			return -1;
+		}
+	}
+
+	// Hung up with nothing left to read
+	return portFailed ? -1 : 0;
+#endif
+}
+
+bool SerialPort::Write(const uint8_t* data, int length, int timeoutMilliseconds)
+{
+	if (!IsOpen())
+	{
+		return false;
+	}
+
+#if defined(_WIN32)
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = m_WriteEvent;
+	DWORD bytesWritten = 0;
+	if (!WriteFile(m_Port, data, length, &bytesWritten, &overlapped))
+	{
+		if (GetLastError() != ERROR_IO_PENDING)
+		{
+			return false;
+		}
+
+		if (WaitForSingleObject(m_WriteEvent, (timeoutMilliseconds < 0) ? INFINITE : timeoutMilliseconds) != WAIT_OBJECT_0)
+		{
+			CancelIoEx(m_Port, &overlapped);
+			GetOverlappedResult(m_Port, &overlapped, &bytesWritten, TRUE);
+			return false;
+		}
+		if (!GetOverlappedResult(m_Port, &overlapped, &bytesWritten, FALSE))
+		{
+			return false;
+		}
+	}
+	return bytesWritten == static_cast<DWORD>(length);
+#else
+	int64_t deadline = MillisecondsNow() + timeoutMilliseconds;
+	while (length > 0)
+	{
+		ssize_t bytesWritten = write(m_Port, data, length);
+		if (bytesWritten > 0)
+		{
+			data += bytesWritten;
+			length -= static_cast<int>(bytesWritten);
+			continue;
+		}
+		if (bytesWritten < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			return false;
+		}
+
+		// Output buffer is full, so wait for it to drain
+		int64_t remaining = deadline - MillisecondsNow();
+		if (timeoutMilliseconds >= 0 && remaining <= 0)
+		{
+			return false;
+		}
+		struct pollfd pollFd = { m_Port, POLLOUT, 0 };
+		if (poll(&pollFd, 1, (timeoutMilliseconds < 0) ? -1 : static_cast<int>(remaining)) < 0 && errno != EINTR)
+		{
+			return false;
+		}
+		if (pollFd.revents & (POLLERR | POLLHUP | POLLNVAL))
+		{
+			return false;
+		}
+	}
+	return true;
+#endif
+}
+
+void SerialPort::DiscardInput()
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	PurgeComm(m_Port, PURGE_RXCLEAR);
+#else
+	tcflush(m_Port, TCIFLUSH);
+#endif
+}
+
+void SerialPort::Wake()
+{
+#if defined(_WIN32)
+	if (m_WakeEvent)
+	{
+		SetEvent(m_WakeEvent);
+	}
+#else
+	if (m_WakeFds[1] >= 0)
+	{
+		uint8_t wakeByte = 1;
+		ssize_t written = write(m_WakeFds[1], &wakeByte, 1);
+		(void)written;
+	}
+#endif
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// A raw 8N1 serial port, using overlapped I/O on Windows and termios everywhere else (waiting with epoll on Linux).
+// One thread reads and writes, while any other thread may call Wake to cut short a wait for input
+class SerialPort
+{
+public:
+	SerialPort();
+	~SerialPort();
+
+	// Port names are COM3 style on Windows, and device paths (/dev/ttyACM0) everywhere else
+	bool Open(const std::string& port, int baudRate);
+	void Close();
+	bool IsOpen() const;
+
+	// Switches an open port to another baud rate. Anything still going out may be sent at either rate
+	bool SetBaudRate(int baudRate);
+
+	// Waits up to timeoutMilliseconds for some input, or until Wake is called, then reads what's there.
+	// Returns the number of bytes read (0 on timeout or wake) or -1 if the port has failed
+	int Read(uint8_t* buffer, int length, int timeoutMilliseconds);
+
+	// Writes all of data, giving up after timeoutMilliseconds
+	bool Write(const uint8_t* data, int length, int timeoutMilliseconds);
+
+	// Throws away any input that hasn't been read yet
+	void DiscardInput();
+
+	// Makes a Read in progress (or the next one) return straight away
+	void Wake();
+
+private:
+	bool Configure(int baudRate);
+
+private:
+#if defined(_WIN32)
+	void*			m_Port;
+	void*			m_ReadEvent;
+	void*			m_WriteEvent;
+	void*			m_WakeEvent;
+	unsigned long	m_ReadTimeout;
+#else
+	int				m_Port;
+	int				m_WakeFds[2];
+	int				m_Epoll;
+#endif
+};
@@ -0,0 +1,1221 @@
+#include "SerialTransport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "LightLayout.h"
+
+static int64_t MillisecondsNow()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SerialTransport::SerialTransport(LatencyStats* latencyStats) :
+	m_LatencyStats(latencyStats),
+	m_StopRequested(false),
+	m_Running(false),
+	m_BoardAlive(false),
+	m_FramesSent(0),
+	m_FramesShown(0),
+	m_FramesDropped(0),
+	m_LightBytesSent(0),
+	m_Features(LightProtocolDefaultFeatures),
+	m_ActiveFeatures(0),
+	m_BaudRate(0),
+	m_ReadyGeneration(0),
+	m_LostGeneration(0),
+	m_FrameCallback(nullptr),
+	m_FrameCallbackContext(nullptr),
+	m_LightColumns(0),
+	m_LightRows(0),
+	m_LightsUpdated(false),
+	m_LightPresentTime(0),
+	m_DebugRequested(false),
+	m_LightGeneration(0),
+	m_ShowGeneration(0),
+	m_LightDataPending(false),
+	m_KeepAliveTime(0),
+	m_NextFrameTime(0),
+	m_SentPresentTime(0),
+	m_SentGeneration(0),
+	m_ReadingDebugLine(false),
+	m_ReplyCommand(0),
+	m_ReplyLength(0),
+	m_ReplyExpected(0),
+	m_Negotiation(NegotiationNone),
+	m_NegotiationTimeout(0),
+	m_BaseBaudRate(0),
+	m_LinkRateCode(0),
+	m_FailedLinkRates(0),
+	m_FramesExpiredInARow(0),
+	m_FrameSequence(0),
+	m_FramesInFlight(0),
+	m_FrameHeld(false),
+	m_HeldSequence(0),
+	m_FrameChunk(0),
+	m_KeyframeNeeded(true),
+	m_ClockQueryTime(0),
+	m_NextClockQueryTime(0),
+	m_ClockSampleCount(0)
+{
+	memset(&m_BoardCapabilities, 0, sizeof(m_BoardCapabilities));
+}
+
+SerialTransport::~SerialTransport()
+{
+	Stop();
+}
+
+bool SerialTransport::Start(const std::string& port, int baudRate, int lightColumns, int lightRows)
+{
+	if (m_Thread.joinable())
+	{
+		return false;
+	}
+
+	// Anything past a byte in either needs a board that takes the layout with 'G'
+	if (lightColumns <= 0 || lightRows <= 0 || static_cast<int64_t>(lightColumns) * lightRows > LightLayoutMaxLights)
+	{
+		return false;
+	}
+
+	if (!m_Port.Open(port, baudRate))
+	{
+		return false;
+	}
+
+	m_BaseBaudRate = baudRate;
+	m_BaudRate = baudRate;
+	m_LinkRateCode = 0;
+	m_FailedLinkRates = 0;
+	m_FramesExpiredInARow = 0;
+
+	m_LightColumns = lightColumns;
+	m_LightRows = lightRows;
+	m_LightValues.assign(lightColumns * lightRows, 0);
+	m_LightData.resize(m_LightValues.size() * 3);
+	m_BaseLightData.resize(m_LightData.size());
+	m_Ditherer.Initialise(static_cast<int>(m_LightValues.size()));
+	m_LightsUpdated = false;
+	m_LightPresentTime = 0;
+	m_DebugRequested = false;
+	m_DebugLines.clear();
+	m_LightGeneration = 0;
+	m_ShowGeneration = 0;
+	m_ReadyGeneration = 0;
+	m_LostGeneration = 0;
+
+	m_LightDataPending = false;
+	m_NextFrameTime = 0;
+	m_SentPresentTime = 0;
+	m_SentGeneration = 0;
+	m_FrameHeld = false;
+	m_ReadingDebugLine = false;
+	m_DebugLine.clear();
+	m_ReplyCommand = 0;
+	m_Negotiation = NegotiationNone;
+	m_ActiveFeatures = 0;
+	m_FramesInFlight = 0;
+	m_FrameData.clear();
+	m_FrameChunkEnds.clear();
+	m_FrameChunk = 0;
+	m_ClockQueryTime = 0;
+	m_ClockSampleCount = 0;
+	m_BoardAlive = false;
+	m_FramesSent = 0;
+	m_FramesShown = 0;
+	m_FramesDropped = 0;
+	m_LightBytesSent = 0;
+
+	m_StopRequested = false;
+	m_Running = true;
+	m_Thread = std::thread(&SerialTransport::Run, this);
+	return true;
+}
+
+void SerialTransport::Stop()
+{
+	if (m_Thread.joinable())
+	{
+		m_StopRequested = true;
+		m_Port.Wake();
+		m_Thread.join();
+	}
+	m_Port.Close();
+	m_Running = false;
+	m_BoardAlive = false;
+}
+
+bool SerialTransport::IsRunning() const
+{
+	return m_Running;
+}
+
+bool SerialTransport::IsBoardAlive() const
+{
+	return m_BoardAlive;
+}
+
+void SerialTransport::SetFeatures(uint16_t features)
+{
+	m_Features = features & LightProtocolHostFeatures;
+}
+
+uint16_t SerialTransport::GetActiveFeatures() const
+{
+	return m_ActiveFeatures;
+}
+
+void SerialTransport::SetLightValues(const int32_t* values, int count, int64_t presentTime)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		size_t copyCount = std::min(static_cast<size_t>(count), m_LightValues.size());
+		if (copyCount > 0)
+		{
+			memcpy(&m_LightValues[0], values, copyCount * sizeof(int32_t));
+		}
+		m_LightsUpdated = true;
+		++m_LightGeneration;
+
+		// Keep the oldest frame we've not sent yet
+		if (m_LightPresentTime == 0)
+		{
+			m_LightPresentTime = presentTime;
+		}
+	}
+
+	// Let the I/O thread tell the board straight away
+	m_Port.Wake();
+}
+
+void SerialTransport::SetFrameCallback(FrameCallback callback, void* context)
+{
+	m_FrameCallback = callback;
+	m_FrameCallbackContext = context;
+}
+
+uint64_t SerialTransport::GetReadyGeneration() const
+{
+	return m_ReadyGeneration;
+}
+
+uint64_t SerialTransport::GetLostGeneration() const
+{
+	return m_LostGeneration;
+}
+
+void SerialTransport::Show(uint64_t generation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_ShowGeneration = generation;
+	}
+	m_Port.Wake();
+}
+
+void SerialTransport::RequestDebugInfo()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_DebugRequested = true;
+	}
+	m_Port.Wake();
+}
+
+bool SerialTransport::TakeDebugLine(std::string* line)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (m_DebugLines.empty())
+	{
+		return false;
+	}
+
+	line->swap(m_DebugLines.front());
+	m_DebugLines.pop_front();
+	return true;
+}
+
+uint64_t SerialTransport::GetFramesSent() const
+{
+	return m_FramesSent;
+}
+
+uint64_t SerialTransport::GetFramesShown() const
+{
+	return m_FramesShown;
+}
+
+uint64_t SerialTransport::GetFramesDropped() const
+{
+	return m_FramesDropped;
+}
+
+uint64_t SerialTransport::GetLightBytesSent() const
+{
+	return m_LightBytesSent;
+}
+
+int SerialTransport::GetBaudRate() const
+{
+	return m_BaudRate;
+}
+
+//
+// Main loop of the I/O thread. Sleeps until the board sends something, new light values are handed over,
+// or something times out
+//
+void SerialTransport::Run()
+{
+	int64_t listenTime = MillisecondsNow() + OpenDelayMilliseconds;
+	uint8_t input[256];
+	while (!m_StopRequested)
+	{
+		int64_t now = MillisecondsNow();
+		int64_t wakeTime = (now < listenTime) ? listenTime : GetNextWakeTime(now);
+
+		int bytesRead = m_Port.Read(input, sizeof(input), static_cast<int>(std::max<int64_t>(0, wakeTime - now)));
+		if (bytesRead < 0)
+		{
+			break;
+		}
+
+		now = MillisecondsNow();
+		if (now < listenTime)
+		{
+			// Ignore any initial input, which is probably garbage from a buffer
+			continue;
+		}
+
+		bool failed = false;
+		for (int index = 0; index < bytesRead && !failed; ++index)
+		{
+			failed = !HandleByte(input[index], now);
+		}
+
+		if (!failed && IsNegotiating() && now >= m_NegotiationTimeout)
+		{
+			failed = !HandleNegotiationTimeout(now);
+		}
+
+		if (failed || !SendPending(now))
+		{
+			break;
+		}
+	}
+
+	m_BoardAlive = false;
+	m_Running = false;
+}
+
+//
+// When the I/O thread next has something to do without any input
+//
+int64_t SerialTransport::GetNextWakeTime(int64_t now) const
+{
+	int64_t wakeTime = now + KeepAliveMilliseconds;
+	if (IsNegotiating())
+	{
+		wakeTime = std::min(wakeTime, m_NegotiationTimeout);
+	}
+	else if (m_BoardAlive && m_FrameChunk < m_FrameChunkEnds.size())
+	{
+		// Straight on with the rest of the frame
+		return now;
+	}
+	else if (m_BoardAlive && !m_LightDataPending)
+	{
+		wakeTime = std::min(wakeTime, m_KeepAliveTime);
+		if (m_NextFrameTime > now)
+		{
+			// Any new light values can go then
+			wakeTime = std::min(wakeTime, m_NextFrameTime);
+		}
+		if (m_ActiveFeatures & LightProtocolFeatureScheduled)
+		{
+			wakeTime = std::min(wakeTime, m_NextClockQueryTime);
+		}
+	}
+
+	if (m_FramesInFlight > 0)
+	{
+		uint8_t oldestSequence = static_cast<uint8_t>(m_FrameSequence - m_FramesInFlight);
+		wakeTime = std::min(wakeTime, m_FrameSendTimes[oldestSequence] + FrameAckTimeoutMilliseconds);
+	}
+	return wakeTime;
+}
+
+//
+// Acts on one byte from the board. Returns false if we couldn't write a response
+//
+bool SerialTransport::HandleByte(uint8_t value, int64_t now)
+{
+	if (m_ReadingDebugLine)
+	{
+		// Debug lines run up to the end of the line
+		if (value == '\n')
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_DebugLines.push_back(m_DebugLine);
+			if (m_DebugLines.size() > MaxDebugLines)
+			{
+				m_DebugLines.pop_front();
+			}
+			m_DebugLine.clear();
+			m_ReadingDebugLine = false;
+		}
+		else if (value != '\r')
+		{
+			m_DebugLine.push_back(static_cast<char>(value));
+		}
+		return true;
+	}
+
+	if (m_ReplyCommand != 0)
+	{
+		// Gathering the rest of a longer reply
+		m_Reply[m_ReplyLength++] = value;
+		if (m_ReplyCommand == 'P' && m_ReplyLength == 1)
+		{
+			// Capabilities start with their length
+			m_ReplyExpected = 1 + value;
+		}
+		if (m_ReplyLength < m_ReplyExpected)
+		{
+			return true;
+		}
+		return HandleReply(now);
+	}
+
+	switch (value)
+	{
+	case 'H':
+		{
+			// Board has sent a Hello packet, so send one back
+			m_BoardAlive = false;
+			m_LightDataPending = false;
+			m_SentPresentTime = 0;
+			m_Negotiation = NegotiationNone;
+			m_ActiveFeatures = 0;
+			m_FramesInFlight = 0;
+			{
+				std::lock_guard<std::mutex> lock(m_Lock);
+				m_LightsUpdated = false;
+			}
+			return WriteByte('H');
+		}
+
+	case 'C':
+		{
+			// Board has requested the config, so send it. Bigger layouts follow with 'G' once it's said it can take them
+			uint8_t config[3] = { 'C', static_cast<uint8_t>(std::min(m_LightColumns, 255)), static_cast<uint8_t>(std::min(m_LightRows, 255)) };
+			m_BoardAlive = true;
+			m_KeepAliveTime = now + KeepAliveMilliseconds;
+			if (!m_Port.Write(config, sizeof(config), WriteTimeoutMilliseconds))
+			{
+				return false;
+			}
+			return BeginNegotiation(now);
+		}
+
+	case 'R':
+		{
+			// Board is ready to receive light data, if we've told it there is some
+			if (m_BoardAlive && m_LightDataPending)
+			{
+				return SendLightData(now);
+			}
+		}
+		break;
+
+	case 'S':
+		{
+			if (m_ActiveFeatures & LightProtocolFeatureFramed)
+			{
+				// Followed by the sequence of the frame shown
+				m_ReplyCommand = 'S';
+				m_ReplyLength = 0;
+				m_ReplyExpected = 1;
+				break;
+			}
+
+			// Board has shown the light data we sent
+			if (m_LatencyStats)
+			{
+				m_LatencyStats->Record(LatencyStageShow, m_SentPresentTime);
+			}
+			m_SentPresentTime = 0;
+			m_ReadyGeneration = m_SentGeneration;
+			++m_FramesShown;
+			FrameDone();
+		}
+		break;
+
+	case 'N':
+		{
+			if (m_ActiveFeatures & LightProtocolFeatureFramed)
+			{
+				// Followed by the sequence of a frame the board couldn't show
+				m_ReplyCommand = 'N';
+				m_ReplyLength = 0;
+				m_ReplyExpected = 1;
+			}
+		}
+		break;
+
+	case 'P':
+	case 'M':
+		{
+			if ((value == 'P' && m_Negotiation == NegotiationCapabilities) || (value == 'M' && m_Negotiation == NegotiationMode))
+			{
+				// Answers to our negotiation. 'P' gets its length from its first byte
+				m_ReplyCommand = value;
+				m_ReplyLength = 0;
+				m_ReplyExpected = (value == 'P') ? 1 : 2;
+			}
+		}
+		break;
+
+	case 'B':
+		{
+			if (m_Negotiation == NegotiationLinkRate)
+			{
+				// Followed by the code of the rate the board has switched to
+				m_ReplyCommand = 'B';
+				m_ReplyLength = 0;
+				m_ReplyExpected = 1;
+			}
+		}
+		break;
+
+	case 'G':
+		{
+			if (m_Negotiation == NegotiationLayout)
+			{
+				// Followed by the number of lights the board has set up
+				m_ReplyCommand = 'G';
+				m_ReplyLength = 0;
+				m_ReplyExpected = 2;
+			}
+		}
+		break;
+
+	case 'T':
+		{
+			if (m_Negotiation == NegotiationLinkTest)
+			{
+				// Followed by the link test, as the board expects to have got it
+				m_ReplyCommand = 'T';
+				m_ReplyLength = 0;
+				m_ReplyExpected = LightLinkTestSize;
+			}
+		}
+		break;
+
+	case 'Q':
+		{
+			if (m_ActiveFeatures & LightProtocolFeatureScheduled)
+			{
+				// Followed by the board's clock
+				m_ReplyCommand = 'Q';
+				m_ReplyLength = 0;
+				m_ReplyExpected = 4;
+			}
+		}
+		break;
+
+	case 'D':
+		{
+			m_ReadingDebugLine = true;
+			m_KeepAliveTime = now + KeepAliveMilliseconds;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+//
+// Acts on a complete multi-byte reply
+//
+bool SerialTransport::HandleReply(int64_t now)
+{
+	uint8_t command = m_ReplyCommand;
+	m_ReplyCommand = 0;
+
+	switch (command)
+	{
+	case 'S':
+		AcknowledgeFrame(m_Reply[0]);
+		break;
+
+	case 'N':
+		RejectFrame(m_Reply[0]);
+		break;
+
+	case 'Q':
+		{
+			if (m_ClockQueryTime == 0)
+			{
+				break;
+			}
+
+			// The board read its clock somewhere between the query going and the answer coming back, so take it
+			// as halfway
+			int64_t replyTime = GetLatencyTimestamp();
+			uint32_t boardTime = m_Reply[0] | (m_Reply[1] << 8) | (m_Reply[2] << 16) | (static_cast<uint32_t>(m_Reply[3]) << 24);
+			int sample = m_ClockSampleCount++ % ClockSyncSamples;
+			m_ClockOffsets[sample] = static_cast<int64_t>(boardTime) - (m_ClockQueryTime + replyTime) / 2000;
+			m_ClockRoundTrips[sample] = replyTime - m_ClockQueryTime;
+			m_ClockQueryTime = 0;
+		}
+		break;
+
+	case 'P':
+		{
+			if (m_ReplyLength < 1 + LightProtocolCapabilitiesSize)
+			{
+				EndNegotiation(0);
+				break;
+			}
+
+			ReadLightProtocolCapabilities(&m_Reply[1], &m_BoardCapabilities);
+			uint16_t features = m_BoardCapabilities.features & m_Features;
+			if (features & LightProtocolFeatureRGB444)
+			{
+				// Only one colour format at a time, and if it's been asked for the smallest is wanted
+				features &= ~LightProtocolFeatureRGB565;
+			}
+			if (features & LightProtocolFeatureScheduled)
+			{
+				// Scheduled frames show together on every board without waiting for 'W'
+				features &= ~LightProtocolFeatureSyncShow;
+			}
+			if (!(features & LightProtocolFeatureFramed) || m_BoardCapabilities.maxLights < m_LightValues.size())
+			{
+				EndNegotiation(0);
+				break;
+			}
+
+			// Ask for the features we both have
+			uint8_t mode[3] = { 'M', static_cast<uint8_t>(features), static_cast<uint8_t>(features >> 8) };
+			m_Negotiation = NegotiationMode;
+			m_NegotiationTimeout = now + NegotiationTimeoutMilliseconds;
+			return m_Port.Write(mode, sizeof(mode), WriteTimeoutMilliseconds);
+		}
+
+	case 'M':
+		{
+			if (m_Negotiation == NegotiationMode)
+			{
+				// The board confirms what it's switched to
+				EndNegotiation(static_cast<uint16_t>(m_Reply[0] | (m_Reply[1] << 8)) & m_Features);
+				if (m_ActiveFeatures & LightProtocolFeatureLargeLayout)
+				{
+					// Send the layout again in full
+					uint8_t layout[5] =
+					{
+						'G',
+						static_cast<uint8_t>(m_LightColumns), static_cast<uint8_t>(m_LightColumns >> 8),
+						static_cast<uint8_t>(m_LightRows), static_cast<uint8_t>(m_LightRows >> 8)
+					};
+					m_Negotiation = NegotiationLayout;
+					m_NegotiationTimeout = now + NegotiationTimeoutMilliseconds;
+					return m_Port.Write(layout, sizeof(layout), WriteTimeoutMilliseconds);
+				}
+				if (m_BoardAlive && (m_ActiveFeatures & LightProtocolFeatureLinkRate))
+				{
+					return RaiseLinkRate(now);
+				}
+			}
+		}
+		break;
+
+	case 'G':
+		{
+			if (static_cast<size_t>(m_Reply[0] | (m_Reply[1] << 8)) != m_LightValues.size())
+			{
+				RejectLayout();
+				break;
+			}
+
+			if (m_ActiveFeatures & LightProtocolFeatureLinkRate)
+			{
+				return RaiseLinkRate(now);
+			}
+			m_Negotiation = NegotiationDone;
+		}
+		break;
+
+	case 'B':
+		{
+			if (m_Reply[0] != m_LinkRateCode)
+			{
+				// The board won't use it, and is staying where it is
+				m_FailedLinkRates |= 1 << m_LinkRateCode;
+				return RaiseLinkRate(now);
+			}
+
+			if (!m_Port.SetBaudRate(LightLinkRates[m_LinkRateCode]))
+			{
+				return FailLinkRate(now);
+			}
+			m_Port.DiscardInput();
+			m_Negotiation = NegotiationLinkSwitch;
+			m_NegotiationTimeout = now + LinkSwitchMilliseconds;
+		}
+		break;
+
+	case 'T':
+		{
+			uint8_t linkTest[LightLinkTestSize];
+			MakeLightLinkTest(linkTest);
+			if (memcmp(m_Reply, linkTest, sizeof(linkTest)) != 0)
+			{
+				return FailLinkRate(now);
+			}
+
+			// Both ways work, so tell the board to stay here
+			m_BaudRate = LightLinkRates[m_LinkRateCode];
+			m_Negotiation = NegotiationDone;
+			return WriteByte('Y');
+		}
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+bool SerialTransport::IsNegotiating() const
+{
+	return m_Negotiation != NegotiationNone && m_Negotiation != NegotiationDone;
+}
+
+//
+// Moves negotiation on when the board hasn't answered in time
+//
+bool SerialTransport::HandleNegotiationTimeout(int64_t now)
+{
+	m_ReplyCommand = 0;
+	switch (m_Negotiation)
+	{
+	case NegotiationCapabilities:
+	case NegotiationMode:
+		// No answer, so it's an older board. Carry on as we were
+		EndNegotiation(0);
+		return true;
+
+	case NegotiationLayout:
+		RejectLayout();
+		return true;
+
+	case NegotiationLinkSwitch:
+		{
+			uint8_t linkTest[1 + LightLinkTestSize] = { 'T' };
+			MakeLightLinkTest(&linkTest[1]);
+			m_Negotiation = NegotiationLinkTest;
+			m_NegotiationTimeout = now + LinkTestTimeoutMilliseconds;
+			return m_Port.Write(linkTest, sizeof(linkTest), WriteTimeoutMilliseconds);
+		}
+
+	case NegotiationLinkRate:
+	case NegotiationLinkTest:
+		return FailLinkRate(now);
+
+	case NegotiationLinkFallback:
+		return RaiseLinkRate(now);
+
+	default:
+		return true;
+	}
+}
+
+//
+// Asks the board what it can do, if we want anything beyond the original protocol. Older boards just log
+// it as an unknown command
+//
+bool SerialTransport::BeginNegotiation(int64_t now)
+{
+	if (m_Features == 0)
+	{
+		EndNegotiation(0);
+		return true;
+	}
+
+	m_Negotiation = NegotiationCapabilities;
+	m_NegotiationTimeout = now + NegotiationTimeoutMilliseconds;
+	return WriteByte('P');
+}
+
+void SerialTransport::EndNegotiation(uint16_t activeFeatures)
+{
+	m_Negotiation = NegotiationDone;
+	m_ActiveFeatures = activeFeatures;
+	m_FramesInFlight = 0;
+	m_FrameHeld = false;
+	m_FramesExpiredInARow = 0;
+	m_KeyframeNeeded = true;
+	m_NextFrameTime = 0;
+	m_ClockQueryTime = 0;
+	m_NextClockQueryTime = 0;
+	m_ClockSampleCount = 0;
+	m_Encoder.SetFeatures(activeFeatures);
+
+	if (!(activeFeatures & LightProtocolFeatureLargeLayout) && (m_LightColumns > 255 || m_LightRows > 255))
+	{
+		// The board only got the config, so it's showing the wrong number of lights
+		RejectLayout();
+	}
+}
+
+//
+// The board can't show our layout, so leave it be. It'll say hello again once it's timed out
+//
+void SerialTransport::RejectLayout()
+{
+	m_Negotiation = NegotiationDone;
+	m_BoardAlive = false;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_DebugLines.push_back("Board can't show " + std::to_string(m_LightColumns) + "x" + std::to_string(m_LightRows) + " lights");
+	if (m_DebugLines.size() > MaxDebugLines)
+	{
+		m_DebugLines.pop_front();
+	}
+}
+
+//
+// Asks the board to switch to the fastest rate we've both got that hasn't already failed, if it's any faster
+//
+bool SerialTransport::RaiseLinkRate(int64_t now)
+{
+	int code = LightLinkRateCount - 1;
+	while (code > 0 && (!(m_BoardCapabilities.linkRates & (1 << code)) || (m_FailedLinkRates & (1 << code)) || LightLinkRates[code] <= m_BaseBaudRate))
+	{
+		--code;
+	}
+
+	if (code == 0)
+	{
+		m_Negotiation = NegotiationDone;
+		return true;
+	}
+
+	uint8_t request[2] = { 'B', static_cast<uint8_t>(code) };
+	m_LinkRateCode = code;
+	m_Negotiation = NegotiationLinkRate;
+	m_NegotiationTimeout = now + LinkTestTimeoutMilliseconds;
+	return m_Port.Write(request, sizeof(request), WriteTimeoutMilliseconds);
+}
+
+//
+// The rate being tried didn't work, so go back to the original one and wait for the board to do the same
+//
+bool SerialTransport::FailLinkRate(int64_t now)
+{
+	m_FailedLinkRates |= 1 << m_LinkRateCode;
+	if (!m_Port.SetBaudRate(m_BaseBaudRate))
+	{
+		return false;
+	}
+	m_Port.DiscardInput();
+	m_Negotiation = NegotiationLinkFallback;
+	m_NegotiationTimeout = now + LinkFallbackMilliseconds;
+	return true;
+}
+
+//
+// Frames have stopped getting through at a raised rate. Most likely the board has lost it and gone back to the
+// original rate, where it'll say hello again
+//
+bool SerialTransport::DropLinkRate()
+{
+	m_FailedLinkRates |= 1 << m_LinkRateCode;
+	m_BaudRate = m_BaseBaudRate;
+	m_BoardAlive = false;
+	m_Negotiation = NegotiationNone;
+	m_ActiveFeatures = 0;
+	m_FramesInFlight = 0;
+	m_FrameHeld = false;
+	return m_Port.SetBaudRate(m_BaseBaudRate);
+}
+
+//
+// The board has shown a frame. Acknowledgements come in order, so any older frames still in flight were lost
+//
+void SerialTransport::AcknowledgeFrame(uint8_t sequence)
+{
+	int framesAfter = static_cast<uint8_t>(m_FrameSequence - sequence - 1);
+	if (framesAfter >= m_FramesInFlight)
+	{
+		// Not one we're waiting on, most likely one we'd already given up on
+		return;
+	}
+
+	m_FramesExpiredInARow = 0;
+	int framesLost = m_FramesInFlight - framesAfter - 1;
+	if (framesLost > 0)
+	{
+		m_FramesDropped += framesLost;
+		m_LostGeneration = m_FrameGenerations[static_cast<uint8_t>(sequence - 1)];
+		m_KeyframeNeeded = true;
+	}
+	m_FramesInFlight = framesAfter;
+
+	if (m_LatencyStats)
+	{
+		// A scheduled frame is acknowledged as it arrives, but isn't shown until its time comes
+		int64_t showTime = std::max(GetLatencyTimestamp(), m_FrameShowTimes[sequence]);
+		m_LatencyStats->RecordAt(LatencyStageShow, m_FramePresentTimes[sequence], showTime);
+	}
+	++m_FramesShown;
+
+	// Any frame in flight after this one takes its place on the board, so only the newest is held for Show
+	m_FrameHeld = (m_ActiveFeatures & LightProtocolFeatureSyncShow) != 0 && m_FramesInFlight == 0;
+	m_HeldSequence = sequence;
+	m_ReadyGeneration = m_FrameGenerations[sequence];
+	FrameDone();
+}
+
+//
+// The board couldn't show a frame, so it and anything older are lost
+//
+void SerialTransport::RejectFrame(uint8_t sequence)
+{
+	int framesAfter = static_cast<uint8_t>(m_FrameSequence - sequence - 1);
+	if (framesAfter >= m_FramesInFlight)
+	{
+		return;
+	}
+
+	m_FramesExpiredInARow = 0;
+	m_FramesDropped += m_FramesInFlight - framesAfter;
+	m_FramesInFlight = framesAfter;
+	m_LostGeneration = m_FrameGenerations[sequence];
+	m_KeyframeNeeded = true;
+	FrameDone();
+}
+
+//
+// Gives up on frames that have gone unacknowledged for too long, so they stop taking up the window
+//
+void SerialTransport::ExpireFrames(int64_t now)
+{
+	bool expired = false;
+	while (m_FramesInFlight > 0)
+	{
+		uint8_t oldestSequence = static_cast<uint8_t>(m_FrameSequence - m_FramesInFlight);
+		if (now < m_FrameSendTimes[oldestSequence] + FrameAckTimeoutMilliseconds)
+		{
+			break;
+		}
+		--m_FramesInFlight;
+		++m_FramesDropped;
+		++m_FramesExpiredInARow;
+		m_LostGeneration = m_FrameGenerations[oldestSequence];
+		m_KeyframeNeeded = true;
+		expired = true;
+	}
+
+	if (expired)
+	{
+		FrameDone();
+	}
+}
+
+void SerialTransport::FrameDone()
+{
+	if (m_FrameCallback)
+	{
+		m_FrameCallback(m_FrameCallbackContext);
+	}
+}
+
+//
+// Packs the very latest light values into m_LightData, returning the present time and generation behind them
+//
+int64_t SerialTransport::TakeLightData(uint64_t* generation)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	PackLightsWire(&m_LightValues[0], static_cast<int>(m_LightValues.size()), LightChannelOrderRGB, &m_LightData[0]);
+	*generation = m_LightGeneration;
+	int64_t presentTime = m_LightPresentTime;
+	m_LightPresentTime = 0;
+
+	// If they've changed since the board was told, it's getting them now
+	m_LightsUpdated = false;
+	return presentTime;
+}
+
+bool SerialTransport::SendLightData(int64_t now)
+{
+	int64_t presentTime = TakeLightData(&m_SentGeneration);
+	if (!m_Port.Write(&m_LightData[0], static_cast<int>(m_LightData.size()), WriteTimeoutMilliseconds))
+	{
+		return false;
+	}
+
+	if (m_LatencyStats)
+	{
+		m_LatencyStats->Record(LatencyStageSerialWrite, presentTime);
+	}
+	m_SentPresentTime = presentTime;
+	m_KeepAliveTime = now + KeepAliveMilliseconds;
+	m_LightDataPending = false;
+	++m_FramesSent;
+	m_LightBytesSent += m_LightData.size();
+	return true;
+}
+
+bool SerialTransport::SendLightFrame(int64_t now)
+{
+	uint8_t sequence = m_FrameSequence;
+	int64_t presentTime = TakeLightData(&m_FrameGenerations[sequence]);
+	LightColourFormat format = GetLightColourFormat(m_ActiveFeatures);
+	if (format != LightColourFormatRGB888)
+	{
+		m_Ditherer.Apply(format, &m_LightData[0], static_cast<int>(m_LightValues.size()));
+	}
+
+	uint8_t type = LightFrameTypeLights;
+	const uint8_t* payload = &m_LightData[0];
+	size_t payloadLength = m_LightData.size();
+	bool encoded = (m_ActiveFeatures & LightProtocolFeatureDelta) || format != LightColourFormatRGB888;
+	if (encoded)
+	{
+		// Based on the last frame sent, which the board will have shown by the time it gets this one unless it was lost
+		const uint8_t* baseData = m_KeyframeNeeded ? nullptr : &m_BaseLightData[0];
+		type = m_Encoder.Encode(&m_LightData[0], baseData, static_cast<int>(m_LightValues.size()), static_cast<uint8_t>(sequence - 1));
+		payload = m_Encoder.GetPayload();
+		payloadLength = m_Encoder.GetPayloadLength();
+	}
+
+	m_FrameData.clear();
+	m_FrameChunkEnds.clear();
+	m_FrameChunk = 0;
+	AppendFrameSchedule(sequence, presentTime);
+	if ((m_ActiveFeatures & LightProtocolFeatureLargeLayout) && payloadLength > LightFrameChunkLength)
+	{
+		for (size_t offset = 0; offset < payloadLength; offset += LightFrameChunkLength)
+		{
+			AppendLightFrameChunk(type, sequence, payload, offset, std::min<size_t>(LightFrameChunkLength, payloadLength - offset), payloadLength, &m_FrameData);
+			m_FrameChunkEnds.push_back(m_FrameData.size());
+		}
+	}
+	else
+	{
+		AppendLightFrame(type, sequence, payload, payloadLength, &m_FrameData);
+		m_FrameChunkEnds.push_back(m_FrameData.size());
+	}
+
+	if (encoded)
+	{
+		m_BaseLightData.swap(m_LightData);
+		m_KeyframeNeeded = false;
+	}
+
+	// Whatever the board was holding is being overwritten
+	m_FrameHeld = false;
+	if (m_ActiveFeatures & LightProtocolFeatureInterpolate)
+	{
+		m_NextFrameTime = now + InterpolatedFrameMilliseconds;
+	}
+	m_FramePresentTimes[sequence] = presentTime;
+	++m_FrameSequence;
+	++m_FramesInFlight;
+	++m_FramesSent;
+	return SendFrameChunk(now);
+}
+
+//
+// Writes the next chunk of the newest frame, or all of it if it isn't chunked
+//
+bool SerialTransport::SendFrameChunk(int64_t now)
+{
+	size_t start = (m_FrameChunk > 0) ? m_FrameChunkEnds[m_FrameChunk - 1] : 0;
+	size_t end = m_FrameChunkEnds[m_FrameChunk++];
+	if (!m_Port.Write(&m_FrameData[start], static_cast<int>(end - start), WriteTimeoutMilliseconds))
+	{
+		return false;
+	}
+
+	// The board only answers the last chunk, so the frame's given the full time from then
+	uint8_t sequence = static_cast<uint8_t>(m_FrameSequence - 1);
+	m_FrameSendTimes[sequence] = now;
+	m_KeepAliveTime = now + KeepAliveMilliseconds;
+	m_LightBytesSent += end - start;
+	if (m_FrameChunk == m_FrameChunkEnds.size() && m_LatencyStats)
+	{
+		m_LatencyStats->Record(LatencyStageSerialWrite, m_FramePresentTimes[sequence]);
+	}
+	return true;
+}
+
+//
+// Sends new light values, or keeps the board alive, if it's not already busy with something
+//
+bool SerialTransport::SendPending(int64_t now)
+{
+	if (!m_BoardAlive || m_LightDataPending || IsNegotiating())
+	{
+		return true;
+	}
+
+	bool framed = (m_ActiveFeatures & LightProtocolFeatureFramed) != 0;
+	if (framed)
+	{
+		ExpireFrames(now);
+		if (m_FramesExpiredInARow >= LinkLossFrames && m_BaudRate != m_BaseBaudRate)
+		{
+			return DropLinkRate();
+		}
+
+		uint64_t showGeneration;
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			showGeneration = m_ShowGeneration;
+			m_ShowGeneration = 0;
+		}
+		if (showGeneration != 0 && m_FrameHeld && showGeneration == m_ReadyGeneration)
+		{
+			// Other boards are being told at the same time, so this goes ahead of anything else
+			uint8_t show[2] = { 'W', m_HeldSequence };
+			m_FrameHeld = false;
+			if (!m_Port.Write(show, sizeof(show), WriteTimeoutMilliseconds))
+			{
+				return false;
+			}
+		}
+
+		if (m_FrameChunk < m_FrameChunkEnds.size())
+		{
+			if (m_FramesInFlight > 0)
+			{
+				// Nothing else can go until the rest of the frame has
+				return SendFrameChunk(now);
+			}
+
+			// The board has dropped it, or we've given up on it
+			m_FrameChunk = m_FrameChunkEnds.size();
+		}
+
+		if ((m_ActiveFeatures & LightProtocolFeatureScheduled) && now >= m_NextClockQueryTime && !SendClockQuery(now))
+		{
+			return false;
+		}
+	}
+
+	// Framed light data can go as soon as there's room in the board's window, unless the board's blending
+	// towards the last frame
+	bool canSendLights = !framed || (m_FramesInFlight < std::max<int>(1, m_BoardCapabilities.window) && now >= m_NextFrameTime);
+	bool lightsUpdated;
+	bool debugRequested;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		lightsUpdated = m_LightsUpdated && canSendLights;
+		debugRequested = m_DebugRequested && !lightsUpdated;
+		if (debugRequested)
+		{
+			m_DebugRequested = false;
+		}
+	}
+
+	if (lightsUpdated)
+	{
+		if (framed)
+		{
+			return SendLightFrame(now);
+		}
+
+		// Notify the board we have updated lights data
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_LightsUpdated = false;
+		}
+		m_KeepAliveTime = now + KeepAliveMilliseconds;
+		m_LightDataPending = true;
+		return WriteByte('A');
+	}
+	else if (debugRequested)
+	{
+		m_KeepAliveTime = now + KeepAliveMilliseconds;
+		return WriteByte('D');
+	}
+	else if (m_KeepAliveTime <= now)
+	{
+		// Just send our keepalive
+		m_KeepAliveTime = now + KeepAliveMilliseconds;
+		return WriteByte('K');
+	}
+	return true;
+}
+
+//
+// Asks the board for its clock. Any earlier query still unanswered is given up on
+//
+bool SerialTransport::SendClockQuery(int64_t now)
+{
+	m_ClockQueryTime = GetLatencyTimestamp();
+	m_NextClockQueryTime = now + ClockSyncMilliseconds;
+	m_KeepAliveTime = now + KeepAliveMilliseconds;
+	return WriteByte('Q');
+}
+
+//
+// The board's clock less ours, in milliseconds, from the reading that came back quickest. Returns false if
+// there haven't been any yet
+//
+bool SerialTransport::GetBoardClockOffset(int64_t* offset) const
+{
+	int sampleCount = std::min(m_ClockSampleCount, ClockSyncSamples);
+	if (sampleCount == 0)
+	{
+		return false;
+	}
+
+	int best = 0;
+	for (int sample = 1; sample < sampleCount; ++sample)
+	{
+		if (m_ClockRoundTrips[sample] < m_ClockRoundTrips[best])
+		{
+			best = sample;
+		}
+	}
+	*offset = m_ClockOffsets[best];
+	return true;
+}
+
+//
+// With the scheduled feature, puts 'Z' ahead of the frame, telling the board when to show it. Until the board's
+// clock is known, frames go without and are shown as they arrive
+//
+void SerialTransport::AppendFrameSchedule(uint8_t sequence, int64_t presentTime)
+{
+	m_FrameShowTimes[sequence] = 0;
+	int64_t offset;
+	if (!(m_ActiveFeatures & LightProtocolFeatureScheduled) || !GetBoardClockOffset(&offset))
+	{
+		return;
+	}
+
+	// Frames without a present time are taken as presented now. Any already too late to make it are shown as
+	// soon as they're in, which keeps the time in reach of the 2 bytes the board gets
+	int64_t currentTime = GetLatencyTimestamp() / 1000;
+	int64_t showTime = ((presentTime > 0) ? presentTime / 1000 : currentTime) + ScheduledFrameDelayMilliseconds;
+	showTime = std::max(showTime, currentTime);
+	m_FrameShowTimes[sequence] = showTime * 1000;
+	showTime += offset;
+	uint8_t schedule[4] = { 'Z', sequence, static_cast<uint8_t>(showTime), static_cast<uint8_t>(showTime >> 8) };
+	m_FrameData.insert(m_FrameData.end(), schedule, schedule + sizeof(schedule));
+}
+
+bool SerialTransport::WriteByte(uint8_t value)
+{
+	return m_Port.Write(&value, 1, WriteTimeoutMilliseconds);
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LatencyStats.h"
+#include "LightColourFormat.h"
+#include "LightFrameCodec.h"
+#include "LightProtocol.h"
+#include "SerialPort.h"
+
+// Runs the controller board's serial protocol on its own I/O thread:
+//   Board 'H' -> 'H'                Hello, after which the board asks for its config
+//   Board 'C' -> 'C', columns, rows Config
+//   'A' -> board 'R' -> light data  Sent whenever there are new light values, 3 bytes per light
+//   Board 'S'                       Light data shown
+//   'K'                             Keepalive, when there's been nothing else to send for a while
+//   'D' -> board 'D' line           Debug info
+// When the board offers it, light data goes as pipelined frames instead of 'A'/'R' (see LightProtocol.h), and
+// as keyframes and delta frames whenever they're smaller (see LightFrameCodec.h). The link is then moved to the
+// fastest baud rate that passes a test, dropping back if the board stops answering there. Layouts too big for
+// the config are sent again with 'G', and big frames go a chunk at a time, so no single write holds things up.
+// With the sync show feature, frames the board has acknowledged are held until Show (see ShardedTransport).
+// With the interpolate feature, frames go no more often than InterpolatedFrameMilliseconds, and the board
+// blends between them.
+// With the scheduled feature, the board's clock is read with 'Q' every so often, and each frame is preceded by
+// 'Z' saying when to show it by that clock, ScheduledFrameDelayMilliseconds after it was presented. The board
+// queues frames until then, so uneven delivery doesn't show. 'S' then only says a frame has arrived.
+// Light values are handed over from any thread and only the latest are sent, so a slow board never holds
+// anyone else up. Start and Stop must not overlap with any other calls
+class SerialTransport
+{
+public:
+	typedef void (*FrameCallback)(void* context);
+
+public:
+	SerialTransport(LatencyStats* latencyStats);
+	~SerialTransport();
+
+	bool Start(const std::string& port, int baudRate, int lightColumns, int lightRows);
+	void Stop();
+
+	// False once the port has failed
+	bool IsRunning() const;
+
+	// True once the board has asked for its config
+	bool IsBoardAlive() const;
+
+	// Protocol features (LightProtocolFeature flags) to use if the board offers them. Takes effect the next
+	// time the board says hello. Defaults to LightProtocolDefaultFeatures
+	void SetFeatures(uint16_t features);
+
+	// The features agreed with the board, or 0 for the original protocol
+	uint16_t GetActiveFeatures() const;
+
+	// Replaces the light values waiting to be sent. presentTime is when the frame behind them was presented,
+	// for measuring latency (0 if not known)
+	void SetLightValues(const int32_t* values, int count, int64_t presentTime);
+
+	// Called on the I/O thread whenever the board acknowledges a frame or one is lost. Set before Start
+	void SetFrameCallback(FrameCallback callback, void* context);
+
+	// Each SetLightValues since Start is a generation, counting from 1. These are the generations of the
+	// frames last acknowledged and last lost (0 if none)
+	uint64_t GetReadyGeneration() const;
+	uint64_t GetLostGeneration() const;
+
+	// With the sync show feature, has the board show the frame it's holding, if it's from this generation
+	void Show(uint64_t generation);
+
+	// Asks the board for a line of debug info, once there's nothing else in flight
+	void RequestDebugInfo();
+
+	// Pops the oldest debug line the board has sent. Returns false if there aren't any
+	bool TakeDebugLine(std::string* line);
+
+	uint64_t GetFramesSent() const;
+	uint64_t GetFramesShown() const;
+
+	// Frames the board never acknowledged, most likely dropped for failing their CRC
+	uint64_t GetFramesDropped() const;
+
+	// Bytes of light data written, including any framing
+	uint64_t GetLightBytesSent() const;
+
+	// The baud rate in use, which is raised above the one started with once the board has passed the link test
+	int GetBaudRate() const;
+
+public:
+	static const int DefaultBaudRate = 288000;
+
+	// The port seems to have some garbage in a buffer somewhere when it first opens, so ignore everything for a bit
+	static const int OpenDelayMilliseconds = 1000;
+
+	static const int KeepAliveMilliseconds = 1000;
+	static const int WriteTimeoutMilliseconds = 100;
+
+	// How long to wait for the board to answer 'P' and 'M'. Older boards never do, and the board doesn't read
+	// anything for a second after its config while its power supply comes on. Old boards drop anything else
+	// sent along with 'P', so nothing else is sent until it's answered
+	static const int NegotiationTimeoutMilliseconds = 1500;
+
+	// A frame not acknowledged by then is taken as lost, making room for the next
+	static const int FrameAckTimeoutMilliseconds = 250;
+
+	// Raising the link rate. The board may still be switching rate when its echo of 'B' arrives, so the test
+	// waits a moment. The board gives up on a rate half a second after switching or answering the test, so
+	// after a failure the next rate isn't tried until it's certain to be back at the original one
+	static const int LinkSwitchMilliseconds = 20;
+	static const int LinkTestTimeoutMilliseconds = 250;
+	static const int LinkFallbackMilliseconds = 750;
+
+	// Frames lost in a row before giving up on a raised rate
+	static const int LinkLossFrames = 4;
+
+	// Time between frames when the board's blending between them, which it does at 100Hz however often they come
+	static const int InterpolatedFrameMilliseconds = 40;
+
+	// With the scheduled feature, how often to read the board's clock, and how many readings to keep. The one
+	// with the quickest round trip gives the best idea of the difference between the clocks
+	static const int ClockSyncMilliseconds = 500;
+	static const int ClockSyncSamples = 4;
+
+	// How long after being presented a scheduled frame is shown. Anything that gets to the board later than
+	// this is shown as soon as it arrives
+	static const int ScheduledFrameDelayMilliseconds = 50;
+
+	// Oldest debug lines are dropped past this
+	static const size_t MaxDebugLines = 32;
+
+private:
+	enum Negotiation
+	{
+		NegotiationNone,			// Still on the original protocol
+		NegotiationCapabilities,	// Sent 'P', waiting for the board's capabilities
+		NegotiationMode,			// Sent 'M', waiting for the board to confirm
+		NegotiationLayout,			// Sent 'G', waiting for the board's light count
+		NegotiationLinkRate,		// Sent 'B', waiting for the board's echo
+		NegotiationLinkSwitch,		// Switched rate, waiting for the board to do the same
+		NegotiationLinkTest,		// Sent the link test, waiting for the board's
+		NegotiationLinkFallback,	// Back at the original rate, waiting for the board to give up too
+		NegotiationDone
+	};
+
+private:
+	void Run();
+	int64_t GetNextWakeTime(int64_t now) const;
+	bool HandleByte(uint8_t value, int64_t now);
+	bool HandleReply(int64_t now);
+	bool IsNegotiating() const;
+	bool HandleNegotiationTimeout(int64_t now);
+	bool BeginNegotiation(int64_t now);
+	void EndNegotiation(uint16_t activeFeatures);
+	void RejectLayout();
+	bool RaiseLinkRate(int64_t now);
+	bool FailLinkRate(int64_t now);
+	bool DropLinkRate();
+	void AcknowledgeFrame(uint8_t sequence);
+	void RejectFrame(uint8_t sequence);
+	void ExpireFrames(int64_t now);
+	int64_t TakeLightData(uint64_t* generation);
+	void FrameDone();
+	bool SendLightData(int64_t now);
+	bool SendLightFrame(int64_t now);
+	bool SendFrameChunk(int64_t now);
+	bool SendPending(int64_t now);
+	bool SendClockQuery(int64_t now);
+	bool GetBoardClockOffset(int64_t* offset) const;
+	void AppendFrameSchedule(uint8_t sequence, int64_t presentTime);
+	bool WriteByte(uint8_t value);
+
+private:
+	LatencyStats*				m_LatencyStats;
+	SerialPort					m_Port;
+	std::thread					m_Thread;
+	std::atomic<bool>			m_StopRequested;
+	std::atomic<bool>			m_Running;
+	std::atomic<bool>			m_BoardAlive;
+	std::atomic<uint64_t>		m_FramesSent;
+	std::atomic<uint64_t>		m_FramesShown;
+	std::atomic<uint64_t>		m_FramesDropped;
+	std::atomic<uint64_t>		m_LightBytesSent;
+	std::atomic<uint16_t>		m_Features;
+	std::atomic<uint16_t>		m_ActiveFeatures;
+	std::atomic<int>			m_BaudRate;
+	std::atomic<uint64_t>		m_ReadyGeneration;
+	std::atomic<uint64_t>		m_LostGeneration;
+	FrameCallback				m_FrameCallback;
+	void*						m_FrameCallbackContext;
+
+	int							m_LightColumns;
+	int							m_LightRows;
+
+	// Shared with the threads handing over light values and reading debug lines
+	std::mutex					m_Lock;
+	std::vector<int32_t>		m_LightValues;
+	bool						m_LightsUpdated;
+	int64_t						m_LightPresentTime;
+	bool						m_DebugRequested;
+	std::deque<std::string>		m_DebugLines;
+	uint64_t					m_LightGeneration;
+	uint64_t					m_ShowGeneration;
+
+	// Only touched by the I/O thread
+	bool						m_LightDataPending;
+	int64_t						m_KeepAliveTime;
+	int64_t						m_NextFrameTime;
+	int64_t						m_SentPresentTime;
+	uint64_t					m_SentGeneration;
+	bool						m_ReadingDebugLine;
+	std::string					m_DebugLine;
+	std::vector<uint8_t>		m_LightData;
+
+	// Multi-byte replies from the board, gathered a byte at a time
+	uint8_t						m_ReplyCommand;
+	uint8_t						m_Reply[1 + 255];
+	int							m_ReplyLength;
+	int							m_ReplyExpected;
+
+	Negotiation					m_Negotiation;
+	int64_t						m_NegotiationTimeout;
+	LightProtocolCapabilities	m_BoardCapabilities;
+
+	// The rate started at, the code of the rate being tried or in use above it, and any rates (as bits by code)
+	// that have already failed since starting
+	int							m_BaseBaudRate;
+	int							m_LinkRateCode;
+	uint8_t						m_FailedLinkRates;
+	int							m_FramesExpiredInARow;
+
+	// Frames sent but not yet acknowledged, the oldest being m_FrameSequence - m_FramesInFlight
+	uint8_t						m_FrameSequence;
+	int							m_FramesInFlight;
+	int64_t						m_FramePresentTimes[256];
+	int64_t						m_FrameShowTimes[256];		// When the board was told to show each, on our clock, or 0 for on arrival
+	int64_t						m_FrameSendTimes[256];
+	uint64_t					m_FrameGenerations[256];
+
+	// With the sync show feature, whether the board is holding the last frame acknowledged
+	bool						m_FrameHeld;
+	uint8_t						m_HeldSequence;
+
+	// The newest frame, as one or more chunk frames ending at m_FrameChunkEnds, sent up to m_FrameChunk
+	std::vector<uint8_t>		m_FrameData;
+	std::vector<size_t>			m_FrameChunkEnds;
+	size_t						m_FrameChunk;
+
+	// With delta frames, what the last frame sent holds. Any lost frame means the board's out of step until a keyframe
+	LightFrameEncoder			m_Encoder;
+	std::vector<uint8_t>		m_BaseLightData;
+	bool						m_KeyframeNeeded;
+
+	// With the scheduled feature, when the clock query in flight was sent (microseconds, or 0 if there isn't
+	// one), when to send the next, and the latest readings of the board's clock less ours (milliseconds)
+	// with how long each took to come back (microseconds)
+	int64_t						m_ClockQueryTime;
+	int64_t						m_NextClockQueryTime;
+	int64_t						m_ClockOffsets[ClockSyncSamples];
+	int64_t						m_ClockRoundTrips[ClockSyncSamples];
+	int							m_ClockSampleCount;
+
+	// Carries rounding over from frame to frame with reduced colour formats
+	LightDitherer				m_Ditherer;
+};
@@ -0,0 +1,322 @@
+#include "ShardedTransport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+ShardedTransport::ShardedTransport(LatencyStats* latencyStats) :
+	m_LatencyStats(latencyStats),
+	m_Features(LightProtocolDefaultFeatures),
+	m_FramesShown(0),
+	m_DebugShard(0),
+	m_StopRequested(false),
+	m_LightsUpdated(false),
+	m_LightPresentTime(0),
+	m_Generation(0)
+{
+}
+
+ShardedTransport::~ShardedTransport()
+{
+	Stop();
+}
+
+bool ShardedTransport::Start(const std::vector<std::string>& ports, int baudRate, int lightColumns, int lightRows)
+{
+	if (!m_Shards.empty() || ports.empty() || lightColumns <= 0 || lightRows <= 0)
+	{
+		return false;
+	}
+
+	int shardCount = static_cast<int>(ports.size());
+	int lightCount = lightColumns * lightRows;
+	if (lightCount < shardCount)
+	{
+		return false;
+	}
+
+	m_Shards.resize(shardCount);
+	bool started = true;
+	for (int index = 0; index < shardCount && started; ++index)
+	{
+		// Each board only needs its count right, so its layout is whole rows where possible and one long row otherwise
+		Shard& shard = m_Shards[index];
+		int shardColumns;
+		int shardRows;
+		if (lightRows >= shardCount)
+		{
+			int firstRow = lightRows * index / shardCount;
+			shardColumns = lightColumns;
+			shardRows = lightRows * (index + 1) / shardCount - firstRow;
+			shard.firstLight = firstRow * lightColumns;
+		}
+		else
+		{
+			shard.firstLight = lightCount * index / shardCount;
+			shardColumns = lightCount * (index + 1) / shardCount - shard.firstLight;
+			shardRows = 1;
+		}
+		shard.lightCount = shardColumns * shardRows;
+		shard.port = ports[index];
+
+		shard.transport.reset(new SerialTransport(m_LatencyStats));
+		shard.transport->SetFeatures(m_Features);
+		if (shardCount > 1)
+		{
+			shard.transport->SetFrameCallback(&ShardedTransport::FrameDone, this);
+		}
+		started = shard.transport->Start(shard.port, baudRate, shardColumns, shardRows);
+	}
+
+	if (!started)
+	{
+		Stop();
+		return false;
+	}
+
+	SetFeatures(m_Features);
+	m_LightValues.assign(lightCount, 0);
+	m_LightsUpdated = false;
+	m_LightPresentTime = 0;
+	m_Generation = 0;
+	m_DebugShard = 0;
+	m_FramesShown = 0;
+	if (shardCount > 1)
+	{
+		m_StopRequested = false;
+		m_Thread = std::thread(&ShardedTransport::Run, this);
+	}
+	return true;
+}
+
+void ShardedTransport::Stop()
+{
+	if (m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			m_StopRequested = true;
+		}
+		m_Wake.notify_all();
+		m_Thread.join();
+	}
+
+	for (Shard& shard : m_Shards)
+	{
+		if (shard.transport)
+		{
+			shard.transport->Stop();
+		}
+	}
+	m_Shards.clear();
+}
+
+bool ShardedTransport::IsRunning() const
+{
+	for (const Shard& shard : m_Shards)
+	{
+		if (!shard.transport->IsRunning())
+		{
+			return false;
+		}
+	}
+	return !m_Shards.empty();
+}
+
+bool ShardedTransport::IsBoardAlive() const
+{
+	for (const Shard& shard : m_Shards)
+	{
+		if (!shard.transport->IsBoardAlive())
+		{
+			return false;
+		}
+	}
+	return !m_Shards.empty();
+}
+
+void ShardedTransport::SetFeatures(uint16_t features)
+{
+	m_Features = features & ~LightProtocolFeatureSyncShow;
+	uint16_t shardFeatures = m_Features;
+	if (m_Shards.size() > 1 && (features & LightProtocolFeatureFramed))
+	{
+		shardFeatures |= LightProtocolFeatureSyncShow;
+	}
+
+	for (Shard& shard : m_Shards)
+	{
+		if (shard.transport)
+		{
+			shard.transport->SetFeatures(shardFeatures);
+		}
+	}
+}
+
+void ShardedTransport::SetLightValues(const int32_t* values, int count, int64_t presentTime)
+{
+	if (m_Shards.size() == 1)
+	{
+		m_Shards[0].transport->SetLightValues(values, count, presentTime);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		size_t copyCount = std::min(static_cast<size_t>(count), m_LightValues.size());
+		if (copyCount > 0)
+		{
+			memcpy(&m_LightValues[0], values, copyCount * sizeof(int32_t));
+		}
+		m_LightsUpdated = true;
+
+		// Keep the oldest frame we've not sent yet
+		if (m_LightPresentTime == 0)
+		{
+			m_LightPresentTime = presentTime;
+		}
+	}
+	m_Wake.notify_all();
+}
+
+void ShardedTransport::RequestDebugInfo()
+{
+	for (Shard& shard : m_Shards)
+	{
+		shard.transport->RequestDebugInfo();
+	}
+}
+
+bool ShardedTransport::TakeDebugLine(std::string* line)
+{
+	// Take turns, so a chatty board can't hide the others
+	for (size_t tries = 0; tries < m_Shards.size(); ++tries)
+	{
+		const Shard& shard = m_Shards[m_DebugShard];
+		m_DebugShard = (m_DebugShard + 1) % m_Shards.size();
+		if (shard.transport->TakeDebugLine(line))
+		{
+			if (m_Shards.size() > 1)
+			{
+				line->insert(0, shard.port + ": ");
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+int ShardedTransport::GetShardCount() const
+{
+	return static_cast<int>(m_Shards.size());
+}
+
+SerialTransport* ShardedTransport::GetShard(int index) const
+{
+	return m_Shards[index].transport.get();
+}
+
+int ShardedTransport::GetShardFirstLight(int index) const
+{
+	return m_Shards[index].firstLight;
+}
+
+int ShardedTransport::GetShardLightCount(int index) const
+{
+	return m_Shards[index].lightCount;
+}
+
+uint64_t ShardedTransport::GetFramesShown() const
+{
+	if (m_Shards.size() == 1)
+	{
+		return m_Shards[0].transport->GetFramesShown();
+	}
+	return m_FramesShown;
+}
+
+//
+// Main loop of the coordinating thread. Hands every board its share of the latest light values, waits until
+// they've all got them, then has them all show them
+//
+void ShardedTransport::Run()
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	while (true)
+	{
+		m_Wake.wait(lock, [this]() { return m_StopRequested || m_LightsUpdated; });
+		if (m_StopRequested)
+		{
+			break;
+		}
+
+		m_SentLightValues = m_LightValues;
+		int64_t presentTime = m_LightPresentTime;
+		m_LightPresentTime = 0;
+		m_LightsUpdated = false;
+
+		// Every shard counts its generations from Start, and only ever gets them from here, so they keep in step
+		uint64_t generation = ++m_Generation;
+		lock.unlock();
+		for (Shard& shard : m_Shards)
+		{
+			shard.transport->SetLightValues(&m_SentLightValues[shard.firstLight], shard.lightCount, presentTime);
+		}
+		lock.lock();
+
+		// A board that's gone quiet shouldn't hold up the rest for long
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ShowTimeoutMilliseconds);
+		m_Wake.wait_until(lock, deadline, [this, generation]() { return m_StopRequested || IsGenerationDone(generation); });
+		if (m_StopRequested)
+		{
+			break;
+		}
+
+		lock.unlock();
+		bool shownEverywhere = true;
+		for (Shard& shard : m_Shards)
+		{
+			if (shard.transport->GetReadyGeneration() == generation)
+			{
+				shard.transport->Show(generation);
+			}
+			else
+			{
+				shownEverywhere = false;
+			}
+		}
+		if (shownEverywhere)
+		{
+			++m_FramesShown;
+		}
+		lock.lock();
+	}
+}
+
+//
+// Whether every board with a connection has either got the light values or lost them
+//
+bool ShardedTransport::IsGenerationDone(uint64_t generation) const
+{
+	for (const Shard& shard : m_Shards)
+	{
+		const SerialTransport* transport = shard.transport.get();
+		if (transport->IsBoardAlive() && transport->GetReadyGeneration() < generation && transport->GetLostGeneration() < generation)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//
+// Called on a shard's I/O thread whenever it gets a frame through or loses one
+//
+void ShardedTransport::FrameDone(void* context)
+{
+	ShardedTransport* transport = static_cast<ShardedTransport*>(context);
+	{
+		std::lock_guard<std::mutex> lock(transport->m_Lock);
+	}
+	transport->m_Wake.notify_all();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LatencyStats.h"
+#include "SerialTransport.h"
+
+// Splits the lights over several controller boards, each with its own port and SerialTransport, so a layout
+// too big for one link can be refreshed as fast as its biggest share. With one port it's just a SerialTransport.
+// With more, boards that offer it hold each frame once they've got it (the sync show feature), and a
+// coordinating thread only has them show it once every board has it, before handing out the next light values.
+// Boards using the scheduled feature instead show each frame at the time it's given, which comes to the same.
+// Start and Stop must not overlap with any other calls
+class ShardedTransport
+{
+public:
+	ShardedTransport(LatencyStats* latencyStats);
+	~ShardedTransport();
+
+	// Splits the lights over the ports in whole rows where there are enough rows to go round, and in even runs
+	// of the strip otherwise
+	bool Start(const std::vector<std::string>& ports, int baudRate, int lightColumns, int lightRows);
+	void Stop();
+
+	// False once any port has failed
+	bool IsRunning() const;
+
+	// True once every board has asked for its config
+	bool IsBoardAlive() const;
+
+	// Protocol features for every board (see SerialTransport::SetFeatures). Sync show is added with more than one
+	void SetFeatures(uint16_t features);
+
+	void SetLightValues(const int32_t* values, int count, int64_t presentTime);
+
+	// Debug lines from every board, starting with their port when there's more than one
+	void RequestDebugInfo();
+	bool TakeDebugLine(std::string* line);
+
+	int GetShardCount() const;
+	SerialTransport* GetShard(int index) const;
+
+	// The lights each board has, as a run of the strip
+	int GetShardFirstLight(int index) const;
+	int GetShardLightCount(int index) const;
+
+	// Light values every board had in time, and so were shown together
+	uint64_t GetFramesShown() const;
+
+public:
+	// How long to wait for every board to have a frame before showing it on those that do
+	static const int ShowTimeoutMilliseconds = 500;
+
+private:
+	struct Shard
+	{
+		std::unique_ptr<SerialTransport>	transport;
+		std::string							port;
+		int									firstLight;
+		int									lightCount;
+	};
+
+private:
+	void Run();
+	bool IsGenerationDone(uint64_t generation) const;
+	static void FrameDone(void* context);
+
+private:
+	LatencyStats*				m_LatencyStats;
+	std::vector<Shard>			m_Shards;
+	std::thread					m_Thread;
+	uint16_t					m_Features;
+	std::atomic<uint64_t>		m_FramesShown;
+	size_t						m_DebugShard;
+
+	// Shared with the threads handing over light values, and woken by the shards as frames get through
+	std::mutex					m_Lock;
+	std::condition_variable		m_Wake;
+	bool						m_StopRequested;
+	std::vector<int32_t>		m_LightValues;
+	bool						m_LightsUpdated;
+	int64_t						m_LightPresentTime;
+
+	// Only touched by the coordinating thread
+	std::vector<int32_t>		m_SentLightValues;
+	uint64_t					m_Generation;
+};
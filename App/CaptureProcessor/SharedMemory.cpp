@@ -0,0 +1,188 @@
+#include "SharedMemory.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+//
+// Names are UTF-8 everywhere, so convert for the wide Win32 calls
+//
+static std::wstring WidenName(const std::string& name)
+{
+	int length = MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, nullptr, 0);
+	if (length <= 0)
+	{
+		return std::wstring();
+	}
+
+	std::wstring wideName(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, name.c_str(), -1, &wideName[0], length);
+	wideName.resize(length - 1);
+	return wideName;
+}
+#endif
+
+SharedMemory::SharedMemory() :
+#if defined(_WIN32)
+	m_Mapping(nullptr),
+#endif
+	m_Data(nullptr),
+	m_Size(0)
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+	Close();
+}
+
+bool SharedMemory::Create(const std::string& name, uint64_t size)
+{
+	Close();
+	if (name.empty() || size == 0)
+	{
+		return false;
+	}
+
+#if defined(_WIN32)
+	m_Mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), WidenName(name).c_str());
+	if (!m_Mapping)
+	{
+		return false;
+	}
+
+	// An existing block might be too small, so only take it over if it isn't
+	bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+	m_Data = static_cast<uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(size)));
+	MEMORY_BASIC_INFORMATION info;
+	if (!m_Data || (existed && (VirtualQuery(m_Data, &info, sizeof(info)) == 0 || info.RegionSize < size)))
+	{
+		Close();
+		return false;
+	}
+#else
+	std::string sharedName = "/" + name;
+	int file = shm_open(sharedName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	bool sized = ftruncate(file, static_cast<off_t>(size)) == 0;
+	void* data = sized ? mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+	close(file);
+	if (data == MAP_FAILED)
+	{
+		shm_unlink(sharedName.c_str());
+		return false;
+	}
+	m_Data = static_cast<uint8_t*>(data);
+	m_UnlinkName = sharedName;
+#endif
+
+	m_Size = size;
+	memset(m_Data, 0, static_cast<size_t>(size));
+	return true;
+}
+
+bool SharedMemory::OpenRead(const std::string& name)
+{
+	Close();
+	if (name.empty())
+	{
+		return false;
+	}
+
+#if defined(_WIN32)
+	m_Mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, WidenName(name).c_str());
+	if (!m_Mapping)
+	{
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	m_Data = static_cast<uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_Data || VirtualQuery(m_Data, &info, sizeof(info)) == 0)
+	{
+		Close();
+		return false;
+	}
+	m_Size = info.RegionSize;
+#else
+	int file = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	void* data = MAP_FAILED;
+	if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+	{
+		data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, file, 0);
+	}
+	close(file);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+	m_Data = static_cast<uint8_t*>(data);
+	m_Size = static_cast<uint64_t>(fileStat.st_size);
+#endif
+
+	return true;
+}
+
+void SharedMemory::Close()
+{
+#if defined(_WIN32)
+	if (m_Data)
+	{
+		UnmapViewOfFile(m_Data);
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+#else
+	if (m_Data)
+	{
+		munmap(m_Data, static_cast<size_t>(m_Size));
+	}
+
+	// Readers keep what they've mapped, but nobody new can find it
+	if (!m_UnlinkName.empty())
+	{
+		shm_unlink(m_UnlinkName.c_str());
+		m_UnlinkName.clear();
+	}
+#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+bool SharedMemory::IsOpen() const
+{
+	return m_Data != nullptr;
+}
+
+uint8_t* SharedMemory::GetData() const
+{
+	return m_Data;
+}
+
+uint64_t SharedMemory::GetSize() const
+{
+	return m_Size;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// A named block of memory shared between processes, using named file mappings on Windows and POSIX shared
+// memory everywhere else. One process creates it and others open it by name, read only. On Windows the name can
+// carry a "Local\" or "Global\" prefix, and elsewhere it must be a plain name without any '/'
+class SharedMemory
+{
+public:
+	SharedMemory();
+	~SharedMemory();
+
+	// Creates (or takes over) the named block, zero filled. It goes away once everyone has closed it
+	bool Create(const std::string& name, uint64_t size);
+
+	// Opens a block someone else created
+	bool OpenRead(const std::string& name);
+
+	void Close();
+
+	bool IsOpen() const;
+	uint8_t* GetData() const;
+	uint64_t GetSize() const;
+
+private:
+#if defined(_WIN32)
+	void*			m_Mapping;
+#else
+	std::string		m_UnlinkName;
+#endif
+	uint8_t*		m_Data;
+	uint64_t		m_Size;
+};
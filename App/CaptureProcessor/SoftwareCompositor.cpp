@@ -0,0 +1,272 @@
+#include "SoftwareCompositor.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "FrameGeometry.h"
+
+static const int BytesPerPixel = 4;
+
+SoftwareCompositor::SoftwareCompositor() :
+	m_SurfaceWidth(0),
+	m_SurfaceHeight(0)
+{
+}
+
+SoftwareCompositor::~SoftwareCompositor()
+{
+}
+
+bool SoftwareCompositor::Initialise(int surfaceWidth, int surfaceHeight)
+{
+	if (surfaceWidth <= 0 || surfaceHeight <= 0)
+	{
+		return false;
+	}
+
+	m_SurfaceWidth = surfaceWidth;
+	m_SurfaceHeight = surfaceHeight;
+	m_Surface.assign(static_cast<size_t>(m_SurfaceWidth) * m_SurfaceHeight * BytesPerPixel, 0);
+	m_UpdatedRects.clear();
+
+	return true;
+}
+
+//
+// Process a given frame and its metadata
+//
+bool SoftwareCompositor::ProcessFrame(FrameSource& frameSource, int offsetX, int offsetY)
+{
+	m_UpdatedRects.clear();
+
+	FrameBuffer frameBuffer;
+	if (!frameSource.GetFrameBuffer(&frameBuffer))
+	{
+		return false;
+	}
+
+	const FrameOutputDesc& outputDesc = frameSource.GetFrameOutputDesc();
+
+	// Process the moves first
+	if (frameSource.GetMoveCount())
+	{
+		ProcessMoves(frameSource.GetMoveRects(), frameSource.GetMoveCount(), offsetX, offsetY, outputDesc, frameBuffer.width, frameBuffer.height);
+	}
+
+	// Now process the dirties
+	if (frameSource.GetDirtyCount())
+	{
+		ProcessDirty(frameBuffer, frameSource.GetDirtyRects(), frameSource.GetDirtyCount(), offsetX, offsetY, outputDesc);
+	}
+
+	return true;
+}
+
+const uint8_t* SoftwareCompositor::GetSurface() const
+{
+	return m_Surface.empty() ? nullptr : &m_Surface[0];
+}
+
+int SoftwareCompositor::GetSurfaceWidth() const
+{
+	return m_SurfaceWidth;
+}
+
+int SoftwareCompositor::GetSurfaceHeight() const
+{
+	return m_SurfaceHeight;
+}
+
+int SoftwareCompositor::GetSurfacePitch() const
+{
+	return m_SurfaceWidth * BytesPerPixel;
+}
+
+const std::vector<FrameRect>& SoftwareCompositor::GetUpdatedRects() const
+{
+	return m_UpdatedRects;
+}
+
+//
+// Copy move rectangles
+//
+void SoftwareCompositor::ProcessMoves(const FrameMoveRect* moveRects, unsigned int moveCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, int texWidth, int texHeight)
+{
+	int pitch = GetSurfacePitch();
+	int outputX = outputDesc.desktopCoordinates.left - offsetX;
+	int outputY = outputDesc.desktopCoordinates.top - offsetY;
+
+	for (unsigned int moveRectIndex = 0; moveRectIndex < moveCount; ++moveRectIndex)
+	{
+		FrameRect srcRect;
+		FrameRect destRect;
+
+		ConvertMoveRect(&srcRect, &destRect, outputDesc, moveRects[moveRectIndex], texWidth, texHeight);
+
+		// Move into surface coordinates, keeping the source and destination the same size if either gets clipped
+		int moveX = destRect.left - srcRect.left;
+		int moveY = destRect.top - srcRect.top;
+
+		FrameRect surfaceSource = srcRect;
+		surfaceSource.left += outputX;
+		surfaceSource.top += outputY;
+		surfaceSource.right += outputX;
+		surfaceSource.bottom += outputY;
+		if (!ClipToSurface(&surfaceSource))
+		{
+			continue;
+		}
+
+		FrameRect surfaceDest;
+		surfaceDest.left = surfaceSource.left + moveX;
+		surfaceDest.top = surfaceSource.top + moveY;
+		surfaceDest.right = surfaceSource.right + moveX;
+		surfaceDest.bottom = surfaceSource.bottom + moveY;
+		if (!ClipToSurface(&surfaceDest))
+		{
+			continue;
+		}
+		surfaceSource.left = surfaceDest.left - moveX;
+		surfaceSource.top = surfaceDest.top - moveY;
+
+		int width = surfaceDest.right - surfaceDest.left;
+		int height = surfaceDest.bottom - surfaceDest.top;
+		size_t rowBytes = static_cast<size_t>(width) * BytesPerPixel;
+
+		// Copy rect out of the surface to our temporary one
+		m_MoveBuffer.resize(rowBytes * height);
+		for (int y = 0; y < height; ++y)
+		{
+			std::memcpy(&m_MoveBuffer[y * rowBytes], &m_Surface[static_cast<size_t>(surfaceSource.top + y) * pitch + surfaceSource.left * BytesPerPixel], rowBytes);
+		}
+
+		// Then back to the new location
+		for (int y = 0; y < height; ++y)
+		{
+			std::memcpy(&m_Surface[static_cast<size_t>(surfaceDest.top + y) * pitch + surfaceDest.left * BytesPerPixel], &m_MoveBuffer[y * rowBytes], rowBytes);
+		}
+
+		AddUpdatedRect(destRect, offsetX, offsetY, outputDesc);
+	}
+}
+
+//
+// Copies dirty rectangles, rotating the pixels into desktop orientation
+//
+void SoftwareCompositor::ProcessDirty(const FrameBuffer& frameBuffer, const FrameRect* dirtyRects, unsigned int dirtyCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc)
+{
+	int pitch = GetSurfacePitch();
+	int outputX = outputDesc.desktopCoordinates.left - offsetX;
+	int outputY = outputDesc.desktopCoordinates.top - offsetY;
+	int outputWidth = outputDesc.desktopCoordinates.right - outputDesc.desktopCoordinates.left;
+	int outputHeight = outputDesc.desktopCoordinates.bottom - outputDesc.desktopCoordinates.top;
+
+	for (unsigned int dirtyIndex = 0; dirtyIndex < dirtyCount; ++dirtyIndex)
+	{
+		// Keep within the frame
+		FrameRect dirtyRect = dirtyRects[dirtyIndex];
+		dirtyRect.left = std::max(dirtyRect.left, 0);
+		dirtyRect.top = std::max(dirtyRect.top, 0);
+		dirtyRect.right = std::min(dirtyRect.right, frameBuffer.width);
+		dirtyRect.bottom = std::min(dirtyRect.bottom, frameBuffer.height);
+		if (dirtyRect.left >= dirtyRect.right || dirtyRect.top >= dirtyRect.bottom)
+		{
+			continue;
+		}
+
+		switch (outputDesc.rotation)
+		{
+		case FrameRotationRotate90:
+		case FrameRotationRotate180:
+		case FrameRotationRotate270:
+			{
+				for (int y = dirtyRect.top; y < dirtyRect.bottom; ++y)
+				{
+					const uint8_t* source = frameBuffer.pixels + static_cast<size_t>(y) * frameBuffer.pitch + dirtyRect.left * BytesPerPixel;
+					for (int x = dirtyRect.left; x < dirtyRect.right; ++x, source += BytesPerPixel)
+					{
+						int destX;
+						int destY;
+						if (outputDesc.rotation == FrameRotationRotate90)
+						{
+							destX = outputWidth - 1 - y;
+							destY = x;
+						}
+						else if (outputDesc.rotation == FrameRotationRotate180)
+						{
+							destX = outputWidth - 1 - x;
+							destY = outputHeight - 1 - y;
+						}
+						else
+						{
+							destX = y;
+							destY = outputHeight - 1 - x;
+						}
+
+						destX += outputX;
+						destY += outputY;
+						if (destX >= 0 && destX < m_SurfaceWidth && destY >= 0 && destY < m_SurfaceHeight)
+						{
+							std::memcpy(&m_Surface[static_cast<size_t>(destY) * pitch + destX * BytesPerPixel], source, BytesPerPixel);
+						}
+					}
+				}
+			}
+			break;
+
+		default:
+			{
+				// No rotation, so straight row copies
+				FrameRect destRect = dirtyRect;
+				destRect.left += outputX;
+				destRect.top += outputY;
+				destRect.right += outputX;
+				destRect.bottom += outputY;
+				if (!ClipToSurface(&destRect))
+				{
+					continue;
+				}
+
+				int sourceX = destRect.left - outputX;
+				int sourceY = destRect.top - outputY;
+				size_t rowBytes = static_cast<size_t>(destRect.right - destRect.left) * BytesPerPixel;
+				for (int y = 0; y < destRect.bottom - destRect.top; ++y)
+				{
+					std::memcpy(&m_Surface[static_cast<size_t>(destRect.top + y) * pitch + destRect.left * BytesPerPixel], frameBuffer.pixels + static_cast<size_t>(sourceY + y) * frameBuffer.pitch + sourceX * BytesPerPixel, rowBytes);
+				}
+			}
+			break;
+		}
+
+		AddUpdatedRect(RotateDirtyRect(dirtyRect, outputDesc), offsetX, offsetY, outputDesc);
+	}
+}
+
+//
+// Clips a rect in surface coordinates to the surface. Returns false if nothing is left
+//
+bool SoftwareCompositor::ClipToSurface(FrameRect* rect) const
+{
+	rect->left = std::max(rect->left, 0);
+	rect->top = std::max(rect->top, 0);
+	rect->right = std::min(rect->right, m_SurfaceWidth);
+	rect->bottom = std::min(rect->bottom, m_SurfaceHeight);
+
+	return rect->left < rect->right && rect->top < rect->bottom;
+}
+
+//
+// Records a rect in output space as updated on the surface
+//
+void SoftwareCompositor::AddUpdatedRect(const FrameRect& rect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc)
+{
+	FrameRect updatedRect;
+	updatedRect.left = rect.left + outputDesc.desktopCoordinates.left - offsetX;
+	updatedRect.top = rect.top + outputDesc.desktopCoordinates.top - offsetY;
+	updatedRect.right = rect.right + outputDesc.desktopCoordinates.left - offsetX;
+	updatedRect.bottom = rect.bottom + outputDesc.desktopCoordinates.top - offsetY;
+	if (ClipToSurface(&updatedRect))
+	{
+		m_UpdatedRects.push_back(updatedRect);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameSource.h"
+
+// CPU version of the ScreenProcessor
+// Composites the moves and dirty rects of each frame from a FrameSource onto a BGRA desktop surface,
+// handling rotation the same way. Used where there's no D3D device, so the compositing and zone
+// averaging can be run against synthetic or recorded frames on any machine
+class SoftwareCompositor
+{
+public:
+	SoftwareCompositor();
+	~SoftwareCompositor();
+
+	bool Initialise(int surfaceWidth, int surfaceHeight);
+
+	// Composites the current frame of frameSource onto the surface. offsetX / offsetY are the
+	// desktop coordinates of the top left of the surface
+	bool ProcessFrame(FrameSource& frameSource, int offsetX, int offsetY);
+
+	const uint8_t* GetSurface() const;
+	int GetSurfaceWidth() const;
+	int GetSurfaceHeight() const;
+	int GetSurfacePitch() const;
+
+	// The rects of the surface that were changed by the last frame, in surface coordinates
+	const std::vector<FrameRect>& GetUpdatedRects() const;
+
+private:
+	void ProcessMoves(const FrameMoveRect* moveRects, unsigned int moveCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc, int texWidth, int texHeight);
+	void ProcessDirty(const FrameBuffer& frameBuffer, const FrameRect* dirtyRects, unsigned int dirtyCount, int offsetX, int offsetY, const FrameOutputDesc& outputDesc);
+	bool ClipToSurface(FrameRect* rect) const;
+	void AddUpdatedRect(const FrameRect& rect, int offsetX, int offsetY, const FrameOutputDesc& outputDesc);
+
+private:
+	int						m_SurfaceWidth;
+	int						m_SurfaceHeight;
+	std::vector<uint8_t>	m_Surface;
+
+	// Scratch copy of a move's source, as the source and destination can overlap
+	std::vector<uint8_t>	m_MoveBuffer;
+
+	std::vector<FrameRect>	m_UpdatedRects;
+};
@@ -0,0 +1,326 @@
+#include "SyntheticFrameSource.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const int BytesPerPixel = 4;
+
+SyntheticFrameSource::SyntheticFrameSource() :
+	m_RandomState(1),
+	m_FrameIndex(0),
+	m_HaveFrame(false)
+{
+	std::memset(&m_Config, 0, sizeof(m_Config));
+	std::memset(&m_OutputDesc, 0, sizeof(m_OutputDesc));
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+}
+
+//
+// A single output with every motion pattern and a sprinkling of small updates
+//
+SyntheticFrameConfig SyntheticFrameSource::GetDefaultConfig(int width, int height)
+{
+	SyntheticFrameConfig config;
+	config.width = width;
+	config.height = height;
+	config.outputIndex = 0;
+	config.outputCount = 1;
+	config.motion = SyntheticMotionScrolling | SyntheticMotionVideo | SyntheticMotionFlash;
+	config.dirtyRectsPerFrame = 4;
+	config.frameRate = 60;
+	config.frameCount = 0;
+	config.seed = 1;
+	return config;
+}
+
+bool SyntheticFrameSource::Initialise(const SyntheticFrameConfig& config)
+{
+	if (config.width <= 0 || config.height <= 0 || config.outputCount <= 0 || config.outputIndex < 0 || config.outputIndex >= config.outputCount || config.frameRate <= 0 || config.dirtyRectsPerFrame < 0)
+	{
+		return false;
+	}
+
+	m_Config = config;
+
+	m_OutputDesc.desktopCoordinates.left = config.outputIndex * config.width;
+	m_OutputDesc.desktopCoordinates.top = 0;
+	m_OutputDesc.desktopCoordinates.right = m_OutputDesc.desktopCoordinates.left + config.width;
+	m_OutputDesc.desktopCoordinates.bottom = config.height;
+	m_OutputDesc.rotation = FrameRotationIdentity;
+
+	// Xorshift can't have a zero state. Mix in the output so each one gets different content
+	m_RandomState = (config.seed ^ (static_cast<uint32_t>(config.outputIndex) * 0x9E3779B9u)) | 1;
+	m_FrameIndex = 0;
+	m_HaveFrame = false;
+
+	m_Frame.assign(static_cast<size_t>(config.width) * config.height * BytesPerPixel, 0);
+	m_DirtyRects.clear();
+	m_MoveRects.clear();
+
+	return true;
+}
+
+bool SyntheticFrameSource::GetFrame(bool* timeout)
+{
+	m_DirtyRects.clear();
+	m_MoveRects.clear();
+	m_HaveFrame = false;
+
+	if (IsFinished())
+	{
+		*timeout = true;
+		return true;
+	}
+	*timeout = false;
+
+	if (m_FrameIndex == 0)
+	{
+		// Like desktop duplication, the first frame is all new
+		GenerateFlash();
+	}
+	else if ((m_Config.motion & SyntheticMotionFlash) && (m_FrameIndex % m_Config.frameRate) == 0)
+	{
+		// Once a second the whole output changes, which covers everything else
+		GenerateFlash();
+	}
+	else
+	{
+		if (m_Config.motion & SyntheticMotionScrolling)
+		{
+			GenerateScroll();
+		}
+
+		if (m_Config.motion & SyntheticMotionVideo)
+		{
+			GenerateVideo();
+		}
+
+		GenerateDirtyRects();
+	}
+
+	m_HaveFrame = true;
+	++m_FrameIndex;
+
+	return true;
+}
+
+bool SyntheticFrameSource::ReleaseFrame()
+{
+	m_DirtyRects.clear();
+	m_MoveRects.clear();
+	m_HaveFrame = false;
+
+	return true;
+}
+
+int SyntheticFrameSource::GetDirtyCount() const
+{
+	return static_cast<int>(m_DirtyRects.size());
+}
+
+const FrameRect* SyntheticFrameSource::GetDirtyRects() const
+{
+	return m_DirtyRects.empty() ? nullptr : &m_DirtyRects[0];
+}
+
+int SyntheticFrameSource::GetMoveCount() const
+{
+	return static_cast<int>(m_MoveRects.size());
+}
+
+const FrameMoveRect* SyntheticFrameSource::GetMoveRects() const
+{
+	return m_MoveRects.empty() ? nullptr : &m_MoveRects[0];
+}
+
+const FrameOutputDesc& SyntheticFrameSource::GetFrameOutputDesc() const
+{
+	return m_OutputDesc;
+}
+
+//
+// Virtual present time of the current frame, in microseconds
+//
+int64_t SyntheticFrameSource::GetPresentTime() const
+{
+	int64_t frameIndex = m_FrameIndex > 0 ? m_FrameIndex - 1 : 0;
+	return (frameIndex * 1000000) / m_Config.frameRate;
+}
+
+bool SyntheticFrameSource::GetFrameBuffer(FrameBuffer* frameBuffer)
+{
+	if (!m_HaveFrame)
+	{
+		return false;
+	}
+
+	frameBuffer->pixels = &m_Frame[0];
+	frameBuffer->width = m_Config.width;
+	frameBuffer->height = m_Config.height;
+	frameBuffer->pitch = m_Config.width * BytesPerPixel;
+	return true;
+}
+
+bool SyntheticFrameSource::IsFinished() const
+{
+	return m_Config.frameCount > 0 && m_FrameIndex >= m_Config.frameCount;
+}
+
+int SyntheticFrameSource::GetFrameIndex() const
+{
+	return m_FrameIndex;
+}
+
+//
+// A window on the left half scrolling up, with a new line of content appearing at the bottom
+//
+void SyntheticFrameSource::GenerateScroll()
+{
+	FrameRect window;
+	window.left = m_Config.width / 8;
+	window.top = m_Config.height / 8;
+	window.right = m_Config.width / 2;
+	window.bottom = (m_Config.height * 7) / 8;
+
+	int step = std::max(1, m_Config.height / 120);
+	if (window.bottom - window.top <= step || window.right <= window.left)
+	{
+		return;
+	}
+
+	FrameRect source = window;
+	source.top += step;
+	MoveRect(source, window.left, window.top);
+
+	FrameRect line = window;
+	line.top = window.bottom - step;
+	AddDirtyRect(line, NextRandom());
+}
+
+//
+// A video window on the right half, repainted every frame
+//
+void SyntheticFrameSource::GenerateVideo()
+{
+	FrameRect window;
+	window.left = (m_Config.width * 9) / 16;
+	window.top = m_Config.height / 4;
+	window.right = (m_Config.width * 15) / 16;
+	window.bottom = (m_Config.height * 3) / 4;
+	if (window.right <= window.left || window.bottom <= window.top)
+	{
+		return;
+	}
+
+	// Slowly cycle the colour so the zones behind the video change smoothly
+	uint32_t phase = static_cast<uint32_t>(m_FrameIndex) * 3;
+	uint32_t colour = ((phase & 0xFF) << 16) | (((phase * 2) & 0xFF) << 8) | ((phase * 5) & 0xFF);
+	AddDirtyRect(window, colour);
+}
+
+void SyntheticFrameSource::GenerateFlash()
+{
+	FrameRect output;
+	output.left = 0;
+	output.top = 0;
+	output.right = m_Config.width;
+	output.bottom = m_Config.height;
+	AddDirtyRect(output, NextRandom());
+}
+
+//
+// Small updates scattered over the output, like a cursor, text or UI
+//
+void SyntheticFrameSource::GenerateDirtyRects()
+{
+	for (int rectIndex = 0; rectIndex < m_Config.dirtyRectsPerFrame; ++rectIndex)
+	{
+		int width = std::min(RandomRange(8, 128), m_Config.width);
+		int height = std::min(RandomRange(8, 128), m_Config.height);
+
+		FrameRect rect;
+		rect.left = RandomRange(0, m_Config.width - width);
+		rect.top = RandomRange(0, m_Config.height - height);
+		rect.right = rect.left + width;
+		rect.bottom = rect.top + height;
+		AddDirtyRect(rect, NextRandom());
+	}
+}
+
+//
+// Moves sourceRect so its top left is at destX, destY and records the move
+//
+void SyntheticFrameSource::MoveRect(const FrameRect& sourceRect, int destX, int destY)
+{
+	int pitch = m_Config.width * BytesPerPixel;
+	int height = sourceRect.bottom - sourceRect.top;
+	size_t rowBytes = static_cast<size_t>(sourceRect.right - sourceRect.left) * BytesPerPixel;
+
+	m_MoveBuffer.resize(rowBytes * height);
+	for (int y = 0; y < height; ++y)
+	{
+		std::memcpy(&m_MoveBuffer[y * rowBytes], &m_Frame[static_cast<size_t>(sourceRect.top + y) * pitch + sourceRect.left * BytesPerPixel], rowBytes);
+	}
+	for (int y = 0; y < height; ++y)
+	{
+		std::memcpy(&m_Frame[static_cast<size_t>(destY + y) * pitch + destX * BytesPerPixel], &m_MoveBuffer[y * rowBytes], rowBytes);
+	}
+
+	FrameMoveRect moveRect;
+	moveRect.sourcePoint.x = sourceRect.left;
+	moveRect.sourcePoint.y = sourceRect.top;
+	moveRect.destinationRect.left = destX;
+	moveRect.destinationRect.top = destY;
+	moveRect.destinationRect.right = destX + (sourceRect.right - sourceRect.left);
+	moveRect.destinationRect.bottom = destY + height;
+	m_MoveRects.push_back(moveRect);
+}
+
+//
+// Fills a rect with a cheap pattern based on colour, so zones don't all end up flat
+//
+void SyntheticFrameSource::FillRect(const FrameRect& rect, uint32_t colour)
+{
+	int pitch = m_Config.width * BytesPerPixel;
+	colour |= 0xFF000000;
+
+	for (int y = rect.top; y < rect.bottom; ++y)
+	{
+		uint32_t* row = reinterpret_cast<uint32_t*>(&m_Frame[static_cast<size_t>(y) * pitch]);
+		for (int x = rect.left; x < rect.right; ++x)
+		{
+			row[x] = colour ^ (static_cast<uint32_t>(x ^ y) & 0x001F1F1F);
+		}
+	}
+}
+
+void SyntheticFrameSource::AddDirtyRect(const FrameRect& rect, uint32_t colour)
+{
+	FillRect(rect, colour);
+	m_DirtyRects.push_back(rect);
+}
+
+uint32_t SyntheticFrameSource::NextRandom()
+{
+	// Xorshift32
+	m_RandomState ^= m_RandomState << 13;
+	m_RandomState ^= m_RandomState >> 17;
+	m_RandomState ^= m_RandomState << 5;
+	return m_RandomState;
+}
+
+//
+// Random value in [minimum, maximum]
+//
+int SyntheticFrameSource::RandomRange(int minimum, int maximum)
+{
+	if (maximum <= minimum)
+	{
+		return minimum;
+	}
+
+	return minimum + static_cast<int>(NextRandom() % static_cast<uint32_t>(maximum - minimum + 1));
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameSource.h"
+
+// Motion patterns the synthetic desktop can generate. Combine with |
+enum SyntheticMotion
+{
+	SyntheticMotionNone = 0,
+	SyntheticMotionScrolling = 1 << 0,		// A window scrolling up, reported as a move plus a dirty strip
+	SyntheticMotionVideo = 1 << 1,			// A video window repainted every frame
+	SyntheticMotionFlash = 1 << 2			// The whole output repainted every so often
+};
+
+struct SyntheticFrameConfig
+{
+	int width;
+	int height;
+
+	// Outputs are laid out left to right, all the same size
+	int outputIndex;
+	int outputCount;
+
+	unsigned int motion;
+
+	// Number of small random dirty rects (cursor, text, UI) per frame
+	int dirtyRectsPerFrame;
+
+	int frameRate;
+
+	// Frames to produce before the source runs dry. 0 for no limit
+	int frameCount;
+
+	uint32_t seed;
+};
+
+// Deterministic stand in for the DuplicationManager
+// Generates frames for one output of a made up desktop, along with the dirty and move rects that
+// describe how each frame differs from the last, exactly like desktop duplication does.
+// The first frame is reported as entirely dirty. Present times are virtual, advancing by one frame
+// period per frame, so runs are repeatable regardless of how fast they're consumed
+class SyntheticFrameSource : public FrameSource
+{
+public:
+	SyntheticFrameSource();
+	virtual ~SyntheticFrameSource();
+
+	static SyntheticFrameConfig GetDefaultConfig(int width, int height);
+
+	bool Initialise(const SyntheticFrameConfig& config);
+
+	virtual bool GetFrame(bool* timeout);
+	virtual bool ReleaseFrame();
+
+	virtual int GetDirtyCount() const;
+	virtual const FrameRect* GetDirtyRects() const;
+	virtual int GetMoveCount() const;
+	virtual const FrameMoveRect* GetMoveRects() const;
+
+	virtual const FrameOutputDesc& GetFrameOutputDesc() const;
+
+	virtual int64_t GetPresentTime() const;
+	virtual bool GetFrameBuffer(FrameBuffer* frameBuffer);
+
+	// True once frameCount frames have been produced
+	bool IsFinished() const;
+	int GetFrameIndex() const;
+
+private:
+	void GenerateScroll();
+	void GenerateVideo();
+	void GenerateFlash();
+	void GenerateDirtyRects();
+
+	void MoveRect(const FrameRect& sourceRect, int destX, int destY);
+	void FillRect(const FrameRect& rect, uint32_t colour);
+	void AddDirtyRect(const FrameRect& rect, uint32_t colour);
+
+	uint32_t NextRandom();
+	int RandomRange(int minimum, int maximum);
+
+private:
+	SyntheticFrameConfig		m_Config;
+	FrameOutputDesc				m_OutputDesc;
+	uint32_t					m_RandomState;
+	int							m_FrameIndex;
+	bool						m_HaveFrame;
+
+	// The current frame, kept in step with the rects reported for it
+	std::vector<uint8_t>		m_Frame;
+	std::vector<uint8_t>		m_MoveBuffer;
+
+	std::vector<FrameRect>		m_DirtyRects;
+	std::vector<FrameMoveRect>	m_MoveRects;
+};
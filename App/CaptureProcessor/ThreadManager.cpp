@@ -15,10 +15,12 @@ class ThreadProc
 public:
 	ThreadProc() :
 		m_SharedSurface(nullptr),
-		m_KeyMutex(nullptr)
+		m_KeyMutex(nullptr),
+		m_PendingPresentTime(0)
 	{
 		m_ScreenProcessor = new ScreenProcessor();
 		m_DuplicationManager = new DuplicationManager();
+		m_FrameSource = m_DuplicationManager;
 	}
 
 	~ThreadProc()
@@ -86,6 +88,18 @@ public:
 		{
 			return;
 		}
+
+		// Open our frame slots, if we're handing frames over through them
+		if (threadData->frameSlots && !OpenFrameSlots(threadData))
+		{
+			return;
+		}
+
+		// Start recording, if we've been asked to. Not being able to is no reason to stop capturing
+		if (!threadData->captureTracePath.empty())
+		{
+			m_CaptureTraceWriter.Open(CaptureTraceWriter::GetOutputPath(threadData->captureTracePath, threadData->output), threadData->captureTracePixels);
+		}
 		
 		// Main duplication loop
 		bool waitToProcessCurrentFrame = false;
@@ -95,7 +109,7 @@ public:
 			{
 				// Get new frame from desktop duplication
 				bool timedOut = false;
-				if(!m_DuplicationManager->GetFrame(&timedOut))
+				if(!m_FrameSource->GetFrame(&timedOut))
 				{
 					// An error occurred getting the next frame drop out of loop which
 					// will check if it was expected or not
@@ -109,12 +123,32 @@ public:
 					continue;
 				}
 
-				if (m_DuplicationManager->GetDirtyCount() == 0 && m_DuplicationManager->GetMoveCount() == 0)
+				if (m_FrameSource->GetDirtyCount() == 0 && m_FrameSource->GetMoveCount() == 0)
 				{
 					// No need to update
-					m_DuplicationManager->ReleaseFrame();
+					m_FrameSource->ReleaseFrame();
 					continue;
 				}
+
+				threadData->latencyStats->Record(LatencyStageAcquire, m_FrameSource->GetPresentTime());
+
+				// Record the frame before it goes anywhere near the shared surface
+				if (m_CaptureTraceWriter.IsOpen() && !m_CaptureTraceWriter.AppendFrame(*m_FrameSource))
+				{
+					// Out of disk, or the mode changed, so finish the trace here
+					m_CaptureTraceWriter.Close();
+				}
+			}
+
+			// With our own frame slots there's nobody to wait for
+			if (threadData->frameSlots)
+			{
+				bool processed = ProcessFrameSlot(threadData);
+				if (!m_FrameSource->ReleaseFrame() || !processed)
+				{
+					break;
+				}
+				continue;
 			}
 
 			// We have a new frame so try and process it
@@ -129,7 +163,7 @@ public:
 			else if (FAILED(hr))
 			{
 				// Generic unknown failure
-				m_DuplicationManager->ReleaseFrame();
+				m_FrameSource->ReleaseFrame();
 				SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
 				break;
 			}
@@ -138,38 +172,172 @@ public:
 			waitToProcessCurrentFrame = false;
 
 			// Process new frame
-			if(!m_ScreenProcessor->ProcessFrame(*m_DuplicationManager, m_SharedSurface, threadData->offsetX, threadData->offsetY))
+			if(!m_ScreenProcessor->ProcessFrame(*m_FrameSource, m_DuplicationManager->GetTexture(), m_SharedSurface, threadData->offsetX, threadData->offsetY))
 			{
-				m_DuplicationManager->ReleaseFrame();
+				m_FrameSource->ReleaseFrame();
 				m_KeyMutex->ReleaseSync(0);
 				break;
 			}
 
+			int64_t presentTime = m_FrameSource->GetPresentTime();
+			threadData->latencyStats->Record(LatencyStageComposite, presentTime);
+
+			// Let the light processor know which parts of the shared surface have changed
+			const std::vector<FrameRect>& updatedRects = m_ScreenProcessor->GetUpdatedRects();
+			if (!updatedRects.empty())
+			{
+				threadData->dirtyRegion->Add(&updatedRects[0], updatedRects.size(), presentTime);
+			}
+
 			// Release acquired keyed mutex
 			hr = m_KeyMutex->ReleaseSync(0);
 			if (FAILED(hr))
 			{
-				m_DuplicationManager->ReleaseFrame();
+				m_FrameSource->ReleaseFrame();
 				SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
 				break;
 			}
 
+			// Let whoever's driving the light processor know there's something new
+			SetEvent(threadData->frameUpdatedEvent);
+
 			// Release frame back to desktop duplication
-			if(!m_DuplicationManager->ReleaseFrame())
+			if(!m_FrameSource->ReleaseFrame())
 			{
 				break;
 			}
 		}
 	}
 
+private:
+	//
+	// Opens the frame slots the light processor made for our output, and makes our own surface to composite onto
+	//
+	bool OpenFrameSlots(ThreadManager::ThreadData* threadData)
+	{
+		ComPtr<ID3D11Device> device = m_ScreenProcessor->GetDevice();
+		device->GetImmediateContext(&m_DeviceContext);
+
+		for (int slot = 0; slot < FrameSlotExchange::SlotsPerOutput; ++slot)
+		{
+			HRESULT hr = device->OpenSharedResource(threadData->frameSlotHandles[slot], __uuidof(ID3D11Texture2D), &m_FrameSlotSurfaces[slot]);
+			if (FAILED(hr))
+			{
+				SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
+				return false;
+			}
+
+			hr = m_FrameSlotSurfaces[slot].As(&m_FrameSlotMutexes[slot]);
+			if (FAILED(hr))
+			{
+				SetAppropriateEvent(hr, nullptr, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
+				return false;
+			}
+		}
+
+		D3D11_TEXTURE2D_DESC outputDescription;
+		m_FrameSlotSurfaces[0]->GetDesc(&outputDescription);
+		outputDescription.MiscFlags = 0;
+		HRESULT hr = device->CreateTexture2D(&outputDescription, nullptr, &m_OutputSurface);
+		if (FAILED(hr))
+		{
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
+			return false;
+		}
+
+		return true;
+	}
+
+	//
+	// Composites the frame onto our own surface, then hands a copy of it over through our frame slots.
+	// The light processor only ever takes the latest, so we never wait on it or any other output
+	//
+	bool ProcessFrameSlot(ThreadManager::ThreadData* threadData)
+	{
+		// Draw the output at the top left of our surface
+		const RECT& outputRect = m_DuplicationManager->GetOutputDesc().DesktopCoordinates;
+		if (!m_ScreenProcessor->ProcessFrame(*m_FrameSource, m_DuplicationManager->GetTexture(), m_OutputSurface, outputRect.left, outputRect.top))
+		{
+			return false;
+		}
+
+		int64_t presentTime = m_FrameSource->GetPresentTime();
+		threadData->latencyStats->Record(LatencyStageComposite, presentTime);
+
+		// Hold on to what's changed, moved to where the output sits on the shared surface, until it's been handed over
+		for (auto updatedRect : m_ScreenProcessor->GetUpdatedRects())
+		{
+			updatedRect.left += outputRect.left - threadData->offsetX;
+			updatedRect.top += outputRect.top - threadData->offsetY;
+			updatedRect.right += outputRect.left - threadData->offsetX;
+			updatedRect.bottom += outputRect.top - threadData->offsetY;
+			m_PendingRects.push_back(updatedRect);
+		}
+		if (presentTime > 0 && (m_PendingPresentTime == 0 || presentTime < m_PendingPresentTime))
+		{
+			m_PendingPresentTime = presentTime;
+		}
+
+		// The slot is ours until we publish it, so this is only here to order the GPU work between devices
+		int slot = threadData->frameSlots->GetWriteSlot(threadData->frameSlotOutput);
+		HRESULT hr = m_FrameSlotMutexes[slot]->AcquireSync(0, 100);
+		if (hr == static_cast<HRESULT>(WAIT_TIMEOUT))
+		{
+			// Hand it over with the next frame
+			return true;
+		}
+		else if (FAILED(hr))
+		{
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
+			return false;
+		}
+
+		m_DeviceContext->CopyResource(m_FrameSlotSurfaces[slot].Get(), m_OutputSurface.Get());
+
+		hr = m_FrameSlotMutexes[slot]->ReleaseSync(0);
+		if (FAILED(hr))
+		{
+			SetAppropriateEvent(hr, SystemTransitionsExpectedErrors, threadData->expectedErrorEvent, threadData->unexpectedErrorEvent);
+			return false;
+		}
+
+		// Publish the frame before its rects, so the light processor can't take the rects and miss the frame
+		threadData->frameSlots->Publish(threadData->frameSlotOutput, m_PendingPresentTime);
+		if (!m_PendingRects.empty())
+		{
+			threadData->dirtyRegion->Add(&m_PendingRects[0], m_PendingRects.size(), m_PendingPresentTime);
+		}
+		m_PendingRects.clear();
+		m_PendingPresentTime = 0;
+
+		SetEvent(threadData->frameUpdatedEvent);
+
+		return true;
+	}
+
 private:
 	// Shared surface & mutex to access it
 	ComPtr<ID3D11Texture2D> m_SharedSurface;
 	ComPtr<IDXGIKeyedMutex> m_KeyMutex;
 
+	// Our own surface, and the frame slots we hand copies of it over through, when each output has its own
+	ComPtr<ID3D11DeviceContext> m_DeviceContext;
+	ComPtr<ID3D11Texture2D> m_OutputSurface;
+	ComPtr<ID3D11Texture2D> m_FrameSlotSurfaces[FrameSlotExchange::SlotsPerOutput];
+	ComPtr<IDXGIKeyedMutex> m_FrameSlotMutexes[FrameSlotExchange::SlotsPerOutput];
+	std::vector<FrameRect> m_PendingRects;
+	int64_t m_PendingPresentTime;
+
 	// Screen processor & duplication manager for this thread
 	ScreenProcessor* m_ScreenProcessor;
 	DuplicationManager* m_DuplicationManager;
+
+	// Where frames come from. Always the duplication manager, as the ScreenProcessor needs its texture. Going
+	// through the interface only keeps the rect handling the same as the benchmark's
+	FrameSource* m_FrameSource;
+
+	// Records the frames we get, when a capture trace has been asked for
+	CaptureTraceWriter m_CaptureTraceWriter;
 };
 
 // Entry point for new duplication threads
@@ -207,7 +375,7 @@ ThreadManager::~ThreadManager()
 //
 // Start up threads for DDA
 //
-bool ThreadManager::Initialise(int singleOutput, unsigned int outputCount, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent, HANDLE terminateThreadsEvent, HANDLE sharedHandle, const RECT& desktopDimensions)
+bool ThreadManager::Initialise(int singleOutput, unsigned int outputCount, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent, HANDLE terminateThreadsEvent, HANDLE frameUpdatedEvent, HANDLE sharedHandle, DirtyRegion* dirtyRegion, LatencyStats* latencyStats, FrameSlotExchange* frameSlots, const std::vector<HANDLE>& frameSlotHandles, const RECT& desktopDimensions, const std::string& captureTracePath, CaptureTracePixels captureTracePixels)
 {
 	m_ThreadCount = outputCount;
 	m_ThreadHandles.resize(m_ThreadCount);
@@ -219,8 +387,20 @@ bool ThreadManager::Initialise(int singleOutput, unsigned int outputCount, HANDL
 		m_ThreadData[threadIndex].unexpectedErrorEvent = unexpectedErrorEvent;
 		m_ThreadData[threadIndex].expectedErrorEvent = expectedErrorEvent;
 		m_ThreadData[threadIndex].terminateThreadsEvent = terminateThreadsEvent;
+		m_ThreadData[threadIndex].frameUpdatedEvent = frameUpdatedEvent;
 		m_ThreadData[threadIndex].output = (singleOutput < 0) ? threadIndex : singleOutput;
 		m_ThreadData[threadIndex].texSharedHandle = sharedHandle;
+		m_ThreadData[threadIndex].dirtyRegion = dirtyRegion;
+		m_ThreadData[threadIndex].latencyStats = latencyStats;
+		m_ThreadData[threadIndex].frameSlots = frameSlots;
+		m_ThreadData[threadIndex].frameSlotOutput = threadIndex;
+		for (int slot = 0; slot < FrameSlotExchange::SlotsPerOutput; ++slot)
+		{
+			size_t handleIndex = threadIndex * FrameSlotExchange::SlotsPerOutput + slot;
+			m_ThreadData[threadIndex].frameSlotHandles[slot] = (handleIndex < frameSlotHandles.size()) ? frameSlotHandles[handleIndex] : nullptr;
+		}
+		m_ThreadData[threadIndex].captureTracePath = captureTracePath;
+		m_ThreadData[threadIndex].captureTracePixels = captureTracePixels;
 		m_ThreadData[threadIndex].offsetX = desktopDimensions.left;
 		m_ThreadData[threadIndex].offsetY = desktopDimensions.top;
 
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include "DirectXResources.h"
+#include "DirtyRegion.h"
+#include "FrameSlotExchange.h"
+#include "CaptureTrace.h"
+#include "LatencyStats.h"
 
 // For handling threads for each screen
 class ThreadManager
@@ -10,7 +15,7 @@ class ThreadManager
 public:
 	ThreadManager();
 	~ThreadManager();
-	bool Initialise(int singleOutput, unsigned int outputCount, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent, HANDLE terminateThreadsEvent, HANDLE sharedHandle, const RECT& desktopDimensions);
+	bool Initialise(int singleOutput, unsigned int outputCount, HANDLE unexpectedErrorEvent, HANDLE expectedErrorEvent, HANDLE terminateThreadsEvent, HANDLE frameUpdatedEvent, HANDLE sharedHandle, DirtyRegion* dirtyRegion, LatencyStats* latencyStats, FrameSlotExchange* frameSlots, const std::vector<HANDLE>& frameSlotHandles, const RECT& desktopDimensions, const std::string& captureTracePath, CaptureTracePixels captureTracePixels);
 	void WaitForThreadTermination();
 
 public:
@@ -25,8 +30,26 @@ public:
 		// Used by WinProc to signal to threads to exit
 		HANDLE terminateThreadsEvent;
 
+		// Signalled whenever a new frame is ready for the light processor
+		HANDLE frameUpdatedEvent;
+
 		// Shared handle for textures
 		HANDLE texSharedHandle;
+
+		// Where to record the rects of the shared surface we update
+		DirtyRegion* dirtyRegion;
+
+		// Where to record how long frames take to get through
+		LatencyStats* latencyStats;
+
+		// Where to hand frames over, when each output has its own frame slots rather than drawing onto the shared surface
+		FrameSlotExchange* frameSlots;
+		unsigned int frameSlotOutput;
+		HANDLE frameSlotHandles[FrameSlotExchange::SlotsPerOutput];
+
+		// Where to record a capture trace of this output, if anywhere
+		std::string captureTracePath;
+		CaptureTracePixels captureTracePixels;
 		
 		// Which output we're processing
 		unsigned int output;
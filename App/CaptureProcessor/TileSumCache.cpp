@@ -0,0 +1,268 @@
+#include "TileSumCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+TileSumCache::TileSumCache() :
+	m_FrameWidth(0),
+	m_FrameHeight(0),
+	m_ZoneColumns(0),
+	m_ZoneRows(0),
+	m_Kernel(ResolvePixelSumKernel(PixelSumKernelAuto)),
+	m_Invalidated(true),
+	m_ColourScaleChanged(true),
+	m_LastUpdatedTileCount(0),
+	m_TileColumns(0),
+	m_TileRows(0)
+{
+	m_ColourScale[0] = m_ColourScale[1] = m_ColourScale[2] = 1.0f;
+}
+
+TileSumCache::~TileSumCache()
+{
+}
+
+bool TileSumCache::Initialise(int frameWidth, int frameHeight, int zoneColumns, int zoneRows, int tileSize)
+{
+	if (frameWidth <= 0 || frameHeight <= 0 || zoneColumns <= 0 || zoneRows <= 0 || tileSize <= 0)
+	{
+		return false;
+	}
+
+	// Tiles are summed into 16 bit values, so can't be taller than this before they'd overflow
+	tileSize = std::min(tileSize, PixelSumMaxRowsBeforeFlush);
+
+	m_FrameWidth = frameWidth;
+	m_FrameHeight = frameHeight;
+	m_ZoneColumns = zoneColumns;
+	m_ZoneRows = zoneRows;
+
+	BuildEdges(&m_TileLeft, &m_TileColumnZone, m_FrameWidth, m_ZoneColumns, tileSize);
+	BuildEdges(&m_TileTop, &m_TileRowZone, m_FrameHeight, m_ZoneRows, tileSize);
+	m_TileColumns = static_cast<int>(m_TileColumnZone.size());
+	m_TileRows = static_cast<int>(m_TileRowZone.size());
+
+	size_t tileCount = static_cast<size_t>(m_TileColumns) * m_TileRows;
+	size_t zoneCount = static_cast<size_t>(m_ZoneColumns) * m_ZoneRows;
+	m_TileSums.assign(tileCount * PixelSumBytesPerPixel, 0);
+	m_ZoneSums.assign(zoneCount * PixelSumBytesPerPixel, 0);
+	m_DirtyTiles.assign(tileCount, 0);
+	m_DirtyZones.assign(zoneCount, 1);
+	m_ZoneValues.assign(zoneCount, 0);
+
+	m_ColumnSums16.assign(m_FrameWidth * PixelSumBytesPerPixel, 0);
+	m_ColumnSums32.assign(m_FrameWidth * PixelSumBytesPerPixel, 0);
+
+	m_Invalidated = true;
+	m_LastUpdatedTileCount = 0;
+
+	return true;
+}
+
+bool TileSumCache::SetKernel(PixelSumKernel kernel)
+{
+	if (!IsPixelSumKernelSupported(kernel))
+	{
+		return false;
+	}
+
+	m_Kernel = ResolvePixelSumKernel(kernel);
+	return true;
+}
+
+void TileSumCache::SetColourScale(float r, float g, float b)
+{
+	if (m_ColourScale[0] != r || m_ColourScale[1] != g || m_ColourScale[2] != b)
+	{
+		m_ColourScale[0] = r;
+		m_ColourScale[1] = g;
+		m_ColourScale[2] = b;
+		m_ColourScaleChanged = true;
+	}
+}
+
+void TileSumCache::Invalidate()
+{
+	m_Invalidated = true;
+}
+
+void TileSumCache::Update(const uint8_t* frame, int pitch, const FrameRect* rects, size_t rectCount)
+{
+	// Work out which tiles need summing
+	if (m_Invalidated)
+	{
+		std::fill(m_DirtyTiles.begin(), m_DirtyTiles.end(), 1);
+		m_Invalidated = false;
+	}
+	else
+	{
+		for (size_t rectIndex = 0; rectIndex < rectCount; ++rectIndex)
+		{
+			MarkTiles(rects[rectIndex]);
+		}
+	}
+
+	// Sum each run of dirty tiles along each tile row
+	m_LastUpdatedTileCount = 0;
+	for (int tileRow = 0; tileRow < m_TileRows; ++tileRow)
+	{
+		uint8_t* dirtyTiles = &m_DirtyTiles[static_cast<size_t>(tileRow) * m_TileColumns];
+		int tileColumn = 0;
+		while (tileColumn < m_TileColumns)
+		{
+			if (!dirtyTiles[tileColumn])
+			{
+				++tileColumn;
+				continue;
+			}
+
+			int endTileColumn = tileColumn;
+			while (endTileColumn < m_TileColumns && dirtyTiles[endTileColumn])
+			{
+				dirtyTiles[endTileColumn] = 0;
+				++endTileColumn;
+			}
+
+			SumTiles(frame, pitch, tileRow, tileColumn, endTileColumn);
+			m_LastUpdatedTileCount += endTileColumn - tileColumn;
+			tileColumn = endTileColumn;
+		}
+	}
+}
+
+void TileSumCache::GetZoneValues(uint32_t* zoneValues)
+{
+	size_t zoneCount = m_ZoneValues.size();
+	for (size_t zoneIndex = 0; zoneIndex < zoneCount; ++zoneIndex)
+	{
+		if (m_DirtyZones[zoneIndex] || m_ColourScaleChanged)
+		{
+			int zoneColumn = static_cast<int>(zoneIndex % m_ZoneColumns);
+			int zoneRow = static_cast<int>(zoneIndex / m_ZoneColumns);
+			uint64_t zoneWidth = static_cast<uint64_t>(((static_cast<int64_t>(zoneColumn) + 1) * m_FrameWidth) / m_ZoneColumns - (static_cast<int64_t>(zoneColumn) * m_FrameWidth) / m_ZoneColumns);
+			uint64_t zoneHeight = static_cast<uint64_t>(((static_cast<int64_t>(zoneRow) + 1) * m_FrameHeight) / m_ZoneRows - (static_cast<int64_t>(zoneRow) * m_FrameHeight) / m_ZoneRows);
+
+			m_ZoneValues[zoneIndex] = ResolvePixelAverage(&m_ZoneSums[zoneIndex * PixelSumBytesPerPixel], zoneWidth * zoneHeight, m_ColourScale);
+			m_DirtyZones[zoneIndex] = 0;
+		}
+	}
+	m_ColourScaleChanged = false;
+
+	std::memcpy(zoneValues, &m_ZoneValues[0], zoneCount * sizeof(uint32_t));
+}
+
+unsigned int TileSumCache::GetLastUpdatedTileCount() const
+{
+	return m_LastUpdatedTileCount;
+}
+
+unsigned int TileSumCache::GetTileCount() const
+{
+	return static_cast<unsigned int>(m_TileColumns * m_TileRows);
+}
+
+//
+// Splits frameSize into tiles of tileSize, also splitting at every zone boundary
+//
+void TileSumCache::BuildEdges(std::vector<int>* edges, std::vector<int>* edgeZones, int frameSize, int zoneCount, int tileSize)
+{
+	edges->clear();
+	edgeZones->clear();
+
+	int position = 0;
+	for (int zone = 0; zone < zoneCount; ++zone)
+	{
+		int zoneEnd = static_cast<int>(((static_cast<int64_t>(zone) + 1) * frameSize) / zoneCount);
+		while (position < zoneEnd)
+		{
+			edges->push_back(position);
+			edgeZones->push_back(zone);
+
+			// Next tile grid line, or the end of the zone if that's sooner
+			position = std::min(((position / tileSize) + 1) * tileSize, zoneEnd);
+		}
+	}
+	edges->push_back(frameSize);
+}
+
+void TileSumCache::MarkTiles(const FrameRect& rect)
+{
+	int left = std::max(0, static_cast<int>(rect.left));
+	int top = std::max(0, static_cast<int>(rect.top));
+	int right = std::min(m_FrameWidth, static_cast<int>(rect.right));
+	int bottom = std::min(m_FrameHeight, static_cast<int>(rect.bottom));
+	if (left >= right || top >= bottom)
+	{
+		return;
+	}
+
+	// Find the tiles containing the first and last pixels
+	int firstColumn = static_cast<int>(std::upper_bound(m_TileLeft.begin(), m_TileLeft.end(), left) - m_TileLeft.begin()) - 1;
+	int endColumn = static_cast<int>(std::upper_bound(m_TileLeft.begin(), m_TileLeft.end(), right - 1) - m_TileLeft.begin());
+	int firstRow = static_cast<int>(std::upper_bound(m_TileTop.begin(), m_TileTop.end(), top) - m_TileTop.begin()) - 1;
+	int endRow = static_cast<int>(std::upper_bound(m_TileTop.begin(), m_TileTop.end(), bottom - 1) - m_TileTop.begin());
+
+	for (int tileRow = firstRow; tileRow < endRow; ++tileRow)
+	{
+		uint8_t* dirtyTiles = &m_DirtyTiles[static_cast<size_t>(tileRow) * m_TileColumns];
+		std::memset(dirtyTiles + firstColumn, 1, endColumn - firstColumn);
+	}
+}
+
+//
+// Re-sums a run of tiles along a tile row, and updates the sums of the zones they're in
+//
+void TileSumCache::SumTiles(const uint8_t* frame, int pitch, int tileRow, int firstTileColumn, int endTileColumn)
+{
+	int left = m_TileLeft[firstTileColumn];
+	int right = m_TileLeft[endTileColumn];
+	int top = m_TileTop[tileRow];
+	int bottom = m_TileTop[tileRow + 1];
+	int byteCount = (right - left) * PixelSumBytesPerPixel;
+
+	// Sum down the columns of the band. Tiles are never taller than the 16 bit flush limit
+	uint16_t* columnSums16 = &m_ColumnSums16[0];
+	uint32_t* columnSums32 = &m_ColumnSums32[0];
+	std::memset(columnSums32, 0, byteCount * sizeof(uint32_t));
+	for (int y = top; y < bottom; ++y)
+	{
+		AccumulatePixelRow(m_Kernel, frame + static_cast<size_t>(y) * pitch + left * PixelSumBytesPerPixel, columnSums16, byteCount);
+	}
+	FlushPixelSums(columnSums16, columnSums32, byteCount);
+
+	// Then across each tile
+	int zoneRow = m_TileRowZone[tileRow];
+	for (int tileColumn = firstTileColumn; tileColumn < endTileColumn; ++tileColumn)
+	{
+		uint32_t newSums[PixelSumBytesPerPixel] = { 0, 0, 0, 0 };
+		const uint32_t* sums = columnSums32 + (m_TileLeft[tileColumn] - left) * PixelSumBytesPerPixel;
+		const uint32_t* endSums = columnSums32 + (m_TileLeft[tileColumn + 1] - left) * PixelSumBytesPerPixel;
+		for (; sums < endSums; sums += PixelSumBytesPerPixel)
+		{
+			newSums[0] += sums[0];
+			newSums[1] += sums[1];
+			newSums[2] += sums[2];
+			newSums[3] += sums[3];
+		}
+
+		// Swap the old tile sums for the new ones in the zone
+		size_t zoneIndex = static_cast<size_t>(zoneRow) * m_ZoneColumns + m_TileColumnZone[tileColumn];
+		uint32_t* tileSums = &m_TileSums[(static_cast<size_t>(tileRow) * m_TileColumns + tileColumn) * PixelSumBytesPerPixel];
+		uint64_t* zoneSums = &m_ZoneSums[zoneIndex * PixelSumBytesPerPixel];
+		bool changed = false;
+		for (int channel = 0; channel < PixelSumBytesPerPixel; ++channel)
+		{
+			if (tileSums[channel] != newSums[channel])
+			{
+				zoneSums[channel] = zoneSums[channel] - tileSums[channel] + newSums[channel];
+				tileSums[channel] = newSums[channel];
+				changed = true;
+			}
+		}
+
+		if (changed)
+		{
+			m_DirtyZones[zoneIndex] = 1;
+		}
+	}
+}
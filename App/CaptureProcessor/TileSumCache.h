@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FrameTypes.h"
+#include "PixelSums.h"
+
+// Incremental CPU downsampler
+// Keeps per-tile colour sums for the frame, where the tile grid is the default tile size
+// split further along the zone boundaries so every tile belongs to exactly one zone.
+// Each update only re-sums the tiles touched by the given rects and only re-resolves the zones
+// those tiles belong to, so a mostly static desktop costs next to nothing to reduce
+class TileSumCache
+{
+public:
+	TileSumCache();
+	~TileSumCache();
+
+	bool Initialise(int frameWidth, int frameHeight, int zoneColumns, int zoneRows, int tileSize = DefaultTileSize);
+
+	bool SetKernel(PixelSumKernel kernel);
+	void SetColourScale(float r, float g, float b);
+
+	// Forces the next update to re-sum the whole frame
+	void Invalidate();
+
+	// Re-sums the tiles touched by rects, which are in frame coordinates
+	void Update(const uint8_t* frame, int pitch, const FrameRect* rects, size_t rectCount);
+
+	// Writes out the zone values (zoneColumns * zoneRows BGRA values), only resolving the zones that changed
+	void GetZoneValues(uint32_t* zoneValues);
+
+	unsigned int GetLastUpdatedTileCount() const;
+	unsigned int GetTileCount() const;
+
+public:
+	static const int DefaultTileSize = 64;
+
+private:
+	void BuildEdges(std::vector<int>* edges, std::vector<int>* edgeZones, int frameSize, int zoneCount, int tileSize);
+	void MarkTiles(const FrameRect& rect);
+	void SumTiles(const uint8_t* frame, int pitch, int tileRow, int firstTileColumn, int endTileColumn);
+
+private:
+	int						m_FrameWidth;
+	int						m_FrameHeight;
+	int						m_ZoneColumns;
+	int						m_ZoneRows;
+	PixelSumKernel			m_Kernel;
+	float					m_ColourScale[3];
+	bool					m_Invalidated;
+	bool					m_ColourScaleChanged;
+	unsigned int			m_LastUpdatedTileCount;
+
+	// Tile boundaries (with an extra entry for the right / bottom edge) and the zone each tile column / row is in
+	std::vector<int>		m_TileLeft;
+	std::vector<int>		m_TileTop;
+	std::vector<int>		m_TileColumnZone;
+	std::vector<int>		m_TileRowZone;
+	int						m_TileColumns;
+	int						m_TileRows;
+
+	// Per-channel sums of every tile and zone, and which ones need recalculating
+	std::vector<uint32_t>	m_TileSums;
+	std::vector<uint64_t>	m_ZoneSums;
+	std::vector<uint8_t>	m_DirtyTiles;
+	std::vector<uint8_t>	m_DirtyZones;
+	std::vector<uint32_t>	m_ZoneValues;
+
+	// Scratch column sums for summing a band of tiles
+	std::vector<uint16_t>	m_ColumnSums16;
+	std::vector<uint32_t>	m_ColumnSums32;
+};
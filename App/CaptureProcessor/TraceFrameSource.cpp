@@ -0,0 +1,254 @@
+#include "TraceFrameSource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+static const int BytesPerPixel = 4;
+
+TraceFrameSource::TraceFrameSource() :
+	m_Timing(TraceTimingFastest),
+	m_Finished(true),
+	m_HaveFrame(false),
+	m_TimingStarted(false),
+	m_FirstPresentTime(0)
+{
+	std::memset(&m_CurrentFrame, 0, sizeof(m_CurrentFrame));
+}
+
+TraceFrameSource::~TraceFrameSource()
+{
+}
+
+bool TraceFrameSource::Initialise(const std::string& path, TraceTiming timing)
+{
+	if (!m_Reader.Open(path))
+	{
+		return false;
+	}
+
+	const CaptureTraceHeader& header = m_Reader.GetHeader();
+	m_Timing = timing;
+	m_Frame.assign(static_cast<size_t>(header.frameWidth) * header.frameHeight * BytesPerPixel, 0);
+	Rewind();
+
+	return true;
+}
+
+bool TraceFrameSource::GetFrame(bool* timeout)
+{
+	m_HaveFrame = false;
+
+	CaptureTraceFrame frame;
+	if (m_Finished || !m_Reader.NextFrame(&frame))
+	{
+		// Nothing more to replay
+		m_Finished = true;
+		*timeout = true;
+		return true;
+	}
+	*timeout = false;
+
+	if (!ApplyFrame(frame))
+	{
+		// Corrupt trace
+		m_Finished = true;
+		return false;
+	}
+
+	if (m_Timing == TraceTimingOriginal)
+	{
+		WaitForPresentTime(frame.presentTime);
+	}
+
+	m_CurrentFrame = frame;
+	m_HaveFrame = true;
+
+	return true;
+}
+
+bool TraceFrameSource::ReleaseFrame()
+{
+	m_CurrentFrame.moveCount = 0;
+	m_CurrentFrame.dirtyCount = 0;
+	m_HaveFrame = false;
+
+	return true;
+}
+
+int TraceFrameSource::GetDirtyCount() const
+{
+	return static_cast<int>(m_CurrentFrame.dirtyCount);
+}
+
+const FrameRect* TraceFrameSource::GetDirtyRects() const
+{
+	return m_CurrentFrame.dirtyRects;
+}
+
+int TraceFrameSource::GetMoveCount() const
+{
+	return static_cast<int>(m_CurrentFrame.moveCount);
+}
+
+const FrameMoveRect* TraceFrameSource::GetMoveRects() const
+{
+	return m_CurrentFrame.moveRects;
+}
+
+const FrameOutputDesc& TraceFrameSource::GetFrameOutputDesc() const
+{
+	return m_Reader.GetHeader().outputDesc;
+}
+
+int64_t TraceFrameSource::GetPresentTime() const
+{
+	return m_CurrentFrame.presentTime;
+}
+
+bool TraceFrameSource::GetFrameBuffer(FrameBuffer* frameBuffer)
+{
+	if (!m_HaveFrame || m_Frame.empty())
+	{
+		return false;
+	}
+
+	frameBuffer->pixels = &m_Frame[0];
+	frameBuffer->width = GetFrameWidth();
+	frameBuffer->height = GetFrameHeight();
+	frameBuffer->pitch = GetFrameWidth() * BytesPerPixel;
+	return true;
+}
+
+void TraceFrameSource::Rewind()
+{
+	m_Reader.Rewind();
+	std::memset(&m_CurrentFrame, 0, sizeof(m_CurrentFrame));
+	m_Finished = false;
+	m_HaveFrame = false;
+	m_TimingStarted = false;
+}
+
+bool TraceFrameSource::IsFinished() const
+{
+	return m_Finished;
+}
+
+int TraceFrameSource::GetFrameWidth() const
+{
+	return m_Reader.GetHeader().frameWidth;
+}
+
+int TraceFrameSource::GetFrameHeight() const
+{
+	return m_Reader.GetHeader().frameHeight;
+}
+
+//
+// Brings the rebuilt frame up to date with a recorded one
+//
+bool TraceFrameSource::ApplyFrame(const CaptureTraceFrame& frame)
+{
+	int frameWidth = GetFrameWidth();
+	int frameHeight = GetFrameHeight();
+	size_t pitch = static_cast<size_t>(frameWidth) * BytesPerPixel;
+
+	if (frame.flags & CaptureTraceFrameFull)
+	{
+		if (frame.pixelSize < m_Frame.size())
+		{
+			return false;
+		}
+		if (!m_Frame.empty())
+		{
+			std::memcpy(&m_Frame[0], frame.pixels, m_Frame.size());
+		}
+		return true;
+	}
+
+	// Moves happen before the dirty regions are drawn
+	for (uint32_t moveIndex = 0; moveIndex < frame.moveCount; ++moveIndex)
+	{
+		ApplyMove(frame.moveRects[moveIndex]);
+	}
+
+	const uint8_t* pixels = frame.pixels;
+	const uint8_t* endPixels = frame.pixels + frame.pixelSize;
+	for (uint32_t dirtyIndex = 0; dirtyIndex < frame.dirtyCount; ++dirtyIndex)
+	{
+		const FrameRect& dirtyRect = frame.dirtyRects[dirtyIndex];
+		int left = std::max(dirtyRect.left, 0);
+		int top = std::max(dirtyRect.top, 0);
+		int right = std::min(dirtyRect.right, frameWidth);
+		int bottom = std::min(dirtyRect.bottom, frameHeight);
+		if (left >= right || top >= bottom)
+		{
+			continue;
+		}
+
+		size_t rowBytes = static_cast<size_t>(right - left) * BytesPerPixel;
+		if (static_cast<size_t>(endPixels - pixels) < rowBytes * (bottom - top))
+		{
+			return false;
+		}
+
+		for (int y = top; y < bottom; ++y, pixels += rowBytes)
+		{
+			std::memcpy(&m_Frame[y * pitch + left * BytesPerPixel], pixels, rowBytes);
+		}
+	}
+
+	return true;
+}
+
+//
+// Moves are stored the way desktop duplication reports them, in the frame's own orientation
+//
+void TraceFrameSource::ApplyMove(const FrameMoveRect& moveRect)
+{
+	int frameWidth = GetFrameWidth();
+	int frameHeight = GetFrameHeight();
+	size_t pitch = static_cast<size_t>(frameWidth) * BytesPerPixel;
+
+	int width = moveRect.destinationRect.right - moveRect.destinationRect.left;
+	int height = moveRect.destinationRect.bottom - moveRect.destinationRect.top;
+	if (width <= 0 || height <= 0 ||
+		moveRect.sourcePoint.x < 0 || moveRect.sourcePoint.y < 0 || moveRect.sourcePoint.x + width > frameWidth || moveRect.sourcePoint.y + height > frameHeight ||
+		moveRect.destinationRect.left < 0 || moveRect.destinationRect.top < 0 || moveRect.destinationRect.right > frameWidth || moveRect.destinationRect.bottom > frameHeight)
+	{
+		return;
+	}
+
+	size_t rowBytes = static_cast<size_t>(width) * BytesPerPixel;
+	m_MoveBuffer.resize(rowBytes * height);
+	for (int y = 0; y < height; ++y)
+	{
+		std::memcpy(&m_MoveBuffer[y * rowBytes], &m_Frame[(moveRect.sourcePoint.y + y) * pitch + moveRect.sourcePoint.x * BytesPerPixel], rowBytes);
+	}
+	for (int y = 0; y < height; ++y)
+	{
+		std::memcpy(&m_Frame[(moveRect.destinationRect.top + y) * pitch + moveRect.destinationRect.left * BytesPerPixel], &m_MoveBuffer[y * rowBytes], rowBytes);
+	}
+}
+
+//
+// Sleeps until a frame is due, keeping the spacing the frames were recorded with
+//
+void TraceFrameSource::WaitForPresentTime(int64_t presentTime)
+{
+	if (!m_TimingStarted)
+	{
+		m_TimingStarted = true;
+		m_FirstPresentTime = presentTime;
+		m_ReplayStart = std::chrono::steady_clock::now();
+		return;
+	}
+
+	// Desktop duplication reports 0 for frames that were never presented, so don't wait on those
+	if (presentTime <= m_FirstPresentTime)
+	{
+		return;
+	}
+
+	std::this_thread::sleep_until(m_ReplayStart + std::chrono::microseconds(presentTime - m_FirstPresentTime));
+}
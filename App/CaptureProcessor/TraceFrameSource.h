@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CaptureTrace.h"
+#include "FrameSource.h"
+
+enum TraceTiming
+{
+	TraceTimingOriginal,	// Frames are handed out at the rate they were recorded
+	TraceTimingFastest		// Frames are handed out as soon as they're asked for
+};
+
+// Replays a capture trace as a FrameSource
+// Rebuilds each frame from the recorded pixels, applying the recorded moves first when only the
+// dirty regions were stored, so the frames, rects and present times match what was captured exactly.
+// Traces are only replayed through the SoftwareCompositor in the benchmark. The DLL records them, but its
+// capture threads can't be driven from one, as they only read frames from desktop duplication
+class TraceFrameSource : public FrameSource
+{
+public:
+	TraceFrameSource();
+	virtual ~TraceFrameSource();
+
+	bool Initialise(const std::string& path, TraceTiming timing);
+
+	virtual bool GetFrame(bool* timeout);
+	virtual bool ReleaseFrame();
+
+	virtual int GetDirtyCount() const;
+	virtual const FrameRect* GetDirtyRects() const;
+	virtual int GetMoveCount() const;
+	virtual const FrameMoveRect* GetMoveRects() const;
+
+	virtual const FrameOutputDesc& GetFrameOutputDesc() const;
+
+	virtual int64_t GetPresentTime() const;
+	virtual bool GetFrameBuffer(FrameBuffer* frameBuffer);
+
+	// Starts again from the first frame
+	void Rewind();
+
+	// True once every frame has been replayed
+	bool IsFinished() const;
+	int GetFrameWidth() const;
+	int GetFrameHeight() const;
+
+private:
+	bool ApplyFrame(const CaptureTraceFrame& frame);
+	void ApplyMove(const FrameMoveRect& moveRect);
+	void WaitForPresentTime(int64_t presentTime);
+
+private:
+	CaptureTraceReader		m_Reader;
+	TraceTiming				m_Timing;
+	bool					m_Finished;
+	bool					m_HaveFrame;
+	CaptureTraceFrame		m_CurrentFrame;
+
+	// The rebuilt frame
+	std::vector<uint8_t>	m_Frame;
+	std::vector<uint8_t>	m_MoveBuffer;
+
+	// When the first frame was replayed, to keep the original spacing of frames
+	bool					m_TimingStarted;
+	int64_t					m_FirstPresentTime;
+	std::chrono::steady_clock::time_point	m_ReplayStart;
+};
@@ -0,0 +1,256 @@
+#include "UdpSocket.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+
+typedef int SocketLength;
+static const uintptr_t NoSocket = INVALID_SOCKET;
+#else
+#include <cerrno>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef socklen_t SocketLength;
+static const int NoSocket = -1;
+#endif
+
+// Big enough for a burst of frames, as nothing is read back to pace them
+static const int SocketBufferSize = 1 << 20;
+
+#if defined(_WIN32)
+//
+// Winsock has to be started before any other call, and is left running until the process exits
+//
+static bool StartWinsock()
+{
+	static const bool started = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+}
+#endif
+
+static void ToSocketAddress(const UdpAddress& address, sockaddr_in* socketAddress)
+{
+	memset(socketAddress, 0, sizeof(*socketAddress));
+	socketAddress->sin_family = AF_INET;
+	socketAddress->sin_addr.s_addr = htonl(address.address);
+	socketAddress->sin_port = htons(address.port);
+}
+
+bool ResolveUdpAddress(const std::string& host, int defaultPort, UdpAddress* address)
+{
+#if defined(_WIN32)
+	if (!StartWinsock())
+	{
+		return false;
+	}
+#endif
+
+	std::string name = host;
+	int port = defaultPort;
+	size_t colon = host.rfind(':');
+	if (colon != std::string::npos)
+	{
+		name = host.substr(0, colon);
+		port = atoi(host.c_str() + colon + 1);
+	}
+	if (name.empty() || port <= 0 || port > 65535)
+	{
+		return false;
+	}
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* results = nullptr;
+	if (getaddrinfo(name.c_str(), nullptr, &hints, &results) != 0 || !results)
+	{
+		return false;
+	}
+
+	address->address = ntohl(reinterpret_cast<const sockaddr_in*>(results->ai_addr)->sin_addr.s_addr);
+	address->port = static_cast<uint16_t>(port);
+	freeaddrinfo(results);
+	return true;
+}
+
+UdpSocket::UdpSocket() :
+	m_Socket(NoSocket)
+{
+}
+
+UdpSocket::~UdpSocket()
+{
+	Close();
+}
+
+bool UdpSocket::Open()
+{
+	Close();
+#if defined(_WIN32)
+	if (!StartWinsock())
+	{
+		return false;
+	}
+#endif
+
+	m_Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (m_Socket == NoSocket)
+	{
+		return false;
+	}
+
+	int bufferSize = SocketBufferSize;
+	unsigned char timeToLive = 1;
+	unsigned char loop = 1;
+	setsockopt(m_Socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+	setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&timeToLive), sizeof(timeToLive));
+	setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loop), sizeof(loop));
+	return true;
+}
+
+bool UdpSocket::Bind(const UdpAddress& address)
+{
+	if (!Open())
+	{
+		return false;
+	}
+
+	int bufferSize = SocketBufferSize;
+	setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+
+	sockaddr_in socketAddress;
+	ToSocketAddress(address, &socketAddress);
+	if (bind(m_Socket, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void UdpSocket::Close()
+{
+	if (m_Socket != NoSocket)
+	{
+#if defined(_WIN32)
+		closesocket(m_Socket);
+#else
+		close(m_Socket);
+#endif
+		m_Socket = NoSocket;
+	}
+}
+
+bool UdpSocket::IsOpen() const
+{
+	return m_Socket != NoSocket;
+}
+
+UdpAddress UdpSocket::GetLocalAddress() const
+{
+	UdpAddress address = { 0, 0 };
+	sockaddr_in socketAddress;
+	SocketLength length = sizeof(socketAddress);
+	if (m_Socket != NoSocket && getsockname(m_Socket, reinterpret_cast<sockaddr*>(&socketAddress), &length) == 0)
+	{
+		address.address = ntohl(socketAddress.sin_addr.s_addr);
+		address.port = ntohs(socketAddress.sin_port);
+	}
+	return address;
+}
+
+int UdpSocket::Send(const UdpPacket* packets, int count)
+{
+	int calls = 0;
+#if defined(__linux__)
+	// As many packets as fit in a batch go in each call, picking up after any the kernel didn't take
+	mmsghdr messages[MaxBatchSize];
+	iovec buffers[MaxBatchSize];
+	sockaddr_in addresses[MaxBatchSize];
+	int sent = 0;
+	while (sent < count)
+	{
+		int batchSize = std::min(count - sent, static_cast<int>(MaxBatchSize));
+		for (int index = 0; index < batchSize; ++index)
+		{
+			const UdpPacket& packet = packets[sent + index];
+			ToSocketAddress(packet.destination, &addresses[index]);
+			buffers[index].iov_base = const_cast<uint8_t*>(packet.data);
+			buffers[index].iov_len = packet.length;
+			memset(&messages[index], 0, sizeof(messages[index]));
+			messages[index].msg_hdr.msg_name = &addresses[index];
+			messages[index].msg_hdr.msg_namelen = sizeof(addresses[index]);
+			messages[index].msg_hdr.msg_iov = &buffers[index];
+			messages[index].msg_hdr.msg_iovlen = 1;
+		}
+
+		int batchSent = sendmmsg(m_Socket, messages, batchSize, 0);
+		++calls;
+		if (batchSent < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		sent += batchSent;
+	}
+#else
+	for (int index = 0; index < count; ++index)
+	{
+		sockaddr_in address;
+		ToSocketAddress(packets[index].destination, &address);
+		++calls;
+		if (sendto(m_Socket, reinterpret_cast<const char*>(packets[index].data), static_cast<int>(packets[index].length), 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+		{
+			return -1;
+		}
+	}
+#endif
+	return calls;
+}
+
+int UdpSocket::Receive(uint8_t* buffer, int length, int timeoutMilliseconds)
+{
+#if defined(_WIN32)
+	WSAPOLLFD pollFd = { m_Socket, POLLRDNORM, 0 };
+	int ready = WSAPoll(&pollFd, 1, timeoutMilliseconds);
+#else
+	pollfd pollFd = { m_Socket, POLLIN, 0 };
+	int ready = poll(&pollFd, 1, timeoutMilliseconds);
+	if (ready < 0 && errno == EINTR)
+	{
+		return 0;
+	}
+#endif
+	if (ready <= 0)
+	{
+		return ready;
+	}
+
+	int received = static_cast<int>(recv(m_Socket, reinterpret_cast<char*>(buffer), length, 0));
+#if defined(_WIN32)
+	if (received < 0 && WSAGetLastError() == WSAEMSGSIZE)
+	{
+		return length;
+	}
+#endif
+	return received < 0 ? -1 : received;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// An IPv4 address and port, both in host byte order
+struct UdpAddress
+{
+	uint32_t address;
+	uint16_t port;
+};
+
+// Looks up "host" or "host:port", using defaultPort if there isn't one
+bool ResolveUdpAddress(const std::string& host, int defaultPort, UdpAddress* address);
+
+struct UdpPacket
+{
+	const uint8_t* data;
+	size_t length;
+	UdpAddress destination;
+};
+
+// A UDP socket, using Winsock on Windows and BSD sockets everywhere else. Sending a batch of packets takes one
+// sendmmsg call on Linux and one call per packet elsewhere, so a frame spread over many packets costs one trip
+// into the kernel where it can. Only one thread may use it at a time
+class UdpSocket
+{
+public:
+	UdpSocket();
+	~UdpSocket();
+
+	// Opens a socket for sending. Multicast goes no further than the local network, and is looped back
+	bool Open();
+
+	// Opens a socket for receiving on address. A port of 0 picks a free one, which GetLocalAddress then has
+	bool Bind(const UdpAddress& address);
+
+	void Close();
+	bool IsOpen() const;
+
+	UdpAddress GetLocalAddress() const;
+
+	// Sends every packet, returning how many calls that took, or -1 if any couldn't be sent
+	int Send(const UdpPacket* packets, int count);
+
+	// Waits up to timeoutMilliseconds for a packet. Returns its length, 0 on timeout, or -1 if the socket has failed.
+	// Anything past length is lost
+	int Receive(uint8_t* buffer, int length, int timeoutMilliseconds);
+
+public:
+	// Most packets handed to the kernel in one call
+	static const int MaxBatchSize = 64;
+
+private:
+#if defined(_WIN32)
+	uintptr_t		m_Socket;
+#else
+	int				m_Socket;
+#endif
+};
@@ -0,0 +1,139 @@
+#include "ZoneAverager.h"
+
+#include <algorithm>
+
+ZoneAverager::ZoneAverager() :
+	m_FrameWidth(0),
+	m_FrameHeight(0),
+	m_ZoneColumns(0),
+	m_ZoneRows(0),
+	m_Kernel(ResolvePixelSumKernel(PixelSumKernelAuto)),
+	m_RowsSinceFlush(0)
+{
+	m_ColourScale[0] = m_ColourScale[1] = m_ColourScale[2] = 1.0f;
+}
+
+ZoneAverager::~ZoneAverager()
+{
+}
+
+bool ZoneAverager::Initialise(int frameWidth, int frameHeight, int zoneColumns, int zoneRows)
+{
+	if (frameWidth <= 0 || frameHeight <= 0 || zoneColumns <= 0 || zoneRows <= 0)
+	{
+		return false;
+	}
+
+	m_FrameWidth = frameWidth;
+	m_FrameHeight = frameHeight;
+	m_ZoneColumns = zoneColumns;
+	m_ZoneRows = zoneRows;
+
+	// Work out the pixel boundaries of each zone
+	m_ZoneLeft.resize(m_ZoneColumns + 1);
+	for (int column = 0; column <= m_ZoneColumns; ++column)
+	{
+		m_ZoneLeft[column] = static_cast<int>((static_cast<int64_t>(column) * m_FrameWidth) / m_ZoneColumns);
+	}
+
+	m_ZoneTop.resize(m_ZoneRows + 1);
+	for (int row = 0; row <= m_ZoneRows; ++row)
+	{
+		m_ZoneTop[row] = static_cast<int>((static_cast<int64_t>(row) * m_FrameHeight) / m_ZoneRows);
+	}
+
+	m_RowSums16.assign(m_FrameWidth * PixelSumBytesPerPixel, 0);
+	m_RowSums32.assign(m_FrameWidth * PixelSumBytesPerPixel, 0);
+	m_RowsSinceFlush = 0;
+
+	return true;
+}
+
+bool ZoneAverager::SetKernel(PixelSumKernel kernel)
+{
+	if (!IsPixelSumKernelSupported(kernel))
+	{
+		return false;
+	}
+
+	m_Kernel = ResolvePixelSumKernel(kernel);
+	return true;
+}
+
+PixelSumKernel ZoneAverager::GetKernel() const
+{
+	return m_Kernel;
+}
+
+void ZoneAverager::SetColourScale(float r, float g, float b)
+{
+	m_ColourScale[0] = r;
+	m_ColourScale[1] = g;
+	m_ColourScale[2] = b;
+}
+
+//
+// Averages every zone of the frame into zoneValues (m_ZoneColumns * m_ZoneRows BGRA values)
+//
+void ZoneAverager::Process(const uint8_t* frame, int pitch, uint32_t* zoneValues)
+{
+	for (int row = 0; row < m_ZoneRows; ++row)
+	{
+		int top = m_ZoneTop[row];
+		int bottom = m_ZoneTop[row + 1];
+
+		// Sum down each column for this row of zones
+		std::fill(m_RowSums32.begin(), m_RowSums32.end(), 0u);
+		for (int y = top; y < bottom; ++y)
+		{
+			AccumulatePixelRow(m_Kernel, frame + static_cast<size_t>(y) * pitch, &m_RowSums16[0], m_FrameWidth * PixelSumBytesPerPixel);
+			if (++m_RowsSinceFlush == PixelSumMaxRowsBeforeFlush)
+			{
+				FlushRowSums();
+			}
+		}
+		FlushRowSums();
+
+		// Then across each zone
+		uint64_t zoneHeight = static_cast<uint64_t>(bottom - top);
+		uint32_t* outputValues = zoneValues + row * m_ZoneColumns;
+		for (int column = 0; column < m_ZoneColumns; ++column)
+		{
+			uint64_t zoneWidth = static_cast<uint64_t>(m_ZoneLeft[column + 1] - m_ZoneLeft[column]);
+			outputValues[column] = ResolveZone(column, zoneWidth * zoneHeight);
+		}
+	}
+}
+
+int ZoneAverager::GetZoneLeft(int column) const
+{
+	return m_ZoneLeft[column];
+}
+
+int ZoneAverager::GetZoneTop(int row) const
+{
+	return m_ZoneTop[row];
+}
+
+void ZoneAverager::FlushRowSums()
+{
+	FlushPixelSums(&m_RowSums16[0], &m_RowSums32[0], static_cast<int>(m_RowSums16.size()));
+	m_RowsSinceFlush = 0;
+}
+
+uint32_t ZoneAverager::ResolveZone(int column, uint64_t pixelCount) const
+{
+	// Total up each channel across the zone
+	uint64_t channelSums[PixelSumBytesPerPixel] = { 0, 0, 0, 0 };
+	const uint32_t* columnSums = &m_RowSums32[0] + m_ZoneLeft[column] * PixelSumBytesPerPixel;
+	const uint32_t* endSums = &m_RowSums32[0] + m_ZoneLeft[column + 1] * PixelSumBytesPerPixel;
+	for (; columnSums < endSums; columnSums += PixelSumBytesPerPixel)
+	{
+		channelSums[0] += columnSums[0];
+		channelSums[1] += columnSums[1];
+		channelSums[2] += columnSums[2];
+		channelSums[3] += columnSums[3];
+	}
+
+	return ResolvePixelAverage(channelSums, pixelCount, m_ColourScale);
+}
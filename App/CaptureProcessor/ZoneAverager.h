@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "PixelSums.h"
+
+// CPU alternative to the DownsamplePixelShader
+// Takes a BGRA frame and produces the exact box-filtered average of every zone in a
+// column / row grid, with the colour scale applied. Output is one BGRA value per zone,
+// laid out row by row the same as the light surface the shader renders into.
+// This has no D3D dependency so it can be run (and benchmarked) on any machine. The DLL averages through
+// TileSumCache instead, so this is only built into the benchmark, as the reference it's checked against
+class ZoneAverager
+{
+public:
+	ZoneAverager();
+	~ZoneAverager();
+
+	bool Initialise(int frameWidth, int frameHeight, int zoneColumns, int zoneRows);
+
+	bool SetKernel(PixelSumKernel kernel);
+	PixelSumKernel GetKernel() const;
+
+	void SetColourScale(float r, float g, float b);
+
+	void Process(const uint8_t* frame, int pitch, uint32_t* zoneValues);
+
+	int GetZoneLeft(int column) const;
+	int GetZoneTop(int row) const;
+
+private:
+	void FlushRowSums();
+	uint32_t ResolveZone(int column, uint64_t pixelCount) const;
+
+private:
+	int						m_FrameWidth;
+	int						m_FrameHeight;
+	int						m_ZoneColumns;
+	int						m_ZoneRows;
+	PixelSumKernel			m_Kernel;
+	float					m_ColourScale[3];
+
+	// Zone boundaries, with one extra entry for the right / bottom edge
+	std::vector<int>		m_ZoneLeft;
+	std::vector<int>		m_ZoneTop;
+
+	// Per-channel column sums for the zone row being processed.
+	// The 16 bit sums are filled by the SIMD kernels and flushed to 32 bits before they can overflow
+	std::vector<uint16_t>	m_RowSums16;
+	std::vector<uint32_t>	m_RowSums32;
+	int						m_RowsSinceFlush;
+};
@@ -6,6 +6,7 @@ using System.Drawing;
 using System.Drawing.Imaging;
 using System.Linq;
 using System.Runtime.InteropServices;
+using System.Text;
 using System.Windows;
 using System.Windows.Media.Imaging;
 using System.Windows.Threading;
@@ -29,19 +30,48 @@ namespace LightsServer
         object ComPortLock = new object();
 
         System.IO.Ports.SerialPort outputComPort;
+
+        // Set when the native transport is talking to the board instead of outputComPort
+        bool nativeTransport;
+
+        // Set when the lights are also going to networked controllers
+        bool networkOutput;
         long serialPortOpenDelay;
         long keepaliveTimer;
 
-        DispatcherTimer lightProcessorTimer;
+        // Capture runs on the driver thread inside CaptureProcessor, which wakes our lights thread whenever
+        // there are new light values, so neither has to poll
+        volatile System.Threading.Thread lightsThread;
+        System.Threading.AutoResetEvent lightsReadyEvent;
+        CaptureProcessor.LightsReadyCallback lightsReadyCallback;
         int lightColumns = 100;
         int lightRows = 3;
-        int[] lightValues;
+
+        // The driver fills these in place, and lightValues points at the ones we're holding
+        RegisteredLightBuffers lightBuffers;
+        IntPtr lightValues;
+
+        // What gets written to the board, packed from the light values we're holding
+        byte[] lightData;
         bool lightsUpdated;
         bool lightDataPending;
 
+        // Sequence number of the light values we last picked up
+        ulong lightSequence;
+
+        // Present times of the frames behind the light values we're holding, and the ones we've sent to the board.
+        // Used to measure how long it takes for changes to reach the LEDs
+        long lightPresentTime;
+        long sentPresentTime;
+
         // Set when we've got an active connection to the controller board
         bool boardIsAlive;
 
+        // Set while an update of the preview is waiting for the UI thread, so however many frames come in meanwhile
+        // it only draws once
+        int previewPending;
+        Action updatePreview;
+
         private System.Windows.Forms.NotifyIcon notifyIcon;
 
         // The main window
@@ -66,6 +96,9 @@ namespace LightsServer
             notifyIcon.ContextMenu = new System.Windows.Forms.ContextMenu(new System.Windows.Forms.MenuItem[] {
                 exitButton
             });
+
+            // Capture picks settings up once when it starts, then again only when one changes
+            LightsServer.Properties.Settings.Default.PropertyChanged += Settings_PropertyChanged;
         }
         
         private void Exit_Clicked(object sender, EventArgs e)
@@ -87,25 +120,123 @@ namespace LightsServer
             {
                 StopCapturing();
 
-                // Try and open the output COM port
-                serialPortOpenDelay = DateTime.Now.AddMilliseconds(SerialPortOpenDelay).Ticks;
-                outputComPort = new System.IO.Ports.SerialPort(comPort, 288000, System.IO.Ports.Parity.None, 8, System.IO.Ports.StopBits.One);
-                outputComPort.NewLine = "\r\n";
-                outputComPort.ReadTimeout = 100;
-                outputComPort.WriteTimeout = 100;
-                outputComPort.DataReceived += OutputComPort_DataReceived;
-                outputComPort.Open();
-
-                lightValues = new int[lightColumns * lightRows];
-                if (CaptureProcessor.Start(-1, lightColumns, lightRows))
+                nativeTransport = LightsServer.Properties.Settings.Default.NativeSerialTransport;
+                if (nativeTransport)
                 {
+                    // The transport runs the whole protocol on its own I/O thread
+                    int transportFeatures = 0;
+                    if (LightsServer.Properties.Settings.Default.FramedLightProtocol)
+                    {
+                        transportFeatures |= CaptureProcessor.TransportFeatureFramed;
+
+                        // Layouts too big for the config, and frames too big to send in one go
+                        transportFeatures |= CaptureProcessor.TransportFeatureLargeLayout;
+                        if (LightsServer.Properties.Settings.Default.CompressedLightFrames)
+                        {
+                            transportFeatures |= CaptureProcessor.TransportFeatureDelta;
+                        }
+
+                        // 24 bit colour unless fewer bits are asked for, to fit more lights down a slow link
+                        int colourBits = LightsServer.Properties.Settings.Default.LightColourBits;
+                        if (colourBits <= 12)
+                        {
+                            transportFeatures |= CaptureProcessor.TransportFeatureRGB444;
+                        }
+                        else if (colourBits <= 16)
+                        {
+                            transportFeatures |= CaptureProcessor.TransportFeatureRGB565;
+                        }
+
+                        // Faster baud rates are tested with the board before they're used, so are safe to leave on
+                        if (LightsServer.Properties.Settings.Default.FastLinkRates)
+                        {
+                            transportFeatures |= CaptureProcessor.TransportFeatureLinkRate;
+                        }
+
+                        // Fewer frames down the link for boards that can blend between them, a frame later
+                        if (LightsServer.Properties.Settings.Default.InterpolateLights)
+                        {
+                            transportFeatures |= CaptureProcessor.TransportFeatureInterpolate;
+                        }
+
+                        // Steadier frames from boards that can queue them, shown a little after they're captured
+                        if (LightsServer.Properties.Settings.Default.ScheduledLightFrames)
+                        {
+                            transportFeatures |= CaptureProcessor.TransportFeatureScheduled;
+                        }
+                    }
+                    CaptureProcessor.SetTransportFeatures(transportFeatures);
+
+                    // Any more boards, separated by ';', get a share of the lights and show in step with this one
+                    String transportPorts = comPort;
+                    String shardComPorts = LightsServer.Properties.Settings.Default.ShardComPorts;
+                    if (!String.IsNullOrEmpty(shardComPorts))
+                    {
+                        transportPorts += ";" + shardComPorts;
+                    }
+                    if (!CaptureProcessor.StartTransport(transportPorts, lightColumns, lightRows))
+                    {
+                        System.Diagnostics.Debug.WriteLine("Couldn't open " + transportPorts);
+                        return;
+                    }
+                }
+                else
+                {
+                    // Try and open the output COM port
+                    serialPortOpenDelay = DateTime.Now.AddMilliseconds(SerialPortOpenDelay).Ticks;
+                    outputComPort = new System.IO.Ports.SerialPort(comPort, 288000, System.IO.Ports.Parity.None, 8, System.IO.Ports.StopBits.One);
+                    outputComPort.NewLine = "\r\n";
+                    outputComPort.ReadTimeout = 100;
+                    outputComPort.WriteTimeout = 100;
+                    outputComPort.DataReceived += OutputComPort_DataReceived;
+                    outputComPort.Open();
+                }
+
+                // Networked controllers get the same lights beside the board. Nothing comes back from them, so only a
+                // bad host or universe mapping stops it
+                if (LightsServer.Properties.Settings.Default.NetworkOutput)
+                {
+                    String networkHost = LightsServer.Properties.Settings.Default.NetworkHost;
+                    int networkProtocol = String.Equals(LightsServer.Properties.Settings.Default.NetworkProtocol, "E131", StringComparison.OrdinalIgnoreCase) ? CaptureProcessor.NetworkProtocolE131 : CaptureProcessor.NetworkProtocolDDP;
+                    networkOutput = CaptureProcessor.StartNetworkTransport(networkHost, networkProtocol, LightsServer.Properties.Settings.Default.NetworkUniverses,
+                        LightsServer.Properties.Settings.Default.NetworkSyncUniverse, lightColumns * lightRows);
+                    if (!networkOutput)
+                    {
+                        System.Diagnostics.Debug.WriteLine("Couldn't start network output to " + networkHost);
+                    }
+                }
+
+                lightValues = IntPtr.Zero;
+                lightData = new byte[lightColumns * lightRows * 3];
+                lightSequence = 0;
+                lightsReadyEvent = new System.Threading.AutoResetEvent(false);
+                lightsReadyCallback = OnLightsReady;
+                previewPending = 0;
+                updatePreview = UpdatePreview;
+
+                // Settings given before the driver starts are in place for the first frame
+                ApplyCaptureSettings();
+                if (CaptureProcessor.StartDriver(-1, lightColumns, lightRows, lightsReadyCallback, IntPtr.Zero))
+                {
+                    // The driver's callback already wakes us for each frame, so the buffers don't need an event of their own
+                    lightBuffers = RegisteredLightBuffers.Register(lightColumns * lightRows, IntPtr.Zero);
+                    if (lightBuffers == null)
+                    {
+                        System.Diagnostics.Debug.WriteLine("Couldn't register light buffers");
+                        CaptureProcessor.StopDriver();
+                        lightsReadyCallback = null;
+                        return;
+                    }
+
+                    CaptureProcessor.ResetLatencyStats();
+                    lightPresentTime = 0;
+                    sentPresentTime = 0;
                     PreviewImage = new WriteableBitmap(lightColumns, lightRows, 72, 72, System.Windows.Media.PixelFormats.Bgr32, null);
 
-                    // Start the update timer
-                    lightProcessorTimer = new DispatcherTimer();
-                    lightProcessorTimer.Tick += ProcessCapture; ;
-                    lightProcessorTimer.Interval = new TimeSpan(0, 0, 0, 0, 16);
-                    lightProcessorTimer.Start();
+                    // Start the lights thread
+                    lightsThread = new System.Threading.Thread(LightsThreadProc);
+                    lightsThread.IsBackground = true;
+                    lightsThread.Start(lightsReadyEvent);
                 }
             }
         }
@@ -137,6 +268,7 @@ namespace LightsServer
                                 boardIsAlive = false;
                                 lightDataPending = false;
                                 lightsUpdated = false;
+                                sentPresentTime = 0;
                                 outputComPort.Write("H");
                             }
                             break;
@@ -154,11 +286,18 @@ namespace LightsServer
                         case 'R':
                             {
                                 // Board is ready to receive light data
-                                if (boardIsAlive && lightValues != null)
+                                if (boardIsAlive && lightData != null)
                                 {
                                     System.Diagnostics.Debug.WriteLine("Board ready to receive, sending light data");
-                                    byte[] lightData = SerialDataBuilder.LightData(lightValues);
+                                    // Packed natively from the buffer we're holding, into the same bytes every time
+                                    if (lightValues != IntPtr.Zero)
+                                    {
+                                        CaptureProcessor.PackLightData(lightValues, lightBuffers.LightCount, lightData, lightData.Length, CaptureProcessor.ChannelOrderRGB);
+                                    }
                                     outputComPort.Write(lightData, 0, lightData.Length);
+                                    CaptureProcessor.RecordLatency(CaptureProcessor.LatencyStageSerialWrite, lightPresentTime);
+                                    sentPresentTime = lightPresentTime;
+                                    lightPresentTime = 0;
                                     keepaliveTimer = DateTime.Now.AddMilliseconds(KeepAliveTime).Ticks;
                                     lightDataPending = false;
                                 }
@@ -169,6 +308,14 @@ namespace LightsServer
                             }
                             break;
 
+                        case 'S':
+                            {
+                                // Board has shown the light data we sent
+                                CaptureProcessor.RecordLatency(CaptureProcessor.LatencyStageShow, sentPresentTime);
+                                sentPresentTime = 0;
+                            }
+                            break;
+
                         case 'D':
                             {
                                 try
@@ -195,14 +342,33 @@ namespace LightsServer
             System.IO.Ports.SerialPort oldComPort;
             lock (ComPortLock)
             {
-                if (lightProcessorTimer != null)
+                if (lightsThread != null)
+                {
+                    // The lights thread leaves once it sees it's been replaced. We can't wait for it here,
+                    // as it needs the lock
+                    lightsThread = null;
+
+                    // Shutdown capture, which wakes the lights thread one last time, and lets go of the light buffers
+                    CaptureProcessor.StopDriver();
+                    lightsReadyCallback = null;
+                    lightValues = IntPtr.Zero;
+                    if (lightBuffers != null)
+                    {
+                        lightBuffers.Dispose();
+                        lightBuffers = null;
+                    }
+                }
+
+                if (nativeTransport)
                 {
-                    // Stop the update timer
-                    lightProcessorTimer.Stop();
-                    lightProcessorTimer = null;
+                    CaptureProcessor.StopTransport();
+                    nativeTransport = false;
+                }
 
-                    // Shutdown capture
-                    CaptureProcessor.Stop();
+                if (networkOutput)
+                {
+                    CaptureProcessor.StopNetworkTransport();
+                    networkOutput = false;
                 }
 
                 oldComPort = outputComPort;
@@ -216,78 +382,105 @@ namespace LightsServer
 
         public bool IsCapturing()
         {
-            return lightProcessorTimer != null;
+            return lightsThread != null;
         }
 
-        private void ProcessCapture(object sender, EventArgs e)
+        // Called from the driver thread whenever there are new light values
+        private void OnLightsReady(IntPtr context)
         {
-            System.Diagnostics.Debug.WriteLine("lightDataPending: " + lightDataPending + " lightsUpdated: " + lightsUpdated);
+            lightsReadyEvent.Set();
+        }
 
-            // Make sure we set the colour scale
+        private void ApplyCaptureSettings()
+        {
             CaptureProcessor.SetColourScale(LightsServer.Properties.Settings.Default.RedTint, LightsServer.Properties.Settings.Default.GreenTint, LightsServer.Properties.Settings.Default.BlueTint);
+            CaptureProcessor.SetDownsampleMode(LightsServer.Properties.Settings.Default.CPUDownsample ? CaptureProcessor.DownsampleCPU : CaptureProcessor.DownsampleGPU);
+            CaptureProcessor.SetCaptureTrace(LightsServer.Properties.Settings.Default.CaptureTracePath, LightsServer.Properties.Settings.Default.CaptureTraceDirtyOnly);
+            CaptureProcessor.SetFrameSlots(LightsServer.Properties.Settings.Default.PerOutputFrameSlots);
+            CaptureProcessor.SetSharedLights(LightsServer.Properties.Settings.Default.SharedLightsName);
+        }
+
+        private void Settings_PropertyChanged(object sender, System.ComponentModel.PropertyChangedEventArgs e)
+        {
+            lock (ComPortLock)
+            {
+                if (lightsThread != null)
+                {
+                    ApplyCaptureSettings();
+                }
+            }
+        }
+
+        private void LightsThreadProc(object param)
+        {
+            System.Threading.AutoResetEvent readyEvent = (System.Threading.AutoResetEvent)param;
+            System.Threading.Thread thisThread = System.Threading.Thread.CurrentThread;
 
-            if (CaptureProcessor.Process())
+            // Wake up whenever the driver has new light values, or to send a keepalive
+            while (lightsThread == thisThread && CaptureProcessor.IsDriverRunning() && (!nativeTransport || CaptureProcessor.IsTransportRunning()))
             {
-                System.Diagnostics.Debug.WriteLine("CaptureProcessor.Process successful");
+                readyEvent.WaitOne(KeepAliveTime);
+                ProcessLights();
+            }
 
-                // Get the values
-                lock (ComPortLock)
+            // If the driver or transport has stopped (because of an error), then make sure to stop capturing
+            if (lightsThread == thisThread)
+            {
+                Dispatcher.BeginInvoke(new Action(() =>
                 {
-                    GCHandle handle = GCHandle.Alloc(lightValues, GCHandleType.Pinned);
-                    try
+                    if (lightsThread == thisThread)
                     {
-                        IntPtr pointer = handle.AddrOfPinnedObject();
-                        CaptureProcessor.GetLightValues(pointer, lightValues.Length);
-                        lightsUpdated = true;
-                    }
-                    finally
-                    {
-                        if (handle.IsAllocated)
-                        {
-                            handle.Free();
-                        }
+                        StopCapturing();
                     }
+                }));
+            }
+        }
+
+        private void ProcessLights()
+        {
+            bool previewUpdated = false;
+            lock (ComPortLock)
+            {
+                if ((outputComPort == null && !nativeTransport) || lightBuffers == null)
+                {
+                    return;
                 }
 
-                // Update the preview image
-                PreviewImage.Lock();
-                unsafe
+                // Take the latest buffer the driver has filled, if it's a new one
+                IntPtr values;
+                ulong sequence;
+                long presentTime;
+                if (lightBuffers.AcquireLatest(out values, out sequence, out presentTime) && sequence != lightSequence)
                 {
-                    int backbuffer = (int)PreviewImage.BackBuffer;
+                    lightValues = values;
+                    lightSequence = sequence;
+                    lightsUpdated = true;
+                    previewUpdated = true;
 
-                    var lightIndex = 0;
-                    for(var row = 0; row < lightRows; ++row)
+                    // Keep the oldest frame we've not sent yet
+                    if (lightPresentTime == 0)
                     {
-                        var currentPixel = backbuffer + (row * PreviewImage.BackBufferStride);
-                        var direction = 1;
-
-                        // Need to reverse direction on odd rows to compensate for the reversing
-                        // done in the capture library
-                        if (row % 2 == 1)
-                        {
-                            direction = -1;
-                            currentPixel += 4 * (lightColumns - 1);
-                        }
+                        lightPresentTime = presentTime;
+                    }
 
-                        for (var column = 0; column < lightColumns; ++column, ++lightIndex, currentPixel += direction * 4)
-                        {
-                            *((int*)currentPixel) = lightValues[lightIndex];
-                        }
+                    // Networked controllers don't have to be ready, so get every new frame straight away
+                    if (networkOutput)
+                    {
+                        CaptureProcessor.SetNetworkLightValues(lightValues, lightBuffers.LightCount, presentTime);
                     }
                 }
-                Int32Rect dirtyRect = new Int32Rect(0, 0, lightColumns, lightRows);
-                PreviewImage.AddDirtyRect(dirtyRect);
-                PreviewImage.Unlock();
-            }
-            else
-            {
-                System.Diagnostics.Debug.WriteLine("CaptureProcessor.Process timed out");
-            }
-            System.Diagnostics.Debug.WriteLine("Done");
 
-            lock (ComPortLock)
-            {
-                if (boardIsAlive && outputComPort != null)
+                if (nativeTransport)
+                {
+                    // Hand the values over, and the transport takes it from there
+                    if (lightsUpdated)
+                    {
+                        CaptureProcessor.SetTransportLightValues(lightValues, lightBuffers.LightCount, lightPresentTime);
+                        lightPresentTime = 0;
+                        lightsUpdated = false;
+                    }
+                }
+                else if (boardIsAlive)
                 {
                     // If we've got updated light values, and an active board to send to, notify the board
                     if (!lightDataPending)
@@ -312,30 +505,108 @@ namespace LightsServer
                         }
                     }
                 }
-                if (!boardIsAlive)
+                else
                 {
                     System.Diagnostics.Debug.WriteLine("Board is dead");
                 }
             }
 
-            // If we've stopped capturing (because of an error), then make sure to stop the updates
-            if(!CaptureProcessor.IsRunning())
+            if (previewUpdated && System.Threading.Interlocked.Exchange(ref previewPending, 1) == 0)
             {
-                StopCapturing();
+                // The preview belongs to the UI thread, which can catch up in its own time
+                Dispatcher.BeginInvoke(updatePreview);
             }
         }
 
+        // Draws the light values the lights thread is holding, straight from the registered buffer. It only lets go
+        // of them under the lock
+        private unsafe void UpdatePreview()
+        {
+            System.Threading.Interlocked.Exchange(ref previewPending, 0);
+            WriteableBitmap previewImage = PreviewImage;
+            if (previewImage == null)
+            {
+                return;
+            }
+
+            lock (ComPortLock)
+            {
+                if (lightBuffers == null || lightValues == IntPtr.Zero || lightBuffers.LightCount != lightColumns * lightRows)
+                {
+                    return;
+                }
+                DrawPreview(previewImage, (int*)lightValues);
+            }
+        }
+
+        private unsafe void DrawPreview(WriteableBitmap previewImage, int* values)
+        {
+            previewImage.Lock();
+            unsafe
+            {
+                int backbuffer = (int)previewImage.BackBuffer;
+
+                var lightIndex = 0;
+                for(var row = 0; row < lightRows; ++row)
+                {
+                    var currentPixel = backbuffer + (row * previewImage.BackBufferStride);
+                    var direction = 1;
+
+                    // Need to reverse direction on odd rows to compensate for the reversing
+                    // done in the capture library
+                    if (row % 2 == 1)
+                    {
+                        direction = -1;
+                        currentPixel += 4 * (lightColumns - 1);
+                    }
+
+                    for (var column = 0; column < lightColumns; ++column, ++lightIndex, currentPixel += direction * 4)
+                    {
+                        *((int*)currentPixel) = values[lightIndex];
+                    }
+                }
+            }
+            Int32Rect dirtyRect = new Int32Rect(0, 0, lightColumns, lightRows);
+            previewImage.AddDirtyRect(dirtyRect);
+            previewImage.Unlock();
+        }
+
         internal void RequestBoardDebugInfo()
         {
+            LogLatencyStats();
+
             lock (ComPortLock)
             {
-                if (outputComPort != null && keepaliveTimer < DateTime.Now.Ticks && !lightDataPending)
+                if (nativeTransport)
+                {
+                    // Log whatever the board has sent since we last asked
+                    StringBuilder debugLine = new StringBuilder(256);
+                    while (CaptureProcessor.GetTransportDebugLine(debugLine, debugLine.Capacity))
+                    {
+                        System.Diagnostics.Debug.WriteLine("From board: " + debugLine.ToString());
+                    }
+                    CaptureProcessor.RequestTransportDebugInfo();
+                }
+                else if (outputComPort != null && keepaliveTimer < DateTime.Now.Ticks && !lightDataPending)
                 {
                     outputComPort.Write("D");
                 }
             }
         }
 
+        private void LogLatencyStats()
+        {
+            string[] stageNames = { "Acquire", "Composite", "Lights", "Serial write", "Show" };
+            long[] values = new long[5];
+            for (int stage = 0; stage < CaptureProcessor.LatencyStageCount; ++stage)
+            {
+                if (CaptureProcessor.GetLatencyPercentiles(stage, values, values.Length))
+                {
+                    System.Diagnostics.Debug.WriteLine(String.Format("Latency {0}: count {1} | p50 {2}us | p99 {3}us | p99.9 {4}us | max {5}us", stageNames[stage], values[0], values[1], values[2], values[3], values[4]));
+                }
+            }
+        }
+
         private void NotifyIcon_DoubleClick(object sender, EventArgs e)
         {
             // Show the window
@@ -20,10 +20,164 @@ namespace LightsServer
         [DllImport("CaptureProcessor.dll")]
         public static extern void SetColourScale(float red, float green, float blue);
 
+        public const int DownsampleGPU = 0;
+        public const int DownsampleCPU = 1;
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetDownsampleMode(int mode);
+
+        [DllImport("CaptureProcessor.dll", CharSet = CharSet.Unicode)]
+        public static extern void SetCaptureTrace(string path, bool dirtyOnly);
+
+        // Gives each output its own frame slots instead of sharing one surface. Takes effect when capture restarts
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetFrameSlots(bool enabled);
+
+        // Publishes every set of light values into a ring in shared memory with this name, for other processes to
+        // read without going through us. An empty name stops sharing them
+        [DllImport("CaptureProcessor.dll", CharSet = CharSet.Unicode)]
+        public static extern void SetSharedLights(string name);
+
         [DllImport("CaptureProcessor.dll")]
         public static extern void GetLightValues(IntPtr values, int length);
 
+        // Points values at the latest light values, which stay put until the next call. Returns true if they've changed
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool AcquireLightValues(out IntPtr values, out int count, out ulong sequence);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern long GetLightPresentTime();
+
+        // Channel orders for GetLightData and PackLightData
+        public const int ChannelOrderRGB = 0;
+        public const int ChannelOrderGRB = 1;
+
+        // Packs the light values last picked up straight into data, 3 bytes per light as they're sent to the board.
+        // data is pinned for the call rather than copied, so it can be kept and sent from frame after frame
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool GetLightData([Out] byte[] data, int length, int channelOrder);
+
+        // Latency stages, each measured from when the frame was presented
+        public const int LatencyStageAcquire = 0;
+        public const int LatencyStageComposite = 1;
+        public const int LatencyStageLights = 2;
+        public const int LatencyStageSerialWrite = 3;
+        public const int LatencyStageShow = 4;
+        public const int LatencyStageCount = 5;
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void RecordLatency(int stage, long presentTime);
+
+        // Values are count, p50, p99, p99.9 and max, with the latencies in microseconds
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool GetLatencyPercentiles(int stage, [Out] long[] values, int length);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void ResetLatencyStats();
+
         [DllImport("CaptureProcessor.dll")]
         public static extern void Stop();
+
+        // Called from the driver thread each time new light values are published, and once more when it stops
+        [UnmanagedFunctionPointer(CallingConvention.StdCall)]
+        public delegate void LightsReadyCallback(IntPtr context);
+
+        // Runs capture on its own thread instead of needing Process to be called. The callback must be kept alive until StopDriver
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool StartDriver(int singleOutput, int lightColumns, int lightRows, LightsReadyCallback callback, IntPtr context);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool IsDriverRunning();
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern IntPtr GetLightsReadyEvent();
+
+        // Copies out the light values from the driver. Returns true if they've changed since the last call
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool GetDriverLightValues([Out] int[] values, int length, out ulong sequence);
+
+        // Registers memory for the driver to fill with light values in place, signalling filledEvent (if not zero) each
+        // time. Only while the driver's running. See RegisteredLightBuffers
+        [DllImport("CaptureProcessor.dll")]
+        public static extern int GetLightBuffersSize(int bufferCount, int lightCount);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool RegisterLightBuffers(IntPtr memory, int length, int bufferCount, int lightCount, IntPtr filledEvent);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void UnregisterLightBuffers();
+
+        // Packs light values held natively, such as in a registered buffer, into the bytes sent for them
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool PackLightData(IntPtr values, int count, [Out] byte[] data, int length, int channelOrder);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void StopDriver();
+
+        // Runs the board's serial protocol on a native I/O thread, in place of System.IO.Ports. Several ports,
+        // separated by ';', split the lights between their boards
+        [DllImport("CaptureProcessor.dll", CharSet = CharSet.Unicode)]
+        public static extern bool StartTransport(string port, int lightColumns, int lightRows);
+
+        // Protocol features the transport may use, if the board offers them
+        public const int TransportFeatureFramed = 0x0001;
+        public const int TransportFeatureDelta = 0x0002;
+        public const int TransportFeatureRGB565 = 0x0004;
+        public const int TransportFeatureRGB444 = 0x0008;
+        public const int TransportFeatureLinkRate = 0x0010;
+        public const int TransportFeatureLargeLayout = 0x0020;
+
+        // The board blends towards each frame itself, so the transport only sends one every 40ms
+        public const int TransportFeatureInterpolate = 0x0080;
+
+        // The board keeps its own time, and queues each frame to show 50ms after it was presented, evening out delivery
+        public const int TransportFeatureScheduled = 0x0100;
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetTransportFeatures(int features);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool IsTransportRunning();
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool IsBoardAlive();
+
+        // Only the latest light values are sent, as soon as the board is ready for them
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetTransportLightValues([In] int[] values, int count, long presentTime);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetTransportLightValues(IntPtr values, int count, long presentTime);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void RequestTransportDebugInfo();
+
+        [DllImport("CaptureProcessor.dll", CharSet = CharSet.Ansi)]
+        public static extern bool GetTransportDebugLine(StringBuilder buffer, int length);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void StopTransport();
+
+        // Protocols for networked pixel controllers
+        public const int NetworkProtocolDDP = 0;
+        public const int NetworkProtocolE131 = 1;
+
+        // Sends the lights over UDP on a native thread, beside the serial transport. An empty host multicasts E1.31.
+        // universes maps lights to universes (or DDP destinations) as "destination:firstLight:lightCount[:startChannel]"
+        // runs separated by ';', and if empty the lights go out in order. A sync universe of 0 means no E1.31 sync
+        [DllImport("CaptureProcessor.dll", CharSet = CharSet.Unicode)]
+        public static extern bool StartNetworkTransport(string host, int protocol, string universes, int syncUniverse, int lightCount);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern bool IsNetworkTransportRunning();
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetNetworkLightValues([In] int[] values, int count, long presentTime);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void SetNetworkLightValues(IntPtr values, int count, long presentTime);
+
+        [DllImport("CaptureProcessor.dll")]
+        public static extern void StopNetworkTransport();
     }
 }
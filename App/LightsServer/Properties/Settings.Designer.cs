@@ -70,5 +70,221 @@ namespace LightsServer.Properties {
                 this["BlueTint"] = value;
             }
         }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("False")]
+        public bool CPUDownsample {
+            get {
+                return ((bool)(this["CPUDownsample"]));
+            }
+            set {
+                this["CPUDownsample"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("")]
+        public string CaptureTracePath {
+            get {
+                return ((string)(this["CaptureTracePath"]));
+            }
+            set {
+                this["CaptureTracePath"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("True")]
+        public bool CaptureTraceDirtyOnly {
+            get {
+                return ((bool)(this["CaptureTraceDirtyOnly"]));
+            }
+            set {
+                this["CaptureTraceDirtyOnly"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("False")]
+        public bool PerOutputFrameSlots {
+            get {
+                return ((bool)(this["PerOutputFrameSlots"]));
+            }
+            set {
+                this["PerOutputFrameSlots"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("False")]
+        public bool NativeSerialTransport {
+            get {
+                return ((bool)(this["NativeSerialTransport"]));
+            }
+            set {
+                this["NativeSerialTransport"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("True")]
+        public bool FramedLightProtocol {
+            get {
+                return ((bool)(this["FramedLightProtocol"]));
+            }
+            set {
+                this["FramedLightProtocol"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("True")]
+        public bool CompressedLightFrames {
+            get {
+                return ((bool)(this["CompressedLightFrames"]));
+            }
+            set {
+                this["CompressedLightFrames"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("24")]
+        public int LightColourBits {
+            get {
+                return ((int)(this["LightColourBits"]));
+            }
+            set {
+                this["LightColourBits"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("True")]
+        public bool FastLinkRates {
+            get {
+                return ((bool)(this["FastLinkRates"]));
+            }
+            set {
+                this["FastLinkRates"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("")]
+        public string ShardComPorts {
+            get {
+                return ((string)(this["ShardComPorts"]));
+            }
+            set {
+                this["ShardComPorts"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("False")]
+        public bool NetworkOutput {
+            get {
+                return ((bool)(this["NetworkOutput"]));
+            }
+            set {
+                this["NetworkOutput"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("")]
+        public string NetworkHost {
+            get {
+                return ((string)(this["NetworkHost"]));
+            }
+            set {
+                this["NetworkHost"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("DDP")]
+        public string NetworkProtocol {
+            get {
+                return ((string)(this["NetworkProtocol"]));
+            }
+            set {
+                this["NetworkProtocol"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("")]
+        public string NetworkUniverses {
+            get {
+                return ((string)(this["NetworkUniverses"]));
+            }
+            set {
+                this["NetworkUniverses"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("0")]
+        public int NetworkSyncUniverse {
+            get {
+                return ((int)(this["NetworkSyncUniverse"]));
+            }
+            set {
+                this["NetworkSyncUniverse"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("")]
+        public string SharedLightsName {
+            get {
+                return ((string)(this["SharedLightsName"]));
+            }
+            set {
+                this["SharedLightsName"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("False")]
+        public bool InterpolateLights {
+            get {
+                return ((bool)(this["InterpolateLights"]));
+            }
+            set {
+                this["InterpolateLights"] = value;
+            }
+        }
+        
+        [global::System.Configuration.UserScopedSettingAttribute()]
+        [global::System.Diagnostics.DebuggerNonUserCodeAttribute()]
+        [global::System.Configuration.DefaultSettingValueAttribute("False")]
+        public bool ScheduledLightFrames {
+            get {
+                return ((bool)(this["ScheduledLightFrames"]));
+            }
+            set {
+                this["ScheduledLightFrames"] = value;
+            }
+        }
     }
 }
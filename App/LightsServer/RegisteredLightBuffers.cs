@@ -0,0 +1,96 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+
+namespace LightsServer
+{
+    // Light values the capture driver fills in place, in memory registered with it once, so nothing is pinned or
+    // copied for each frame. The memory holds a header, then the sequence and present time of each buffer, then
+    // the buffers themselves (see RegisteredLightBuffers.h in CaptureProcessor)
+    class RegisteredLightBuffers : IDisposable
+    {
+        const int BufferCount = 3;
+        const int HeaderSize = 16;
+        const int InfoSize = 16;
+
+        IntPtr memory;
+        int lightCount;
+
+        RegisteredLightBuffers(IntPtr memory, int lightCount)
+        {
+            this.memory = memory;
+            this.lightCount = lightCount;
+        }
+
+        // Registers buffers for lightCount lights with the running driver, which signals filledEvent (if not zero)
+        // each time it fills one. Returns null if they couldn't be registered
+        public static RegisteredLightBuffers Register(int lightCount, IntPtr filledEvent)
+        {
+            int size = CaptureProcessor.GetLightBuffersSize(BufferCount, lightCount);
+            if (size <= 0)
+            {
+                return null;
+            }
+
+            IntPtr memory = Marshal.AllocHGlobal(size);
+            if (!CaptureProcessor.RegisterLightBuffers(memory, size, BufferCount, lightCount, filledEvent))
+            {
+                Marshal.FreeHGlobal(memory);
+                return null;
+            }
+            return new RegisteredLightBuffers(memory, lightCount);
+        }
+
+        public int LightCount
+        {
+            get { return lightCount; }
+        }
+
+        // Takes the latest light values, which the driver then leaves alone until the next call. Returns false if
+        // there aren't any yet
+        public unsafe bool AcquireLatest(out IntPtr values, out ulong sequence, out long presentTime)
+        {
+            values = IntPtr.Zero;
+            sequence = 0;
+            presentTime = 0;
+
+            // Say which one we're reading, then make sure it's still the latest, or the driver could be filling it
+            int* header = (int*)memory;
+            int index = Thread.VolatileRead(ref header[0]);
+            while (index >= 0)
+            {
+                Interlocked.Exchange(ref header[1], index);
+                int latestIndex = Thread.VolatileRead(ref header[0]);
+                if (latestIndex == index)
+                {
+                    break;
+                }
+                index = latestIndex;
+            }
+            if (index < 0)
+            {
+                return false;
+            }
+
+            byte* info = (byte*)memory + HeaderSize + index * InfoSize;
+            sequence = *(ulong*)info;
+            presentTime = *(long*)(info + 8);
+            values = (IntPtr)((byte*)memory + HeaderSize + BufferCount * InfoSize + (long)index * lightCount * 4);
+            return true;
+        }
+
+        // Only once the driver has stopped or let go of the buffers
+        public void Dispose()
+        {
+            if (memory != IntPtr.Zero)
+            {
+                CaptureProcessor.UnregisterLightBuffers();
+                Marshal.FreeHGlobal(memory);
+                memory = IntPtr.Zero;
+            }
+        }
+    }
+}
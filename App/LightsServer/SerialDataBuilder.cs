@@ -9,34 +9,12 @@ namespace LightsServer
     {
         public static byte[] Config(int columnCount, int rowCount)
         {
-            // Control character, byte for width, byte for height
+            // Control character, byte for width, byte for height. Only the native transport can send anything bigger
             byte[] configData = new byte[3];
             configData[0] = (byte)'C';
-            configData[1] = (byte)columnCount;
-            configData[2] = (byte)rowCount;
+            configData[1] = (byte)Math.Min(columnCount, 255);
+            configData[2] = (byte)Math.Min(rowCount, 255);
             return configData;
         }
-
-        public static byte[] LightData(int[] lightValues)
-        {
-            // 3 bytes per light
-            byte[] lightData = new byte[lightValues.Length * 3];
-
-            var byteIndex = 0;
-            for(var lightIndex = 0; lightIndex < lightValues.Length; ++lightIndex)
-            {
-                // Extract the R, G and B bytes from the light values
-                var lightValue = lightValues[lightIndex];
-                byte red = (byte)((lightValue & 0xFF0000) >> 16);
-                byte green = (byte)((lightValue & 0xFF00) >> 8);
-                byte blue = (byte)((lightValue & 0xFF));
-
-                lightData[byteIndex++] = red;
-                lightData[byteIndex++] = green;
-                lightData[byteIndex++] = blue;
-            }
-
-            return lightData;
-        }
     }
 }
@@ -10,6 +10,43 @@
 // In: 'K' - Keep alive packet sent from the PC to indicate we're still here, but no light data is available
 // In: 'D' - Output debug info
 // Out: 'D' - A line of debug info
+// Out: 'S' - Light data shown. Sent once the light data has been pushed out to the LEDs, so the PC can measure latency
+// In: 'P' - Protocol query. Sent from the PC after the config to ask what the board supports. Older boards ignore it
+// Out: 'P' + capabilities - A length byte (7), then the protocol version, feature flags (2 bytes), frame window, max LED count (2 bytes) and link rates (see LINK_RATES)
+// In: 'M' + features - Switch to the given feature flags (2 bytes)
+// Out: 'M' + features - The feature flags now in use (2 bytes)
+// In: 'B' + rate code - Switch to LinkRates[code]. Needs the link rate feature
+// Out: 'B' + rate code - The rate being switched to, or 0 to stay where we are. Both ends switch straight after
+// In: 'T' + link test - At the new rate, a 64 byte test pattern (see LINK_TEST_BYTE) and its CRC-16
+// Out: 'T' + link test - The same back, once it's come through intact
+// In: 'Y' - Stay at the new rate. Without it, or if the test doesn't come through, we go back to SERIAL_BAUD_RATE
+// In: 'G' + layout - LED X and Y counts as 2 bytes each, for layouts too big for the config. Needs the large layout feature
+// Out: 'G' + LED count - The number of LEDs now running (2 bytes), or 0 if that's more than MAX_NUM_LEDS
+// In: 'W' + sequence - Show the frame being held, if it's this one. Needs the sync show feature, and always carries the
+//     sequence, even once the frame it was for has been lost
+// With the interpolate feature, frames aren't shown straight away but blended into at UPDATES_PER_SECOND, from
+// whatever's showing, over about as long as frames are taking to come in
+// In: 'Q' - Clock query. Needs the scheduled feature
+// Out: 'Q' + time - Our millis() (4 bytes), so the PC can work out the difference between our clocks
+// In: 'Z' + sequence + time - Show that frame once millis() reaches this (the low 2 bytes), rather than as soon as it's
+//     in. Frames wait their turn in a queue (see SCHEDULED_FRAME_COUNT). Needs the scheduled feature
+// Once the framed feature is in use, light data is sent as frames instead of 'A'/'R':
+// In: Light frame - 0xA5 0x5A, type, sequence, payload length (2 bytes), payload, CRC-16 of type to payload (2 bytes)
+//     'L' - 3 bytes * number of LEDs
+//     'K' - Keyframe. Runs covering every LED (see below). Needs the delta feature
+//     'D' - Delta frame. The sequence of the frame it changes, then runs. Needs the delta feature
+//     '5' - 2 bytes per LED, little endian, with red in the top 5 bits, then 6 bits of green and 5 of blue. Needs the RGB565 feature
+//     '4' - 12 bits per LED, as 4 bit red, green, blue, red... high half of each byte first. Needs the RGB444 feature
+//     'C' - Chunk of a bigger frame. That frame's type, where the chunk goes in its payload (3 bytes) and its payload length (3 bytes),
+//           then the chunk. Chunks come in order with the frame's sequence, and only the last is answered. Needs the large layout feature
+// Out: 'S' + sequence - Light frame shown, or with the sync show feature, held until 'W' so several boards can show together
+// Out: 'N' + sequence - Light frame dropped, because it failed its CRC or doesn't follow on from the frame being shown
+// Keyframe and delta frame runs start with a byte holding the run type in the top two bits and its length - 1 below:
+//     Skip (0x00) - LEDs unchanged. Delta frames only
+//     Delta (0x40) - 2 bytes per LED, little endian, with signed 5 bit changes to red (bits 0-4), green (5-9) and blue (10-14). Delta frames only
+//     Literal (0x80) - 3 bytes per LED
+//     Repeat (0xC0) - 3 bytes, for every LED in the run
+// Multi-byte values are little endian, and 'K' and 'D' carry on working between frames
 
 #include <bitswap.h>
 #include <chipsets.h>
@@ -42,20 +79,58 @@
 // Power supply config
 #define POWER_SUPPLY_PIN 4
 
+// Time the power supply is given to come on, or go off, before we carry on
+#define POWER_SUPPLY_SETTLE_MILLIS 1000
+
 // LED type config
 #define LED_TYPE WS2812B
 #define LED_PIN 5
 #define COLOR_ORDER GRB
 
-// Maximum allowed LEDs
+// Maximum allowed LEDs. Each takes 3 bytes of RAM, so boards with more to spare can raise this, up to 65535
 #define MAX_NUM_LEDS 300
 
 // Default brightness (0 - 255)
 #define BRIGHTNESS  64
 
-// How fast to update the LEDs
+// How fast to update the LEDs while blending towards a new frame, with the interpolate feature
 #define UPDATES_PER_SECOND 100
 
+// Longest a frame is blended in over, so the first after a pause doesn't take forever to appear
+#define MAX_INTERPOLATE_MILLIS 250
+
+// Whether light data is received into a second set of LED values, swapped with the ones being shown once a whole
+// frame has come in and checked out. Frames cut short or corrupted then never touch the strip, and on boards that
+// can receive while they show, the next frame can come in while this one goes out. It takes another 3 bytes per
+// LED, which the smaller AVRs don't have to spare
+#if defined(RAMEND) && RAMEND < 0x1000
+#define DOUBLE_BUFFER_LEDS 0
+#else
+#define DOUBLE_BUFFER_LEDS 1
+#endif
+
+// Whether the board can offer the interpolate feature, rendering the LEDs itself between frames so the PC can
+// send far fewer of them. The blended values get a set of their own, so it needs double buffering and another
+// 3 bytes per LED. FastLED blocks interrupts while it shows on most boards, so there a frame that starts coming
+// in during a step is lost, and sent again as a keyframe
+#define INTERPOLATE_LEDS DOUBLE_BUFFER_LEDS
+
+// How many frames can wait to be shown at the time the PC gives them, with the scheduled feature. Each takes a set
+// of LED values of its own, so it needs double buffering, and 0 leaves the feature out
+#if !DOUBLE_BUFFER_LEDS
+#define SCHEDULED_FRAME_COUNT 0
+#elif defined(RAMEND) && RAMEND < 0x4000
+#define SCHEDULED_FRAME_COUNT 2
+#else
+#define SCHEDULED_FRAME_COUNT 4
+#endif
+
+// Longest a frame waits for its time, in case the PC's got our clock wrong
+#define MAX_SCHEDULE_MILLIS 500
+
+// Baud rate we start at, and go back to whenever we lose the PC
+#define SERIAL_BAUD_RATE 288000
+
 // Timeout in millis for the last received input from the serial
 #define SERIAL_INPUT_TIMEOUT_MILLIS 2000
 
@@ -65,12 +140,92 @@
 // Time between 'H'ello packets in millis
 #define SERIAL_TIME_BETWEEN_HELLO_MILLIS 1000
 
+// Bytes held between arriving and being handled. The serial port's own buffer only holds 64 on most boards,
+// so everything it has is moved over each time round the loop, before it can fill up. Must be a power of 2
+#define RECEIVE_BUFFER_SIZE 256
+
+// Framed protocol config
+#define PROTOCOL_VERSION 1
+#define PROTOCOL_FEATURE_FRAMED 0x0001
+#define PROTOCOL_FEATURE_DELTA 0x0002
+#define PROTOCOL_FEATURE_RGB565 0x0004
+#define PROTOCOL_FEATURE_RGB444 0x0008
+#define PROTOCOL_FEATURE_LINK_RATE 0x0010
+#define PROTOCOL_FEATURE_LARGE_LAYOUT 0x0020
+#define PROTOCOL_FEATURE_SYNC_SHOW 0x0040
+#define PROTOCOL_FEATURE_INTERPOLATE 0x0080
+#define PROTOCOL_FEATURE_SCHEDULED 0x0100
+#define PROTOCOL_FEATURES (PROTOCOL_FEATURE_FRAMED | PROTOCOL_FEATURE_DELTA | PROTOCOL_FEATURE_RGB565 | PROTOCOL_FEATURE_RGB444 | PROTOCOL_FEATURE_LINK_RATE | PROTOCOL_FEATURE_LARGE_LAYOUT | PROTOCOL_FEATURE_SYNC_SHOW | (INTERPOLATE_LEDS ? PROTOCOL_FEATURE_INTERPOLATE : 0) | (SCHEDULED_FRAME_COUNT ? PROTOCOL_FEATURE_SCHEDULED : 0))
+
+// How many frames the PC can send before waiting for an 'S'. FastLED blocks interrupts while it shows on most
+// boards, so anything arriving then is lost. Boards that can receive while showing can raise this to let the PC
+// stream frames back to back
+#define FRAME_WINDOW 1
+
+#define FRAME_SYNC_0 0xA5
+#define FRAME_SYNC_1 0x5A
+#define FRAME_TYPE_LIGHTS 'L'
+#define FRAME_TYPE_KEYFRAME 'K'
+#define FRAME_TYPE_DELTA 'D'
+#define FRAME_TYPE_RGB565 '5'
+#define FRAME_TYPE_RGB444 '4'
+#define FRAME_TYPE_CHUNK 'C'
+
+#define CHUNK_HEADER_SIZE 7
+
+#define RUN_TYPE_MASK 0xC0
+#define RUN_SKIP 0x00
+#define RUN_DELTA 0x40
+#define RUN_LITERAL 0x80
+#define RUN_REPEAT 0xC0
+
+// Baud rates the PC can ask for by code, and which of them we can switch to (one bit each, code 0 being where
+// we start). Take out any the board's USB serial chip can't manage
+const long LinkRates[] = { 288000, 500000, 1000000, 2000000 };
+#define LINK_RATE_COUNT 4
+#define LINK_RATES 0x0F
+
+#define LINK_TEST_LENGTH 64
+#define LINK_TEST_BYTE(index) ((uint8_t)((index) * 0x4B + 0xA5))
+
 // ------------------------------
 // LED control
 // ------------------------------
 
-// Current and target LED values
-CRGB CurrentLEDValues[MAX_NUM_LEDS];
+// LED values, two sets of them if double buffered, plus one for each frame that can wait to be shown
+CRGB LEDValueBuffers[DOUBLE_BUFFER_LEDS ? 2 + SCHEDULED_FRAME_COUNT : 1][MAX_NUM_LEDS];
+
+// The LED values of the frame being shown, or blended towards when interpolating, and the ones light data is
+// received into. The same set unless double buffered
+CRGB* CurrentLEDValues = LEDValueBuffers[0];
+CRGB* ReceivedLEDValues = LEDValueBuffers[DOUBLE_BUFFER_LEDS ? 1 : 0];
+
+#if SCHEDULED_FRAME_COUNT
+// Frames waiting to be shown, oldest first, with when they're due, and the sets of LED values not in use
+CRGB* ScheduledLEDValues[SCHEDULED_FRAME_COUNT];
+long ScheduledFrameTimes[SCHEDULED_FRAME_COUNT];
+uint8_t ScheduledFrameCount = 0;
+CRGB* SpareLEDValues[SCHEDULED_FRAME_COUNT];
+uint8_t SpareLEDValueCount = 0;
+
+// Sequence of the frame the last 'Z' was for and when it's due, or -1 if it's been and gone
+int ScheduleSequence = -1;
+long ScheduleTime = 0;
+#endif
+
+#if INTERPOLATE_LEDS
+// With the interpolate feature, the LED values being shown, on their way towards CurrentLEDValues
+CRGB InterpolatedLEDValues[MAX_NUM_LEDS];
+
+// Whether they're still on their way, when they should get there, and when they last took a step
+bool Interpolating = false;
+long InterpolateEndTime = 0;
+long LastInterpolateTime = 0;
+
+// When the last frame came in, and how far apart frames have been coming in on average, or 0 if we don't know yet
+long LastFrameTime = 0;
+uint16_t FrameIntervalMillis = 0;
+#endif
 
 // Number of LEDs running
 int LEDCount = 0;
@@ -79,26 +234,104 @@ int LEDCount = 0;
 // Serial protocol
 // -----------------------------
 
-// For tracking our serial mode
+// For tracking our serial mode. Each one is advanced a byte or a tick at a time from the loop, so nothing waits
 enum ECurrentSerialMode
 {
-  Initialise,
-  Waiting
+  Initialise,             // Sending 'H'ello now and then
+  HelloSent,              // Waiting for the PC's 'H'ello back
+  ConfigRequested,        // Waiting for the config
+  PoweringUp,             // Giving the power supply time to come on. Anything the PC sends waits until it has
+  Waiting,                // Handling commands and light frames
+  ReceivingLights,        // Taking the light data after an 'A'
+  TestingLinkRate,        // Waiting for the PC's link test at a new rate
+  ConfirmingLinkRate,     // Sent the link test back, waiting for 'Y'
+  PoweringDown            // Giving the power supply time to go off, before we start again
 };
 
 ECurrentSerialMode CurrentSerialMode;
 
-// Timer for timing serial events / handling timeouts
+// Timer for timing serial events / handling timeouts. In the modes before Waiting, when to move on
 long SerialTimeoutTime = 0;
 
 // Buffer for receiving serial packets
 uint8_t SerialBuffer[16];
 
+// Bytes received but not handled yet, from ReceiveTail up to ReceiveHead. Both only ever count up, and wrap
+// around the buffer
+uint8_t ReceiveBuffer[RECEIVE_BUFFER_SIZE];
+uint16_t ReceiveHead = 0;
+uint16_t ReceiveTail = 0;
+
+// How much of the light data after an 'A' has come in
+uint32_t LightBytesReceived = 0;
+
+// When to give up on the rest of a command or exchange, or 0 if we're not waiting on one
+long CommandTimeoutTime = 0;
+
+// How much of the link test has come in, or -1 if we're still looking for its 'T'
+int LinkTestBytesReceived = -1;
+uint16_t LinkTestCRC = 0;
+
+// Feature flags the PC has switched on
+uint16_t ActiveFeatures = 0;
+
+// Baud rate the serial port is running at
+long CurrentBaudRate = SERIAL_BAUD_RATE;
+
+// For tracking where we are in a light frame
+enum EFrameState
+{
+  FrameSync0,
+  FrameSync1,
+  FrameHeader,
+  FrameChunkHeader,
+  FramePayload,
+  FrameCRC
+};
+
+EFrameState CurrentFrameState = FrameSync0;
+
+// Type, sequence and payload length of the current frame
+uint8_t FrameHeaderBytes[4];
+
+uint16_t FrameBytesReceived = 0;
+uint16_t FramePayloadLength = 0;
+uint16_t FrameCRCValue = 0;
+uint16_t FrameReceivedCRC = 0;
+
+// Type of the light data coming in, where we are in it and how long it is. Chunked frames carry on across chunks
+uint8_t FrameType = 0;
+uint32_t FrameDataOffset = 0;
+uint32_t FrameDataLength = 0;
+
+// Type, offset and length of the current chunk's frame
+uint8_t ChunkHeaderBytes[CHUNK_HEADER_SIZE];
+
+// Sequence of the chunked frame partly received, or -1 if there isn't one
+int ChunkedFrameSequence = -1;
+
+// Whether 'G' can still come, as the PC only sends it between 'M' and the first frame
+bool LayoutExpected = false;
+
+// Sequence of the last frame in, shown or waiting, or -1 if its LED values have been partly overwritten since
+int ShownFrameSequence = -1;
+
+// Sequence of the frame in the LED values being shown that's waiting for 'W', or -1 if there isn't one
+int HeldFrameSequence = -1;
+
+// Where we are in the runs of a keyframe or delta frame
+bool FrameDecodeOK = false;
+uint16_t FrameLEDIndex = 0;
+uint8_t FrameRunType = 0;
+uint8_t FrameRunRemaining = 0;
+uint8_t FrameRunBytes[3];
+uint8_t FrameRunBytesReceived = 0;
+
 // Setup function
 void setup()
 {
   // Start the serial port
-  Serial.begin(288000);
+  Serial.begin(SERIAL_BAUD_RATE);
 
   // Set PIN 4 as output to control the relay
   pinMode(POWER_SUPPLY_PIN, OUTPUT);
@@ -109,6 +342,13 @@ void setup()
   CurrentSerialMode = Initialise;
 
   fill_solid(CurrentLEDValues, MAX_NUM_LEDS, CRGB::Black);
+  fill_solid(ReceivedLEDValues, MAX_NUM_LEDS, CRGB::Black);
+#if SCHEDULED_FRAME_COUNT
+  for (uint8_t index = 0; index < SCHEDULED_FRAME_COUNT; ++index)
+  {
+    SpareLEDValues[SpareLEDValueCount++] = LEDValueBuffers[2 + index];
+  }
+#endif
 
   // Initialise FastLED
   FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(CurrentLEDValues, MAX_NUM_LEDS);
@@ -117,25 +357,50 @@ void setup()
   FastLED.show();
 }
 
-bool waitForSerialData(int numBytesToWaitFor)
+// Number of bytes received but not handled yet
+uint16_t receivedCount()
 {
-  long responseTimeout = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
-  uint8_t serialBufferIndex = 0;
+  return ReceiveHead - ReceiveTail;
+}
 
-  while (serialBufferIndex < numBytesToWaitFor && millis() < responseTimeout)
+// Moves everything the serial port has over to the receive buffer, in as few reads as it fits in
+void fillReceiveBuffer()
+{
+  uint16_t count = min((uint16_t)Serial.available(), (uint16_t)(RECEIVE_BUFFER_SIZE - receivedCount()));
+  while (count > 0)
   {
-    if (Serial.available())
-    {
-      SerialBuffer[serialBufferIndex++] = Serial.read();
-    }
+    uint16_t start = ReceiveHead & (RECEIVE_BUFFER_SIZE - 1);
+    uint16_t block = min(count, (uint16_t)(RECEIVE_BUFFER_SIZE - start));
+    Serial.readBytes(&ReceiveBuffer[start], block);
+    ReceiveHead += block;
+    count -= block;
   }
+}
+
+uint8_t peekReceived(uint16_t offset)
+{
+  return ReceiveBuffer[(ReceiveTail + offset) & (RECEIVE_BUFFER_SIZE - 1)];
+}
+
+uint8_t takeReceived()
+{
+  return ReceiveBuffer[ReceiveTail++ & (RECEIVE_BUFFER_SIZE - 1)];
+}
 
-  bool receivedAll = numBytesToWaitFor == serialBufferIndex;
-  if(!receivedAll)
+// Copies out up to length received bytes, returning how many there were
+uint16_t takeReceived(uint8_t* output, uint16_t length)
+{
+  uint16_t count = min(length, receivedCount());
+  uint16_t copied = 0;
+  while (copied < count)
   {
-    Serial.println("DTimed out waiting for serial data");
+    uint16_t start = ReceiveTail & (RECEIVE_BUFFER_SIZE - 1);
+    uint16_t block = min((uint16_t)(count - copied), (uint16_t)(RECEIVE_BUFFER_SIZE - start));
+    memcpy(output + copied, &ReceiveBuffer[start], block);
+    ReceiveTail += block;
+    copied += block;
   }
-  return receivedAll;
+  return count;
 }
 
 void cleanSerialBuffer()
@@ -144,14 +409,897 @@ void cleanSerialBuffer()
   {
     Serial.read();
   }
+  ReceiveTail = ReceiveHead;
+}
+
+// CRC-16/CCITT-FALSE, one byte at a time
+uint16_t updateCRC(uint16_t crc, uint8_t value)
+{
+  crc ^= (uint16_t)value << 8;
+  for (uint8_t bit = 0; bit < 8; ++bit)
+  {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Waits for everything we've sent to go, then switches the serial port to another rate
+void setBaudRate(long baudRate)
+{
+  Serial.flush();
+  Serial.end();
+  Serial.begin(baudRate);
+  CurrentBaudRate = baudRate;
+}
+
+// Goes back to handling commands once the link test is over, and back to SERIAL_BAUD_RATE if it failed
+void endLinkTest(bool passed)
+{
+  if (!passed)
+  {
+    setBaudRate(SERIAL_BAUD_RATE);
+  }
+  CurrentSerialMode = Waiting;
+  CommandTimeoutTime = 0;
+
+  // Reset our timeout
+  SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+}
+
+// Checks the PC's link test at a new rate as it comes in and sends it back, then waits for the PC to say it got
+// through too. Anything wrong, or taking too long, fails the test
+void receiveLinkTest()
+{
+  while (receivedCount() > 0 && CurrentSerialMode != Waiting)
+  {
+    uint8_t value = takeReceived();
+    if (CurrentSerialMode == ConfirmingLinkRate)
+    {
+      endLinkTest(value == 'Y');
+    }
+    else if (LinkTestBytesReceived < 0)
+    {
+      // Skip anything garbled by the switch
+      if (value == 'T')
+      {
+        LinkTestBytesReceived = 0;
+        LinkTestCRC = 0xFFFF;
+      }
+    }
+    else if (LinkTestBytesReceived < LINK_TEST_LENGTH)
+    {
+      if (value != LINK_TEST_BYTE(LinkTestBytesReceived))
+      {
+        endLinkTest(false);
+      }
+      else
+      {
+        LinkTestCRC = updateCRC(LinkTestCRC, value);
+        ++LinkTestBytesReceived;
+      }
+    }
+    else if (value != ((LinkTestBytesReceived == LINK_TEST_LENGTH) ? (LinkTestCRC & 0xFF) : (LinkTestCRC >> 8)))
+    {
+      endLinkTest(false);
+    }
+    else if (++LinkTestBytesReceived == LINK_TEST_LENGTH + 2)
+    {
+      Serial.write('T');
+      for (uint8_t index = 0; index < LINK_TEST_LENGTH; ++index)
+      {
+        Serial.write(LINK_TEST_BYTE(index));
+      }
+      Serial.write(LinkTestCRC & 0xFF);
+      Serial.write(LinkTestCRC >> 8);
+
+      CurrentSerialMode = ConfirmingLinkRate;
+      CommandTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
+    }
+  }
+
+  if (CurrentSerialMode != Waiting && millis() >= CommandTimeoutTime)
+  {
+    endLinkTest(false);
+  }
+}
+
+#if INTERPOLATE_LEDS
+// Switches the strip between showing CurrentLEDValues as they are, and blending towards them
+void setInterpolating(bool interpolating)
+{
+  Interpolating = false;
+  FrameIntervalMillis = 0;
+  if (interpolating)
+  {
+    memcpy(InterpolatedLEDValues, CurrentLEDValues, sizeof(InterpolatedLEDValues));
+    FastLED[0].setLeds(InterpolatedLEDValues, MAX_NUM_LEDS);
+  }
+  else
+  {
+    FastLED[0].setLeds(CurrentLEDValues, MAX_NUM_LEDS);
+  }
+}
+
+// Takes the next step towards CurrentLEDValues, once it's time to. Steps are put off while a frame or command is
+// part way in, so showing doesn't lose the rest of it
+void interpolateLEDValues()
+{
+  long now = millis();
+  if (!Interpolating || now < LastInterpolateTime + 1000 / UPDATES_PER_SECOND || receivedCount() > 0 || CurrentFrameState != FrameSync0)
+  {
+    return;
+  }
+
+  if (now >= InterpolateEndTime)
+  {
+    memcpy(InterpolatedLEDValues, CurrentLEDValues, LEDCount * sizeof(CRGB));
+    Interpolating = false;
+  }
+  else
+  {
+    // Each step goes its share of the rest of the way, so late ones catch up
+    fract8 amount = (uint32_t)(now - LastInterpolateTime) * 256 / (InterpolateEndTime - LastInterpolateTime);
+    nblend(InterpolatedLEDValues, CurrentLEDValues, LEDCount, amount);
+  }
+  LastInterpolateTime = now;
+  FastLED.show();
+}
+#endif
+
+#if SCHEDULED_FRAME_COUNT
+// Drops any frames waiting to be shown, and the time for the next
+void clearScheduledLEDValues()
+{
+  while (ScheduledFrameCount > 0)
+  {
+    SpareLEDValues[SpareLEDValueCount++] = ScheduledLEDValues[--ScheduledFrameCount];
+  }
+  ScheduleSequence = -1;
+}
+#endif
+
+void resetProtocol()
+{
+  if (CurrentBaudRate != SERIAL_BAUD_RATE)
+  {
+    setBaudRate(SERIAL_BAUD_RATE);
+  }
+  ActiveFeatures = 0;
+  CommandTimeoutTime = 0;
+  CurrentFrameState = FrameSync0;
+  ShownFrameSequence = -1;
+  HeldFrameSequence = -1;
+  ChunkedFrameSequence = -1;
+#if INTERPOLATE_LEDS
+  setInterpolating(false);
+#endif
+#if SCHEDULED_FRAME_COUNT
+  clearScheduledLEDValues();
+#endif
+}
+
+// Makes the light data just received the current LED values. Double buffered, the sets swap over and the
+// old one gets the next frame, which it's free for as soon as the new one starts to go out
+void swapLEDValues()
+{
+#if DOUBLE_BUFFER_LEDS
+  CRGB* shownValues = CurrentLEDValues;
+  CurrentLEDValues = ReceivedLEDValues;
+  ReceivedLEDValues = shownValues;
+  if (!(ActiveFeatures & PROTOCOL_FEATURE_INTERPOLATE))
+  {
+    FastLED[0].setLeds(CurrentLEDValues, MAX_NUM_LEDS);
+  }
+#endif
+}
+
+// Shows the current LED values, or with the interpolate feature, starts blending towards them
+void showLEDValues()
+{
+#if INTERPOLATE_LEDS
+  if (ActiveFeatures & PROTOCOL_FEATURE_INTERPOLATE)
+  {
+    // Over the average time between frames, so we get there about when the next one comes in
+    long now = millis();
+    uint16_t interval = min(now - LastFrameTime, (long)MAX_INTERPOLATE_MILLIS);
+    FrameIntervalMillis = FrameIntervalMillis ? (FrameIntervalMillis * 3 + interval) / 4 : interval;
+    LastFrameTime = now;
+
+    Interpolating = true;
+    InterpolateEndTime = now + FrameIntervalMillis;
+    LastInterpolateTime = now - 1000 / UPDATES_PER_SECOND;
+    interpolateLEDValues();
+    return;
+  }
+#endif
+  FastLED.show();
+}
+
+#if SCHEDULED_FRAME_COUNT
+// Makes the oldest waiting frame the one being shown, giving the set of LED values it replaces to the spares
+void takeScheduledLEDValues()
+{
+  SpareLEDValues[SpareLEDValueCount++] = CurrentLEDValues;
+  CurrentLEDValues = ScheduledLEDValues[0];
+  --ScheduledFrameCount;
+  for (uint8_t index = 0; index < ScheduledFrameCount; ++index)
+  {
+    ScheduledLEDValues[index] = ScheduledLEDValues[index + 1];
+    ScheduledFrameTimes[index] = ScheduledFrameTimes[index + 1];
+  }
+  if (!(ActiveFeatures & PROTOCOL_FEATURE_INTERPOLATE))
+  {
+    FastLED[0].setLeds(CurrentLEDValues, MAX_NUM_LEDS);
+  }
+}
+
+// Shows the newest of the waiting frames that are due. Any older ones have missed their turn, so are skipped
+void showScheduledLEDValues()
+{
+  bool due = false;
+  while (ScheduledFrameCount > 0 && millis() >= ScheduledFrameTimes[0])
+  {
+    takeScheduledLEDValues();
+    due = true;
+  }
+  if (due)
+  {
+    showLEDValues();
+  }
+}
+#endif
+
+// Puts the light data just received in the queue, if the PC has given it a time or there are frames ahead of it.
+// Returns false if it's to be shown straight away instead
+bool scheduleLEDValues(uint8_t sequence)
+{
+#if SCHEDULED_FRAME_COUNT
+  bool scheduled = ScheduleSequence == sequence;
+  if (!scheduled && ScheduledFrameCount == 0)
+  {
+    return false;
+  }
+
+  if (ScheduledFrameCount == SCHEDULED_FRAME_COUNT)
+  {
+    // No room, so the oldest goes early
+    takeScheduledLEDValues();
+    showLEDValues();
+  }
+  ScheduledLEDValues[ScheduledFrameCount] = ReceivedLEDValues;
+  ScheduledFrameTimes[ScheduledFrameCount++] = scheduled ? ScheduleTime : millis();
+  ReceivedLEDValues = SpareLEDValues[--SpareLEDValueCount];
+  ScheduleSequence = -1;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// The LED values of the last frame in, whether it's been shown yet or not
+CRGB* getLatestLEDValues()
+{
+#if SCHEDULED_FRAME_COUNT
+  if (ScheduledFrameCount > 0)
+  {
+    return ScheduledLEDValues[ScheduledFrameCount - 1];
+  }
+#endif
+  return CurrentLEDValues;
+}
+
+// Sign extends a 5 bit change from a delta run
+int8_t getLEDDelta(uint16_t delta, uint8_t shift)
+{
+  int8_t change = (delta >> shift) & 0x1F;
+  return (change & 0x10) ? change - 0x20 : change;
+}
+
+// Applies the next payload byte of a keyframe or delta frame to the LED values
+void decodeFrameByte(uint8_t value)
+{
+  if (FrameType == FRAME_TYPE_DELTA && FrameDataOffset == 0)
+  {
+    // Delta frames only make sense on top of the frame they were made from
+    FrameDecodeOK = value == ShownFrameSequence;
+    if (FrameDecodeOK)
+    {
+#if DOUBLE_BUFFER_LEDS
+      memcpy(ReceivedLEDValues, getLatestLEDValues(), LEDCount * sizeof(CRGB));
+#else
+      ShownFrameSequence = -1;
+#endif
+    }
+    return;
+  }
+
+  if (FrameRunRemaining == 0)
+  {
+    // Start of a run
+    FrameRunType = value & RUN_TYPE_MASK;
+    FrameRunRemaining = (value & ~RUN_TYPE_MASK) + 1;
+    FrameRunBytesReceived = 0;
+    if (FrameLEDIndex + FrameRunRemaining > LEDCount || (FrameType != FRAME_TYPE_DELTA && (FrameRunType == RUN_SKIP || FrameRunType == RUN_DELTA)))
+    {
+      FrameDecodeOK = false;
+    }
+    else if (FrameRunType == RUN_SKIP)
+    {
+      FrameLEDIndex += FrameRunRemaining;
+      FrameRunRemaining = 0;
+    }
+    return;
+  }
+
+  FrameRunBytes[FrameRunBytesReceived++] = value;
+  if (FrameRunType == RUN_DELTA && FrameRunBytesReceived == 2)
+  {
+    uint16_t delta = FrameRunBytes[0] | (FrameRunBytes[1] << 8);
+    CRGB& led = ReceivedLEDValues[FrameLEDIndex++];
+    led.r += getLEDDelta(delta, 0);
+    led.g += getLEDDelta(delta, 5);
+    led.b += getLEDDelta(delta, 10);
+    FrameRunBytesReceived = 0;
+    --FrameRunRemaining;
+  }
+  else if (FrameRunType == RUN_LITERAL && FrameRunBytesReceived == 3)
+  {
+    ReceivedLEDValues[FrameLEDIndex++] = CRGB(FrameRunBytes[0], FrameRunBytes[1], FrameRunBytes[2]);
+    FrameRunBytesReceived = 0;
+    --FrameRunRemaining;
+  }
+  else if (FrameRunType == RUN_REPEAT && FrameRunBytesReceived == 3)
+  {
+    fill_solid(&ReceivedLEDValues[FrameLEDIndex], FrameRunRemaining, CRGB(FrameRunBytes[0], FrameRunBytes[1], FrameRunBytes[2]));
+    FrameLEDIndex += FrameRunRemaining;
+    FrameRunRemaining = 0;
+  }
+}
+
+// Widens the next payload byte of a reduced colour frame into the LED values. Channels are widened by repeating
+// their top bits, so full brightness stays full brightness
+void unpackFrameByte(uint8_t value)
+{
+  if (FrameType == FRAME_TYPE_RGB565)
+  {
+    if ((FrameDataOffset & 1) == 0)
+    {
+      FrameRunBytes[0] = value;
+      return;
+    }
+    uint16_t packed = FrameRunBytes[0] | (value << 8);
+    uint8_t red = packed >> 11;
+    uint8_t green = (packed >> 5) & 0x3F;
+    uint8_t blue = packed & 0x1F;
+    ReceivedLEDValues[FrameDataOffset / 2] = CRGB((red << 3) | (red >> 2), (green << 2) | (green >> 4), (blue << 3) | (blue >> 2));
+  }
+  else
+  {
+    // Two channels per byte, with the last one missing if there's an odd number of LEDs
+    uint8_t* channels = &ReceivedLEDValues[0].r;
+    uint32_t channel = FrameDataOffset * 2;
+    channels[channel] = (value >> 4) * 17;
+    if (channel + 1 < LEDCount * 3)
+    {
+      channels[channel + 1] = (value & 0x0F) * 17;
+    }
+  }
+}
+
+// Tells the PC a frame was dropped, so it can send a keyframe rather than waiting
+void rejectFrame()
+{
+  Serial.write('N');
+  Serial.write(FrameHeaderBytes[1]);
+}
+
+// Checks the light data a frame or chunk holds can be shown, and gets ready to take it. A chunk has to carry on
+// from the last one, as if any went missing the frame can't be shown
+bool startFrameData(uint8_t frameType, uint32_t offset, uint32_t length)
+{
+  if (offset != 0)
+  {
+    return ChunkedFrameSequence == FrameHeaderBytes[1] && frameType == FrameType && offset == FrameDataOffset && length == FrameDataLength;
+  }
+
+  bool valid = false;
+  if (frameType == FRAME_TYPE_LIGHTS)
+  {
+    valid = length == LEDCount * 3UL;
+  }
+  else if (frameType == FRAME_TYPE_RGB565)
+  {
+    valid = (ActiveFeatures & PROTOCOL_FEATURE_RGB565) && length == LEDCount * 2UL;
+  }
+  else if (frameType == FRAME_TYPE_RGB444)
+  {
+    valid = (ActiveFeatures & PROTOCOL_FEATURE_RGB444) && length == (LEDCount * 3UL + 1) / 2;
+  }
+  else if (frameType == FRAME_TYPE_KEYFRAME || frameType == FRAME_TYPE_DELTA)
+  {
+    // Compressed frames are never bigger than plain ones
+    valid = (ActiveFeatures & PROTOCOL_FEATURE_DELTA) && length != 0 && length <= LEDCount * 3UL;
+  }
+
+  if (valid)
+  {
+    FrameType = frameType;
+    FrameDataOffset = 0;
+    FrameDataLength = length;
+    FrameDecodeOK = true;
+    FrameLEDIndex = 0;
+    FrameRunRemaining = 0;
+    HeldFrameSequence = -1;
+#if !DOUBLE_BUFFER_LEDS
+    if (frameType != FRAME_TYPE_DELTA)
+    {
+      // About to be overwritten
+      ShownFrameSequence = -1;
+    }
+#endif
+  }
+  return valid;
+}
+
+// Drops the frame being received, and looks for the next one
+void dropFrame()
+{
+  rejectFrame();
+  ChunkedFrameSequence = -1;
+  CurrentFrameState = FrameSync0;
+}
+
+// Takes the next byte of a light frame. The payload goes straight into the received LED values, which are only
+// shown once the CRC checks out. Single buffered, a corrupt frame leaves them out of step, so the PC follows up
+// with a keyframe. Chunks of a bigger frame each have their own CRC, and the frame is shown once the last one
+// checks out
+void receiveFrameByte(uint8_t value)
+{
+  switch (CurrentFrameState)
+  {
+    case FrameSync0:
+      if (value == FRAME_SYNC_0)
+      {
+        CurrentFrameState = FrameSync1;
+      }
+      break;
+
+    case FrameSync1:
+      if (value == FRAME_SYNC_1)
+      {
+        CurrentFrameState = FrameHeader;
+        FrameBytesReceived = 0;
+        FrameCRCValue = 0xFFFF;
+      }
+      else if (value != FRAME_SYNC_0)
+      {
+        CurrentFrameState = FrameSync0;
+      }
+      break;
+
+    case FrameHeader:
+      FrameHeaderBytes[FrameBytesReceived++] = value;
+      FrameCRCValue = updateCRC(FrameCRCValue, value);
+      if (FrameBytesReceived == sizeof(FrameHeaderBytes))
+      {
+        FramePayloadLength = FrameHeaderBytes[2] | (FrameHeaderBytes[3] << 8);
+        FrameBytesReceived = 0;
+
+        if (FrameHeaderBytes[0] == FRAME_TYPE_CHUNK)
+        {
+          if ((ActiveFeatures & PROTOCOL_FEATURE_LARGE_LAYOUT) && FramePayloadLength > CHUNK_HEADER_SIZE)
+          {
+            CurrentFrameState = FrameChunkHeader;
+          }
+          else
+          {
+            dropFrame();
+          }
+        }
+        else if (startFrameData(FrameHeaderBytes[0], 0, FramePayloadLength))
+        {
+          CurrentFrameState = FramePayload;
+        }
+        else
+        {
+          // Not something we can show, so look for the next frame
+          dropFrame();
+        }
+      }
+      break;
+
+    case FrameChunkHeader:
+      ChunkHeaderBytes[FrameBytesReceived++] = value;
+      FrameCRCValue = updateCRC(FrameCRCValue, value);
+      if (FrameBytesReceived == CHUNK_HEADER_SIZE)
+      {
+        uint32_t offset = ChunkHeaderBytes[1] | ((uint32_t)ChunkHeaderBytes[2] << 8) | ((uint32_t)ChunkHeaderBytes[3] << 16);
+        uint32_t length = ChunkHeaderBytes[4] | ((uint32_t)ChunkHeaderBytes[5] << 8) | ((uint32_t)ChunkHeaderBytes[6] << 16);
+        if (offset + FramePayloadLength - CHUNK_HEADER_SIZE <= length && startFrameData(ChunkHeaderBytes[0], offset, length))
+        {
+          CurrentFrameState = FramePayload;
+        }
+        else
+        {
+          dropFrame();
+        }
+      }
+      break;
+
+    case FramePayload:
+      if (FrameType == FRAME_TYPE_LIGHTS)
+      {
+        (&ReceivedLEDValues[0].r)[FrameDataOffset] = value;
+      }
+      else if (FrameType == FRAME_TYPE_RGB565 || FrameType == FRAME_TYPE_RGB444)
+      {
+        unpackFrameByte(value);
+      }
+      else if (FrameDecodeOK)
+      {
+        decodeFrameByte(value);
+      }
+      ++FrameDataOffset;
+      ++FrameBytesReceived;
+      FrameCRCValue = updateCRC(FrameCRCValue, value);
+      if (FrameBytesReceived == FramePayloadLength)
+      {
+        CurrentFrameState = FrameCRC;
+        FrameBytesReceived = 0;
+      }
+      break;
+
+    case FrameCRC:
+      if (FrameBytesReceived++ == 0)
+      {
+        FrameReceivedCRC = value;
+      }
+      else
+      {
+        FrameReceivedCRC |= (uint16_t)value << 8;
+        CurrentFrameState = FrameSync0;
+        bool complete = FrameType == FRAME_TYPE_LIGHTS || FrameType == FRAME_TYPE_RGB565 || FrameType == FRAME_TYPE_RGB444 || (FrameDecodeOK && FrameRunRemaining == 0 && (FrameType == FRAME_TYPE_DELTA || FrameLEDIndex == LEDCount));
+        if (FrameReceivedCRC != FrameCRCValue)
+        {
+          Serial.println("DDropped corrupt light frame");
+          dropFrame();
+        }
+        else if (FrameDataOffset < FrameDataLength)
+        {
+          // Good chunk, so wait for the next
+          ChunkedFrameSequence = FrameHeaderBytes[1];
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+        else if (!complete)
+        {
+          // Most likely a delta frame following one we dropped
+          dropFrame();
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+        else
+        {
+          ChunkedFrameSequence = -1;
+          if (!scheduleLEDValues(FrameHeaderBytes[1]))
+          {
+            swapLEDValues();
+            if (ActiveFeatures & PROTOCOL_FEATURE_SYNC_SHOW)
+            {
+              // The other boards might not have theirs yet, so wait for 'W'
+              HeldFrameSequence = FrameHeaderBytes[1];
+#if INTERPOLATE_LEDS
+              // Nor start blending towards it until then
+              Interpolating = false;
+#endif
+            }
+            else
+            {
+              showLEDValues();
+            }
+          }
+          ShownFrameSequence = FrameHeaderBytes[1];
+          Serial.write('S');
+          Serial.write(FrameHeaderBytes[1]);
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+  }
+}
+
+// Takes the light data after an 'A' as it comes in, straight into the received LED values, and shows it once it's all here
+void receiveLights()
+{
+  uint32_t numBytesToReceive = LEDCount * 3UL;
+  LightBytesReceived += takeReceived(&ReceivedLEDValues[0].r + LightBytesReceived, min(numBytesToReceive - LightBytesReceived, (uint32_t)RECEIVE_BUFFER_SIZE));
+  if (LightBytesReceived == numBytesToReceive)
+  {
+    Serial.println("DGot light data");
+
+    // We've received all our light data
+    swapLEDValues();
+    showLEDValues();
+    Serial.write('S');
+    CurrentSerialMode = Waiting;
+
+    // Reset our timeout
+    SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+  }
+}
+
+// How many bytes a command takes, including itself. It isn't handled until they've all come in
+uint8_t getCommandLength(uint8_t command)
+{
+  switch (command)
+  {
+    case 'M':
+      return 3;
+
+    case 'B':
+      return (ActiveFeatures & PROTOCOL_FEATURE_LINK_RATE) ? 2 : 1;
+
+    case 'G':
+      return (ActiveFeatures & PROTOCOL_FEATURE_LARGE_LAYOUT) ? 5 : 1;
+
+    case 'W':
+      // Whether or not anything's held, or the PC would be out of step whenever a frame it's asked for was lost
+      return (ActiveFeatures & PROTOCOL_FEATURE_SYNC_SHOW) ? 2 : 1;
+
+    case 'Z':
+      return (ActiveFeatures & PROTOCOL_FEATURE_SCHEDULED) ? 4 : 1;
+
+    default:
+      return 1;
+  }
+}
+
+// Handles the next received byte, or command if it's all here. Returns false if there's more to come first
+bool receiveCommand()
+{
+  uint8_t incomingByte = peekReceived(0);
+  bool framed = (ActiveFeatures & PROTOCOL_FEATURE_FRAMED) != 0;
+  if (framed && (CurrentFrameState != FrameSync0 || incomingByte == FRAME_SYNC_0))
+  {
+    takeReceived();
+    LayoutExpected = false;
+    receiveFrameByte(incomingByte);
+    return true;
+  }
+
+  if (framed && (incomingByte == 'A' || incomingByte == 'P' || incomingByte == 'M' || (incomingByte == 'G' && !LayoutExpected)))
+  {
+    // The PC never sends these once framed, or 'G' once frames have started, so they're left over from a dropped frame
+    takeReceived();
+    return true;
+  }
+
+  uint8_t commandLength = getCommandLength(incomingByte);
+  if (receivedCount() < commandLength)
+  {
+    if (CommandTimeoutTime == 0)
+    {
+      CommandTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
+    }
+    else if (millis() >= CommandTimeoutTime)
+    {
+      // The rest isn't coming, so drop what there is of it
+      Serial.println("DTimed out waiting for serial data");
+      CommandTimeoutTime = 0;
+      ReceiveTail = ReceiveHead;
+      return true;
+    }
+    return false;
+  }
+  CommandTimeoutTime = 0;
+  takeReceived();
+  takeReceived(SerialBuffer, commandLength - 1);
+
+  switch (incomingByte)
+  {
+    case 'A':
+      {
+        // Light data is available, so signal we're ready for it then receive it
+        SerialTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
+        LightBytesReceived = 0;
+        CurrentSerialMode = ReceivingLights;
+        Serial.write('R');
+      }
+      break;
+
+    case 'P':
+      {
+        // Tell the PC what we support
+        uint8_t capabilities[] =
+        {
+          'P', 7, PROTOCOL_VERSION,
+          PROTOCOL_FEATURES & 0xFF, PROTOCOL_FEATURES >> 8,
+          FRAME_WINDOW,
+          MAX_NUM_LEDS & 0xFF, MAX_NUM_LEDS >> 8,
+          LINK_RATES
+        };
+        Serial.write(capabilities, sizeof(capabilities));
+      }
+      break;
+
+    case 'M':
+      {
+        // Switch to whichever of the requested features we support, and confirm them
+        ActiveFeatures = (SerialBuffer[0] | (SerialBuffer[1] << 8)) & PROTOCOL_FEATURES;
+        CurrentFrameState = FrameSync0;
+#if INTERPOLATE_LEDS
+        setInterpolating((ActiveFeatures & PROTOCOL_FEATURE_INTERPOLATE) != 0);
+#endif
+        LayoutExpected = true;
+        Serial.write('M');
+        Serial.write(ActiveFeatures & 0xFF);
+        Serial.write(ActiveFeatures >> 8);
+
+        // Reset our timeout
+        SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+      }
+      break;
+
+    case 'B':
+      {
+        // Switch to a faster rate if it's one we can do, going back if it fails its test
+        if (ActiveFeatures & PROTOCOL_FEATURE_LINK_RATE)
+        {
+          uint8_t code = SerialBuffer[0];
+          if (code >= LINK_RATE_COUNT || !(LINK_RATES & (1 << code)))
+          {
+            code = 0;
+          }
+          Serial.write('B');
+          Serial.write(code);
+          if (code != 0)
+          {
+            // The link test follows at the new rate
+            setBaudRate(LinkRates[code]);
+            CurrentSerialMode = TestingLinkRate;
+            CommandTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
+            LinkTestBytesReceived = -1;
+          }
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+
+    case 'G':
+      {
+        // The full layout, which we take if there's room
+        if (ActiveFeatures & PROTOCOL_FEATURE_LARGE_LAYOUT)
+        {
+          uint16_t columns = SerialBuffer[0] | (SerialBuffer[1] << 8);
+          uint16_t rows = SerialBuffer[2] | (SerialBuffer[3] << 8);
+          uint32_t count = (uint32_t)columns * rows;
+          if (count > MAX_NUM_LEDS)
+          {
+            count = 0;
+          }
+          else
+          {
+            LEDCount = count;
+          }
+          Serial.write('G');
+          Serial.write(count & 0xFF);
+          Serial.write(count >> 8);
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+
+    case 'W':
+      {
+        // Show the frame we're holding, if it's the one the PC means
+        if ((ActiveFeatures & PROTOCOL_FEATURE_SYNC_SHOW) && commandLength == 2)
+        {
+          if (SerialBuffer[0] == HeldFrameSequence)
+          {
+            showLEDValues();
+            HeldFrameSequence = -1;
+          }
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+
+#if SCHEDULED_FRAME_COUNT
+    case 'Q':
+      {
+        // Tell the PC the time by our clock
+        if (ActiveFeatures & PROTOCOL_FEATURE_SCHEDULED)
+        {
+          unsigned long now = millis();
+          Serial.write('Q');
+          Serial.write(now & 0xFF);
+          Serial.write((now >> 8) & 0xFF);
+          Serial.write((now >> 16) & 0xFF);
+          Serial.write(now >> 24);
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+
+    case 'Z':
+      {
+        // When the PC wants a frame shown, as far as it can tell by our clock
+        if ((ActiveFeatures & PROTOCOL_FEATURE_SCHEDULED) && commandLength == 4)
+        {
+          long now = millis();
+          int16_t wait = (int16_t)(uint16_t)((SerialBuffer[1] | (SerialBuffer[2] << 8)) - (uint16_t)now);
+          ScheduleSequence = SerialBuffer[0];
+          ScheduleTime = now + constrain(wait, 0, MAX_SCHEDULE_MILLIS);
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+#endif
+
+    case 'K':
+      {
+        // Reset our timeout
+        SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+      }
+      break;
+
+    case 'D':
+      {
+        String debugInfo = String("D") + "SerialTimeoutTime: " + String(SerialTimeoutTime) + " | millis(): " + String(millis()) + " | CurrentSerialMode: " + String(CurrentSerialMode) + " | ActiveFeatures: " + String(ActiveFeatures) + " | CurrentBaudRate: " + String(CurrentBaudRate);
+        Serial.println(debugInfo);
+      }
+      break;
+
+    default:
+      {
+        if (framed)
+        {
+          // Most likely the rest of a dropped frame, so skip it and keep looking for the next one
+          break;
+        }
+
+        // Unknown command, so ignore it
+        uint8_t* currentByte = &CurrentLEDValues[0].r;
+        String info = String("D Unknown command received: ") + String(incomingByte) + String(" Remaining buffer length: ") + String(receivedCount() + Serial.available()) + String(" First light value: ") + String(*currentByte);
+        Serial.println(info);
+        cleanSerialBuffer();
+      }
+      break;
+  }
+  return true;
+}
+
+// Whether we're talking to the PC, so should give up if it goes quiet
+bool isConnected()
+{
+  return CurrentSerialMode == Waiting || CurrentSerialMode == ReceivingLights || CurrentSerialMode == TestingLinkRate || CurrentSerialMode == ConfirmingLinkRate;
 }
 
 void loop()
 {
-  // If we're not in the initialise mode, and haven't heard anything over the serial for a while, timeout and reset
-  if (CurrentSerialMode != Initialise && millis() >= SerialTimeoutTime)
+  // Move over whatever has come in, so the serial port's buffer never fills up
+  fillReceiveBuffer();
+
+  // If we're talking to the PC, and haven't heard anything over the serial for a while, timeout and reset
+  if (isConnected() && millis() >= SerialTimeoutTime)
   {
+    if (CurrentSerialMode == ReceivingLights)
+    {
+      Serial.println("DTimed out receiving light data");
+    }
+
     // We've timed out. Reset the lights and go back to the initialise state
+    resetProtocol();
     if (LEDCount != 0)
     {
       fill_solid(CurrentLEDValues, MAX_NUM_LEDS, CRGB::Black);
@@ -159,12 +1307,10 @@ void loop()
       LEDCount = 0;
     }
 
-    // Turn off the power supply
+    // Turn off the power supply, and give it time to go off before saying hello again
     digitalWrite(POWER_SUPPLY_PIN, LOW);
-    delay(1000);
-
-    CurrentSerialMode = Initialise;
-    SerialTimeoutTime = millis() + SERIAL_TIME_BETWEEN_HELLO_MILLIS;
+    CurrentSerialMode = PoweringDown;
+    SerialTimeoutTime = millis() + POWER_SUPPLY_SETTLE_MILLIS;
   }
 
   switch (CurrentSerialMode)
@@ -172,7 +1318,7 @@ void loop()
     case Initialise:
       {
         cleanSerialBuffer();
-        
+
         // Send a 'H'ello packet periodically until we get one back
         if (millis() >= SerialTimeoutTime)
         {
@@ -180,104 +1326,119 @@ void loop()
 
           // Send a 'H'
           Serial.write('H');
-          if (waitForSerialData(1))
+          CurrentSerialMode = HelloSent;
+          CommandTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+
+    case HelloSent:
+      {
+        if (receivedCount() > 0)
+        {
+          if (takeReceived() == 'H')
           {
-            if(SerialBuffer[0] == 'H')
-            {
-              // Got an 'H' back, so request our config
-              Serial.write('C');
-              if (waitForSerialData(3))
-              {
-                if(SerialBuffer[0] == 'C')
-                {
-                  Serial.println("DGot config, thanks!");
-                  
-                  // Read out our config
-                  LEDCount = SerialBuffer[1] * SerialBuffer[2];
-                  CurrentSerialMode = Waiting;
-
-                  // Turn on our power supply
-                  digitalWrite(POWER_SUPPLY_PIN, HIGH);
-                  delay(1000);
-    
-                  // Reset our timeout
-                  SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
-                }
-                else
-                {
-                  Serial.println("DMalformed config received");
-                }
-              }
-            }
+            // Got an 'H' back, so request our config
+            Serial.write('C');
+            CurrentSerialMode = ConfigRequested;
+            CommandTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
+          }
+          else
+          {
+            CurrentSerialMode = Initialise;
           }
         }
+        else if (millis() >= CommandTimeoutTime)
+        {
+          Serial.println("DTimed out waiting for serial data");
+          CurrentSerialMode = Initialise;
+        }
       }
       break;
 
-    case Waiting:
+    case ConfigRequested:
       {
-        if (Serial.available())
+        if (receivedCount() >= 3)
         {
-          int incomingByte = Serial.read();
-          switch (incomingByte)
+          takeReceived(SerialBuffer, 3);
+          if(SerialBuffer[0] == 'C')
           {
-            case 'A':
-              {
-                // Light data is available, so signal we're ready for it then receive it
-                SerialTimeoutTime = millis() + SERIAL_RESPONSE_TIMEOUT_MILLIS;
-                int numBytesToReceive = LEDCount * 3;
-                uint8_t* currentByte = &CurrentLEDValues[0].r;
-                uint8_t* endByte = currentByte + numBytesToReceive;
-                Serial.write('R');
-                while (currentByte < endByte && millis() < SerialTimeoutTime)
-                {
-                  if(Serial.available())
-                  {
-                    *currentByte = Serial.read();
-                    ++currentByte;
-                  }
-                }
-                if(currentByte == endByte)
-                {
-                  Serial.println("DGot light data");
-                  
-                  // We've received all our light data
-                  FastLED.show();
-
-                  // Reset our timeout
-                  SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
-                }
-                else
-                {
-                  Serial.println("DTimed out receiving light data");
-                }
-              }
-              break;
-
-            case 'K':
-              {
-                // Reset our timeout
-                SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
-              }
-              break;
-
-            case 'D':
-              {
-                String debugInfo = String("D") + "SerialTimeoutTime: " + String(SerialTimeoutTime) + " | millis(): " + String(millis()) + " | CurrentSerialMode: " + String(CurrentSerialMode);
-                Serial.println(debugInfo);
-              }
-              break;
-
-            default:
-              {
-                // Unknown command, so ignore it
-                uint8_t* currentByte = &CurrentLEDValues[0].r;
-                String info = String("D Unknown command received: ") + String(incomingByte) + String(" Remaining buffer length: ") + String(Serial.available()) + String(" First light value: ") + String(*currentByte);
-                Serial.println(info);
-                cleanSerialBuffer();
-              }
-              break;
+            Serial.println("DGot config, thanks!");
+
+            // Read out our config. Anything bigger follows with 'G', if the PC knows how
+            LEDCount = min(SerialBuffer[1] * SerialBuffer[2], MAX_NUM_LEDS);
+            resetProtocol();
+
+            // Turn on our power supply, and give it time to come on
+            digitalWrite(POWER_SUPPLY_PIN, HIGH);
+            CurrentSerialMode = PoweringUp;
+            SerialTimeoutTime = millis() + POWER_SUPPLY_SETTLE_MILLIS;
           }
+          else
+          {
+            Serial.println("DMalformed config received");
+            CurrentSerialMode = Initialise;
+          }
+        }
+        else if (millis() >= CommandTimeoutTime)
+        {
+          Serial.println("DTimed out waiting for serial data");
+          CurrentSerialMode = Initialise;
+        }
+      }
+      break;
+
+    case PoweringUp:
+      {
+        if (millis() >= SerialTimeoutTime)
+        {
+          CurrentSerialMode = Waiting;
+
+          // Reset our timeout
+          SerialTimeoutTime = millis() + SERIAL_INPUT_TIMEOUT_MILLIS;
+        }
+      }
+      break;
+
+    case Waiting:
+      {
+        // Handle everything that's come in, unless a command is still waiting on the rest of its bytes
+        while (receivedCount() > 0 && CurrentSerialMode == Waiting && receiveCommand())
+        {
+        }
+
+#if SCHEDULED_FRAME_COUNT
+        // Then show any frames that are due
+        showScheduledLEDValues();
+#endif
+
+#if INTERPOLATE_LEDS
+        // And carry on towards the frame being shown
+        interpolateLEDValues();
+#endif
+      }
+      break;
+
+    case ReceivingLights:
+      {
+        receiveLights();
+      }
+      break;
+
+    case TestingLinkRate:
+    case ConfirmingLinkRate:
+      {
+        receiveLinkTest();
+      }
+      break;
+
+    case PoweringDown:
+      {
+        cleanSerialBuffer();
+        if (millis() >= SerialTimeoutTime)
+        {
+          CurrentSerialMode = Initialise;
+          SerialTimeoutTime = millis() + SERIAL_TIME_BETWEEN_HELLO_MILLIS;
         }
       }
       break;